@@ -23,6 +23,13 @@ struct AABB
                 point.z >= min.z - epsilon && point.z <= max.z + epsilon);
     }
     
+    bool contains(const AABB &other) const 
+    {
+        return (other.min.x >= min.x && other.max.x <= max.x &&
+                other.min.y >= min.y && other.max.y <= max.y &&
+                other.min.z >= min.z && other.max.z <= max.z);
+    }
+    
     bool intersects(const AABB &other) const 
     {
         return (min.x <= other.max.x && max.x >= other.min.x &&
@@ -30,6 +37,13 @@ struct AABB
                 min.z <= other.max.z && max.z >= other.min.z);
     }
 
+    bool intersects(const AABB &other, Real margin) const 
+    {
+        return (min.x <= other.max.x + margin && max.x + margin >= other.min.x &&
+                min.y <= other.max.y + margin && max.y + margin >= other.min.y &&
+                min.z <= other.max.z + margin && max.z + margin >= other.min.z);
+    }
+
     void expand(const Real3 &point) 
     {
         min = glm::min(min, point);
@@ -1,9 +1,30 @@
+#pragma once
+
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <unordered_map>
 #include <stack>
 #include <algorithm>
+#include <vector>
+#include <string_view>
+#include <charconv>
+#include <stdexcept>
+
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
 
 struct XMLNode {
     int int_value;
@@ -138,4 +159,241 @@ public:
     }
 };
 
+// Read only mapping of a whole file, kept open while the object lives.
+class MappedFile {
+private:
+    const char* data = nullptr;
+    size_t      size = 0;
+#if defined(_WIN32)
+    HANDLE file    = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+public:
+    MappedFile(const std::string& filename) {
+#if defined(_WIN32)
+        file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            throw std::runtime_error("Errore: impossibile aprire " + filename);
+        }
+
+        LARGE_INTEGER file_size;
+        GetFileSizeEx(file, &file_size);
+        size = (size_t)file_size.QuadPart;
+        if (size == 0) return;
+
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Errore: impossibile aprire " + filename);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+        size = (size_t)st.st_size;
+        if (size == 0) return;
+
+        void* view = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) data = (const char*)view;
+#endif
+        if (!data) {
+            close_file();
+            throw std::runtime_error("Errore: impossibile mappare " + filename);
+        }
+    }
+
+    ~MappedFile() { close_file(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    std::string_view view() const { return std::string_view(data, data ? size : 0); }
+
+private:
+    void close_file() {
+#if defined(_WIN32)
+        if (data)                         UnmapViewOfFile(data);
+        if (mapping)                      CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+        mapping = nullptr;
+        file    = INVALID_HANDLE_VALUE;
+#else
+        if (data)    munmap((void*)data, size);
+        if (fd >= 0) ::close(fd);
+        fd = -1;
+#endif
+        data = nullptr;
+    }
+};
+
+// Forward only reader over an XML buffer, without building a tree. Names and
+// text are views into the buffer (no copies, entities are not decoded), so
+// they are valid while the buffer is. Tags may span or share lines.
+// Declarations, comments and DOCTYPE are skipped.
+//
+// depth() is the nesting level of the current element, 1 for the root. For
+// text tokens it is the level of the element the text is in.
+//
+//     XMLCursor cursor(file.view());
+//     while (cursor.find("Record")) {
+//         int depth = cursor.depth();
+//         while (cursor.next_child(depth))
+//             if (cursor.name() == "Value") value = cursor.int_text();
+//     }
+class XMLCursor {
+public:
+    enum Kind { Open, Empty, Close, Text, End };
+
+private:
+    std::string_view buffer;
+    size_t           pos = 0;
+
+    Kind             token_kind  = End;
+    std::string_view token_name;
+    std::string_view token_text;
+    int              token_depth = 0;
+    int              open_depth  = 0;
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+    static std::string_view trim(std::string_view s) {
+        size_t start = 0, end = s.size();
+        while (start < end && is_space(s[start]))   start++;
+        while (end > start && is_space(s[end - 1])) end--;
+        return s.substr(start, end - start);
+    }
+
+    // moves pos past the next occurrence of pattern, to the end if missing
+    void skip_past(std::string_view pattern) {
+        size_t found = buffer.find(pattern, pos);
+        pos = (found == std::string_view::npos) ? buffer.size() : found + pattern.size();
+    }
+
+    // moves pos past the '>' closing the tag, ignoring '>' in quoted attributes
+    // and returns the position of that '>'
+    size_t skip_tag() {
+        char quote = 0;
+        for (; pos < buffer.size(); pos++) {
+            char c = buffer[pos];
+            if (quote)                      { if (c == quote) quote = 0; }
+            else if (c == '"' || c == '\'') quote = c;
+            else if (c == '>')              return pos++;
+        }
+        return buffer.size();
+    }
+
+public:
+    XMLCursor(std::string_view buffer) : buffer(buffer) {}
+
+    Kind             kind()  const { return token_kind; }
+    std::string_view name()  const { return token_name; }
+    std::string_view text()  const { return token_text; }
+    int              depth() const { return token_depth; }
+
+    // moves to the next token, false at the end of the buffer
+    bool next() {
+        while (pos < buffer.size()) {
+            if (buffer[pos] != '<') {
+                size_t start = pos;
+                size_t end   = buffer.find('<', pos);
+                pos = (end == std::string_view::npos) ? buffer.size() : end;
+
+                std::string_view text = trim(buffer.substr(start, pos - start));
+                if (text.empty()) continue;
+
+                token_kind  = Text;
+                token_name  = {};
+                token_text  = text;
+                token_depth = open_depth;
+                return true;
+            }
 
+            std::string_view rest = buffer.substr(pos);
+            if (rest.compare(0, 2, "<?") == 0)    { skip_past("?>");  continue; }
+            if (rest.compare(0, 4, "<!--") == 0)  { skip_past("-->"); continue; }
+            if (rest.compare(0, 9, "<![CDATA[") == 0) {
+                size_t start = pos + 9;
+                skip_past("]]>");
+                token_kind  = Text;
+                token_name  = {};
+                token_text  = buffer.substr(start, std::max(pos, start + 3) - start - 3);
+                token_depth = open_depth;
+                return true;
+            }
+            if (rest.compare(0, 2, "<!") == 0)    { skip_tag(); continue; }
+
+            bool   closing    = rest.size() > 1 && rest[1] == '/';
+            size_t name_start = pos + (closing ? 2 : 1);
+            pos = name_start;
+            size_t tag_end = skip_tag();
+
+            size_t name_end = name_start;
+            while (name_end < tag_end && !is_space(buffer[name_end]) && buffer[name_end] != '/' && buffer[name_end] != '>') name_end++;
+
+            token_name = buffer.substr(name_start, name_end - name_start);
+            token_text = {};
+
+            if (closing) {
+                token_kind  = Close;
+                token_depth = open_depth--;
+            }
+            else if (tag_end < buffer.size() && buffer[tag_end - 1] == '/') {
+                token_kind  = Empty;
+                token_depth = open_depth + 1;
+            }
+            else {
+                token_kind  = Open;
+                token_depth = ++open_depth;
+            }
+            return true;
+        }
+
+        token_kind  = End;
+        token_name  = {};
+        token_text  = {};
+        token_depth = 0;
+        return false;
+    }
+
+    // moves to the next element (Open or Empty) with that name, anywhere below
+    bool find(std::string_view tag) {
+        while (next()) {
+            if ((token_kind == Open || token_kind == Empty) && token_name == tag) return true;
+        }
+        return false;
+    }
+
+    // moves to the next direct child of the element at parent_depth, skipping
+    // the deeper ones; false (on its Close token) once that element ends
+    bool next_child(int parent_depth) {
+        while (next()) {
+            if (token_kind == Close && token_depth <= parent_depth)                       return false;
+            if ((token_kind == Open || token_kind == Empty) && token_depth == parent_depth + 1) return true;
+        }
+        return false;
+    }
+
+    // text of the element the cursor is on, "" for an empty element. Moves to
+    // the text token, the following token is the Close of the element.
+    std::string_view element_text() {
+        if (token_kind != Open) return {};
+
+        int element_depth = token_depth;
+        if (!next()) return {};
+        if (token_kind == Text && token_depth == element_depth) return token_text;
+        return {};
+    }
+
+    // integer value of the element text, 0 when it does not start with a number
+    int int_text() {
+        std::string_view text = element_text();
+        int value = 0;
+        if (!text.empty() && text[0] == '+') text.remove_prefix(1);
+        std::from_chars(text.data(), text.data() + text.size(), value);
+        return value;
+    }
+};
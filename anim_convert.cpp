@@ -0,0 +1,78 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include <filesystem>
+
+#include "types.h"
+#include "anim_stream.cpp"
+
+// Expands an animation stream (export_format = stream) to the OBJ sequence
+// the viewer writes with export_format = obj, one <prefix>Boxs_<frame>.obj and
+// one <prefix>Wrap_<frame>.obj per frame, for the Blender import.
+//
+//   XPBDAnimToObj stream.xani [-o dir] [-p prefix] [-s max_stretch_perc]
+//
+//   -o  output directory, default the directory of the stream
+//   -p  file prefix, default the prefix the stream was exported with
+//   -s  wrap colored by stretch up to max_stretch_perc (export_stretch_perc),
+//       default as exported
+
+int main(int argc, char** argv)
+{
+    auto usage = []() { std::cerr << "usage: XPBDAnimToObj stream.xani [-o dir] [-p prefix] [-s max_stretch_perc]\n"; };
+
+    std::string stream_file, output_dir, prefix, stretch;
+    bool        has_prefix = false;
+
+    for (int ai = 1; ai < argc; ai++)
+    {
+        std::string arg = argv[ai];
+        if (arg[0] != '-') { stream_file = arg; continue; }
+
+        if (ai + 1 >= argc) { usage(); return 1; }
+        std::string value = argv[++ai];
+
+        if      (arg == "-o") output_dir = value;
+        else if (arg == "-p") { prefix = value; has_prefix = true; }
+        else if (arg == "-s") stretch = value;
+        else { usage(); return 1; }
+    }
+
+    if (stream_file.empty()) { usage(); return 1; }
+
+    AnimStreamReader reader;
+    if (!reader.open(stream_file))
+    {
+        std::cerr << "Cannot read " << stream_file << " (not an animation stream, or damaged)\n";
+        return 1;
+    }
+
+    if (output_dir.empty()) output_dir = std::filesystem::path(stream_file).parent_path().string();
+    if (!output_dir.empty()) output_dir = (std::filesystem::path(output_dir) / "").string();
+
+    AnimFrame frame;
+    ObjFrame  obj_frame;
+    ObjText   buffer;
+    obj_frame.directory = output_dir;
+
+    uint64_t frames = 0, bytes = 0;
+    while (reader.next(frame))
+    {
+        reader.to_obj_frame(frame, obj_frame);
+        obj_frame.directory = output_dir;
+        if (has_prefix) obj_frame.prefix = prefix;
+        if (!stretch.empty())
+        {
+            obj_frame.wrap_displacement     = true;
+            obj_frame.max_displacement_perc = (Real)std::atof(stretch.c_str());
+        }
+
+        bytes += write_obj_frame(obj_frame, buffer);
+        frames++;
+    }
+
+    std::cout << frames << " frames, " << reader.header.num_bodies << " bodies, " << reader.springs.size() << " springs, "
+              << bytes / (1024.0 * 1024.0) << " MB of OBJ in " << (output_dir.empty() ? "." : output_dir) << "\n";
+
+    return 0;
+}
@@ -0,0 +1,406 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "types.h"
+#include "rigid.cpp"
+#include "scene.cpp"
+#include "obj_export.cpp"
+
+// Animation stream (export_format = stream), the compact alternative to one
+// Boxs and one Wrap OBJ file per frame. The topology is written once, each
+// frame is the pose of every rigid body and a bit per rigid spring (torn
+// springs are inactive). XPBDAnimToObj expands a stream to the OBJ sequence.
+//
+//   Header                  magic, version, flags, counts, scale_factor, quantum
+//   prefix                  header.prefix_size bytes
+//   sizes                   num_bodies x 3 double
+//   springs                 num_springs x Spring
+//   frames                  FrameHeader, active bits, payload_size bytes
+//
+// payload: per body position and quaternion as 7 float, or with QUANTIZED
+// the position in steps of quantum and the quaternion as its largest
+// component index and the other three in 16 bits, as zigzag varints. With
+// DELTA the varints are the differences to the previous frame.
+// All values little endian.
+struct AnimStream
+{
+    static constexpr char     MAGIC[8] = {'X', 'P', 'B', 'D', 'A', 'N', 'I', '1'};
+    static constexpr uint32_t VERSION  = 1;
+
+    enum Flags : uint32_t { QUANTIZED = 1, DELTA = 2, STRETCH_COLORS = 4 };
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t num_bodies;
+        uint32_t num_springs;
+        uint32_t prefix_size;
+        uint32_t reserved;
+        double   scale_factor;
+        double   quantum;          // position step with QUANTIZED
+        double   max_stretch_perc; // wrap colors with STRETCH_COLORS
+    };
+
+    struct Spring
+    {
+        uint32_t i1, i2;
+        double   r1[3], r2[3];
+        double   rest_length;
+    };
+
+    struct FrameHeader
+    {
+        uint32_t frame;
+        uint32_t payload_size;
+        double   offset[3];
+    };
+
+    static_assert(sizeof(Header) == 56 && sizeof(Spring) == 64 && sizeof(FrameHeader) == 32, "the stream is written as raw structs");
+
+    // position steps, index of the largest quaternion component, the other three
+    using Quantized = std::array<int64_t, 7>;
+
+    static constexpr double QUAT_SCALE = 32767.0 / 0.70710678118654752; // the other components are at most sqrt(1/2)
+
+    static Quantized quantize(const Real3& position, const Quat& orientation, double quantum)
+    {
+        Quantized v;
+        for (int k = 0; k < 3; k++) v[k] = (int64_t)std::llround(position[k] / quantum);
+
+        int largest = 0;
+        for (int k = 1; k < 4; k++) if (std::abs(orientation[k]) > std::abs(orientation[largest])) largest = k;
+
+        double sign = orientation[largest] < 0.0 ? -1.0 : 1.0; // q and -q are the same rotation
+        v[3] = largest;
+        for (int k = 0, j = 4; k < 4; k++)
+            if (k != largest) v[j++] = (int64_t)std::llround(sign * orientation[k] * QUAT_SCALE);
+
+        return v;
+    }
+
+    static void dequantize(const Quantized& v, double quantum, Real3& position, Quat& orientation)
+    {
+        for (int k = 0; k < 3; k++) position[k] = Real(v[k] * quantum);
+
+        int    largest = (int)v[3] & 3;
+        double sum     = 0.0;
+        for (int k = 0, j = 4; k < 4; k++)
+        {
+            if (k == largest) continue;
+            double c = v[j++] / QUAT_SCALE;
+            orientation[k] = Real(c);
+            sum += c * c;
+        }
+        orientation[largest] = Real(std::sqrt(std::max(0.0, 1.0 - sum)));
+    }
+
+    static void put_varint(std::string& out, int64_t value)
+    {
+        uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+        while (zigzag >= 0x80)
+        {
+            out += char((zigzag & 0x7f) | 0x80);
+            zigzag >>= 7;
+        }
+        out += char(zigzag);
+    }
+
+    static bool get_varint(const char*& p, const char* end, int64_t& value)
+    {
+        uint64_t zigzag = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            uint8_t byte = (uint8_t)*p++;
+            zigzag |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+            {
+                value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// Writes the frames of one scene. open records the topology: a scene with
+// other bodies or springs needs a new stream.
+struct AnimStreamWriter
+{
+    uint64_t frames   = 0;
+    uint64_t bytes    = 0;
+    double   write_ms = 0.0;
+
+    bool is_open() const { return out.is_open(); }
+
+    // quantum 0 writes float poses, delta needs a quantum
+    bool open(const std::string& path, const Scene& scene, const std::string& prefix, Real scale_factor, Real quantum, bool delta,
+              bool stretch_colors, Real max_stretch_perc)
+    {
+        close();
+
+        out.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open())
+        {
+            std::cerr << "Error: cannot write file " << path << "\n";
+            return false;
+        }
+
+        const auto& springs = scene.rigid_constraints();
+
+        header = {};
+        std::memcpy(header.magic, AnimStream::MAGIC, sizeof(AnimStream::MAGIC));
+        header.version          = AnimStream::VERSION;
+        header.flags            = 0;
+        if (quantum > 0.0)          header.flags |= AnimStream::QUANTIZED;
+        if (quantum > 0.0 && delta) header.flags |= AnimStream::DELTA;
+        if (stretch_colors)         header.flags |= AnimStream::STRETCH_COLORS;
+        header.num_bodies       = (uint32_t)scene.rigid_objects.size();
+        header.num_springs      = (uint32_t)springs.size();
+        header.prefix_size      = (uint32_t)prefix.size();
+        header.scale_factor     = scale_factor;
+        header.quantum          = quantum;
+        header.max_stretch_perc = max_stretch_perc;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(prefix.data(), prefix.size());
+
+        for (const RigidBox& box : scene.rigid_objects)
+        {
+            double size[3] = {box.size.x, box.size.y, box.size.z};
+            out.write(reinterpret_cast<const char*>(size), sizeof(size));
+        }
+
+        for (const auto& cons : springs)
+        {
+            AnimStream::Spring spring = {cons.i1, cons.i2, {cons.r1.x, cons.r1.y, cons.r1.z}, {cons.r2.x, cons.r2.y, cons.r2.z}, cons.rest_length};
+            out.write(reinterpret_cast<const char*>(&spring), sizeof(spring));
+        }
+
+        previous.assign(header.num_bodies, AnimStream::Quantized{});
+        frames   = 0;
+        bytes    = (uint64_t)out.tellp();
+        write_ms = 0.0;
+
+        return (bool)out;
+    }
+
+    void write_frame(const Scene& scene, uint64_t frame, Real3 offset)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        const auto& springs = scene.rigid_constraints();
+        if (scene.rigid_objects.size() != header.num_bodies || springs.size() != header.num_springs)
+        {
+            std::cerr << "Animation stream: the scene changed, frame " << frame << " not written\n";
+            return;
+        }
+
+        std::string &active = buffer[0], &payload = buffer[1];
+
+        active.assign((header.num_springs + 7) / 8, '\0');
+        for (size_t si = 0; si < springs.size(); si++)
+            if (springs[si].active) active[si / 8] |= char(1 << (si % 8));
+
+        payload.clear();
+        if (header.flags & AnimStream::QUANTIZED)
+        {
+            for (size_t bi = 0; bi < scene.rigid_objects.size(); bi++)
+            {
+                const RigidBox &box = scene.rigid_objects[bi];
+                AnimStream::Quantized v = AnimStream::quantize(box.position, box.orientation, header.quantum);
+
+                for (int k = 0; k < 7; k++) AnimStream::put_varint(payload, v[k] - previous[bi][k]);
+                if (header.flags & AnimStream::DELTA) previous[bi] = v;
+            }
+        }
+        else
+        {
+            for (const RigidBox& box : scene.rigid_objects)
+            {
+                float pose[7] = {(float)box.position.x, (float)box.position.y, (float)box.position.z,
+                                 (float)box.orientation[0], (float)box.orientation[1], (float)box.orientation[2], (float)box.orientation[3]};
+                payload.append(reinterpret_cast<const char*>(pose), sizeof(pose));
+            }
+        }
+
+        AnimStream::FrameHeader frame_header = {(uint32_t)frame, (uint32_t)payload.size(), {offset.x, offset.y, offset.z}};
+        out.write(reinterpret_cast<const char*>(&frame_header), sizeof(frame_header));
+        out.write(active.data(), active.size());
+        out.write(payload.data(), payload.size());
+
+        frames++;
+        bytes    += sizeof(frame_header) + active.size() + payload.size();
+        write_ms += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+
+    void close()
+    {
+        if (out.is_open()) out.close();
+    }
+
+private:
+
+    std::ofstream                       out;
+    AnimStream::Header                  header = {};
+    std::vector<AnimStream::Quantized>  previous;
+    std::string                         buffer[2];
+};
+
+struct AnimFrame
+{
+    uint64_t           frame  = 0;
+    Real3              offset = Real3(0.0);
+    std::vector<Real3> positions;
+    std::vector<Quat>  orientations;
+    std::vector<bool>  active;
+};
+
+struct AnimStreamReader
+{
+    AnimStream::Header              header = {};
+    std::string                     prefix;
+    std::vector<Real3>              sizes;
+    std::vector<AnimStream::Spring> springs;
+
+    // false for a file that is not an animation stream or is damaged: sizes
+    // past the end of the file, springs between bodies that do not exist
+    bool open(const std::string& path)
+    {
+        in.open(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open()) return false;
+
+        file_size = (uint64_t)in.tellg();
+        in.seekg(0);
+
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            std::memcmp(header.magic, AnimStream::MAGIC, sizeof(AnimStream::MAGIC)) != 0 ||
+            header.version != AnimStream::VERSION) return false;
+
+        uint64_t topology_size = (uint64_t)header.prefix_size + (uint64_t)header.num_bodies * 3 * sizeof(double) +
+                                 (uint64_t)header.num_springs * sizeof(AnimStream::Spring);
+        if (topology_size > remaining()) return false;
+
+        prefix.assign(header.prefix_size, '\0');
+        if (!in.read(&prefix[0], prefix.size())) return false;
+
+        sizes.resize(header.num_bodies);
+        for (Real3& size : sizes)
+        {
+            double s[3];
+            if (!in.read(reinterpret_cast<char*>(s), sizeof(s))) return false;
+            size = Real3(s[0], s[1], s[2]);
+        }
+
+        springs.resize(header.num_springs);
+        if (!in.read(reinterpret_cast<char*>(springs.data()), springs.size() * sizeof(AnimStream::Spring))) return false;
+
+        for (const AnimStream::Spring& spring : springs)
+            if (spring.i1 >= header.num_bodies || spring.i2 >= header.num_bodies) return false;
+
+        previous.assign(header.num_bodies, AnimStream::Quantized{});
+        return true;
+    }
+
+    // false at the end of the stream (or on a truncated frame)
+    bool next(AnimFrame& frame)
+    {
+        AnimStream::FrameHeader frame_header;
+        if (!in.read(reinterpret_cast<char*>(&frame_header), sizeof(frame_header))) return false;
+
+        std::string active((header.num_springs + 7) / 8, '\0');
+        if ((uint64_t)active.size() + frame_header.payload_size > remaining()) return false;
+
+        std::string payload(frame_header.payload_size, '\0');
+        if (!in.read(&active[0], active.size()) || !in.read(&payload[0], payload.size())) return false;
+
+        frame.frame  = frame_header.frame;
+        frame.offset = Real3(frame_header.offset[0], frame_header.offset[1], frame_header.offset[2]);
+
+        frame.active.resize(header.num_springs);
+        for (size_t si = 0; si < frame.active.size(); si++) frame.active[si] = (active[si / 8] >> (si % 8)) & 1;
+
+        frame.positions.resize(header.num_bodies);
+        frame.orientations.resize(header.num_bodies);
+
+        const char *p = payload.data(), *end = p + payload.size();
+        for (size_t bi = 0; bi < header.num_bodies; bi++)
+        {
+            if (header.flags & AnimStream::QUANTIZED)
+            {
+                AnimStream::Quantized v;
+                for (int k = 0; k < 7; k++)
+                {
+                    int64_t delta;
+                    if (!AnimStream::get_varint(p, end, delta)) return false;
+                    v[k] = previous[bi][k] + delta;
+                }
+                if (header.flags & AnimStream::DELTA) previous[bi] = v;
+
+                AnimStream::dequantize(v, header.quantum, frame.positions[bi], frame.orientations[bi]);
+            }
+            else
+            {
+                float pose[7];
+                if (end - p < (ptrdiff_t)sizeof(pose)) return false;
+                std::memcpy(pose, p, sizeof(pose));
+                p += sizeof(pose);
+
+                frame.positions[bi]    = Real3(pose[0], pose[1], pose[2]);
+                frame.orientations[bi] = Quat(pose[3], pose[4], pose[5], pose[6]);
+            }
+        }
+
+        return true;
+    }
+
+    // the frame as export_scene_to_obj and export_wrap_to_obj saw it
+    void to_obj_frame(const AnimFrame& frame, ObjFrame& obj_frame) const
+    {
+        obj_frame.frame                 = frame.frame;
+        obj_frame.prefix                = prefix;
+        obj_frame.scale_factor          = header.scale_factor;
+        obj_frame.offset                = frame.offset;
+        obj_frame.wrap_displacement     = header.flags & AnimStream::STRETCH_COLORS;
+        obj_frame.max_displacement_perc = header.max_stretch_perc;
+
+        obj_frame.boxes.clear();
+        for (size_t bi = 0; bi + 1 < header.num_bodies; bi++)
+            obj_frame.boxes.push_back({frame.positions[bi], frame.orientations[bi], sizes[bi]});
+
+        obj_frame.segments.clear();
+        for (size_t si = 0; si < springs.size(); si++)
+        {
+            if (!frame.active[si]) continue;
+
+            const AnimStream::Spring &spring = springs[si];
+            Real3 p1 = body_to_world(Real3(spring.r1[0], spring.r1[1], spring.r1[2]), frame.positions[spring.i1], frame.orientations[spring.i1]);
+            Real3 p2 = body_to_world(Real3(spring.r2[0], spring.r2[1], spring.r2[2]), frame.positions[spring.i2], frame.orientations[spring.i2]);
+            obj_frame.segments.push_back({p1, p2, Real((glm::length(p2 - p1) - spring.rest_length) / spring.rest_length)});
+        }
+    }
+
+private:
+
+    // bytes after the read position
+    uint64_t remaining()
+    {
+        std::streamoff position = in.tellg();
+        return position < 0 || (uint64_t)position > file_size ? 0 : file_size - (uint64_t)position;
+    }
+
+    std::ifstream                      in;
+    uint64_t                           file_size = 0;
+    std::vector<AnimStream::Quantized> previous;
+};
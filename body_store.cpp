@@ -0,0 +1,152 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "types.h"
+#include "rigid.cpp"
+
+// Structure of arrays working copy of the rigid body data read and written by
+// the constraint solver, indexed like Scene::rigid_objects. Gathered from the
+// boxes after integration and scattered back before the velocity update, so
+// the solver loops touch only these arrays and not the whole RigidBox.
+//
+// rotation caches the matrix of orientation: whoever changes an orientation
+// calls mark_moved (rebuilt on the next rotation_of) or refresh_rotation.
+// Parallel solvers must only call rotation_of on bodies they own.
+//
+// Values are in solver precision (SolverReal, see types.h). With XPBD_MIXED
+// the positions are float offsets from origin, a double point inside the
+// pallet, and scatter adds only the float corrections to the double state of
+// the bodies the solver moved. In the other modes origin is 0 and the values
+// are copied back as they are.
+struct RigidBodyStore
+{
+    std::vector<SolverReal3>   position;
+    std::vector<SolverQuat>    orientation;
+    std::vector<SolverReal3x3> rotation;
+    std::vector<uint8_t>       rotation_dirty;
+    std::vector<uint8_t>       moved;
+    std::vector<SolverReal>    mass;
+    std::vector<SolverReal>    inv_mass;    // 0 for static and kinematic bodies
+    std::vector<SolverReal3>   inv_inertia; // diagonal of the body space inverse inertia, 0 for static
+    std::vector<uint8_t>       movable;     // dynamic and awake: corrected by the solver
+
+    Real3 origin = Real3(0.0);
+
+#if defined(XPBD_MIXED)
+    std::vector<SolverReal3> gathered_position;
+    std::vector<SolverQuat>  gathered_orientation;
+#endif
+
+    size_t size() const { return position.size(); }
+
+    SolverReal3 to_local(const Real3 &p_world) const { return SolverReal3(p_world - origin); }
+    Real3       to_world(const SolverReal3 &p) const { return origin + Real3(p); }
+
+    void clear()
+    {
+        position.clear();
+        orientation.clear();
+        rotation.clear();
+        rotation_dirty.clear();
+        moved.clear();
+        mass.clear();
+        inv_mass.clear();
+        inv_inertia.clear();
+        movable.clear();
+#if defined(XPBD_MIXED)
+        gathered_position.clear();
+        gathered_orientation.clear();
+#endif
+    }
+
+    void gather(const std::vector<RigidBox> &boxes)
+    {
+        size_t n = boxes.size();
+        position.resize(n);
+        orientation.resize(n);
+        rotation.resize(n);
+        rotation_dirty.assign(n, 0);
+        moved.assign(n, 0);
+        mass.resize(n);
+        inv_mass.resize(n);
+        inv_inertia.resize(n);
+        movable.resize(n);
+
+#if defined(XPBD_MIXED)
+        origin = Real3(0.0);
+        for (const RigidBox &box : boxes)
+        {
+            if (box.is_static) continue;
+            origin = box.position;
+            break;
+        }
+#endif
+
+        for (size_t bi = 0; bi < n; bi++)
+        {
+            const RigidBox &box = boxes[bi];
+
+            position[bi]    = to_local(box.position);
+            orientation[bi] = SolverQuat(box.orientation);
+#if defined(XPBD_MIXED)
+            rotation[bi]    = quat_to_rotmat(orientation[bi]);
+#else
+            rotation[bi]    = box.get_frame().rotation;
+#endif
+            // static and sleeping bodies have infinite mass in the solver: a
+            // body that is not corrected must not take a share of C either
+            movable[bi]     = !box.is_static && !box.is_sleeping;
+            mass[bi]        = SolverReal(box.mass);
+            inv_mass[bi]    = movable[bi] ? SolverReal(box.inv_mass) : SolverReal(0.0);
+            inv_inertia[bi] = movable[bi] ? SolverReal3(box.inv_inertia_tensor[0][0],
+                                                        box.inv_inertia_tensor[1][1],
+                                                        box.inv_inertia_tensor[2][2]) : SolverReal3(0.0);
+        }
+
+#if defined(XPBD_MIXED)
+        gathered_position    = position;
+        gathered_orientation = orientation;
+#endif
+    }
+
+    void scatter(std::vector<RigidBox> &boxes) const
+    {
+        for (size_t bi = 0; bi < boxes.size(); bi++)
+        {
+            if (!movable[bi] || !moved[bi]) continue;
+#if defined(XPBD_MIXED)
+            boxes[bi].position   += Real3(position[bi] - gathered_position[bi]);
+            boxes[bi].orientation = glm::normalize(boxes[bi].orientation + Quat(orientation[bi] - gathered_orientation[bi]));
+#else
+            boxes[bi].position    = position[bi];
+            boxes[bi].orientation = orientation[bi];
+#endif
+        }
+    }
+
+    const SolverReal3x3& rotation_of(Index bi)
+    {
+        if (rotation_dirty[bi]) refresh_rotation(bi);
+        return rotation[bi];
+    }
+
+    void mark_moved(Index bi)
+    {
+        rotation_dirty[bi] = 1;
+        moved[bi]          = 1;
+    }
+
+    void refresh_rotation(Index bi)
+    {
+        rotation[bi]       = quat_to_rotmat(orientation[bi]);
+        rotation_dirty[bi] = 0;
+    }
+
+    SolverReal generalized_inverse_mass(Index bi, const SolverReal3 &pb, const SolverReal3 &nb) const
+    {
+        SolverReal3 r_cross_n = glm::cross(pb, nb);
+        return inv_mass[bi] + glm::dot(r_cross_n, inv_inertia[bi] * r_cross_n);
+    }
+};
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <set>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+
+#include "types.h"
+#include "AABB.cpp"
+
+using BodyPair = std::pair<Index, Index>;
+
+// Incremental sweep and prune: the endpoint lists of the three axes are kept
+// sorted between calls, so with small motions insertion sort costs ~O(n) and
+// the overlapping pairs are updated only where two endpoints swap.
+struct SweepAndPrune
+{
+    struct Endpoint
+    {
+        Real  value;
+        Index body;
+        bool  is_min;
+    };
+
+    std::array<std::vector<Endpoint>, 3> axes;
+    std::set<BodyPair> pairs;
+
+    size_t num_bodies = 0;
+    uint64_t swaps    = 0;
+
+    void clear()
+    {
+        for (auto &axis : axes) axis.clear();
+        pairs.clear();
+        num_bodies = 0;
+        swaps      = 0;
+    }
+
+    // at equal values min comes first, so that touching boxes overlap like in AABB::intersects
+    static bool before(const Endpoint &e1, const Endpoint &e2)
+    {
+        if (e1.value != e2.value) return e1.value < e2.value;
+        return e1.is_min && !e2.is_min;
+    }
+
+    static BodyPair make_pair(Index a, Index b)
+    {
+        return a < b ? BodyPair(a, b) : BodyPair(b, a);
+    }
+
+    void rebuild(const std::vector<AABB> &aabbs)
+    {
+        num_bodies = aabbs.size();
+        pairs.clear();
+
+        for (int a = 0; a < 3; a++)
+        {
+            std::vector<Endpoint> &axis = axes[a];
+            axis.clear();
+            axis.reserve(num_bodies * 2);
+
+            for (Index bi = 0; bi < num_bodies; bi++)
+            {
+                axis.push_back({aabbs[bi].min[a], bi, true});
+                axis.push_back({aabbs[bi].max[a], bi, false});
+            }
+
+            std::sort(axis.begin(), axis.end(), before);
+        }
+
+        std::vector<Index> active;
+        for (const Endpoint &e : axes[0])
+        {
+            if (!e.is_min)
+            {
+                active.erase(std::find(active.begin(), active.end(), e.body));
+                continue;
+            }
+
+            for (Index other : active)
+                if (aabbs[e.body].intersects(aabbs[other])) pairs.insert(make_pair(e.body, other));
+
+            active.push_back(e.body);
+        }
+    }
+
+    void update(const std::vector<AABB> &aabbs)
+    {
+        if (aabbs.size() != num_bodies)
+        {
+            rebuild(aabbs);
+            return;
+        }
+
+        for (int a = 0; a < 3; a++)
+        {
+            std::vector<Endpoint> &axis = axes[a];
+
+            for (Endpoint &e : axis)
+                e.value = e.is_min ? aabbs[e.body].min[a] : aabbs[e.body].max[a];
+
+            for (size_t i = 1; i < axis.size(); i++)
+            {
+                Endpoint moving = axis[i];
+                size_t j = i;
+
+                while (j > 0 && before(moving, axis[j-1]))
+                {
+                    const Endpoint &passed = axis[j-1];
+
+                    // min moved left of a max: the two intervals start overlapping on this axis
+                    if (moving.is_min && !passed.is_min)
+                    {
+                        if (aabbs[moving.body].intersects(aabbs[passed.body]))
+                            pairs.insert(make_pair(moving.body, passed.body));
+                    }
+                    // max moved left of a min: the two intervals stop overlapping
+                    else if (!moving.is_min && passed.is_min)
+                    {
+                        pairs.erase(make_pair(moving.body, passed.body));
+                    }
+
+                    axis[j] = passed;
+                    j--;
+                    swaps++;
+                }
+
+                axis[j] = moving;
+            }
+        }
+    }
+};
+
+// Persistent per-pair data, kept sorted by (b1, b2) across broadphase updates.
+// axis is the last separating axis (or minimum penetration axis) found by SAT.
+struct CachedPair
+{
+    Index b1, b2;
+    Real3 axis     = Real3(0.0);
+    bool  has_axis = false;
+};
+
+void update_pair_cache(std::vector<CachedPair> &cache, const std::vector<BodyPair> &pairs)
+{
+    std::vector<CachedPair> new_cache;
+    new_cache.reserve(pairs.size());
+
+    size_t ci = 0;
+    for (const BodyPair &pair : pairs)
+    {
+        while (ci < cache.size() && BodyPair(cache[ci].b1, cache[ci].b2) < pair) ci++;
+
+        if (ci < cache.size() && cache[ci].b1 == pair.first && cache[ci].b2 == pair.second) 
+            new_cache.push_back(cache[ci]);
+        else 
+            new_cache.push_back({pair.first, pair.second});
+    }
+
+    cache.swap(new_cache);
+}
+
+void brute_force_pairs(const std::vector<AABB> &aabbs, std::vector<BodyPair> &pairs)
+{
+    pairs.clear();
+    for (Index i = 0; i < aabbs.size(); i++)
+        for (Index j = i+1; j < aabbs.size(); j++)
+            if (aabbs[i].intersects(aabbs[j])) pairs.push_back({i, j});
+}
+
+// Bounding volume hierarchy over bodies that never move (ground, fixtures).
+// Built once, then queried only by the moving bodies.
+struct StaticBVH
+{
+    struct Node
+    {
+        AABB  aabb;
+        Index left  = 0;
+        Index right = 0;
+        Index body  = 0;
+        bool  leaf  = false;
+    };
+
+    std::vector<Node> nodes;
+
+    void clear() { nodes.clear(); }
+
+    void build(const std::vector<AABB> &aabbs, const std::vector<Index> &bodies)
+    {
+        nodes.clear();
+        if (bodies.empty()) return;
+
+        std::vector<Index> items(bodies.size());
+        std::iota(items.begin(), items.end(), 0);
+
+        nodes.reserve(2 * bodies.size());
+        build_node(aabbs, bodies, items, 0, items.size());
+    }
+
+    Index build_node(const std::vector<AABB> &aabbs, const std::vector<Index> &bodies, std::vector<Index> &items, size_t begin, size_t end)
+    {
+        Index node_idx = nodes.size();
+        nodes.push_back(Node());
+
+        AABB aabb = aabbs[items[begin]];
+        for (size_t i = begin+1; i < end; i++) 
+        {
+            aabb.expand(aabbs[items[i]].min);
+            aabb.expand(aabbs[items[i]].max);
+        }
+        nodes[node_idx].aabb = aabb;
+
+        if (end - begin == 1) 
+        {
+            nodes[node_idx].leaf = true;
+            nodes[node_idx].body = bodies[items[begin]];
+            return node_idx;
+        }
+
+        // median split on the longest axis
+        Real3 extent = aabb.max - aabb.min;
+        int axis = 0;
+        if (extent.y > extent[axis]) axis = 1;
+        if (extent.z > extent[axis]) axis = 2;
+
+        size_t mid = (begin + end) / 2;
+        std::nth_element(items.begin() + begin, items.begin() + mid, items.begin() + end, [&](Index i1, Index i2) {
+            return aabbs[i1].min[axis] + aabbs[i1].max[axis] < aabbs[i2].min[axis] + aabbs[i2].max[axis];
+        });
+
+        Index left  = build_node(aabbs, bodies, items, begin, mid);
+        Index right = build_node(aabbs, bodies, items, mid, end);
+
+        nodes[node_idx].left  = left;
+        nodes[node_idx].right = right;
+
+        return node_idx;
+    }
+
+    template <typename F>
+    void query(const AABB &aabb, F &&on_overlap) const
+    {
+        if (nodes.empty()) return;
+
+        Index stack[64];
+        int   top = 0;
+        stack[top++] = 0;
+
+        while (top > 0) 
+        {
+            const Node &node = nodes[stack[--top]];
+            if (!node.aabb.intersects(aabb)) continue;
+
+            if (node.leaf) 
+            {
+                on_overlap(node.body);
+                continue;
+            }
+
+            stack[top++] = node.left;
+            stack[top++] = node.right;
+        }
+    }
+};
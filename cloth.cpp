@@ -11,7 +11,7 @@
 #include <sstream>
 
 #include "types.h"
-#include "mesh.cpp"
+#include "constraint.cpp"
 #include "AABB.cpp"
 #include "settings.cpp"
 
@@ -34,44 +34,9 @@ struct Cloth {
     uint32_t grid_height;
     Real cell_size;
     
-    ClothMesh mesh;
+    std::vector<uint32_t> triangles; // rendering and export, 3 vertex indices per triangle
     AABB aabb;
     
-    Cloth(Cloth&& other) noexcept
-        : positions(std::move(other.positions)),
-          old_positions(std::move(other.old_positions)),
-          velocities(std::move(other.velocities)),
-          inv_masses(std::move(other.inv_masses)),
-          edges(std::move(other.edges)),
-          grid_width(other.grid_width),
-          grid_height(other.grid_height),
-          cell_size(other.cell_size),
-          mesh(std::move(other.mesh)),
-          aabb(other.aabb)
-    {
-        mesh.vertices = &positions;
-        for (auto& e : edges) e.setObject(this);
-    }
-    
-    Cloth& operator=(Cloth&& other) noexcept {
-        if (this != &other) {
-            positions = std::move(other.positions);
-            old_positions = std::move(other.old_positions);
-            velocities = std::move(other.velocities);
-            inv_masses = std::move(other.inv_masses);
-            edges = std::move(other.edges);
-            grid_width = other.grid_width;
-            grid_height = other.grid_height;
-            cell_size = other.cell_size;
-            mesh = std::move(other.mesh);
-            aabb = other.aabb;
-            
-            mesh.vertices = &positions;
-            for (auto& e : edges) e.setObject(this);
-        }
-        return *this;
-    }
-    
     Cloth(Real3 top_left, Real3 bottom_right, uint32_t density, Real total_mass, Real edge_compliance = 0.0)
         : grid_width(density), grid_height(density), cell_size(0.0)
     {
@@ -111,8 +76,8 @@ struct Cloth {
         // Crea gli edge constraints
         create_edge_constraints(edge_compliance);
         
-        // Crea la mesh per il rendering
-        create_mesh();
+        // Crea i triangoli per il rendering
+        create_triangles();
         
         update_aabb();
     }
@@ -165,12 +130,13 @@ private:
     
     void add_edge(Real compliance, uint32_t v1, uint32_t v2) {
         Real rest_length = distance(positions[v1], positions[v2]);
-        edges.emplace_back(compliance, this, v1, v2, rest_length);
+        edges.emplace_back(compliance, v1, v2, rest_length);
     }
     
-    void create_mesh() {
+    void create_triangles() {
         // Crea triangoli per la mesh di rendering
-        std::vector<GLuint> indices;
+        std::vector<uint32_t> &indices = triangles;
+        indices.clear();
         indices.reserve((grid_width - 1) * (grid_height - 1) * 6);
         
         for (uint32_t j = 0; j < grid_height - 1; ++j) {
@@ -191,8 +157,6 @@ private:
                 indices.push_back(bottom_left);
             }
         }
-        
-        mesh = ClothMesh(&positions, indices, edges);
     }
     
 public:
@@ -255,11 +219,6 @@ public:
         }
     }
     
-    void draw() {
-        mesh.drawWireframe();
-        // mesh.drawPoints(); // Opzionale: mostra i punti
-    }
-    
     uint32_t num_vertices() const { return positions.size(); }
     uint32_t num_edges() const { return edges.size(); }
     
@@ -11,10 +11,12 @@
 
 #include "object.cpp"
 #include "rigid.cpp"
+#include "sat_kernel.cpp"
 
 Real NOT_COLLISION_THRESHOLD = 1e-3;
 Real EDGE_CROSS_NOT_VALID_THRESHOLD = 0.98;
 
+
 struct CollisionInfo 
 {
     bool    intersecting;
@@ -31,6 +33,8 @@ struct RigidCollisionInfo
     uint8_t owner;
     std::array<Real3, 16> manifold;
     uint8_t manifold_size;
+    uint8_t clipped_size = 0; // manifold size before reduction
+    std::array<Real, 16> depths = {}; // per point penetration along axis, negative within the speculative margin
 };
 
 void print_collision_info(const CollisionInfo& info) 
@@ -108,6 +112,16 @@ std::pair<Real, Real> project_box(const RigidBox& box, const Real3& axis)
     return {min_proj, max_proj};
 }
 
+// Strict test (no NOT_COLLISION_THRESHOLD): a cached axis is only a slightly
+// rotated SAT axis, near the threshold it can disagree with a full SAT_box_box.
+bool separated_on_axis(const RigidBox& b1, const RigidBox& b2, const Real3& axis, Real margin = 0.0) 
+{
+    auto [min1, max1] = project_box(b1, axis);
+    auto [min2, max2] = project_box(b2, axis);
+
+    return std::min(max1, max2) - std::max(min1, min2) < -margin;
+}
+
 std::array<Real, 2> project_tetrahedron(const std::array<Real3, 4>& ps, const Real3& axis) 
 {
     Real min_proj = std::numeric_limits<Real>::max();
@@ -124,8 +138,8 @@ std::array<Real, 2> project_tetrahedron(const std::array<Real3, 4>& ps, const Re
 
 CollisionInfo SAT_tet_tet(TetraObject &obj1, Tetrahedron &tetra1, TetraObject &obj2, Tetrahedron &tetra2) 
 {    
-    tetra1.init_normals_edges();
-    tetra2.init_normals_edges();
+    tetra1.init_normals_edges(obj1.positions, obj1.old_positions);
+    tetra2.init_normals_edges(obj2.positions, obj2.old_positions);
 
     std::array<Real3, 4> p1 = {
         obj1.positions[tetra1.vs[0]],
@@ -188,14 +202,102 @@ CollisionInfo SAT_tet_tet(TetraObject &obj1, Tetrahedron &tetra1, TetraObject &o
     return {true, min_axis, min_overlap, coll_owner};
 }
 
-RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2) 
+// Keeps at most max_points (<= 4) points of a clipped face manifold: the deepest
+// one, the farthest from it, the one making the largest triangle and the one
+// adding the most area outside that triangle (areas measured on the plane with
+// normal n). max_points <= 0 disables the reduction. Returns the new size.
+uint8_t reduce_manifold(std::array<Real3, 16> &manifold, uint8_t size, std::array<Real, 16> &depths, const Real3 &n, int max_points) 
+{
+    if (max_points <= 0) return size;
+
+    max_points = std::min(max_points, 4);
+    if (size <= max_points) return size;
+
+    std::array<bool, 16> taken = {};
+    std::array<Real3, 16> reduced;
+    std::array<Real, 16>  reduced_depths;
+    uint8_t reduced_size = 0;
+
+    auto take = [&](int i) 
+    {
+        taken[i] = true;
+        reduced_depths[reduced_size] = depths[i];
+        reduced[reduced_size++]      = manifold[i];
+    };
+
+    // deepest
+    int best = 0;
+    for (int i=1; i<size; i++) 
+        if (depths[i] > depths[best]) best = i;
+    take(best);
+
+    // farthest from the deepest
+    if (reduced_size < max_points) 
+    {
+        best = -1;
+        Real best_dist = -1.0;
+        for (int i=0; i<size; i++) 
+        {
+            if (taken[i]) continue;
+            Real dist = glm::length(manifold[i] - reduced[0]);
+            if (dist > best_dist) { best_dist = dist; best = i; }
+        }
+        take(best);
+    }
+
+    // largest triangle, its orientation around n decides the sign of the last area
+    Real side = 1.0;
+    if (reduced_size < max_points) 
+    {
+        best = -1;
+        Real best_area = -1.0;
+        for (int i=0; i<size; i++) 
+        {
+            if (taken[i]) continue;
+            Real area = glm::dot(glm::cross(reduced[1] - reduced[0], manifold[i] - reduced[0]), n);
+            if (std::abs(area) > best_area) { best_area = std::abs(area); best = i; side = area >= 0.0 ? 1.0 : -1.0; }
+        }
+        take(best);
+    }
+
+    // point outside the triangle adding the largest area
+    if (reduced_size < max_points) 
+    {
+        best = -1;
+        Real best_area = 0.0;
+        for (int i=0; i<size; i++) 
+        {
+            if (taken[i]) continue;
+            for (int e=0; e<3; e++) 
+            {
+                const Real3 &a = reduced[e];
+                const Real3 &b = reduced[(e+1)%3];
+                Real area = -side * glm::dot(glm::cross(b - a, manifold[i] - a), n);
+                if (area > best_area) { best_area = area; best = i; }
+            }
+        }
+        if (best >= 0) take(best); // otherwise the rest lies inside the triangle
+    }
+
+    for (int i=0; i<reduced_size; i++) 
+    {
+        manifold[i] = reduced[i];
+        depths[i]   = reduced_depths[i];
+    }
+    return reduced_size;
+}
+
+// margin > 0 makes the test speculative: pairs up to margin apart are reported
+// as intersecting, with a negative min overlap, and the manifold keeps the
+// incident points up to margin above the reference face.
+RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2, Real margin = 0.0, int manifold_max_points = 4) 
 {
     std::array<Real3, 15>   axes;
     std::array<uint8_t, 15> axes_owner;
     int axis_count = 0;
 
-    std::array<Real3, 3> b1_normals = quat_to_axes(b1.orientation);
-    std::array<Real3, 3> b2_normals = quat_to_axes(b2.orientation);
+    const std::array<Real3, 3> &b1_normals = b1.get_frame().axes;
+    const std::array<Real3, 3> &b2_normals = b2.get_frame().axes;
 
     for (const auto& n : b1_normals) 
     {
@@ -266,7 +368,7 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
 
         Real overlap = std::min(max1, max2) - std::max(min1, min2);
 
-        if (overlap < NOT_COLLISION_THRESHOLD) return {false, Real3(0.0), 0.0, 0}; 
+        if (overlap < NOT_COLLISION_THRESHOLD - margin) return {false, axis, 0.0, 0}; // separating axis
         if (overlap < min_overlap && axes_owner[ai] != 3) 
         {
             if (glm::dot(axis, center_vec) > 0.0) axis = -axis;
@@ -297,8 +399,8 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
                 Real s = (b*e - c*d) / den;
                 Real t = (a*e - b*d) / den;
 
-                s = glm::clamp(s, 0.0, 1.0);
-                t = glm::clamp(t, 0.0, 1.0);
+                s = glm::clamp(s, Real(0.0), Real(1.0));
+                t = glm::clamp(t, Real(0.0), Real(1.0));
 
                 Real3 cp1 = p1 + s * u;
                 Real3 cp2 = q1 + t * v;
@@ -307,11 +409,11 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
             } 
 
             // parallel 
-            Real3 mid1 = 0.5 * (p1 + p2);
+            Real3 mid1 = Real(0.5) * (p1 + p2);
 
             Real t = glm::dot(mid1 - q1, v) / glm::dot(v, v);
             
-            t = glm::clamp(t, 0.0, 1.0);
+            t = glm::clamp(t, Real(0.0), Real(1.0));
 
             Real3 cp1 = mid1;
             Real3 cp2 = q1 + t * v;
@@ -360,8 +462,13 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
             }
         }
 
-        // return {true, min_axis, min_overlap, coll_owner, manifold, 2};
-        return {true, min_axis, min_dist, coll_owner, manifold, 2}; // TOCHECK: is min_dist circ= min_overlap
+        // the depth is the overlap on the SAT axis, as for face contacts: the
+        // closest edge points can belong to another pair of edges than the
+        // ones crossing along the axis, min_dist is not a depth
+        std::array<Real, 16> depths = {};
+        depths[0] = min_overlap;
+
+        return {true, min_axis, min_overlap, coll_owner, manifold, 2, 2, depths};
     }
 
     RigidBox *ref_box   = &b1;
@@ -450,7 +557,7 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
         Real3 face_center = (box->world_vertices[face[0]] +
                              box->world_vertices[face[1]] +
                              box->world_vertices[face[2]] +
-                             box->world_vertices[face[3]]) * 0.25;
+                             box->world_vertices[face[3]]) * Real(0.25);
 
         if (glm::dot(normal, box->position - face_center) > 0.0f) 
         {
@@ -495,7 +602,7 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
     Real3 ref_face_center = (ref_box->world_vertices[ref_faces[ref_face_idx][0]] +
                              ref_box->world_vertices[ref_faces[ref_face_idx][1]] +
                              ref_box->world_vertices[ref_faces[ref_face_idx][2]] +
-                             ref_box->world_vertices[ref_faces[ref_face_idx][3]]) * 0.25;
+                             ref_box->world_vertices[ref_faces[ref_face_idx][3]]) * Real(0.25);
 
     side_planes[0][0] = ref_face_center;
     side_planes[0][1] = - coll_axis;
@@ -504,7 +611,7 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
     {
         Real3 v1 = ref_box->world_vertices[ref_faces[ref_face_idx][i-1]];
         Real3 v2 = ref_box->world_vertices[ref_faces[ref_face_idx][(i)%4]];
-        Real3 edge_center = (v1 + v2) * 0.5;
+        Real3 edge_center = (v1 + v2) * Real(0.5);
         Real3 side_plane_normal = glm::normalize(glm::cross((v2-v1), - coll_axis));
 
         if (glm::dot(side_plane_normal, (edge_center - ref_face_center)) < 0.0)
@@ -543,6 +650,8 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
         Real3 plane_center = side_planes[pi][0];
         Real3 plane_normal = side_planes[pi][1];
 
+        if (pi == 0) plane_center += margin * plane_normal;
+
         for (int mi=0; mi<manifold_size; mi++) {
 
             Real3 v1 = manifold[mi];
@@ -576,5 +685,13 @@ RigidCollisionInfo SAT_box_box(RigidBox &b1, RigidBox &b2)
             manifold[mi] = new_manifold[mi];
     }
 
-    return {true, min_axis, min_overlap, coll_owner, manifold, manifold_size};
+    uint8_t clipped_size = manifold_size;
+
+    std::array<Real, 16> depths;
+    for (int mi=0; mi<manifold_size; mi++)
+        depths[mi] = -signed_distance(side_planes[0][0], side_planes[0][1], manifold[mi]);
+
+    manifold_size = reduce_manifold(manifold, manifold_size, depths, coll_axis, manifold_max_points);
+
+    return {true, min_axis, min_overlap, coll_owner, manifold, manifold_size, clipped_size, depths};
 }
\ No newline at end of file
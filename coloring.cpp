@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+
+#include "types.h"
+
+// Constraints grouped in colors such that no two constraints of the same color
+// move the same body, so each color can be solved in parallel without locks.
+// order holds constraint indices color by color, color c is
+// order[color_start[c] .. color_start[c+1]).
+struct ConstraintColoring
+{
+    std::vector<Index> order;
+    std::vector<Index> color_start;
+    bool valid = false;
+
+    void clear()
+    {
+        order.clear();
+        color_start.clear();
+        valid = false;
+    }
+
+    Index num_colors() const { return color_start.empty() ? 0 : Index(color_start.size() - 1); }
+};
+
+static constexpr Index NO_BODY = std::numeric_limits<Index>::max();
+
+// Greedy coloring in constraint order: every pass takes the remaining
+// constraints whose bodies are still free in the current color, so each color
+// keeps the serial order. bodies_of(ci, b1, b2) gives the bodies moved by
+// constraint ci, NO_BODY for static ones. active(ci) filters constraints out.
+template <typename BodiesOf, typename Active>
+void color_constraints(ConstraintColoring &coloring, size_t num_bodies, size_t count, BodiesOf &&bodies_of, Active &&active)
+{
+    coloring.order.clear();
+    coloring.color_start.clear();
+    coloring.color_start.push_back(0);
+
+    std::vector<Index> remaining;
+    remaining.reserve(count);
+    for (Index ci = 0; ci < count; ci++)
+        if (active(ci)) remaining.push_back(ci);
+
+    // body_color[b] == color when b is already moved by a constraint of that color
+    std::vector<Index> body_color(num_bodies, NO_BODY);
+    std::vector<Index> next;
+
+    for (Index color = 0; !remaining.empty(); color++)
+    {
+        next.clear();
+
+        for (Index ci : remaining)
+        {
+            Index b1, b2;
+            bodies_of(ci, b1, b2);
+
+            bool free = (b1 == NO_BODY || body_color[b1] != color) &&
+                        (b2 == NO_BODY || body_color[b2] != color);
+
+            if (!free)
+            {
+                next.push_back(ci);
+                continue;
+            }
+
+            if (b1 != NO_BODY) body_color[b1] = color;
+            if (b2 != NO_BODY) body_color[b2] = color;
+            coloring.order.push_back(ci);
+        }
+
+        coloring.color_start.push_back(Index(coloring.order.size()));
+        remaining.swap(next);
+    }
+
+    coloring.valid = true;
+}
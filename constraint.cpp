@@ -1,25 +1,44 @@
 #pragma once
 
 #include <array>
+#include <vector>
+#include <cmath>
 #include <algorithm>
 
 #include "types.h"
 #include "AABB.cpp"
 
 
-struct RigidBox;
-struct TetraObject;
-struct Cloth;
+Real tetra_volume(Real3 &x1, Real3 &x2, Real3 &x3, Real3 &x4) 
+{
+    Real3 v1 = x2 - x1;
+    Real3 v2 = x3 - x1;
+    Real3 v3 = x4 - x1;
 
-std::array<Real3, 4> get_tetra_points(TetraObject* obj, VertexIndex vs[4]);
-std::array<Real3, 4> get_old_tetra_points(TetraObject* obj, VertexIndex vs[4]);
+    Real3 cross = glm::cross(v1, v2);
+    Real dot    = glm::dot(cross, v3);
+    Real volume = std::abs(dot) / 6.0;
 
+    return volume;
+}
+
+inline Real distance(Real3 &p1, Real3 &p2) {
+    return glm::length(p2 - p1);
+}
+
+inline std::array<Real3, 4> get_tetra_points(const std::vector<Real3> &positions, const VertexIndex vs[4]) {
+    return {positions[vs[0]],
+            positions[vs[1]],
+            positions[vs[2]],
+            positions[vs[3]]};
+}
+
+// Plain base without virtual functions: constraints are stored by value in
+// vectors of their own type and never used through a Constraint pointer.
 struct Constraint {
     Real compliance;
     Real lambda = 0.0;
 
-    virtual ~Constraint() = default;
-
     Constraint(Real compliance) : compliance(compliance) {}
 
     void reset() { lambda = 0.0; }
@@ -27,36 +46,30 @@ struct Constraint {
 
 // ##############################################
 
+// Constraints hold no pointers: the internal ones (edges, tetrahedra, vertex
+// collisions) are solved together with the object that owns them, the global
+// ones refer to objects by index in the Scene vectors. Objects and constraints
+// can then be moved and copied as plain values.
+
 struct ClothEdge : Constraint {
-    Cloth *cloth;
     VertexIndex v1, v2; 
     Real rest_length;
 
     ClothEdge(
         Real compliance, 
-        Cloth *cloth,
         VertexIndex v1, 
         VertexIndex v2, 
         Real length) 
         : Constraint(compliance), 
-          cloth(cloth), 
           rest_length(length),  
           v1(v1), v2(v2)
         {}
-
-    void setObject(Cloth* o) { cloth = o; }
 };
 
 struct InternalConstraint : Constraint {
-    TetraObject *obj;
 
-    InternalConstraint(
-        Real compliance, 
-        TetraObject *o) 
-        : Constraint(compliance), 
-          obj(o) {}
-
-    void setObject(TetraObject* o) { obj = o; }
+    InternalConstraint(Real compliance) 
+        : Constraint(compliance) {}
 };
 
 struct GlobalConstraint : Constraint {
@@ -79,13 +92,12 @@ struct Tetrahedron : InternalConstraint {
 
     Tetrahedron(
         Real compliance,
-        TetraObject *obj,
         VertexIndex v1, 
         VertexIndex v2, 
         VertexIndex v3, 
         VertexIndex v4, 
         Real volume)
-        : InternalConstraint(compliance, obj), 
+        : InternalConstraint(compliance), 
           rest_volume(volume) 
            {
         vs[0] = v1;
@@ -96,16 +108,16 @@ struct Tetrahedron : InternalConstraint {
 
     inline void reset() { initialized = false; }
 
-    inline void init_normals_edges() {
+    inline void init_normals_edges(const std::vector<Real3> &positions, const std::vector<Real3> &old_positions) {
 
         if (initialized) return;
 
-        std::array<Real3, 4> ps     = get_tetra_points(obj, vs);
-        std::array<Real3, 4> old_ps = get_old_tetra_points(obj, vs);
+        std::array<Real3, 4> ps     = get_tetra_points(positions, vs);
+        std::array<Real3, 4> old_ps = get_tetra_points(old_positions, vs);
 
         auto addNormal = [&](Real3 a, Real3 b, Real3 c, Real3 opp, int idx) {
             Real3 normal     = glm::normalize(glm::cross(b - a, c - a));
-            Real3 center     = (a + b + c) / 3.0;
+            Real3 center     = (a + b + c) / Real(3.0);
             Real3 toOpposite = opp - center;
             if (glm::dot(normal, toOpposite) > 0.0) normal = -normal;
 
@@ -124,16 +136,16 @@ struct Tetrahedron : InternalConstraint {
         edges[4] = ps[3] - ps[1];
         edges[5] = ps[3] - ps[2];
 
-        center     = (ps[0] + ps[1] + ps[2] + ps[3]) / 4.0;
-        old_center = (old_ps[0] + old_ps[1] + old_ps[2] + old_ps[3]) / 4.0;
+        center     = (ps[0] + ps[1] + ps[2] + ps[3]) / Real(4.0);
+        old_center = (old_ps[0] + old_ps[1] + old_ps[2] + old_ps[3]) / Real(4.0);
 
         initialized = true;
     }
 
-    void update_aabb() {
-        std::array<Real3, 4> positions = get_tetra_points(obj, vs);
-        aabb = AABB(positions[0], positions[0]);
-        for (int i=1; i<4; i++) aabb.expand(positions[i]);
+    void update_aabb(const std::vector<Real3> &positions) {
+        std::array<Real3, 4> ps = get_tetra_points(positions, vs);
+        aabb = AABB(ps[0], ps[0]);
+        for (int i=1; i<4; i++) aabb.expand(ps[i]);
     }
 };
 
@@ -143,11 +155,10 @@ struct Edge : InternalConstraint {
 
     Edge(
         Real compliance,
-        TetraObject *obj,
         VertexIndex v1, 
         VertexIndex v2, 
         Real length)
-        : InternalConstraint(compliance, obj),
+        : InternalConstraint(compliance),
           rest_length(length),  
           v1(v1), v2(v2) {}
 };
@@ -160,55 +171,58 @@ struct CollisionConstraint : InternalConstraint{
     bool  active;
 
     CollisionConstraint()
-        : InternalConstraint(0.0, nullptr), 
+        : InternalConstraint(0.0), 
           v(0), 
           goal_position(Real3(0.0)), 
           active(false) {}
 
     CollisionConstraint(
         Real compliance,
-        TetraObject *obj,
         VertexIndex v, 
         Real3 goal_position, 
         bool active = false)
         : v(v),
           goal_position(goal_position), 
           active(active), 
-          InternalConstraint(compliance, obj) {}
+          InternalConstraint(compliance) {}
 };
 
 // ##############################################
 
+// o1 and o2 index Scene::objects
 struct SpringConstraint : GlobalConstraint{
-    TetraObject *obj1, *obj2;
+    Index o1, o2;
     VertexIndex v1, v2;
     Real rest_length;
 
     SpringConstraint(
         Real compliance,
-        TetraObject *obj1, 
-        TetraObject *obj2, 
+        Index o1, 
+        Index o2, 
         VertexIndex v1, 
         VertexIndex v2, 
         Real length)
         : GlobalConstraint(compliance),
-          obj1(obj1), 
-          obj2(obj2), 
+          o1(o1), 
+          o2(o2), 
           v1(v1), 
           v2(v2), 
           rest_length(length) {}
 };
 
+// The rigid constraints refer to their bodies by index in Scene::rigid_objects,
+// so they hold no pointers and stay valid when the body vector grows.
+
 struct FixedRigidSpringConstraint : GlobalConstraint {
 
-    RigidBox *box;
+    Index     box;
     Real3     body_attach;
     Real3     world_attach;
     Real      rest_length;
 
     FixedRigidSpringConstraint(
         Real compliance,
-        RigidBox *box,
+        Index     box,
         Real3     body_attach,
         Real3     world_attach,
         Real      length)
@@ -221,21 +235,21 @@ struct FixedRigidSpringConstraint : GlobalConstraint {
 
 struct RigidSpringConstraint : GlobalConstraint {
 
-    RigidBox *b1, *b2;
+    Index     i1, i2;
     Real3     r1, r2;
     Real      rest_length;
     bool active = true;
 
     RigidSpringConstraint(
         Real compliance,
-        RigidBox *b1,
-        RigidBox *b2,
+        Index     i1,
+        Index     i2,
         Real3     r1,
         Real3     r2,
         Real      length)
         : GlobalConstraint(compliance),
-          b1(b1),
-          b2(b2),
+          i1(i1),
+          i2(i2),
           r1(r1),
           r2(r2),
           rest_length(length) {}
@@ -243,23 +257,27 @@ struct RigidSpringConstraint : GlobalConstraint {
 
 struct RigidCollisionConstraint : GlobalConstraint {
 
-    RigidBox *b1, *b2;
+    Index     i1, i2;
     Real3     p1, p2;
     Real3     r1, r2;
     Real      d;
     Real3     n;
 
+    // tracked: r1/r2 are fixed body anchors and p1/p2 follow the bodies, so the
+    // contact stays valid for several substeps without a new detection
+    bool tracked = false;
+
     RigidCollisionConstraint(
         Real compliance,
-        RigidBox *b1,
-        RigidBox *b2,
+        Index     i1,
+        Index     i2,
         Real3     p1,
         Real3     p2,
         Real      penetration,
         Real3     normal)
         : GlobalConstraint(compliance),
-          b1(b1),
-          b2(b2),
+          i1(i1),
+          i2(i2),
           p1(p1),
           p2(p2),
           d(penetration),
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <vector>
+#include <tuple>
+
+// One vector per constraint type, the types listed at compile time. for_each
+// calls fn on every pool in list order, so the code written with it (reset,
+// the serial solver loop) handles a new constraint kind once the type is added
+// to the list and the solver has a solve overload for it.
+template <typename... Constraints>
+struct ConstraintPools
+{
+    std::tuple<std::vector<Constraints>...> pools;
+
+    template <typename C>
+    std::vector<C>& get() { return std::get<std::vector<C>>(pools); }
+
+    template <typename C>
+    const std::vector<C>& get() const { return std::get<std::vector<C>>(pools); }
+
+    template <typename F>
+    void for_each(F &&fn) { (fn(get<Constraints>()), ...); }
+
+    template <typename F>
+    void for_each(F &&fn) const { (fn(get<Constraints>()), ...); }
+
+    void clear() { for_each([](auto &pool) { pool.clear(); }); }
+};
@@ -0,0 +1,201 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+
+#if defined(XPBD_ZLIB)
+    #include <zlib.h>
+#endif
+
+#include "types.h"
+#include "pallet_scene.cpp"
+
+// Binary columnar export of a DataCollection, the data_format = columns
+// alternative to DataCollection::print. A file is a sequence of blocks, one
+// per run, so the runs of a sweep are appended to the same file:
+//
+//   "XPBDCOL1"   8 bytes
+//   uint64       header size (little endian)
+//   header       JSON, padded with spaces to a multiple of 8 bytes
+//   columns      one after the other, each starting at a multiple of 8
+//
+// header: {"run_id": 3, "run": "<prefix>", "rows": 150, "columns": [
+//            {"name": "times", "dtype": "<f8", "shape": [150], "codec": "raw",
+//             "offset": 0, "size": 1200}, ...]}
+//
+// offset is from the first column of the block, size the stored bytes. dtype
+// and shape are numpy's: com_drift is [rows, 3], run_id an int64 column so
+// the blocks concatenate into one table. codec is "zlib" when the block was
+// written with compress (and the build has zlib), each column compressed on
+// its own. The series are the ones enabled in print_flags; a group sampled at
+// a rate of its own (data_rate_springs, data_rate_bodies) has its own times
+// column and fewer rows. A streamed run (data_stream) is several blocks with
+// the same run_id.
+
+static constexpr char COLUMN_MAGIC[8] = {'X', 'P', 'B', 'D', 'C', 'O', 'L', '1'};
+
+struct ColumnBlock
+{
+    struct Column
+    {
+        std::string       name;
+        std::string       dtype;
+        std::vector<int>  shape;
+        std::string       codec = "raw";
+        std::vector<char> bytes;
+    };
+
+    std::vector<Column> columns;
+
+    template <typename T>
+    void add(const std::string& name, const T* data, size_t rows, int width = 1)
+    {
+        Column column;
+        column.name  = name;
+        column.dtype = dtype<T>();
+        column.shape = width == 1 ? std::vector<int>{(int)rows} : std::vector<int>{(int)rows, width};
+        column.bytes.resize(rows * width * sizeof(T));
+        if (!column.bytes.empty()) std::memcpy(column.bytes.data(), data, column.bytes.size());
+        columns.push_back(std::move(column));
+    }
+
+    // false when the build has no zlib, the columns stay raw
+    bool compress()
+    {
+#if defined(XPBD_ZLIB)
+        for (Column& column : columns)
+        {
+            uLongf size = compressBound((uLong)column.bytes.size());
+            std::vector<char> packed(size);
+            if (compress2(reinterpret_cast<Bytef*>(packed.data()), &size,
+                          reinterpret_cast<const Bytef*>(column.bytes.data()), (uLong)column.bytes.size(), 6) != Z_OK) continue;
+
+            packed.resize(size);
+            column.bytes = std::move(packed);
+            column.codec = "zlib";
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void write(std::ostream& out, int64_t run_id, const std::string& run, size_t rows) const
+    {
+        auto padded = [](size_t size) { return (size + 7) / 8 * 8; };
+
+        std::ostringstream header;
+        header << "{\"run_id\": " << run_id << ", \"run\": \"" << json_escape(run) << "\", \"rows\": " << rows << ", \"columns\": [";
+
+        size_t offset = 0;
+        for (size_t ci = 0; ci < columns.size(); ci++)
+        {
+            const Column& column = columns[ci];
+
+            header << (ci > 0 ? ", " : "") << "{\"name\": \"" << json_escape(column.name) << "\", \"dtype\": \"" << column.dtype << "\", \"shape\": [";
+            for (size_t si = 0; si < column.shape.size(); si++) header << (si > 0 ? ", " : "") << column.shape[si];
+            header << "], \"codec\": \"" << column.codec << "\", \"offset\": " << offset << ", \"size\": " << column.bytes.size() << "}";
+
+            offset += padded(column.bytes.size());
+        }
+        header << "]}";
+
+        std::string json = header.str();
+        json.resize(padded(json.size()), ' ');
+
+        uint64_t header_size = json.size();
+        out.write(COLUMN_MAGIC, sizeof(COLUMN_MAGIC));
+        write_le(out, header_size);
+        out.write(json.data(), json.size());
+
+        static const char zeros[8] = {};
+        for (const Column& column : columns)
+        {
+            out.write(column.bytes.data(), column.bytes.size());
+            out.write(zeros, padded(column.bytes.size()) - column.bytes.size());
+        }
+    }
+
+private:
+
+    template <typename T> static std::string dtype();
+
+    static void write_le(std::ostream& out, uint64_t value)
+    {
+        char bytes[8];
+        for (int i = 0; i < 8; i++) bytes[i] = char((value >> (8 * i)) & 0xff);
+        out.write(bytes, 8);
+    }
+
+    static std::string json_escape(const std::string& text)
+    {
+        std::string escaped;
+        for (char c : text)
+        {
+            if      (c == '"' || c == '\\') { escaped += '\\'; escaped += c; }
+            else if ((unsigned char)c < 0x20) escaped += ' ';
+            else                              escaped += c;
+        }
+        return escaped;
+    }
+};
+
+// the format is little endian, as every target of this code
+template <> std::string ColumnBlock::dtype<double>()  { return "<f8"; }
+template <> std::string ColumnBlock::dtype<float>()   { return "<f4"; }
+template <> std::string ColumnBlock::dtype<int32_t>() { return "<i4"; }
+template <> std::string ColumnBlock::dtype<int64_t>() { return "<i8"; }
+
+// held while a block is appended to a .xcol file, the runs of a sweep share it
+std::mutex& column_file_mutex()
+{
+    static std::mutex mutex;
+    return mutex;
+}
+
+// Appends the block of one run to out. Returns false when compress was asked
+// but the build has no zlib (the block is written raw).
+bool write_data_columns(std::ostream& out, const DataCollection& data, int64_t run_id, const std::string& run, bool compress = false)
+{
+    static_assert(sizeof(Real3) == 3 * sizeof(Real), "com_drift is written as rows of 3 Real");
+
+    const DataCollection::Flags& flags = data.print_flags;
+    size_t rows = data.times.size();
+
+    ColumnBlock block;
+
+    std::vector<int64_t> run_ids(rows, run_id);
+    block.add("run_id", run_ids.data(), rows);
+
+    auto series = [&](bool enabled, const char* name, const std::vector<Real>& values)
+    {
+        if (enabled) block.add(name, values.data(), values.size());
+    };
+
+    series(flags.times,            "times",                data.times);
+    series(flags.times && data.own_times(DATA_SPRINGS), "times_springs", data.times_springs);
+    series(flags.times && data.own_times(DATA_BODIES),  "times_bodies",  data.times_bodies);
+    series(flags.accelerations,    "accelerations",        data.accelerations);
+    series(flags.displacements,    "displacements",        data.displacements);
+    series(flags.angles,           "angles",               data.angles);
+    series(flags.elastic_energies, "elastic_energies",     data.elastic_energies);
+    series(flags.max_force,        "max_force_recorded",   data.max_force_recorded);
+    series(flags.total_force,      "total_force_recorded", data.total_force_recorded);
+    series(flags.kinetic_energy,   "kinetic_energy",       data.kinetic_energy);
+    series(flags.total_stretch,    "total_stretch_x",      data.total_stretch_x);
+    series(flags.total_stretch,    "total_stretch_y",      data.total_stretch_y);
+    series(flags.total_stretch,    "total_stretch_z",      data.total_stretch_z);
+
+    if (flags.com_drift) block.add("com_drift", reinterpret_cast<const Real*>(data.com_drift.data()), data.com_drift.size(), 3);
+
+    bool compressed = !compress || block.compress();
+
+    block.write(out, run_id, run, rows);
+    return compressed;
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+
+#include "types.h"
+#include "settings.cpp"
+#include "spsc_ring.cpp"
+#include "pallet_scene.cpp"
+#include "data_export.cpp"
+
+// Streaming data collection (data_stream): DataCollection::update pushes its
+// samples into an SpscRing and a writer thread appends them to the .xcol file
+// as they come, one column block every BlockRows samples or every second. The
+// memory of a run stays at the ring and one block whatever its length, and a
+// crash loses at most the last second. The solver thread never waits: on a
+// full ring the sample is dropped and counted.
+
+// streaming needs the columns format, Python lists are printed at the end
+inline bool streams_data(const Settings& settings)
+{
+    return settings.data_stream && settings.data_format == "columns";
+}
+
+struct DataStreamStats
+{
+    uint64_t samples    = 0; // pushed into the ring
+    uint64_t dropped    = 0; // lost on a full ring
+    size_t   high_water = 0; // highest ring fill
+    size_t   capacity   = 0;
+    uint64_t blocks     = 0; // column blocks written
+    bool     compressed = true;  // false: data_compress without zlib
+    bool     failed     = false; // a write failed
+};
+
+struct DataStreamWriter
+{
+    static constexpr size_t BlockRows = 512;
+
+    DataStreamWriter() {}
+    DataStreamWriter(const DataStreamWriter&) = delete;
+    DataStreamWriter& operator=(const DataStreamWriter&) = delete;
+
+    ~DataStreamWriter() { close(); }
+
+    bool is_open() const { return writer.joinable(); }
+
+    // Opens path for appending and starts the writer thread, data pushes into
+    // the ring from then on. Call before TransportRun::reset, which reads
+    // data.stream to skip the reserve of the series.
+    void open(DataCollection& data, const std::string& path, int64_t run_id, const std::string& run, bool compress, size_t capacity)
+    {
+        close();
+
+        out.open(native_path(path), std::ios::out | std::ios::binary | std::ios::app);
+        if (!out.is_open()) throw std::runtime_error("cannot write " + path);
+
+        ring = std::make_unique<SpscRing<DataSample>>(capacity);
+
+        this->run_id   = run_id;
+        this->run      = run;
+        this->compress = compress;
+        stats          = DataStreamStats();
+        stats.capacity = ring->capacity();
+        closing        = false;
+
+        attached    = &data;
+        data.stream = ring.get();
+        writer      = std::thread([this]() { writer_loop(); });
+    }
+
+    // Writes what is left in the ring, stops the writer and detaches the
+    // DataCollection. The collection must not be updated meanwhile.
+    DataStreamStats close()
+    {
+        if (!is_open()) return stats;
+
+        closing.store(true, std::memory_order_release);
+        writer.join();
+
+        stats.samples    = ring->pushed();
+        stats.dropped    = ring->dropped();
+        stats.high_water = ring->high_water();
+
+        attached->stream = nullptr;
+        attached         = nullptr;
+        out.close();
+
+        return stats;
+    }
+
+private:
+
+    void writer_loop()
+    {
+        // the sampling rates and flags of the run, set by TransportRun::reset
+        // after open: read them at the first sample
+        bool   configured = false;
+        size_t rows       = 0;
+        auto   last_block = std::chrono::steady_clock::now();
+
+        auto flush = [&]()
+        {
+            {
+                std::lock_guard<std::mutex> lock(column_file_mutex());
+                stats.compressed &= write_data_columns(out, chunk, run_id, run, compress);
+                out.flush();
+            }
+            stats.failed |= !out;
+            stats.blocks++;
+
+            chunk.clear();
+            rows       = 0;
+            last_block = std::chrono::steady_clock::now();
+        };
+
+        DataSample sample;
+        while (true)
+        {
+            // read before draining: every sample is pushed before close sets it
+            bool last = closing.load(std::memory_order_acquire);
+
+            bool popped = false;
+            while (ring->try_pop(sample))
+            {
+                if (!configured)
+                {
+                    chunk.print_flags = attached->print_flags;
+                    std::copy(attached->sample_every, attached->sample_every + 3, chunk.sample_every);
+                    configured = true;
+                }
+
+                chunk.record(sample);
+                popped = true;
+                if (++rows == BlockRows) flush();
+            }
+
+            if (rows > 0 && (last || std::chrono::steady_clock::now() - last_block >= std::chrono::seconds(1))) flush();
+            if (last) return;
+
+            if (!popped) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    std::unique_ptr<SpscRing<DataSample>> ring;
+    std::thread       writer;
+    std::atomic<bool> closing{false};
+
+    DataCollection *attached = nullptr;
+    DataCollection  chunk;    // the samples of the next block, writer thread only
+    std::ofstream   out;
+
+    int64_t     run_id   = 0;
+    std::string run;
+    bool        compress = false;
+
+    DataStreamStats stats;
+};
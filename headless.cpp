@@ -0,0 +1,280 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+
+#include "types.h"
+#include "settings.cpp"
+#include "scene.cpp"
+#include "scene_cache.cpp"
+#include "pallet_scene.cpp"
+#include "sweep.cpp"
+#include "job_queue.cpp"
+
+// Runs the transport profile of rigid_world_schema without a window or GL
+// context, as fast as the solver goes, and writes the DataCollection lists to
+// a file.
+//
+//   XPBDPalletHeadless [-C dir] [-c file.conf] [-o data.py] [-j threads] [name=value ...]
+//
+//   -C  working directory, the data paths are relative to it as for the viewer
+//       (..\..\palleting_data from build\Release)
+//   -c  configuration file, default ..\..\configurations\c1.conf
+//   -o  output file, default data.py (data_<prefix>.py when prefix is set, .xcol
+//       with data_format = columns, appended to)
+//   -j  threads of a sweep, default all the hardware threads
+//
+// name=value sets any CONFIG_PARAMS entry after the configuration file.
+// Every run ends by printing its state hash (scene_state_hash): the same
+// configuration must print the same hash whatever the thread counts and, with
+// sat_kernel = reference or check, the SIMD kernels.
+// name=v1,v2,... makes a sweep: one run per point of the grid of the listed
+// values (see make_sweep), -o is then the directory of the data files.
+//
+// With a job queue directory shared by several processes or machines
+// (see JobQueue):
+//
+//   XPBDPalletHeadless -q dir submit [-c file.conf] [name=value[,value...] ...]
+//   XPBDPalletHeadless -q dir work [-j threads] [-t lease seconds]
+//   XPBDPalletHeadless -q dir summary [-o merged.py]
+//
+// submit writes one job per grid point, work runs jobs until the queue is
+// empty, summary merges the results (default dir/summary.py) and prints the
+// throughput and the stragglers.
+
+static void usage()
+{
+    std::cerr << "usage: XPBDPalletHeadless [-C dir] [-c file.conf] [-o data.py] [-j threads] [name=value[,value...] ...]\n"
+              << "       XPBDPalletHeadless -q dir submit|work|summary [-j threads] [-t lease seconds] ...\n";
+}
+
+int main(int argc, char* argv[])
+{
+    std::string config_file = "..\\..\\configurations\\c1.conf";
+    std::string output_file;
+    size_t      sweep_threads = std::max(1u, std::thread::hardware_concurrency());
+    std::string queue_dir;
+    std::string queue_mode;
+    double      lease_timeout = 300.0;
+
+    std::unordered_map<std::string, std::string> overrides;
+    std::vector<SweepAxis> axes;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+
+        if (arg == "submit" || arg == "work" || arg == "summary") { queue_mode = arg; continue; }
+
+        if ((arg == "-C" || arg == "-c" || arg == "-o" || arg == "-j" || arg == "-q" || arg == "-t") && i + 1 < argc)
+        {
+            std::string value = argv[++i];
+            if      (arg == "-c") config_file   = value;
+            else if (arg == "-o") output_file   = value;
+            else if (arg == "-j") sweep_threads = std::max(1, std::atoi(value.c_str()));
+            else if (arg == "-q") queue_dir     = value;
+            else if (arg == "-t") lease_timeout = std::atof(value.c_str());
+            else
+            {
+                std::error_code ec;
+                fs::current_path(value, ec);
+                if (ec) { std::cerr << "Cannot enter " << value << ": " << ec.message() << "\n"; return 1; }
+            }
+            continue;
+        }
+
+        size_t equal_pos = arg.find('=');
+        if (equal_pos == std::string::npos || equal_pos == 0) { usage(); return 1; }
+
+        std::string name  = arg.substr(0, equal_pos);
+        std::string value = arg.substr(equal_pos + 1);
+
+        if (value.find(',') == std::string::npos) { overrides[name] = value; continue; }
+
+        SweepAxis axis = {name, {}};
+        std::stringstream values(value);
+        for (std::string v; std::getline(values, v, ',');) if (!v.empty()) axis.values.push_back(v);
+        if (axis.values.empty()) { usage(); return 1; }
+        axes.push_back(axis);
+    }
+
+    if (queue_dir.empty() != queue_mode.empty()) { usage(); return 1; }
+
+    JobQueue queue(native_path(queue_dir));
+    queue.lease_timeout = lease_timeout;
+
+    if (queue_mode == "work")
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        size_t jobs_run = run_queue_worker(queue, sweep_threads);
+        double wall_s   = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+        std::cout << queue_worker_name() << ": " << jobs_run << " jobs in " << wall_s << " s\n";
+        return 0;
+    }
+
+    if (queue_mode == "summary")
+    {
+        std::string merged_file = output_file.empty() ? (queue.root / "summary.py").string() : output_file;
+        std::ofstream merged(merged_file, std::ios::out | std::ios::trunc);
+        if (!merged.is_open()) { std::cerr << "Cannot write " << merged_file << "\n"; return 1; }
+
+        QueueSummary summary = summarize_queue(queue, merged);
+
+        std::cout << summary.done << " done (" << summary.failed << " failed, " << summary.retried << " re-leased), "
+                  << summary.running << " running, " << summary.pending << " pending\n";
+        std::cout << "throughput: " << summary.jobs_per_hour << " jobs per hour over " << summary.span_s << " s\n";
+        std::cout << "job time: median " << summary.median_s << " s, p90 " << summary.p90_s << " s, max " << summary.max_s << " s\n";
+        std::cout << "stragglers (over twice the median): " << summary.stragglers.size() << "\n";
+        for (const std::string& id : summary.stragglers) std::cout << "    " << id << "\n";
+        for (const auto& [worker, jobs] : summary.jobs_per_worker) std::cout << worker << ": " << jobs << " jobs\n";
+        std::cout << "merged data in " << merged_file << "\n";
+
+        // jobs run with data_format = columns, next to the Python file
+        fs::path columns_file = fs::path(merged_file).replace_extension(".xcol");
+        std::ofstream columns(columns_file, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (merge_queue_columns(queue, columns) > 0) std::cout << "merged columns in " << columns_file.string() << "\n";
+        else { columns.close(); fs::remove(columns_file); }
+        return 0;
+    }
+
+    if (!fs::exists(native_path(config_file)))
+    {
+        std::cerr << "Configuration file not found: " << config_file << "\n";
+        return 1;
+    }
+
+    if (!load_configuration_file(native_path(config_file))) return 1;
+
+    Settings settings = current_settings();
+
+    try
+    {
+        std::vector<std::string> unknown = apply_configuration(settings, overrides);
+        if (!unknown.empty())
+        {
+            for (const auto& name : unknown) std::cerr << "Unknown setting: " << name << "\n";
+            return 1;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Invalid setting value: " << e.what() << "\n";
+        return 1;
+    }
+
+    settings.collect_data = true;
+
+    if (queue_mode == "submit")
+    {
+        try
+        {
+            std::vector<SweepRun> runs = make_sweep(settings, axes);
+            size_t added = queue.submit(runs);
+            std::cout << added << " jobs added to " << queue_dir << " (" << runs.size() - added << " already queued)\n";
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Submit: " << e.what() << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    if (!axes.empty())
+    {
+        std::vector<SweepRun> runs;
+        try
+        {
+            runs = make_sweep(settings, axes, output_file.empty() ? "." : output_file);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Sweep: " << e.what() << "\n";
+            return 1;
+        }
+
+        if (!output_file.empty())
+        {
+            std::error_code ec;
+            fs::create_directories(output_file, ec);
+        }
+
+        SweepReport report = run_sweep(runs, sweep_threads);
+
+        std::cout << report.runs << " runs (" << report.failed << " failed) on " << report.threads << " threads in " << report.wall_s << " s, "
+                  << report.run_s / std::max<size_t>(report.runs, 1) << " s per run, " << report.runs_per_hour() << " runs per hour\n";
+
+        return report.failed == 0 ? 0 : 1;
+    }
+
+    bool columns = settings.data_format == "columns";
+    if (output_file.empty()) output_file = (settings.prefix.empty() ? "data" : "data_" + settings.prefix) + (columns ? ".xcol" : ".py");
+
+    SimulationContext ctx(settings);
+    SceneCache       scene_cache;
+    DataCollection   data;
+    DataStreamWriter stream;
+    TransportRun     run;
+
+    if (streams_data(settings))
+    {
+        try
+        {
+            stream.open(data, output_file, 0, settings.prefix, settings.data_compress, settings.data_stream_buffer);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot write " << output_file << " (" << e.what() << ")\n";
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    run.reset(ctx, scene_cache, data);
+    while (!run.advance(ctx, data));
+
+    Real wall_ms = std::chrono::duration<Real, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (stream.is_open())
+    {
+        DataStreamStats stats = stream.close();
+        if (stats.failed) { std::cerr << "Cannot write " << output_file << "\n"; return 1; }
+        if (!stats.compressed) std::cerr << "data_compress: built without zlib, columns written uncompressed\n";
+
+        std::cout << "stream: " << stats.samples << " samples in " << stats.blocks << " blocks, " << stats.dropped << " dropped, ring peak "
+                  << stats.high_water << " of " << stats.capacity << "\n";
+    }
+    else
+    {
+        SweepRun written;
+        written.settings    = ctx.settings;
+        written.output_file = output_file;
+        try
+        {
+            write_run_data(written, data);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Cannot write " << output_file << " (" << e.what() << ")\n";
+            return 1;
+        }
+    }
+
+    std::cout << ctx.settings.schema_folder << ": " << run.step << " steps, " << ctx.scene.rigid_objects.size() << " bodies, "
+              << wall_ms << " ms (" << run.total_physics_time / run.step << " ms per XPBD step), data in " << output_file << "\n";
+    std::cout << "state " << state_hash_string(scene_state_hash(ctx.scene)) << "\n";
+
+    // sat_kernel = check as a test: the SIMD lanes must match the scalar ones
+    if (ctx.stats.kernel_mismatches > 0)
+    {
+        std::cerr << ctx.stats.kernel_mismatches << " SAT kernel lanes differ from the scalar kernel\n";
+        return 2;
+    }
+
+    return 0;
+}
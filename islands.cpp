@@ -0,0 +1,59 @@
+#pragma once
+
+#include <vector>
+#include <numeric>
+
+#include "types.h"
+
+// Disjoint sets over body indices (union by size, path halving), used to group
+// rigid bodies connected by springs and contacts into islands.
+struct UnionFind
+{
+    std::vector<Index> parent;
+    std::vector<Index> size;
+
+    void reset(size_t n)
+    {
+        parent.resize(n);
+        size.assign(n, 1);
+        std::iota(parent.begin(), parent.end(), 0);
+    }
+
+    Index find(Index i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    }
+
+    void unite(Index a, Index b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a == b) return;
+
+        if (size[a] < size[b]) std::swap(a, b);
+        parent[b] = a;
+        size[a]  += size[b];
+    }
+};
+
+// Constraints of one island as indices into the scene constraint vectors, in
+// the order the serial solver visits them. Islands share no dynamic body, so
+// they can be solved concurrently with the same result as the serial loops.
+struct SolverIsland
+{
+    std::vector<Index> fixed_springs;
+    std::vector<Index> springs;
+    std::vector<Index> contacts;
+
+    void clear()
+    {
+        fixed_springs.clear();
+        springs.clear();
+        contacts.clear();
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "types.h"
+#include "coloring.cpp"
+
+// Correction computed by one constraint for one body, applied later (Jacobi).
+// weight is 0 when the constraint did not move the body in this iteration.
+struct BodyDelta
+{
+    SolverReal3 dp     = SolverReal3(0.0);
+    SolverQuat  dq     = SolverQuat(0.0);
+    SolverReal  weight = 0.0;
+};
+
+// Jacobi buffers: one BodyDelta slot per (constraint, body) incidence, laid out
+// as fixed springs [1 slot], springs [2 slots], contacts [2 slots], and the
+// incidences of every body in CSR form (slots of body b are
+// slots[offsets[b] .. offsets[b+1]), in increasing slot order). Each body sums
+// its own slots in that fixed order, so the result does not depend on the
+// number of threads.
+struct JacobiBuffers
+{
+    std::vector<BodyDelta> deltas;
+    std::vector<Index>     offsets;
+    std::vector<Index>     slots;
+
+    Index spring_base  = 0;
+    Index contact_base = 0;
+
+    void clear()
+    {
+        deltas.clear();
+        offsets.clear();
+        slots.clear();
+    }
+
+    // body_of(slot) gives the body moved through that slot, NO_BODY for static ones
+    template <typename BodyOf>
+    void build(size_t num_bodies, Index num_fixed, Index num_springs, Index num_contacts, BodyOf &&body_of)
+    {
+        spring_base  = num_fixed;
+        contact_base = num_fixed + 2 * num_springs;
+
+        Index num_slots = contact_base + 2 * num_contacts;
+        deltas.resize(num_slots);
+
+        offsets.assign(num_bodies + 1, 0);
+        for (Index si = 0; si < num_slots; si++)
+        {
+            Index b = body_of(si);
+            if (b != NO_BODY) offsets[b + 1]++;
+        }
+
+        for (size_t b = 0; b < num_bodies; b++) offsets[b + 1] += offsets[b];
+
+        slots.resize(offsets[num_bodies]);
+        std::vector<Index> fill(offsets.begin(), offsets.end() - 1);
+
+        for (Index si = 0; si < num_slots; si++)
+        {
+            Index b = body_of(si);
+            if (b != NO_BODY) slots[fill[b]++] = si;
+        }
+    }
+};
@@ -0,0 +1,471 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <system_error>
+#include <atomic>
+#include <limits>
+#include <unordered_map>
+
+#if defined(_WIN32)
+    #include <process.h>
+#else
+    #include <unistd.h>
+#endif
+
+#include "types.h"
+#include "settings.cpp"
+#include "sweep.cpp"
+
+// Sweeps spread over processes (or machines) that share only a directory:
+//
+//   pending/<id>.job           settings of a run, as a .conf file; the id is
+//                              the run prefix and a hash of the settings
+//   running/<id>.job.<worker>  claimed: renamed from pending/ by one worker,
+//                              touched about once a second while it runs
+//   done/<id>.done             completion marker, key = value lines
+//   results/data_<id>.py       DataCollection output (data_<id>.xcol with
+//                              data_format = columns)
+//
+// rename is atomic on one filesystem, so two workers never claim the same
+// job. A lease not touched for lease_timeout seconds (a crashed worker) goes
+// back to pending/ with a "# re-leased" line, the next claim counts them.
+// Files are written under a temporary name and renamed in place, a worker
+// publishes a result only while it still holds the lease.
+
+// seconds since the epoch, comparable between machines with synced clocks
+inline double queue_clock()
+{
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// host-pid, unique among the workers of a queue
+std::string queue_worker_name()
+{
+    const char *host = std::getenv("COMPUTERNAME");
+    if (!host) host = std::getenv("HOSTNAME");
+
+#if defined(_WIN32)
+    int pid = _getpid();
+#else
+    char buffer[256] = {};
+    if (!host && gethostname(buffer, sizeof(buffer) - 1) == 0) host = buffer;
+    int pid = (int)getpid();
+#endif
+
+    return std::string(host ? host : "local") + "-" + std::to_string(pid);
+}
+
+struct JobQueue
+{
+    fs::path root;
+    double   lease_timeout = 300.0; // seconds without a heartbeat
+
+    explicit JobQueue(const std::string& directory) : root(directory) {}
+
+    fs::path pending() const { return root / "pending"; }
+    fs::path running() const { return root / "running"; }
+    fs::path done()    const { return root / "done"; }
+    fs::path results() const { return root / "results"; }
+
+    void create() const
+    {
+        for (const fs::path& dir : {pending(), running(), done(), results()}) fs::create_directories(dir);
+    }
+
+    // One job per run, the job id is the run prefix and a hash of all its
+    // settings: the prefix encodes only the swept values. Runs already in the
+    // queue (pending, running or done) are skipped. Returns the jobs added.
+    size_t submit(const std::vector<SweepRun>& runs) const
+    {
+        create();
+
+        size_t added = 0;
+        for (const SweepRun& run : runs)
+        {
+            std::ostringstream settings;
+            write_configuration(settings, run.settings);
+
+            std::string id = job_id(run.settings.prefix, settings.str());
+            if (known(id)) continue;
+
+            std::ostringstream conf;
+            conf << "# job " << id << "\n"
+                 << "# run_id " << run.run_id << "\n"
+                 << settings.str();
+
+            if (!write_in_place(pending() / (id + ".job"), conf.str()))
+                throw std::runtime_error("cannot write job " + id);
+            added++;
+        }
+        return added;
+    }
+
+    // Renames the first pending job to running/, false when none is left
+    // (or every rename was lost to other workers).
+    bool claim(const std::string& worker, std::string& id, fs::path& lease) const
+    {
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(pending(), ec))
+        {
+            if (entry.path().extension() != ".job") continue;
+
+            fs::path target = running() / (entry.path().filename().string() + "." + worker);
+            fs::rename(entry.path(), target, ec);
+            if (ec) continue; // taken by another worker
+
+            id    = entry.path().stem().string();
+            lease = target;
+            heartbeat(lease);
+            return true;
+        }
+        return false;
+    }
+
+    void heartbeat(const fs::path& lease) const
+    {
+        std::error_code ec;
+        fs::last_write_time(lease, fs::file_time_type::clock::now(), ec);
+    }
+
+    // Moves the leases older than lease_timeout back to pending/, returns how
+    // many. A lease is first renamed to running/<id>.job.releasing.<worker>:
+    // of two workers releasing it one rename fails, and the "# re-leased" line
+    // goes into a file only this worker holds.
+    size_t release_expired(const std::string& worker) const
+    {
+        size_t released = 0;
+        auto   now      = fs::file_time_type::clock::now();
+
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(running(), ec))
+        {
+            std::error_code time_ec;
+            auto touched = fs::last_write_time(entry.path(), time_ec);
+            if (time_ec || std::chrono::duration<double>(now - touched).count() < lease_timeout) continue;
+
+            std::string name   = entry.path().filename().string();
+            size_t      suffix = name.find(".job.");
+            if (suffix == std::string::npos) continue;
+
+            // the worker of the lease, also when a releasing or publishing
+            // worker died holding it
+            std::string id   = name.substr(0, suffix);
+            std::string from = name.substr(suffix + 5);
+            from = from.substr(0, std::min(from.find(".releasing."), from.find(".publishing.")));
+
+            fs::path owned = running() / (id + ".job.releasing." + worker);
+            std::error_code move_ec;
+            fs::rename(entry.path(), owned, move_ec);
+            if (move_ec) continue; // released by another worker
+            heartbeat(owned);
+
+            {
+                // in | out never creates the file: nothing is written if it was taken meanwhile
+                std::fstream out(owned, std::ios::in | std::ios::out | std::ios::ate);
+                out << "# re-leased from " << from << "\n";
+            }
+
+            fs::rename(owned, pending() / (id + ".job"), move_ec);
+            if (!move_ec) released++;
+        }
+        return released;
+    }
+
+    // Runs a claimed job, writes its data file and the completion marker, and
+    // drops the lease. The data goes to a temporary file first: a worker
+    // whose lease expired and was re-leased meanwhile drops its result, the
+    // job runs again elsewhere. Returns false then.
+    bool run_job(const std::string& worker, const std::string& id, const fs::path& lease, SceneCache& cache) const
+    {
+        double claimed_at = queue_clock();
+
+        SweepRun run;
+        int      attempts = 1;
+        {
+            std::ifstream in(lease);
+            std::stringstream conf;
+            conf << in.rdbuf();
+
+            std::string line, run_id;
+            while (std::getline(conf, line))
+            {
+                attempts += line.rfind("# re-leased", 0) == 0;
+                if (line.rfind("# run_id ", 0) == 0) run_id = line.substr(9);
+            }
+            conf.clear();
+            conf.seekg(0);
+
+            std::unordered_map<std::string, std::string> values = read_configuration(conf);
+            try
+            {
+                if (!run_id.empty()) run.run_id = std::stoll(run_id);
+                std::vector<std::string> unknown = apply_configuration(run.settings, values);
+                if (!unknown.empty()) run.error = "unknown setting " + unknown.front();
+            }
+            catch (const std::exception& e)
+            {
+                run.error = std::string("invalid job file (") + e.what() + ")";
+            }
+        }
+
+        fs::path result = results() / ("data_" + id + (run.settings.data_format == "columns" ? ".xcol" : ".py"));
+        run.output_file = result.string() + ".tmp." + worker;
+
+        // columns are appended, start from an empty file
+        std::error_code ec;
+        fs::remove(run.output_file, ec);
+
+        if (run.error.empty()) run_sweep_point(run, cache, [&]() { heartbeat(lease); });
+
+        // renaming the lease (touched, release_expired leaves it alone) fails
+        // when it was re-leased
+        fs::path publishing = running() / (id + ".job.publishing." + worker);
+        heartbeat(lease);
+        fs::rename(lease, publishing, ec);
+        if (ec)
+        {
+            fs::remove(run.output_file, ec);
+            return false;
+        }
+
+        if (run.error.empty())
+        {
+            fs::rename(run.output_file, result, ec);
+            if (ec) run.error = "cannot write " + result.string();
+        }
+        if (!run.error.empty()) fs::remove(run.output_file, ec);
+
+        std::ostringstream marker;
+        marker.precision(17);
+        marker << "worker = "      << worker                            << "\n"
+               << "status = "      << (run.error.empty() ? "ok" : "failed") << "\n"
+               << "steps = "       << run.steps                         << "\n"
+               << "wall_ms = "     << run.wall_ms                       << "\n"
+               << "claimed_at = "  << claimed_at                        << "\n"
+               << "finished_at = " << queue_clock()                     << "\n"
+               << "attempts = "    << attempts                          << "\n"
+               << "error = "       << run.error                         << "\n";
+
+        write_in_place(done() / (id + ".done"), marker.str());
+
+        fs::remove(publishing, ec);
+        return true;
+    }
+
+    bool has_jobs(const fs::path& dir) const
+    {
+        std::error_code ec;
+        return fs::exists(dir, ec) && !fs::is_empty(dir, ec);
+    }
+
+private:
+
+    // <prefix>_<FNV-1a of the settings>, the same on every machine sharing
+    // the queue (std::hash is not)
+    static std::string job_id(const std::string& prefix, const std::string& settings)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (unsigned char c : settings) hash = (hash ^ c) * 1099511628211ull;
+
+        std::ostringstream id;
+        id << prefix << "_" << std::hex << std::setw(16) << std::setfill('0') << hash;
+        return id.str();
+    }
+
+    bool known(const std::string& id) const
+    {
+        if (fs::exists(pending() / (id + ".job")) || fs::exists(done() / (id + ".done"))) return true;
+
+        std::error_code ec;
+        for (const auto& entry : fs::directory_iterator(running(), ec))
+            if (entry.path().filename().string().rfind(id + ".job.", 0) == 0) return true;
+
+        return false;
+    }
+
+    static bool write_in_place(const fs::path& path, const std::string& content)
+    {
+        fs::path temporary = path;
+        temporary += ".tmp." + queue_worker_name();
+        {
+            std::ofstream out(temporary, std::ios::out | std::ios::trunc);
+            if (!out.is_open()) return false;
+            out << content;
+            if (!out) return false;
+        }
+
+        std::error_code ec;
+        fs::rename(temporary, path, ec);
+        return !ec;
+    }
+};
+
+// Claims and runs jobs on num_threads threads until the queue has neither
+// pending nor running jobs. An idle worker re-leases expired jobs and waits
+// for the running ones, which may still come back. Returns the jobs published.
+size_t run_queue_worker(const JobQueue& queue, size_t num_threads, std::ostream& log = std::cout)
+{
+    std::string worker = queue_worker_name();
+    std::mutex  log_mutex;
+    std::atomic<size_t> jobs_run{0};
+
+    auto thread_loop = [&](size_t ti)
+    {
+        std::string name = num_threads > 1 ? worker + "-" + std::to_string(ti) : worker;
+        SceneCache  cache;
+
+        while (true)
+        {
+            std::string id;
+            fs::path    lease;
+
+            if (queue.claim(name, id, lease))
+            {
+                bool published = queue.run_job(name, id, lease, cache);
+                jobs_run += published;
+
+                std::lock_guard<std::mutex> lock(log_mutex);
+                log << name << ": " << id << (published ? " done\n" : " dropped, re-leased meanwhile\n");
+                continue;
+            }
+
+            if (queue.release_expired(name) > 0) continue;
+            if (!queue.has_jobs(queue.running()) && !queue.has_jobs(queue.pending())) return;
+
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t ti = 1; ti < num_threads; ti++) threads.emplace_back(thread_loop, ti);
+    thread_loop(0);
+
+    for (std::thread& thread : threads) thread.join();
+
+    return jobs_run;
+}
+
+struct QueueSummary
+{
+    size_t pending = 0, running = 0, done = 0, failed = 0, retried = 0;
+
+    double span_s       = 0.0; // first claim to last completion
+    double jobs_per_hour = 0.0;
+
+    double median_s = 0.0, p90_s = 0.0, max_s = 0.0;
+    std::vector<std::string> stragglers; // ids of the jobs over twice the median
+
+    std::map<std::string, size_t> jobs_per_worker;
+};
+
+// Reads the completion markers, merges the data files of the finished jobs in
+// one Python file (runs["<id>"]["<list>"] = [...]) and computes throughput and
+// straggler statistics.
+QueueSummary summarize_queue(const JobQueue& queue, std::ostream& merged)
+{
+    QueueSummary summary;
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(queue.pending(), ec)) summary.pending += entry.path().extension() == ".job";
+    for (const auto& entry : fs::directory_iterator(queue.running(), ec)) summary.running += entry.is_regular_file();
+
+    struct Finished { std::string id; double wall_s; };
+    std::vector<Finished> finished;
+    double first_claim = std::numeric_limits<double>::max(), last_finish = 0.0;
+
+    merged << "runs = {}\n\n";
+
+    for (const auto& entry : fs::directory_iterator(queue.done(), ec))
+    {
+        if (entry.path().extension() != ".done") continue;
+
+        std::ifstream in(entry.path());
+        std::unordered_map<std::string, std::string> marker = read_configuration(in);
+
+        std::string id = entry.path().stem().string();
+        summary.done++;
+        summary.jobs_per_worker[marker["worker"]]++;
+        if (marker["status"] != "ok") { summary.failed++; continue; }
+
+        int    attempts;
+        double wall_ms, claimed_at, finished_at;
+        try
+        {
+            attempts    = std::stoi(marker["attempts"]);
+            wall_ms     = std::stod(marker["wall_ms"]);
+            claimed_at  = std::stod(marker["claimed_at"]);
+            finished_at = std::stod(marker["finished_at"]);
+        }
+        catch (const std::exception&)
+        {
+            summary.failed++; // a damaged marker
+            continue;
+        }
+
+        if (attempts > 1) summary.retried++;
+
+        finished.push_back({id, wall_ms / 1000.0});
+        first_claim = std::min(first_claim, claimed_at);
+        last_finish = std::max(last_finish, finished_at);
+
+        // "name = [...]" lines of DataCollection::print, columns results are
+        // merged by merge_queue_columns
+        std::ifstream data(queue.results() / ("data_" + id + ".py"));
+        if (!data.is_open()) continue;
+
+        merged << "runs[\"" << id << "\"] = {}\n";
+        for (std::string line; std::getline(data, line);)
+        {
+            size_t equal_pos = line.find(" = [");
+            if (line.empty() || line[0] == '#' || equal_pos == std::string::npos) continue;
+            merged << "runs[\"" << id << "\"][\"" << line.substr(0, equal_pos) << "\"] = " << line.substr(equal_pos + 3) << "\n";
+        }
+        merged << "\n";
+    }
+
+    if (finished.empty()) return summary;
+
+    std::sort(finished.begin(), finished.end(), [](const Finished& a, const Finished& b) { return a.wall_s < b.wall_s; });
+
+    summary.span_s        = std::max(last_finish - first_claim, 1e-9);
+    summary.jobs_per_hour = 3600.0 * (double)finished.size() / summary.span_s;
+    summary.median_s      = finished[finished.size() / 2].wall_s;
+    summary.p90_s         = finished[std::min(finished.size() - 1, finished.size() * 9 / 10)].wall_s;
+    summary.max_s         = finished.back().wall_s;
+
+    for (const Finished& job : finished)
+        if (job.wall_s > 2.0 * summary.median_s) summary.stragglers.push_back(job.id);
+
+    return summary;
+}
+
+// Concatenates the column blocks of the finished jobs (results/*.xcol) in
+// out, ordered by job id. Returns the number of files merged.
+size_t merge_queue_columns(const JobQueue& queue, std::ostream& out)
+{
+    std::vector<fs::path> files;
+
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(queue.results(), ec))
+        if (entry.path().extension() == ".xcol") files.push_back(entry.path());
+
+    std::sort(files.begin(), files.end());
+
+    for (const fs::path& file : files)
+    {
+        std::ifstream in(file, std::ios::binary);
+        out << in.rdbuf();
+    }
+    return files.size();
+}
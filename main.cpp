@@ -34,22 +34,18 @@ namespace fs = std::filesystem;
 #include "settings.cpp"
 #include "rendering.cpp"
 #include "rigid.cpp"
-
-#define MEASURE_TIME(function_call, accumulator)                                                   \
-do {                                                                                               \
-    auto start_##accumulator = std::chrono::high_resolution_clock::now();                          \
-    function_call;                                                                                 \
-    auto elapsed_##accumulator = std::chrono::high_resolution_clock::now() - start_##accumulator;  \
-    accumulator += std::chrono::duration<Real, std::milli>(elapsed_##accumulator).count();         \
-} while(0)
+#include "scene_cache.cpp"
+#include "pallet_scene.cpp"
+#include "data_export.cpp"
+#include "data_stream.cpp"
+#include "obj_export.cpp"
+#include "anim_stream.cpp"
 
 // Callback per ridimensionamento finestra
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     glViewport(0, 0, width, height);
 }
 
-extern Real delta_t; 
-
 extern unsigned int WIDTH;
 extern unsigned int HEIGHT;
 extern bool DO_VIDEO;
@@ -61,10 +57,6 @@ using string = std::string;
 CONFIG_PARAMS
 #undef X
 
-extern Real3 gravity;
-
-extern uint64_t frequency;
-
 // const std::chrono::duration<double, std::milli> targetFrameDuration(1000.0 / targetFPS);
 std::chrono::steady_clock::time_point frameStart;
 std::chrono::steady_clock::time_point simulationStart;
@@ -72,11 +64,15 @@ std::chrono::steady_clock::time_point simulationStart;
 GLFWwindow* window         = nullptr;
 unsigned int objectProgram = 0;
 unsigned int groundProgram = 0;
-Scene  scene;
+SimulationContext sim;
+Scene &scene = sim.scene;
 Ground ground;
 SpringRenderer spring_renderer; 
 FixedRigidSpringRenderer fixed_rigid_spring_renderer; 
 RigidSpringRenderer rigid_spring_renderer; 
+RigidBoxRenderer rigid_box_renderer; 
+SoftBodyRenderer soft_body_renderer; 
+SceneCache scene_cache;
 
 void parseArgument(int argc, char* argv[]) {
 
@@ -261,11 +257,11 @@ void rendering(Real3 center = Real3(0.0))
 
     set_shader(objectProgram, MVP);
     background(0.05f, 0.05f, 0.05f);
-    for (RigidBox &obj : scene.rigid_objects) obj.draw();
+    rigid_box_renderer.draw(scene);
 
-    // for (TetraObject &obj : scene.objects)       obj.draw();
-    // for (SceneObject &obj : scene.scene_objects) obj.draw();
-    // for (Cloth &cloth : scene.cloths) cloth.draw();
+    // soft_body_renderer.drawObjects(scene);
+    // soft_body_renderer.drawSceneObjects(scene);
+    // soft_body_renderer.drawCloths(scene);
 
     set_shader(groundProgram, MVP);
     // ground.draw();
@@ -287,71 +283,22 @@ void null_rendering(Real3 center = Real3(0.0))
 
 void attach_vertices(Scene &scene, Index obj1, Index obj2, VertexIndex v1, VertexIndex v2, Real rest_length = 0.0) 
 {
-    TetraObject &o1 = scene.getObject(obj1);
-    TetraObject &o2 = scene.getObject(obj2);
-
-    SpringConstraint con(wrap_compliance, &o1, &o2, v1, v2, rest_length);
+    SpringConstraint con(wrap_compliance, obj1, obj2, v1, v2, rest_length);
     scene.addConstraint(con);
 }
 
-std::string find_single_file(const std::string& folder_path) 
-{
-    for (const auto& entry : fs::directory_iterator(folder_path)) {
-        if (entry.is_regular_file()) {
-            return entry.path().string(); // ritorna il path completo
-        }
-    }
-    throw std::runtime_error("Nessun file trovato in " + folder_path);
-}
-
-std::vector<std::string> find_files_in_folder(const std::string& folder_path) 
-{
-    std::vector<std::string> files;
-    for (const auto& entry : fs::directory_iterator(folder_path)) {
-        if (entry.is_regular_file()) {
-            files.push_back(entry.path().string());
-        }
-    }
-    if (files.empty()) {
-        throw std::runtime_error("Nessun file trovato in " + folder_path);
-    }
-    return files;
-}
-
-struct Box 
-{
-    Real3 position;
-    Real3 size;
-    Real  weight;
-};
-
 std::pair<int, int> load_schema(const std::string& schema_path) 
 {
     try 
     {
-        XMLParser pallet_parser( find_single_file("..\\..\\" + schema_path + "\\Pallet"));
-        XMLParser secondary_parser(find_single_file("..\\..\\" + schema_path + "\\SecondaryPackaging"));
-        XMLParser schema_parser(find_single_file("..\\..\\" + schema_path + "\\PalletisingSchema"));
-
-        std::vector<XMLParser> layer_parsers;
-        auto layers_files = find_files_in_folder( "..\\..\\" + schema_path + "\\Layer");
-        for (const auto& file : layers_files)
-            layer_parsers.emplace_back(file);
-
-        XMLNode pallet_XML  = pallet_parser.parse();
-        XMLNode secondary_XML = secondary_parser.parse();
-        XMLNode schema_XML  = schema_parser.parse();
-
-        std::vector<XMLNode> layer_XMLs;
-        for (auto& parser : layer_parsers)
-            layer_XMLs.push_back(parser.parse());
+        PalletSchema schema = read_pallet_schema(schema_path);
 
         Real mult = 0.001;
 
-        Real weight = mult * secondary_XML.find_first("Weight")->int_value;
-        Real height = mult * secondary_XML.find_first("Height")->int_value;
-        Real width  = mult * secondary_XML.find_first("Width")->int_value;
-        Real length = mult * secondary_XML.find_first("Length")->int_value;
+        Real weight = mult * schema.weight;
+        Real height = mult * schema.height;
+        Real width  = mult * schema.width;
+        Real length = mult * schema.length;
 
         std::vector<Box> boxes;
 
@@ -360,33 +307,26 @@ std::pair<int, int> load_schema(const std::string& schema_path)
         
         std::pair<int, int> last_layer_idxs = {0,0};
 
-        for (auto& layer_info : schema_XML["PalSchemaClass"][0]["LayerPaths"][0]["string"]) 
+        for (const auto& layer_file_name : schema.layer_paths) 
         {
-            std::string layer_file_name = layer_info.value;
-
-            for (auto& layer_XML : layer_XMLs) 
+            auto layer = schema.layers.find(layer_file_name);
+            if (layer != schema.layers.end()) 
             {
-                if (layer_XML.file_name != layer_file_name) continue;
-
-                std::vector<XMLNode> boxes_position = layer_XML["LayerClass"][0]["SPDisposal"][0]["PalSchema_SPDisposalClass"];
-
                 last_layer_idxs.first = boxes.size();
 
-                for (auto& box_pos : boxes_position) 
+                for (const Disposal& box_pos : layer->second) 
                 {
-                    Real x = mult * box_pos.find_first("_x")->int_value;
-                    Real z = mult * box_pos.find_first("_y")->int_value;
+                    Real x = mult * box_pos.x;
+                    Real z = mult * box_pos.y;
                     Real y = layer_num * height - 2.0;
 
-                    if (box_pos.find_first("_rotation")->value == "true") 
+                    if (box_pos.rotation) 
                         boxes.push_back({Real3(x, y, z), Real3(width, height, length), weight});
                     else
                         boxes.push_back({Real3(x, y, z), Real3(length, height, width), weight});
                 }
 
                 last_layer_idxs.second = boxes.size();
-
-                break;
             }
             layer_num++;
             // if (layer_num > 0) break;
@@ -474,7 +414,7 @@ struct KeyEqual {
 
 void world_schema() {
     
-    XPBD_init();
+    XPBD_init(sim);
 
     uint64_t step = 0;
     Real time     = 0.0;
@@ -508,21 +448,21 @@ void world_schema() {
 
     while (!glfwWindowShouldClose(window)) {
 
-        time = step * delta_t;
+        time = step * sim.delta_t;
 
         Real3 velocity(8.0, 0.0, 0.0);
-        if (time < 2.0)       velocity *= Real3(0.0, 0.0, 0.0) + time / 2.0;
-        else if (time < 3.0)  velocity *= Real3(0.0, 0.0, 0.0) + (3.0 - time) / 1.0;
+        if (time < 2.0)       velocity *= Real3(0.0, 0.0, 0.0) + time / Real(2.0);
+        else if (time < 3.0)  velocity *= Real3(0.0, 0.0, 0.0) + (Real(3.0) - time) / Real(1.0);
         else                  velocity *= 0.0;
 
         for (const auto& [key, init_pos] : positions) {
             TetraObject* obj      = key.first;
             VertexIndex vi        = key.second;
-            positions[{obj, vi}] += velocity * delta_t;
+            positions[{obj, vi}] += velocity * sim.delta_t;
             obj->positions[vi]    = positions[{obj, vi}];
         }
 
-        XPBD_step(scene);
+        XPBD_step(sim);
 
         if (DO_VIDEO && step%10 == 0) {
             loop_init();
@@ -551,7 +491,7 @@ void world_schema() {
 
 void cloth_world() {
 
-    XPBD_init();
+    XPBD_init(sim);
 
     uint64_t step = 0;
     Real time     = 0.0;
@@ -567,11 +507,11 @@ void cloth_world() {
             export_cloth_to_obj(scene, step / (4), 1.0);
         }
 
-        time = step * delta_t;
+        time = step * sim.delta_t;
 
         loop_init();
 
-        XPBD_step(scene);
+        XPBD_step(sim);
 
         rendering(); 
 
@@ -583,7 +523,7 @@ void cloth_world() {
 
 void tetraball_world() {
 
-    XPBD_init();
+    XPBD_init(sim);
 
     uint64_t step = 0;
     Real time     = 0.0;
@@ -600,11 +540,11 @@ void tetraball_world() {
             export_tetra_surface_with_normals(scene, step / 10, 5, 2, 2, 1.0);
         }
 
-        time = step * delta_t;
+        time = step * sim.delta_t;
 
         loop_init();
 
-        XPBD_step(scene);
+        XPBD_step(sim);
 
         rendering(); 
 
@@ -615,7 +555,7 @@ void tetraball_world() {
 }
 
 void collision_world() {
-    XPBD_init();
+    XPBD_init(sim);
 
     RigidBox b1(Real3(0.0, 0.0, 0.0), Real3(1.0, 1.0, 1.0), 1.0);
     RigidBox b2(Real3(0.9, 0.0, 0.0), Real3(1.0, 1.0, 1.0), 1.0);
@@ -634,7 +574,7 @@ void collision_world() {
 }
 
 void falling_rigid_world() {
-    XPBD_init();
+    XPBD_init(sim);
 
     uint64_t step = 0;
     Real time = 0.0;
@@ -657,7 +597,7 @@ void falling_rigid_world() {
     scene.addRigidConstraint(
         FixedRigidSpringConstraint(
             0.00001,                 // compliance del vincolo
-            &falling_box,            // corpo rigido
+            0,                       // corpo rigido
             local_attach_point,      // punto di attacco locale sul corpo
             world_anchor_point,      // punto fisso nel mondo
             rest_length              // lunghezza a riposo
@@ -669,11 +609,11 @@ void falling_rigid_world() {
     clear_folder("..\\..\\animation", ".obj");
 
     while (!glfwWindowShouldClose(window)) {
-        time = step * delta_t;
+        time = step * sim.delta_t;
 
         loop_init();
 
-        XPBD_step(scene);
+        XPBD_step(sim);
         
         if (step % 10 == 0) {
             export_falling_rigid_to_obj(scene, step / 10, 1.0);
@@ -690,7 +630,7 @@ void falling_rigid_world() {
 }
 
 void two_rigid_bodies_world() {
-    XPBD_init();
+    XPBD_init(sim);
 
     uint64_t step = 0;
     Real time = 0.0;
@@ -722,15 +662,15 @@ void two_rigid_bodies_world() {
     scene.addRigidConstraint(
         RigidSpringConstraint(
             0.005,                  // compliance del vincolo
-            &scene.getRigidObject(0), // primo corpo rigido
-            &scene.getRigidObject(1), // secondo corpo rigido  
+            0,                        // primo corpo rigido
+            1,                        // secondo corpo rigido  
             r1,                       // punto di attacco locale sul primo corpo
             r2,                       // punto di attacco locale sul secondo corpo
             rest_length               // lunghezza a riposo
         )
     );
 
-    gravity = Real3(0.0, 0.0, 0.0);
+    sim.gravity = Real3(0.0, 0.0, 0.0);
 
     std::cout << "Constraint created \n";
 
@@ -741,11 +681,11 @@ void two_rigid_bodies_world() {
     std::cout << "Inizio simulazione due corpi rigidi con vincolo a molla...\n";
 
     while (!glfwWindowShouldClose(window)) {
-        time = step * delta_t;
+        time = step * sim.delta_t;
 
         loop_init();
 
-        XPBD_step(scene);
+        XPBD_step(sim);
         
         // Esporta ogni 10 frame
         if (step % 10 == 0) {
@@ -770,7 +710,7 @@ void rigid_world_schema_stretch_stats(int num_iters)
 
     Real scale_factor = 4.0;
 
-    Box bpallet = load_rigid_schema("palleting_data\\" + schema_folder, scale_factor);
+    Box bpallet = load_rigid_schema(scene, "palleting_data\\" + schema_folder, scale_factor);
 
     AABB stack_aabb = scene.getRigidObject(0).aabb;
     for (Index i=0; i<scene.rigid_objects.size(); i++) {
@@ -872,15 +812,13 @@ void rigid_world_schema_stretch_stats(int num_iters)
             Real3 a1 = attachPoint(pr1, b1);
             Real3 a2 = attachPoint(pr2, b2);
 
-            RigidBox *bx1  = validBox(b1)  ? &scene.getRigidObject(b1)  : nullptr;
-            RigidBox *bx2  = validBox(b2)  ? &scene.getRigidObject(b2) : nullptr;
 
             if (validBox(b1) && validBox(b2) && (b1 != b2)) {
                 Real distance = glm::length(pr1 - pr2);
                 scene.addRigidConstraint(
                     RigidSpringConstraint(
                         wrap_compliance, 
-                        bx1, bx2, 
+                        b1, b2, 
                         a1, a2, 
                         distance));
             }
@@ -900,7 +838,7 @@ void rigid_world_schema_stretch_stats(int num_iters)
                     scene.addRigidConstraint(
                             FixedRigidSpringConstraint(
                                 base_attach_compliance, 
-                                &box, 
+                                bi, 
                                 box.body_vertices[vi], 
                                 v,
                                 0.0));
@@ -915,7 +853,7 @@ void rigid_world_schema_stretch_stats(int num_iters)
 
         scene.clear();
                 
-        Box bpallet = load_rigid_schema("palleting_data\\" + schema_folder, scale_factor);
+        Box bpallet = load_rigid_schema(scene, "palleting_data\\" + schema_folder, scale_factor);
 
         XPBD_init();
 
@@ -930,7 +868,7 @@ void rigid_world_schema_stretch_stats(int num_iters)
                     Real3(center.x, -2.0 - bpallet.size.y/2.0 - 0.001, center.z),
                     Real3(bpallet.size.x + 1.0, bpallet.size.y, bpallet.size.z + 1.0),
                     1.0));
-        scene.getRigidObject(scene.rigid_objects.size()-1).make_static();
+        scene.getRigidObject(scene.rigid_objects.size()-1).make_kinematic();
 
         // GROUND
         scene.addRigidObject(
@@ -951,14 +889,14 @@ void rigid_world_schema_stretch_stats(int num_iters)
         wrapPlaneRandomLength(p3, p6, glm::max(length_z, length_y) * glm::clamp(wrap_param, 0.1, 0.9), wrap_steps, 0);
         wrapPlaneRandomLength(p4, p6, glm::max(length_x, length_z) * glm::clamp(wrap_param, 0.1, 0.9), wrap_steps, 1); 
 
-        for (int c=0; c<scene.rigid_constraints.size(); c++) 
+        for (int c=0; c<scene.rigid_constraints().size(); c++) 
         {
             Index plane_index = c / wrap_steps;
 
-            auto& constraint = scene.rigid_constraints[c];
+            auto& constraint = scene.rigid_constraints()[c];
 
-            RigidBox *b1 = constraint.b1;
-            RigidBox *b2 = constraint.b2;
+            RigidBox *b1 = &scene.rigid_objects[constraint.i1];
+            RigidBox *b2 = &scene.rigid_objects[constraint.i2];
 
             Real3 r1 = constraint.r1;
             Real3 r2 = constraint.r2;
@@ -1041,10 +979,10 @@ void rigid_world_schema_stretch_stats(int num_iters)
 
             vel_vector   += acc_vector * delta_t;
             Real3 offset  = vel_vector * delta_t;
-            for (FixedRigidSpringConstraint &c : scene.fixed_rigid_constraints)
+            for (FixedRigidSpringConstraint &c : scene.fixed_rigid_constraints())
                 c.world_attach += offset;
             center += offset;
-            pallet_hitbox.translate(offset);
+            pallet_hitbox.move_kinematic(offset, delta_t);
 
             XPBD_step(scene);
 
@@ -1052,13 +990,13 @@ void rigid_world_schema_stretch_stats(int num_iters)
                 int frame = step / (25*10/SUB_FRAMES);
                 if (frame >= STAT_FRAMES) break;
                 if (frame < STAT_FRAMES) {
-                    for (int c=0; c<scene.rigid_constraints.size(); c++) {
-                        auto& constraint = scene.rigid_constraints[c];
+                    for (int c=0; c<scene.rigid_constraints().size(); c++) {
+                        auto& constraint = scene.rigid_constraints()[c];
                         auto& grid_indices = constr_to_grid_index[c];
 
                         Real force_magnitude = constraint.lambda / (delta_t*delta_t);
-                        Real3 w1 = body_to_world(constraint.r1, constraint.b1->position, constraint.b1->orientation);
-                        Real3 w2 = body_to_world(constraint.r2, constraint.b2->position, constraint.b2->orientation);
+                        Real3 w1 = scene.bodyToWorld(constraint.i1, constraint.r1);
+                        Real3 w2 = scene.bodyToWorld(constraint.i2, constraint.r2);
                         // Real3 d  = glm::normalize(w1 -  w2);
                         Real stretching = glm::length(w1 - w2) - constraint.rest_length;
 
@@ -1105,292 +1043,62 @@ T snap(T &v, T step) { if (step <= 0) return v;  return v = std::round(v / step)
 
 #define SliderReal(description, param, min, max) ImGui::SliderScalar(description, ImGuiDataType_Double, param, min, max, "%.2f")
 
-struct DataCollection
-{
-    static constexpr size_t DataPointsPerSecond = 50;
+static DataCollection   data;
+static DataStreamWriter data_writer;
 
-    struct Flags 
-    {
-        bool times            = true;
-        bool accelerations    = true;
-        bool displacements    = true;
-        bool angles           = true;
-        bool elastic_energies = true;
-        bool max_force        = true;
-        bool total_force      = true;
-        bool total_stretch    = true;
-        bool kinetic_energy   = true;
-        bool com_drift        = true;
-    } print_flags;
-
-    std::string postfix = "";
-
-    std::vector<Real> displacements;
-    std::vector<Real> times;
-    std::vector<Real> angles;
-    std::vector<Real> accelerations;
-    std::vector<Real> elastic_energies;
-    std::vector<Real> max_force_recorded;
-    std::vector<Real> total_force_recorded;
-    std::vector<Real> total_stretch_x;
-    std::vector<Real> total_stretch_y;
-    std::vector<Real> total_stretch_z;
-    std::vector<Real> kinetic_energy;
-    std::vector<Real3> com_drift;
-
-    Real3 initial_com;
-    int last_layer_idxs[2];
-
-    DataCollection() {}
-
-    void init(Scene& scene, const AABB& stack_aabb, int last_layer_indexes[2], size_t num_data_points)
-    {
-        displacements.clear();
-        angles.clear();
-        accelerations.clear();
-        elastic_energies.clear();
-        max_force_recorded.clear();
-        total_force_recorded.clear();
-        total_stretch_x.clear();
-        total_stretch_y.clear();
-        total_stretch_z.clear();
-        kinetic_energy.clear();
-        com_drift.clear();
-        times.clear();
-
-        displacements.reserve(num_data_points);
-        angles.reserve(num_data_points);
-        accelerations.reserve(num_data_points);
-        elastic_energies.reserve(num_data_points);
-        max_force_recorded.reserve(num_data_points);
-        total_force_recorded.reserve(num_data_points);
-        total_stretch_x.reserve(num_data_points);
-        total_stretch_y.reserve(num_data_points);
-        total_stretch_z.reserve(num_data_points);
-        kinetic_energy.reserve(num_data_points);
-        com_drift.reserve(num_data_points);
-        times.reserve(num_data_points);
-
-        last_layer_idxs[0] = last_layer_indexes[0];
-        last_layer_idxs[1] = last_layer_indexes[1];
-
-        Real3 current_com_sum = Real3(0.0);
-        Real total_mass       = 0.0;
-
-        for(size_t i=0; i<scene.rigid_objects.size()-2; i++) 
-        {
-            const auto& box = scene.getRigidObject(i);
-
-            current_com_sum += box.position * box.mass;   
-            total_mass      += box.mass;
-        }
+void render_data_collection_ui(DataCollection& data)
+{
+    ImGui::Begin("Data Collection", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
 
-        initial_com = current_com_sum / total_mass;
+    if (ImGui::Checkbox("Enable Data Collection", &collect_data)) 
+    { 
+        reset_simulation = true; 
     }
-    
-    void update(Scene& scene, Real time, Real3 center, Real base_x, Real base_y, Real3 acc_vector)
-    {
-        Real x = std::numeric_limits<Real>::max();
-        Real y = 0.0;
-
-        for (int i=last_layer_idxs[0]; i<last_layer_idxs[1]; i++) 
-        {
-            const RigidBox &box = scene.rigid_objects[i];
-            if (box.min_x() < x) 
-            {
-                x = box.min_x();
-                y = box.max_y();
-            }
-        }
-
-        Real disp  = x - base_x;
-        Real angle = glm::degrees(atan2(y - base_y, disp)) - 90.0;
-
-        displacements.push_back(disp);
-        angles.push_back(angle);
-        accelerations.push_back(acc_vector.x);
-        times.push_back(time);
 
-        // ===================================================================
-
-        Real total_elastic_energy = 0.0;
-        Real max_force            = std::numeric_limits<Real>::lowest();
-        Real total_magnitude      = 0.0;
-        Real3 total_stretch       = Real3(0.0);
-
-        for (const auto& constraint : scene.rigid_constraints) 
-        {   
-            const RigidBox *b1 = constraint.b1;
-            const RigidBox *b2 = constraint.b2;
-
-            if (b1 == b2) continue;
-
-            Real3 p1 = body_to_world(constraint.r1, b1->position, b1->orientation);
-            Real3 p2 = body_to_world(constraint.r2, b2->position, b2->orientation);
-
-            Real3 dir = p2 - p1;
-            Real dist = glm::length(dir);
-            Real C    = dist - constraint.rest_length;
-
-            if (C <= 0.0) continue;
-
-            Real3 stretch_dir = dir / dist;
-            Real3 stretch_vec = glm::abs(stretch_dir) * C;
-
-            Real force_scalar = constraint.lambda / (delta_t * delta_t);
-
-            total_stretch += stretch_vec;
-
-            total_magnitude += std::abs(force_scalar);
-
-            max_force = std::max(max_force, std::abs(force_scalar));
-
-            if (constraint.compliance > 0.0) total_elastic_energy += (C * C) / (2.0 * constraint.compliance);
-        }
-        
-        elastic_energies.push_back(total_elastic_energy);
-        max_force_recorded.push_back(max_force);
-        total_force_recorded.push_back(total_magnitude);
-        total_stretch_x.push_back(total_stretch.x);
-        total_stretch_y.push_back(total_stretch.y);
-        total_stretch_z.push_back(total_stretch.z);
-
-        // ==================================================================
-
-        Real total_ke = 0.0;
-
-        Real3 current_com_sum = Real3(0.0);
-        Real total_mass       = 0.0;
-
-        for(size_t i=0; i<scene.rigid_objects.size()-2; i++) 
-        {
-            const auto& box = scene.getRigidObject(i);
-
-            Real3x3 R       = quat_to_rotmat(box.orientation);
-            Real3x3 I_world = R * box.inertia_tensor * glm::transpose(R);
-
-            total_ke += 0.5 * box.mass * glm::dot(box.velocity, box.velocity);
-            total_ke += 0.5 * glm::dot(box.angular_velocity, I_world * box.angular_velocity);
-
-            current_com_sum += box.position * box.mass;   
-            total_mass      += box.mass;
-        }
-
-        Real3 current_com = current_com_sum / total_mass;
+    if (collect_data)
+    {
+        ImGui::Separator();
+        ImGui::Text("Selection for Python Export:");
         
-        current_com.x -= center.x;
+        ImGui::Checkbox("Times",                  &data.print_flags.times);
+        ImGui::Checkbox("Accelerations",          &data.print_flags.accelerations);
+        ImGui::Checkbox("Displacements",          &data.print_flags.displacements);
+        ImGui::Checkbox("Tilt Angles",            &data.print_flags.angles);
+        ImGui::Checkbox("Elastic Energies",       &data.print_flags.elastic_energies);
+        ImGui::Checkbox("Max Forces",             &data.print_flags.max_force);
+        ImGui::Checkbox("Total Forces",           &data.print_flags.total_force);
+        ImGui::Checkbox("Material Stretch (XYZ)", &data.print_flags.total_stretch);
+        ImGui::Checkbox("Kinetic Energy",         &data.print_flags.kinetic_energy);
+        ImGui::Checkbox("CoM Drift (XYZ)",        &data.print_flags.com_drift);
+
+        char buf[128];
+        strncpy(buf, data.postfix.c_str(), sizeof(buf));
+        if (ImGui::InputText("Postfix", buf, sizeof(buf))) { data.postfix = std::string(buf);  }
 
-        kinetic_energy.push_back(total_ke);
-        com_drift.push_back(current_com - initial_com);
-    }
+        ImGui::Separator();
 
-    void print()
-    {
-        static auto pythonListPrint = [&](std::string list_name, const std::vector<Real>& vec) 
-        {
-            std::cout << list_name << (postfix != "" ? "_" : "") << postfix << " = [";
-            for (size_t i=0; i<vec.size(); i++) 
-            {
-                std::cout << vec[i];
-                if (i < vec.size()-1) std::cout << ", ";
-            }
-            std::cout << "]\n\n";
-        };
+        if(ImGui::Button("Clear Output")) std::system("cls");
 
-        static auto pythonReal3Print = [&](std::string list_name, const std::vector<Real3>& vec, int axis) 
+        auto setAll = [&](bool value)
         {
-            std::cout << list_name << (postfix != "" ? "_" : "") << postfix << " = [";
-            for (size_t i=0; i<vec.size(); i++) 
-            {
-                std::cout << vec[i][axis]; 
-                if (i < vec.size()-1) std::cout << ", ";
-            }
-            std::cout << "]\n\n";
+            data.print_flags.times            = value;
+            data.print_flags.accelerations    = value;
+            data.print_flags.displacements    = value;
+            data.print_flags.angles           = value;
+            data.print_flags.elastic_energies = value;
+            data.print_flags.max_force        = value;
+            data.print_flags.total_force      = value;
+            data.print_flags.total_stretch    = value;
+            data.print_flags.kinetic_energy   = value;
+            data.print_flags.com_drift        = value;
         };
 
-        std::cout << "# --- Data Export Start ---\n\n";
-
-        if (print_flags.times)            pythonListPrint("times", times);
-        if (print_flags.accelerations)    pythonListPrint("accelerations", accelerations);
-        if (print_flags.displacements)    pythonListPrint("displacements", displacements);
-        if (print_flags.angles)           pythonListPrint("angles", angles);
-        if (print_flags.elastic_energies) pythonListPrint("elastic_energies", elastic_energies);
-        if (print_flags.max_force)        pythonListPrint("max_force_recorded", max_force_recorded);
-        if (print_flags.total_force)      pythonListPrint("total_force_recorded", total_force_recorded);
-        if (print_flags.kinetic_energy)   pythonListPrint("kinetic_energy", kinetic_energy);
-
-        if (print_flags.total_stretch) 
-        {
-            pythonListPrint("total_stretch_x", total_stretch_x);
-            pythonListPrint("total_stretch_y", total_stretch_y);
-            pythonListPrint("total_stretch_z", total_stretch_z);
-        }
-
-        if (print_flags.com_drift) {
-            pythonReal3Print("com_drift_x", com_drift, 0);
-            pythonReal3Print("com_drift_y", com_drift, 1);
-            pythonReal3Print("com_drift_z", com_drift, 2);
-        }
-
-        std::cout << "# --- Data Export End ---\n" << std::endl;
+        if(ImGui::Button("Set All False")) setAll(false);
+        if(ImGui::Button("Set All True"))  setAll(true);
     }
 
-    void render_ui()
-    {
-        ImGui::Begin("Data Collection", nullptr, ImGuiWindowFlags_AlwaysAutoResize);
-
-        if (ImGui::Checkbox("Enable Data Collection", &collect_data)) 
-        { 
-            reset_simulation = true; 
-        }
-
-        if (collect_data)
-        {
-            ImGui::Separator();
-            ImGui::Text("Selection for Python Export:");
-            
-            ImGui::Checkbox("Times",                  &print_flags.times);
-            ImGui::Checkbox("Accelerations",          &print_flags.accelerations);
-            ImGui::Checkbox("Displacements",          &print_flags.displacements);
-            ImGui::Checkbox("Tilt Angles",            &print_flags.angles);
-            ImGui::Checkbox("Elastic Energies",       &print_flags.elastic_energies);
-            ImGui::Checkbox("Max Forces",             &print_flags.max_force);
-            ImGui::Checkbox("Total Forces",           &print_flags.total_force);
-            ImGui::Checkbox("Material Stretch (XYZ)", &print_flags.total_stretch);
-            ImGui::Checkbox("Kinetic Energy",         &print_flags.kinetic_energy);
-            ImGui::Checkbox("CoM Drift (XYZ)",        &print_flags.com_drift);
-
-            char buf[128];
-            strncpy(buf, postfix.c_str(), sizeof(buf));
-            if (ImGui::InputText("Postfix", buf, sizeof(buf))) { postfix = std::string(buf);  }
-
-            ImGui::Separator();
-
-            if(ImGui::Button("Clear Output")) std::system("cls");
-
-            static auto setAll = [&](bool value)
-            {
-                print_flags.times            = value;
-                print_flags.accelerations    = value;
-                print_flags.displacements    = value;
-                print_flags.angles           = value;
-                print_flags.elastic_energies = value;
-                print_flags.max_force        = value;
-                print_flags.total_force      = value;
-                print_flags.total_stretch    = value;
-                print_flags.kinetic_energy   = value;
-                print_flags.com_drift        = value;
-            };
-
-            if(ImGui::Button("Set All False")) setAll(false);
-            if(ImGui::Button("Set All True"))  setAll(true);
-        }
-
-        ImGui::End();
-    }
-};
-
-static DataCollection data;
+    ImGui::End();
+}
 
 
 void render_ui(uint64_t steps, Real time, Real total_physics_time) 
@@ -1439,6 +1147,19 @@ void render_ui(uint64_t steps, Real time, Real total_physics_time)
 
         if(ImGui::SliderInt("Constr. Iterations", &xpbd_iters_x_step, 1, 50)) { reset_simulation = true; }
 
+        ImGui::Checkbox("SAP Broadphase", &sap_broadphase);
+
+        if(ImGui::SliderInt("Collision Substeps", &collision_substeps, 1, 8)) { reset_simulation = true; }
+
+        ImGui::Checkbox("Body Sleeping", &enable_sleeping);
+
+        ImGui::SliderInt("Solver Threads", &solver_threads, 1, 16);
+
+        const char *solver_modes[] = {"islands", "colored", "jacobi"};
+        int solver_mode_idx = 0;
+        for (int mi = 0; mi < 3; mi++) if (solver_mode == solver_modes[mi]) solver_mode_idx = mi;
+        if (ImGui::Combo("Solver Mode", &solver_mode_idx, solver_modes, 3)) solver_mode = solver_modes[solver_mode_idx];
+
         ImGui::Separator();
         ImGui::Text("Compliance Settings");
 
@@ -1464,21 +1185,21 @@ void render_ui(uint64_t steps, Real time, Real total_physics_time)
 
         if (SliderReal("Acceleration Time", &acc_time, &min, &max)) 
         {
-            snap(acc_time, 0.1);
+            snap(acc_time, Real(0.1));
             deceleration = - (acc_time * accel_magnitude) / dec_time;
             reset_simulation = true;
         }
 
         if (SliderReal("Deceleration Time", &dec_time, &min, &max)) 
         {
-            snap(dec_time, 0.1);
+            snap(dec_time, Real(0.1));
             deceleration = - (acc_time * accel_magnitude) / dec_time;
             reset_simulation = true;
         }
 
         if (SliderReal("Still Time", &still_time, &min, &max)) 
         {
-            snap(still_time, 0.1);
+            snap(still_time, Real(0.1));
             reset_simulation = true;
         }
 
@@ -1699,7 +1420,7 @@ void render_ui(uint64_t steps, Real time, Real total_physics_time)
 
         ImGui::End();
 
-        data.render_ui();
+        render_data_collection_ui(data);
     }
     else if (app_state == AppState::RUNNING) 
     {
@@ -1709,6 +1430,7 @@ void render_ui(uint64_t steps, Real time, Real total_physics_time)
         ImGui::Text("Time: %.2f s", time);
         // ImGui::Text("Velocity: %.2f m/s", glm::length(vel_vector));
         ImGui::Text("Physics Time: %.2f ms", (total_physics_time / steps));
+        if (enable_sleeping) ImGui::Text("Sleeping Bodies: %u", scene.sleeping_bodies);
 
         ImGui::Separator();
         if (ImGui::Button("Stop Simulation")) app_state = AppState::FINISHED;
@@ -1733,702 +1455,71 @@ void render_ui(uint64_t steps, Real time, Real total_physics_time)
     }
 }
 
-Box load_rigid_schema(const std::string& schema_path, Real scale, int *last_layer_idxs = nullptr) 
-{
-    try 
-    {
-        XMLParser pallet_parser(find_single_file("..\\..\\"    + schema_path + "\\Pallet"));
-        XMLParser secondary_parser(find_single_file("..\\..\\" + schema_path + "\\SecondaryPackaging"));
-        XMLParser schema_parser(find_single_file("..\\..\\"    + schema_path + "\\PalletisingSchema"));
-
-        std::vector<XMLParser> layer_parsers;
-        auto layers_files = find_files_in_folder( "..\\..\\" + schema_path + "\\Layer");
-        for (const auto& file : layers_files)
-            layer_parsers.emplace_back(file);
-
-        XMLNode pallet_XML  = pallet_parser.parse();
-        XMLNode secondary_XML = secondary_parser.parse();
-        XMLNode schema_XML  = schema_parser.parse();
-
-        std::vector<XMLNode> layer_XMLs;
-        for (auto& parser : layer_parsers)
-            layer_XMLs.push_back(parser.parse());
-
-        Real mult = 0.001;
-
-        Real weight =         mult * secondary_XML.find_first("Weight")->int_value;
-        Real height = scale * mult * secondary_XML.find_first("Height")->int_value;
-        Real width  = scale * mult * secondary_XML.find_first("Width")->int_value;
-        Real length = scale * mult * secondary_XML.find_first("Length")->int_value;
-
-        Real total_weight = 0.0;
-
-        std::vector<Box> boxes;
-
-        int layer_num = 0;
-        for (auto& layer_info : schema_XML["PalSchemaClass"][0]["LayerPaths"][0]["string"]) 
-        {
-            std::string layer_file_name = layer_info.value;
-
-            for (auto& layer_XML : layer_XMLs) 
-            {
-                if (layer_XML.file_name != layer_file_name) continue;
-
-                std::vector<XMLNode> boxes_position = layer_XML["LayerClass"][0]["SPDisposal"][0]["PalSchema_SPDisposalClass"];
-
-                if (last_layer_idxs != nullptr) last_layer_idxs[0] = (int) boxes.size();
-
-                for (auto& box_pos : boxes_position) 
-                {
-                    Real x = scale * mult * box_pos.find_first("_x")->int_value;
-                    Real z = scale * mult * box_pos.find_first("_y")->int_value;
-                    Real y = layer_num * height - 2.0;
-
-                    if (box_pos.find_first("_rotation")->value == "true") 
-                        boxes.push_back({Real3(x, y, z), Real3(width, height, length), weight});
-                    else
-                        boxes.push_back({Real3(x, y, z), Real3(length, height, width), weight});
-
-                    total_weight += weight;
-                }
-
-                if (last_layer_idxs != nullptr) last_layer_idxs[1] = (int) boxes.size();
-
-                break;
-            }
-            layer_num++;
-        }
-
-        // std::cout << "Total boxes weight: " << total_weight << " kg\n";
-
-        for (const auto& box : boxes) 
-        {
-            scene.addRigidObject(RigidBox(box.position + box.size*0.5, box.size, box.weight));
-        }
-
-        // PALLET
-
-        XMLNode pallet = pallet_XML["PalletClass"][0];
-        Real size_x = scale * mult * pallet.find_first("DimX")->int_value;
-        Real size_z = scale * mult * pallet.find_first("DimY")->int_value;
-        Real size_y = scale * mult * pallet.find_first("Dim_Z")->int_value;
-
-        return {Real3(0.0), Real3(size_x, size_y, size_z), 1.0};
-    } 
-    catch (const std::exception& e) { std::cerr << "Error loading schema: " << e.what() << "\n"; }
-
-    return {Real3(0.0), Real3(1.0), 1.0};
-}
-
-struct AccelerationProfile 
-{
-    Real acc_time;
-    Real dec_time;
-    Real still_time;
-    Real acceleration;
-    Real deceleration;
-    Real blend_time = 0.25;
-
-    Real get_acceleration(Real time) const 
-    {
-        static auto smoothstep = [](Real edge0, Real edge1, Real x) -> Real 
-        {
-            x = std::clamp((x - edge0) / (edge1 - edge0), 0.0, 1.0);
-            return x * x * (3 - 2 * x);
-        };
-
-        static auto blend = [](Real phase_start, Real blend_time, Real time, Real from, Real to) 
-        {
-            if (time < phase_start + blend_time) 
-            {
-                Real t = smoothstep(phase_start, phase_start + blend_time, time);
-                return from + t * (to - from);
-            }
-            return to;
-        };
-
-        if (time < acc_time) 
-            return blend(0.0, blend_time, time, 0.0, acceleration);
-        
-        if (time < acc_time + dec_time) 
-            return blend(acc_time, blend_time, time, acceleration, deceleration);
-        
-        if (time < acc_time + dec_time + still_time) 
-            return blend(acc_time + dec_time, blend_time, time, deceleration, 0.0);
-        
-        return 0.0;
-    }
-
-    bool is_complete(Real time) const 
-    {
-        return time >= acc_time + dec_time + still_time;
-    }
-};
-
-AABB getSceneAABB()
-{
-    AABB aabb = scene.getRigidObject(0).aabb;
-    for (Index i=0; i<scene.rigid_objects.size(); i++) 
-    {
-        RigidBox &box = scene.getRigidObject(i);
-        aabb.expand(box.aabb.min);
-        aabb.expand(box.aabb.max);
-    }
-
-    return aabb;
-}
-
-struct PrepareSceneOutput
-{
-    AABB stack_aabb;
-    int last_layer_indexes[2];
-};
-
-PrepareSceneOutput prepare_scene()
+void rigid_world_schema() 
 {
-    scene.clear();
-
-    int last_layer_idxs[2];
-
-    Box bpallet = load_rigid_schema("palleting_data\\" + schema_folder, scale_factor, last_layer_idxs);
-
-    AABB stack_aabb = getSceneAABB();
-    Real3 center    = (stack_aabb.min + stack_aabb.max) * 0.5;
-
-    Real length_x = stack_aabb.max.x - stack_aabb.min.x;
-    Real length_y = stack_aabb.max.y - stack_aabb.min.y;
-    Real length_z = stack_aabb.max.z - stack_aabb.min.z;
-
-    Real slitta_height = 0.10 * scale_factor;
-    Real pallet_height = 0.13 * scale_factor;
-
-    // PALLET HITBOX
-    scene.addRigidObject(
-            RigidBox(
-                Real3(center.x, -2.0 - bpallet.size.y/2.0 - 0.001, center.z),
-                Real3(bpallet.size.x + 1.0, bpallet.size.y, bpallet.size.z + 1.0),
-                1.0));
-    scene.getRigidObject(scene.rigid_objects.size()-1).make_static();
-
-    // GROUND
-    scene.addRigidObject(
-            RigidBox(
-                Real3(28.5, - 3.0 - pallet_height - slitta_height,  center.z),
-                Real3(62.0, 2.0,  bpallet.size.z + 4.0),
-                1.0));
-    scene.getRigidObject(scene.rigid_objects.size()-1).make_static();
-
-    auto whichBox = [&](Real3 p) -> Index 
-    {
-        for (Index i=0; i<scene.rigid_objects.size()-1; i++) 
-        {
-            if (scene.getRigidObject(i).aabb.contains(p, 1e-4)) return i;
-        }
-        return scene.rigid_objects.size()-1;
-    };
-
-    auto validBox = [&](Index i) -> bool 
-    {
-        return i < scene.rigid_objects.size()-2;
-    };
-
-    auto attachPoint = [&](Real3 p, Index i) -> Real3 {
-        RigidBox &box = scene.getRigidObject(i);
-        return p - box.position;
-    };
-
-    auto wrapPlane = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, bool both_directions = true) 
-    {
-        int gen_cons = 0;
-
-        for (uint8_t i=0; i<=steps; i++) {
-        for (uint8_t j=0; j<=steps; j++) {
-
-            Real step1_size = glm::length(step1);
-            Real step2_size = glm::length(step2);
-            
-            Real3 p  = p1 + step1 * ((Real) i) + step2 * ((Real) j);
-            Real3 pr = p  + step1;
-            Real3 pd = p  + step2;
-
-            Index bi  = whichBox(p);
-            Index bir = whichBox(pr);
-            Index bid = whichBox(pd);
-
-            Real3 a  = attachPoint(p,  bi);
-            Real3 ar = attachPoint(pr, bir);
-            Real3 ad = attachPoint(pd, bid);
-
-            RigidBox *b  = validBox(bi)  ? &scene.getRigidObject(bi)  : nullptr;
-            RigidBox *br = validBox(bir) ? &scene.getRigidObject(bir) : nullptr;
-            RigidBox *bd = validBox(bid) ? &scene.getRigidObject(bid) : nullptr;
-
-            if (validBox(bi) && validBox(bir)) {
-                scene.addRigidConstraint(
-                        RigidSpringConstraint(
-                            wrap_compliance, 
-                            b,  br, 
-                            a,  ar, 
-                            step1_size));
-                if (bi != bir) gen_cons++;
-            }
-
-            if (both_directions && validBox(bi) && validBox(bid)) {
-                scene.addRigidConstraint(
-                        RigidSpringConstraint(
-                            wrap_compliance, 
-                            b,  bd, 
-                            a,  ad, 
-                            step2_size));
-                if (bi != bid) gen_cons++;
-            }
-        }}
-
-        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
-    };
-
-    auto wrapPlaneRandom = [&](Real3 p1, Real3 p2, int num_constraints) 
-    {
-        Real step_x = p2.x - p1.x;
-        Real step_y = p2.y - p1.y;
-        Real step_z = p2.z - p1.z;
-
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<Real> dis(0.0, 1.0);
-
-        int gen_cons = 0;
-
-        while (gen_cons < num_constraints) 
-        {
-            Real u1 = dis(gen);
-            Real v1 = dis(gen);
-            Real w1 = dis(gen);
-
-            Real u2 = dis(gen);
-            Real v2 = dis(gen);
-            Real w2 = dis(gen);
-
-            Real3 pr1 = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
-            Real3 pr2 = p1 + Real3(u2 * step_x, v2 * step_y, w2 * step_z);
-
-            Index b1 = whichBox(pr1);
-            Index b2 = whichBox(pr2);
-            
-            Real3 a1 = attachPoint(pr1, b1);
-            Real3 a2 = attachPoint(pr2, b2);
-
-            RigidBox *bx1 = validBox(b1) ? &scene.getRigidObject(b1) : nullptr;
-            RigidBox *bx2 = validBox(b2) ? &scene.getRigidObject(b2) : nullptr;
-
-            if (validBox(b1) && validBox(b2) && (b1 != b2)) 
-            {
-                Real distance = glm::length(pr1 - pr2);
-                scene.addRigidConstraint(
-                    RigidSpringConstraint(
-                        wrap_compliance, 
-                        bx1, bx2, 
-                        a1,  a2, 
-                        distance));
-                gen_cons++;
-            }
-        }
-
-        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
-    };
-
-    auto wrapPlaneRandomLength = [&](Real3 p1, Real3 p2, Real length, int num_constraints, int plane_axis) {
-        
-        Real step_x = p2.x - p1.x;
-        Real step_y = p2.y - p1.y;
-        Real step_z = p2.z - p1.z;
-
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_real_distribution<Real> dis(0.0, 1.0);
-
-        int gen_cons = 0;
-        
-        for (int k = 0; k < num_constraints; k++) 
-        {
-
-            // Real u1 = dis(gen);
-            // Real v1 = dis(gen);
-            // Real w1 = dis(gen);
-            Real3 pr1; // = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
-            Real3 pr2;
-
-            while(true) { 
-                Real u1 = dis(gen);
-                Real v1 = dis(gen);
-                Real w1 = dis(gen);
-                pr1     = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
-
-                Real rand_direction = dis(gen) * 2.0 * glm::pi<Real>();
-                Real cos_length = glm::cos(rand_direction) * length;
-                Real sin_length = glm::sin(rand_direction) * length;
-                switch(plane_axis) {
-                    case 0: pr2 = pr1 + Real3(0.0, cos_length, sin_length); break;
-                    case 1: pr2 = pr1 + Real3(cos_length, 0.0, sin_length); break;
-                    case 2: pr2 = pr1 + Real3(cos_length, sin_length, 0.0); break;
-                }
-                bool inside = (pr2.x >= p1.x && pr2.x <= p2.x &&
-                               pr2.y >= p1.y && pr2.y <= p2.y &&
-                               pr2.z >= p1.z && pr2.z <= p2.z);
-
-                if (!inside) continue;
-
-                Index b1 = whichBox(pr1);
-                Index b2 = whichBox(pr2);
-
-                if (validBox(b1) && validBox(b2) && (b1 != b2)) break;
-            }
-
-            
-            Index b1 = whichBox(pr1);
-            Index b2 = whichBox(pr2);
-            
-            Real3 a1 = attachPoint(pr1, b1);
-            Real3 a2 = attachPoint(pr2, b2);
-
-            RigidBox *bx1  = validBox(b1)  ? &scene.getRigidObject(b1)  : nullptr;
-            RigidBox *bx2  = validBox(b2)  ? &scene.getRigidObject(b2) : nullptr;
-
-            if (validBox(b1) && validBox(b2) && (b1 != b2)) 
-            {
-                Real distance = glm::length(pr1 - pr2);
-                scene.addRigidConstraint(
-                    RigidSpringConstraint(
-                        wrap_compliance, 
-                        bx1, bx2, 
-                        a1, a2, 
-                        distance));
-                gen_cons++;
-            }
-        }
-
-        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
-    };
-
-    auto transform_axis_aligned_rectangle = [](Real3& p1,  Real3& p2, Real scale, Real rotation_angle, int plane_axis) 
-    {    
-        Real3 center = (p1 + p2) * 0.5;
-
-        p1 -= center;
-        p2 -= center;
-
-        p1 *= scale;
-        p2 *= scale;
-        
-        Real4x4 transform = Real4x4(1.0f);
-
-        Real angle_rad = glm::radians(rotation_angle);
-        if      (plane_axis == 0) transform = glm::rotate(transform, angle_rad, Real3(1.0f, 0.0f, 0.0f));
-        else if (plane_axis == 1) transform = glm::rotate(transform, angle_rad, Real3(0.0f, 1.0f, 0.0f));
-        else                      transform = glm::rotate(transform, angle_rad, Real3(0.0f, 0.0f, 1.0f));
-
-        Real4 p1t = transform * Real4(p1, 1.0f);
-        Real4 p2t = transform * Real4(p2, 1.0f);
-        
-        p1 = Real3(p1t.x, p1t.y, p1t.z);
-        p2 = Real3(p2t.x, p2t.y, p2t.z);
-
-        p1 += center;
-        p2 += center;
-    };
-
-    auto rotate_around_origin = [](Real3& point, Real angle_degrees, int plane_axis) {
-        Real angle_rad = glm::radians(angle_degrees);
-        Real cos_angle = std::cos(angle_rad);
-        Real sin_angle = std::sin(angle_rad);
-        
-        if (plane_axis == 0) { 
-            Real y = point.y * cos_angle - point.z * sin_angle;
-            Real z = point.y * sin_angle + point.z * cos_angle;
-            point.y = y;
-            point.z = z;
-        } else if (plane_axis == 1) { 
-            Real x = point.x * cos_angle + point.z * sin_angle;
-            Real z = -point.x * sin_angle + point.z * cos_angle;
-            point.x = x;
-            point.z = z;
-        } else { 
-            Real x = point.x * cos_angle - point.y * sin_angle;
-            Real y = point.x * sin_angle + point.y * cos_angle;
-            point.x = x;
-            point.y = y;
-        }
-    };
-
-    auto wrapPlaneRotated = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real angle, int plane_axis) 
-    {
+    std::ofstream fout("..\\..\\animation\\camera_x.txt", std::ios::out | std::ios::trunc);
+    if (!fout.is_open()) { std::cerr << "Errore apertura file!" << std::endl; return; }
 
-        Real3 c1p1 = p1;
-        Real3 c1p2 = p2;
-        Real3 c1step1 = step1;
-        Real3 c1step2 = step2;
-        transform_axis_aligned_rectangle(c1p1, c1p2, 3.0, angle, plane_axis);
-        rotate_around_origin(c1step1, angle, plane_axis);
-        rotate_around_origin(c1step2, angle, plane_axis);
-        steps += steps*2;
+    TransportRun run;
 
-        wrapPlane(c1p1, c1p2, c1step1, c1step2, steps);
-    };
+    int SLOWING_FACTOR;
 
-    auto wrapPlaneRotatedMirrored = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real angle, int plane_axis) 
-    {
+    ObjExporter      obj_exporter;
+    AnimStreamWriter anim_writer;
 
-        Real3 c1p1 = p1;
-        Real3 c1p2 = p2;
-        Real3 c1step1 = step1;
-        Real3 c1step2 = step2;
-        transform_axis_aligned_rectangle(c1p1, c1p2, 3.0, angle, plane_axis);
-        rotate_around_origin(c1step1, angle, plane_axis);
-        rotate_around_origin(c1step2, angle, plane_axis);
-        
-        Real3 c2p1 = p1;
-        Real3 c2p2 = p2;
-        Real3 c2step1 = step1;
-        Real3 c2step2 = step2;
-        transform_axis_aligned_rectangle(c2p1, c2p2, 3.0, -angle, plane_axis);
-        rotate_around_origin(c2step1, -angle, plane_axis);
-        rotate_around_origin(c2step2, -angle, plane_axis);
-
-        steps += steps*2;
-
-        wrapPlane(c1p1, c1p2, c1step1, c1step2, steps, false);
-        wrapPlane(c2p1, c2p2, c2step1, c2step2, steps, false);
-    };
-
-    auto wrapPlaneShifted = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real shift) 
+    auto exportFrameToObj = [&](uint64_t step, Real3 center)
     {
+        uint64_t frame = step / (sim.frequency/SLOWING_FACTOR);
 
-        p1 += step1 * shift + step2 * shift;
-        p2 += step1 * shift + step2 * shift;
-
-        wrapPlane(p1, p2, step1, step2, steps);
-    };
-
-    auto wrapPlaneEdges = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real shift) 
-    {
-        // Opposite edges: B1 (p1→p1+step1*N) and B3 (p2→p2-step1*N)
-        for (uint8_t i = 0; i <= steps; i++) 
+        if (export_format == "stream")
         {
-
-            Real t  = (Real) i / (Real) steps;
-            Real to = (Real) (steps - i) / (Real) steps;
-
-            Real3 e1 = p1 + step1 * (t  * (Real)steps);                // Edge 1 point
-            Real3 e3 = p2 - step1 * (to * (Real)steps) + step1*shift;  // Opposite edge point
-
-            Index b1 = whichBox(e1);
-            Index b3 = whichBox(e3);
-
-            if (validBox(b1) && validBox(b3)) 
-            {
-                Real3 a1  = attachPoint(e1, b1);
-                Real3 a3  = attachPoint(e3, b3);
-                Real dist = glm::length(e1 - e3);
-
-                scene.addRigidConstraint(
-                        RigidSpringConstraint(
-                            wrap_compliance,
-                            &scene.getRigidObject(b1),
-                            &scene.getRigidObject(b3),
-                            a1, a3, dist));
-            }
+            if (!anim_writer.is_open())
+                anim_writer.open("..\\..\\animation\\" + prefix + "anim.xani", scene, prefix, scale_factor, anim_quantum, anim_delta,
+                                 export_stretch_perc, tearing_stretch_percentage);
+            anim_writer.write_frame(scene, frame, -center);
         }
-    };
-
-    auto attachBase = [&](Real3 p1, Real3 p2) 
-    {
-        for (Index bi=0; bi<scene.rigid_objects.size()-1; bi++) 
+        else
         {
-            RigidBox &box = scene.getRigidObject(bi);
-            for (int vi=0; vi<8; vi++) {
-                Real3 v = box.world_vertices[vi];
-
-                if ( (v.x >= std::min(p1.x, p2.x) - 1e-4) && (v.x <= std::max(p1.x, p2.x) + 1e-4) &&
-                     (v.z >= std::min(p1.z, p2.z) - 1e-4) && (v.z <= std::max(p1.z, p2.z) + 1e-4) &&
-                     (std::abs(v.y - p1.y) < 1e-4) ) 
-                {
-                    
-                    scene.addRigidConstraint(
-                            FixedRigidSpringConstraint(
-                                base_attach_compliance, 
-                                &box, 
-                                box.body_vertices[vi], 
-                                v,
-                                0.0));
-                }
-            }   
+            if (!obj_exporter.running()) obj_exporter.start(export_obj_threads, export_obj_queue);
+            obj_exporter.capture(scene, frame, scale_factor, -center, prefix, export_stretch_perc, tearing_stretch_percentage);
         }
+        fout << center.x / scale_factor << "\n";
     };
 
-    auto applyWrapType = [&](
-        const std::string& type, int steps, Real param, 
-        const Real3& p0, const Real3& p1, const Real3& p2, const Real3& p3, 
-        const Real3& p4, const Real3& p5, const Real3& p6, const Real3& p7,
-        const Real3& xstep, const Real3& ystep, const Real3& zstep,
-        Real length_x, Real length_y, Real length_z) 
+    auto stopObjExport = [&]()
     {
-        if (type == NONE) return;
-
-        if (type == ROTATED) 
-        {
-            wrapPlaneRotated(p1, p6, xstep, ystep, steps, param, 2);
-            wrapPlaneRotated(p0, p7, xstep, ystep, steps, param, 2);
-            wrapPlaneRotated(p0, p5, zstep, ystep, steps, param, 0);
-            wrapPlaneRotated(p3, p6, zstep, ystep, steps, param, 0);
-            wrapPlaneRotated(p4, p6, xstep, zstep, steps, param, 1);
-        }
-        else if (type == ROTATED_MIRRORED) 
+        if (anim_writer.is_open())
         {
-            wrapPlaneRotatedMirrored(p1, p6, xstep, ystep, steps, param, 2);
-            wrapPlaneRotatedMirrored(p0, p7, xstep, ystep, steps, param, 2);
-            wrapPlaneRotatedMirrored(p0, p5, zstep, ystep, steps, param, 0);
-            wrapPlaneRotatedMirrored(p3, p6, zstep, ystep, steps, param, 0);
-            wrapPlaneRotatedMirrored(p4, p6, xstep, zstep, steps, param, 1);
+            anim_writer.close();
+            std::cout << "Animation stream: " << anim_writer.frames << " frames, " << anim_writer.bytes / 1024.0 << " KB, "
+                      << (anim_writer.frames ? anim_writer.write_ms / anim_writer.frames : 0.0) << " ms per frame\n";
         }
-        else if (type == GRID) 
-        {
-            wrapPlane(p1, p6, xstep, ystep, steps);
-            wrapPlane(p0, p7, xstep, ystep, steps);
-            wrapPlane(p0, p5, zstep, ystep, steps);
-            wrapPlane(p3, p6, zstep, ystep, steps);
-            wrapPlane(p4, p6, xstep, zstep, steps);
-        }
-        else if (type == SHIFTED) 
-        {
-            wrapPlaneShifted(p1, p6, xstep, ystep, steps, param);
-            wrapPlaneShifted(p0, p7, xstep, ystep, steps, param);
-            wrapPlaneShifted(p0, p5, zstep, ystep, steps, param);
-            wrapPlaneShifted(p3, p6, zstep, ystep, steps, param);
-            wrapPlaneShifted(p4, p6, xstep, zstep, steps, param);
-        }
-        else if (type == RANDOM) 
-        {
-            wrapPlaneRandom(p1, p6, steps);
-            wrapPlaneRandom(p0, p7, steps);
-            wrapPlaneRandom(p0, p5, steps);
-            wrapPlaneRandom(p3, p6, steps);
-            wrapPlaneRandom(p4, p6, steps);
-        }
-        else if (type == RANDOM_LENGTH) 
-        {
-            Real clamp_p = glm::clamp((Real)param, 0.0, 0.9);
-            wrapPlaneRandomLength(p1, p6, length_x * clamp_p, steps, 2);
-            wrapPlaneRandomLength(p0, p7, length_x * clamp_p, steps, 2);
-            wrapPlaneRandomLength(p0, p5, length_z * clamp_p, steps, 0);
-            wrapPlaneRandomLength(p3, p6, length_z * clamp_p, steps, 0);
-            wrapPlaneRandomLength(p4, p6, length_x * clamp_p, steps, 1);
-        }
-        else if (type == EDGES) 
-        {
-            wrapPlaneEdges(p1, p6, ystep, xstep, steps, param);
-            wrapPlaneEdges(p0, p7, ystep, xstep, steps, param);
-            wrapPlaneEdges(p0, p5, ystep, zstep, steps, param);
-            wrapPlaneEdges(p3, p6, ystep, zstep, steps, param);
-            wrapPlaneEdges(p4, p6, xstep, zstep, steps, param);
-        }
-    };
-
-    Real3 p0(stack_aabb.min.x, stack_aabb.min.y, stack_aabb.min.z);
-    Real3 p1(stack_aabb.min.x, stack_aabb.min.y, stack_aabb.max.z);
-    Real3 p2(stack_aabb.max.x, stack_aabb.min.y, stack_aabb.max.z);
-    Real3 p3(stack_aabb.max.x, stack_aabb.min.y, stack_aabb.min.z);
-
-    Real3 p4(stack_aabb.min.x, stack_aabb.max.y, stack_aabb.min.z);
-    Real3 p5(stack_aabb.min.x, stack_aabb.max.y, stack_aabb.max.z);
-    Real3 p6(stack_aabb.max.x, stack_aabb.max.y, stack_aabb.max.z);
-    Real3 p7(stack_aabb.max.x, stack_aabb.max.y, stack_aabb.min.z);
 
-    auto run_wrap = [&](std::string type, int steps, Real param) 
-    {
-        if (type == NONE) return;
-
-        Real3 xstep(length_x / (Real)steps, 0.0, 0.0);
-        Real3 ystep(0.0, length_y / (Real)steps, 0.0);
-        Real3 zstep(0.0, 0.0, length_z / (Real)steps);
+        if (!obj_exporter.running()) return;
 
-        applyWrapType(type, steps, param, p0, p1, p2, p3, p4, p5, p6, p7, xstep, ystep, zstep, length_x, length_y, length_z);
+        obj_exporter.stop();
+        ObjExportStats stats = obj_exporter.get_stats();
+        std::cout << "OBJ export: " << stats.frames << " frames, " << stats.capture_ms_per_frame() << " ms per frame in the simulation ("
+                  << stats.stall_ms << " ms waiting), " << stats.write_ms_per_frame() << " ms per frame in the writers, "
+                  << stats.bytes / (1024.0 * 1024.0) << " MB\n";
     };
 
-    run_wrap(wrap_type,     wrap_steps,     wrap_param);
-    run_wrap(wrap_type_sec, wrap_steps_sec, wrap_param_sec);
-
-    attachBase(p0, p2);
-
-    scene.addSceneObject(load_scene_object_from_obj("..\\..\\assets\\slitta.obj", scale_factor));
-    scene.addSceneObject(load_scene_object_from_obj("..\\..\\assets\\pallet.obj", scale_factor));
-
-    RigidBox &pallet_hitbox = scene.rigid_objects[scene.rigid_objects.size()-2];
-    SceneObject &slitta = scene.scene_objects[0];
-    SceneObject &pallet = scene.scene_objects[1];
-
-    slitta.translate(Real3(center.x, -2.0 - pallet_height, center.z));
-    pallet.translate(Real3(center.x, -2.0, center.z));
-
-    return {stack_aabb, {last_layer_idxs[0], last_layer_idxs[1]}};
-}
-
-void rigid_world_schema() 
-{
-    std::ofstream fout("..\\..\\animation\\camera_x.txt", std::ios::out | std::ios::trunc);
-    if (!fout.is_open()) { std::cerr << "Errore apertura file!" << std::endl; return; }
-
-    uint64_t step;
-    Real     time;
-
-    Real total_physics_time;
-    AccelerationProfile profile;
-    Real3 vel_vector;
-
-    AABB  stack_aabb;
-    Real3 center;
-
-    RigidBox *pallet_hitbox;
-
-    
-    Real base_x, base_y;
-
-    int SLOWING_FACTOR;
-
-    auto exportFrameToObj = [&](uint64_t step, Real3 center)
-    {
-        export_scene_to_obj(scene, (step / (frequency/SLOWING_FACTOR)), scale_factor, -center, prefix);
-        if (export_stretch_perc)
-            export_wrap_displacement_to_obj(scene,  (step / (frequency/SLOWING_FACTOR)), tearing_stretch_percentage, scale_factor, -center, prefix);
-        else
-            export_wrap_to_obj(scene,  (step / (frequency/SLOWING_FACTOR)), scale_factor, -center, prefix);
-        fout << center.x / scale_factor << "\n";
-    };
+    auto data_file = [&]() { return sim.settings.prefix.empty() ? std::string("data.xcol") : "data_" + sim.settings.prefix + ".xcol"; };
 
     auto reset_state = [&]()
     {
-        total_physics_time = 0.0;
-        vel_vector         = Real3(0.0);
-        profile            = {acc_time, dec_time, still_time, acceleration, deceleration};
-        step               = 0;
-        time               = 0.0;
-
-        auto [stack_aabb, last_layer_idxs] = prepare_scene();
-        center     = (stack_aabb.min + stack_aabb.max) * 0.5;
-        center.x   = 0.0;
+        sim.settings = current_settings();
 
-        size_t num_data_points = (acc_time + dec_time + still_time) * DataCollection::DataPointsPerSecond; 
+        stopObjExport();
+        data_writer.close();
+        if (collect_data && streams_data(sim.settings))
+            data_writer.open(data, data_file(), 0, sim.settings.prefix, sim.settings.data_compress, sim.settings.data_stream_buffer);
 
-        data.init(scene, stack_aabb, last_layer_idxs, num_data_points);
-        base_x = stack_aabb.min.x;
-        base_y = stack_aabb.min.y;
-
-        XPBD_init(xpbd_steps_x_second, xpbd_iters_x_step);
+        run.reset(sim, scene_cache, data);
 
         rigid_spring_renderer.init(scene);
         fixed_rigid_spring_renderer.init(scene);
 
-        pallet_hitbox = &scene.rigid_objects[scene.rigid_objects.size()-2];
-
         SLOWING_FACTOR = video_fps;
     };
 
@@ -2440,61 +1531,43 @@ void rigid_world_schema()
 
         if (app_state == AppState::RUNNING)
         {
-            if (export_obj && (step % (frequency/SLOWING_FACTOR) == 0)) exportFrameToObj(step, center);
+            if (export_obj && (run.step % (sim.frequency/SLOWING_FACTOR) == 0)) exportFrameToObj(run.step, run.center);
 
-            time = step * delta_t;
+            sim.settings = current_settings(); // the settings panel edits the globals while running
 
-            if (profile.is_complete(time)) 
+            if (run.advance(sim, data)) 
             {
                 end_simulation = true;
                 app_state      = AppState::FINISHED;
             }
-
-            Real3 acc_vector = Real3(profile.get_acceleration(time), 0.0, 0.0);
-
-            vel_vector  += acc_vector * delta_t;
-            Real3 offset = vel_vector * delta_t;
-
-            for (FixedRigidSpringConstraint &c : scene.fixed_rigid_constraints) c.world_attach += offset;
-            center += offset;
-            base_x += offset.x;
-            pallet_hitbox->translate(offset);
-
-            MEASURE_TIME(XPBD_step(scene), total_physics_time);
-
-            if (apply_tearing && (step % (frequency / 60) == 0))
-            {
-                for (auto& constraint : scene.rigid_constraints) 
-                {   
-                    Real curr_length    = getLength(constraint);
-                    Real stretch        = curr_length - constraint.rest_length;
-                    Real tear_threshold = constraint.rest_length * tearing_stretch_percentage;
-
-                    if (stretch > tear_threshold) constraint.active = false;
-
-                    // Real force_magnitude = constraint.lambda / (delta_t*delta_t);
-                    // if (std::abs(force_magnitude) > force_tearing_threshold) constraint.active = false;
-                }
-            }
-
-            if (collect_data && step % (frequency / DataCollection::DataPointsPerSecond) == 0)
-                data.update(scene, time, center, base_x, base_y, acc_vector);
-
-            step++;
         }
 
-        if (app_state != AppState::RUNNING || step % (frequency/60) == 0) 
+        if (app_state != AppState::RUNNING || run.step % (sim.frequency/60) == 0) 
         {
             loop_init();
-            render_ui(step, time, total_physics_time); 
-            rendering(Real3(center.x, center.y, center.z)); 
+            render_ui(run.step, run.time, run.total_physics_time); 
+            rendering(Real3(run.center.x, run.center.y, run.center.z)); 
             loop_terminate();
         }
 
         if (end_simulation)
         {
             end_simulation = false;
-            if (collect_data) data.print();
+            stopObjExport();
+            if (data_writer.is_open())
+            {
+                DataStreamStats stats = data_writer.close();
+                std::cout << "Data streamed to " << data_file() << ": " << stats.samples << " samples, " << stats.dropped << " dropped\n";
+            }
+            else if (collect_data && sim.settings.data_format == "columns")
+            {
+                std::string file = data_file();
+                std::ofstream out(file, std::ios::out | std::ios::binary | std::ios::app);
+                if (!write_data_columns(out, data, 0, sim.settings.prefix, sim.settings.data_compress))
+                    std::cerr << "data_compress: built without zlib, columns written uncompressed\n";
+                std::cout << "Data appended to " << file << "\n";
+            }
+            else if (collect_data) data.print();
         }
 
         if (reset_simulation) 
@@ -2504,6 +1577,7 @@ void rigid_world_schema()
         }
     }
 
+    stopObjExport();
     fout.close();
 }
 
@@ -11,23 +11,10 @@
 #include "constraint.cpp"
 
 #include <stdio.h>
+#include <type_traits>
 
-Real tetra_volume(Real3 &x1, Real3 &x2, Real3 &x3, Real3 &x4) 
-{
-    Real3 v1 = x2 - x1;
-    Real3 v2 = x3 - x1;
-    Real3 v3 = x4 - x1;
-
-    Real3 cross = glm::cross(v1, v2);
-    Real dot    = glm::dot(cross, v3);
-    Real volume = std::abs(dot) / 6.0;
-
-    return volume;
-}
-
-inline Real distance(Real3 &p1, Real3 &p2) {
-    return glm::length(p2 - p1);
-}
+// vertex attribute type of Real buffers
+static constexpr GLenum GL_REAL = std::is_same<Real, float>::value ? GL_FLOAT : GL_DOUBLE;
 
 struct TetraMesh 
 {
@@ -56,7 +43,7 @@ struct TetraMesh
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3) * vertices->size(), vertices->data(), GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, sizeof(Real3), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, sizeof(Real3), (void*)0);
         glEnableVertexAttribArray(0);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -73,7 +60,7 @@ struct TetraMesh
         glBufferData(GL_ARRAY_BUFFER, normalVertices.size() * sizeof(Real3), normalVertices.data(), GL_DYNAMIC_DRAW);
 
         glEnableVertexAttribArray(0);
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, sizeof(Real3), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, sizeof(Real3), (void*)0);
 
         glBindVertexArray(0);
     }
@@ -160,7 +147,7 @@ struct TetraMesh
 
             auto addNormal = [&](Real3 a, Real3 b, Real3 c, Real3 opp) {
                 Real3 normal = glm::normalize(glm::cross(b - a, c - a));
-                Real3 center = (a + b + c) / 3.0;
+                Real3 center = (a + b + c) / Real(3.0);
 
                 Real3 toOpposite = opp - center;
                 if (glm::dot(normal, toOpposite) > 0.0) normal = -normal;
@@ -180,14 +167,14 @@ struct TetraMesh
 
 struct BoxMesh 
 {
-    std::vector<Real3>* vertices;
     GLuint VAO, VBO, EBO_edges, EBO_faces;  // Two separate EBOs
     std::vector<GLuint> edgeIndices;
     std::vector<GLuint> faceIndices;
 
     BoxMesh() = default;
     
-    BoxMesh(std::vector<Real3> *vs) : vertices(vs) 
+    // the box vertices are not kept, they are passed and uploaded at every draw
+    BoxMesh(const BoxVertices &vertices) 
     {
         buildEdgeIndices();
         buildFaceIndices();
@@ -200,10 +187,10 @@ struct BoxMesh
         glBindVertexArray(VAO);
         
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(Real3) * vertices->size(), 
-                     vertices->data(), GL_DYNAMIC_DRAW);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(Real3) * vertices.size(), 
+                     vertices.data(), GL_DYNAMIC_DRAW);
         
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, sizeof(Real3), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, sizeof(Real3), (void*)0);
         glEnableVertexAttribArray(0);
         
         // Setup edge EBO
@@ -249,21 +236,21 @@ struct BoxMesh
         };
     }
     
-    void drawSolid() 
+    void drawSolid(const BoxVertices &vertices) 
     {
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Real3) * vertices->size(), vertices->data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Real3) * vertices.size(), vertices.data());
         
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_faces);  
         glDrawElements(GL_TRIANGLES, faceIndices.size(), GL_UNSIGNED_INT, 0);
     }
     
-    void drawWireframe() 
+    void drawWireframe(const BoxVertices &vertices) 
     {
         glBindVertexArray(VAO);
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Real3) * vertices->size(), vertices->data());
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Real3) * vertices.size(), vertices.data());
         
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_edges); 
         glLineWidth(1.0f);
@@ -291,7 +278,7 @@ struct TriangleMesh {
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3) * vertices->size(), vertices->data(), GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, sizeof(Real3), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, sizeof(Real3), (void*)0);
         glEnableVertexAttribArray(0);
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
@@ -348,7 +335,7 @@ struct ClothMesh {
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * triangleIndices.size(),
                      triangleIndices.data(), GL_DYNAMIC_DRAW);
         
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, sizeof(Real3), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, sizeof(Real3), (void*)0);
         glEnableVertexAttribArray(0);
         
         glBindVertexArray(0);
@@ -0,0 +1,428 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <array>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <charconv>
+#include <cstdio>
+
+#include "types.h"
+#include "rigid.cpp"
+#include "scene.cpp"
+
+// OBJ frames of the pallet scene (boxes and wrap) for the animation folder.
+// The simulation thread only copies what a frame needs into an ObjFrame: a
+// pose per box and the endpoints of the active springs. Formatting and disk
+// I/O happen on the writer threads of an ObjExporter, each file formatted with
+// std::to_chars in a reused buffer and written in one call. Numbers keep the
+// six significant digits operator<< gave.
+
+struct ObjFrame
+{
+    struct BoxPose
+    {
+        Real3 position;
+        Quat  orientation;
+        Real3 size;
+    };
+
+    struct WrapSegment
+    {
+        Real3 p1, p2;
+        Real  stretch_perc; // (length - rest length) / rest length
+    };
+
+    uint64_t    frame = 0;
+    std::string directory = "..\\..\\animation\\";
+    std::string prefix;
+    Real        scale_factor = 1.0;
+    Real3       offset       = Real3(0.0);
+
+    bool wrap_displacement     = false; // stretch as vertex color, else shared endpoints once
+    Real max_displacement_perc = 0.01;
+
+    std::vector<BoxPose>     boxes;
+    std::vector<WrapSegment> segments;
+
+    // the boxes but the last one (the ground) and the active rigid springs
+    void capture(const Scene &scene, uint64_t frame, Real scale_factor, Real3 offset, const std::string& prefix)
+    {
+        this->frame        = frame;
+        this->prefix       = prefix;
+        this->scale_factor = scale_factor;
+        this->offset       = offset;
+
+        boxes.clear();
+        segments.clear();
+
+        for (size_t i = 0; i + 1 < scene.rigid_objects.size(); ++i)
+        {
+            const RigidBox &box = scene.rigid_objects[i];
+            boxes.push_back({box.position, box.orientation, box.size});
+        }
+
+        for (const auto& cons : scene.rigid_constraints())
+        {
+            if (!cons.active) continue;
+
+            Real3 p1 = scene.bodyToWorld(cons.i1, cons.r1);
+            Real3 p2 = scene.bodyToWorld(cons.i2, cons.r2);
+            segments.push_back({p1, p2, (glm::length(p2 - p1) - cons.rest_length) / cons.rest_length});
+        }
+    }
+};
+
+// Text of one OBJ file, appended to a buffer kept across files
+struct ObjText
+{
+    std::string text;
+
+    ObjText& operator<<(const char *s)        { text += s; return *this; }
+    ObjText& operator<<(const std::string& s) { text += s; return *this; }
+
+    template <typename T>
+    ObjText& operator<<(T value)
+    {
+        char  digits[32];
+        char *end;
+        if constexpr (std::is_floating_point<T>::value) end = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::general, 6).ptr;
+        else                                            end = std::to_chars(digits, digits + sizeof(digits), value).ptr;
+        text.append(digits, end);
+        return *this;
+    }
+};
+
+std::string obj_frame_path(const std::string& directory, const std::string& object_type, uint64_t frame)
+{
+    char number[32];
+    std::snprintf(number, sizeof(number), "%04llu", (unsigned long long)frame);
+    return directory + object_type + "_" + number + ".obj";
+}
+
+// the whole file in one write, unbuffered stream
+bool write_obj_file(const std::string& filename, const std::string& text)
+{
+    std::ofstream out;
+    out.rdbuf()->pubsetbuf(nullptr, 0);
+    out.open(filename);
+
+    if (!out.is_open())
+    {
+        std::cerr << "Error: cannot write file " << filename << "\n";
+        return false;
+    }
+
+    out.write(text.data(), (std::streamsize)text.size());
+    return (bool)out;
+}
+
+void format_boxes_obj(const ObjFrame& frame, ObjText& out)
+{
+    static constexpr std::array<std::array<int, 4>, 6> cube_quads = {{
+        {{3, 2, 1, 0}}, // -Y
+        {{4, 5, 6, 7}}, // +Y
+        {{0, 4, 7, 3}}, // -X
+        {{1, 2, 6, 5}}, // +X
+        {{0, 1, 5, 4}}, // +Z
+        {{2, 3, 7, 6}}  // -Z
+    }};
+
+    int vertex_offset = 0;
+    for (size_t i = 0; i < frame.boxes.size(); ++i)
+    {
+        const ObjFrame::BoxPose &box = frame.boxes[i];
+
+        // corners in the order of RigidBox::body_vertices
+        Real3 h = box.size * Real(0.5);
+        std::array<Real3, 8> corners = {
+            Real3(-h.x, -h.y, -h.z), Real3(-h.x, -h.y,  h.z), Real3( h.x, -h.y,  h.z), Real3( h.x, -h.y, -h.z),
+            Real3(-h.x,  h.y, -h.z), Real3(-h.x,  h.y,  h.z), Real3( h.x,  h.y,  h.z), Real3( h.x,  h.y, -h.z),
+        };
+
+        Real3x3 R = quat_to_rotmat(box.orientation);
+
+        out << "g Box_" << i << "\n";
+
+        for (const Real3& corner : corners)
+        {
+            Real3 scaled_pos = (body_to_world(corner, box.position, R) + frame.offset) / frame.scale_factor;
+            out << "v " << scaled_pos.x << " " << scaled_pos.y << " " << scaled_pos.z << "\n";
+        }
+
+        for (const auto& quad : cube_quads)
+        {
+            out << "f " << (quad[0] + 1 + vertex_offset) << " " << (quad[1] + 1 + vertex_offset) << " "
+                        << (quad[2] + 1 + vertex_offset) << " " << (quad[3] + 1 + vertex_offset) << "\n";
+        }
+
+        vertex_offset += 8;
+    }
+}
+
+void format_wrap_obj(const ObjFrame& frame, ObjText& out)
+{
+    out << "# Wrapped Pallet Export - Frame " << frame.frame << "\n";
+    out << "o " << frame.prefix << "Wrap\n";
+
+    if (frame.wrap_displacement)
+    {
+        // two colored vertices per spring, green (rest) to red (max_displacement_perc)
+        for (const ObjFrame::WrapSegment& segment : frame.segments)
+        {
+            Real3 scaled_p1 = (segment.p1 + frame.offset) / frame.scale_factor;
+            Real3 scaled_p2 = (segment.p2 + frame.offset) / frame.scale_factor;
+
+            Real t = glm::clamp(segment.stretch_perc, Real(0.0), frame.max_displacement_perc) / frame.max_displacement_perc;
+
+            for (const Real3& p : {scaled_p1, scaled_p2})
+                out << "v " << (float) p.x << " " << (float) p.y << " " << (float) p.z << " "
+                    << (float) t << " " << (float) (1.0 - t) << " " << 0.0f << "\n";
+        }
+
+        for (size_t si = 0; si < frame.segments.size(); si++)
+            out << "l " << (2 * si + 1) << " " << (2 * si + 2) << "\n";
+
+        return;
+    }
+
+    std::vector<Real3>               unique_points;
+    std::vector<std::pair<int, int>> constraint_lines;
+
+    unique_points.reserve(frame.segments.size() * 2);
+    constraint_lines.reserve(frame.segments.size());
+
+    auto find_or_add_point = [&](const Real3& pos) -> int
+    {
+        constexpr Real tolerance_sq = 1e-12;
+
+        for (size_t i = 0; i < unique_points.size(); ++i)
+        {
+            Real3 diff = unique_points[i] - pos;
+            if (glm::dot(diff, diff) < tolerance_sq) return static_cast<int>(i);
+        }
+
+        unique_points.push_back(pos);
+        return static_cast<int>(unique_points.size() - 1);
+    };
+
+    for (const ObjFrame::WrapSegment& segment : frame.segments)
+    {
+        int idx1 = find_or_add_point(segment.p1);
+        int idx2 = find_or_add_point(segment.p2);
+        constraint_lines.push_back({idx1, idx2});
+    }
+
+    for (const auto& point : unique_points)
+    {
+        Real3 scaled_pos = (point + frame.offset) / frame.scale_factor;
+        out << "v " << scaled_pos.x << " " << scaled_pos.y << " " << scaled_pos.z << "\n";
+    }
+
+    for (const auto& [idx1, idx2] : constraint_lines)
+        out << "l " << (idx1 + 1) << " " << (idx2 + 1) << "\n";
+}
+
+// The files of a frame, <prefix>Boxs_<frame>.obj and <prefix>Wrap_<frame>.obj,
+// returns the bytes written
+size_t write_obj_frame(const ObjFrame& frame, ObjText& buffer, bool boxes = true, bool wrap = true)
+{
+    size_t bytes = 0;
+
+    if (boxes)
+    {
+        buffer.text.clear();
+        format_boxes_obj(frame, buffer);
+        if (write_obj_file(obj_frame_path(frame.directory, frame.prefix + "Boxs", frame.frame), buffer.text)) bytes += buffer.text.size();
+    }
+
+    if (wrap)
+    {
+        buffer.text.clear();
+        format_wrap_obj(frame, buffer);
+        if (write_obj_file(obj_frame_path(frame.directory, frame.prefix + "Wrap", frame.frame), buffer.text)) bytes += buffer.text.size();
+    }
+
+    return bytes;
+}
+
+// synchronous exports, for a single frame (the starting configuration)
+
+void export_scene_to_obj(Scene &scene, uint64_t frame, Real scale_factor, Real3 offset = Real3(0.0), std::string prefix = "")
+{
+    ObjFrame obj_frame;
+    ObjText  buffer;
+    obj_frame.capture(scene, frame, scale_factor, offset, prefix);
+    write_obj_frame(obj_frame, buffer, true, false);
+}
+
+void export_wrap_displacement_to_obj(Scene &scene, uint64_t frame, Real max_displacement_perc, Real scale_factor = 1.0, Real3 offset = Real3(0.0), const std::string& prefix = "")
+{
+    ObjFrame obj_frame;
+    ObjText  buffer;
+    obj_frame.capture(scene, frame, scale_factor, offset, prefix);
+    obj_frame.wrap_displacement     = true;
+    obj_frame.max_displacement_perc = max_displacement_perc;
+    write_obj_frame(obj_frame, buffer, false, true);
+}
+
+void export_wrap_to_obj(Scene &scene, uint64_t frame, Real scale_factor = 1.0, Real3 offset = Real3(0.0), const std::string& prefix = "")
+{
+    ObjFrame obj_frame;
+    ObjText  buffer;
+    obj_frame.capture(scene, frame, scale_factor, offset, prefix);
+    write_obj_frame(obj_frame, buffer, false, true);
+}
+
+struct ObjExportStats
+{
+    uint64_t frames     = 0;
+    double   capture_ms = 0.0; // simulation thread, snapshot copies
+    double   stall_ms   = 0.0; // simulation thread, waiting for a free ObjFrame
+    double   write_ms   = 0.0; // writer threads, formatting and writing
+    uint64_t bytes      = 0;
+
+    double capture_ms_per_frame() const { return frames ? capture_ms / frames : 0.0; }
+    double write_ms_per_frame()   const { return frames ? write_ms   / frames : 0.0; }
+};
+
+// Frames captured by the simulation thread, written by num_threads writer
+// threads. The ObjFrames come from a pool of pool_size reused buffers: when
+// the writers are a whole pool behind, capture waits for one (stall_ms).
+struct ObjExporter
+{
+    ObjExporter() {}
+    ObjExporter(const ObjExporter&) = delete;
+    ObjExporter& operator=(const ObjExporter&) = delete;
+
+    ~ObjExporter() { stop(); }
+
+    void start(size_t num_threads, size_t pool_size)
+    {
+        stop();
+
+        pool.assign(std::max<size_t>(pool_size, 1), ObjFrame());
+        free_frames.clear();
+        for (ObjFrame &frame : pool) free_frames.push_back(&frame);
+
+        stats    = ObjExportStats();
+        stopping = false;
+
+        for (size_t ti = 0; ti < std::max<size_t>(num_threads, 1); ti++) writers.emplace_back([this]() { writer_loop(); });
+    }
+
+    bool running() const { return !writers.empty(); }
+
+    void capture(const Scene &scene, uint64_t frame, Real scale_factor, Real3 offset, const std::string& prefix,
+                 bool wrap_displacement, Real max_displacement_perc)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+
+        ObjFrame *obj_frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            free_cv.wait(lock, [&]() { return !free_frames.empty(); });
+            obj_frame = free_frames.back();
+            free_frames.pop_back();
+        }
+
+        auto got_frame = std::chrono::high_resolution_clock::now();
+
+        obj_frame->capture(scene, frame, scale_factor, offset, prefix);
+        obj_frame->wrap_displacement     = wrap_displacement;
+        obj_frame->max_displacement_perc = max_displacement_perc;
+
+        auto end = std::chrono::high_resolution_clock::now();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queue.push_back(obj_frame);
+            stats.stall_ms   += std::chrono::duration<double, std::milli>(got_frame - start).count();
+            stats.capture_ms += std::chrono::duration<double, std::milli>(end - got_frame).count();
+        }
+        queue_cv.notify_one();
+    }
+
+    // waits for the queued frames to be written
+    void flush()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        free_cv.wait(lock, [&]() { return free_frames.size() == pool.size(); });
+    }
+
+    // flushes and joins the writers
+    void stop()
+    {
+        if (!running()) return;
+
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        queue_cv.notify_all();
+
+        for (std::thread &writer : writers) writer.join();
+        writers.clear();
+    }
+
+    ObjExportStats get_stats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+
+    void writer_loop()
+    {
+        ObjText buffer;
+        buffer.text.reserve(1 << 20);
+
+        while (true)
+        {
+            ObjFrame *frame;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                queue_cv.wait(lock, [&]() { return stopping || !queue.empty(); });
+                if (queue.empty()) return;
+
+                frame = queue.front();
+                queue.pop_front();
+            }
+
+            auto start = std::chrono::high_resolution_clock::now();
+
+            size_t bytes = write_obj_frame(*frame, buffer);
+
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.frames++;
+                stats.write_ms += ms;
+                stats.bytes    += bytes;
+                free_frames.push_back(frame);
+            }
+            free_cv.notify_all();
+        }
+    }
+
+    std::vector<ObjFrame>    pool;
+    std::vector<ObjFrame*>   free_frames;
+    std::deque<ObjFrame*>    queue;
+    std::vector<std::thread> writers;
+
+    std::mutex              mutex;
+    std::condition_variable queue_cv;
+    std::condition_variable free_cv;
+    bool                    stopping = false;
+
+    ObjExportStats stats;
+};
@@ -5,7 +5,7 @@
 #include <set>
 
 #include "types.h"
-#include "mesh.cpp"
+#include "constraint.cpp"
 #include "AABB.cpp"
 #include "settings.cpp"
 
@@ -16,7 +16,6 @@ extern Real volume_compliance;
 
 struct TetraObject {
 
-    TetraMesh mesh;
     std::vector<Tetrahedron> tetras;
 
     std::vector<Edge>        edges;
@@ -30,48 +29,9 @@ struct TetraObject {
     std::vector<std::vector<uint32_t>> vertex_collisions;
     std::vector<CollisionConstraint>   vertex_collisions_constraints;
 
-    AABB aabb;
-
-    TetraObject(TetraObject&& other) noexcept
-        : mesh(std::move(other.mesh)),
-          tetras(std::move(other.tetras)),
-          edges(std::move(other.edges)),
-          positions(std::move(other.positions)),
-          old_positions(std::move(other.old_positions)),
-          velocities(std::move(other.velocities)),
-          inv_masses(std::move(other.inv_masses)),
-          vertex_edges(std::move(other.vertex_edges)),
-          vertex_tetras(std::move(other.vertex_tetras)),
-          vertex_collisions(std::move(other.vertex_collisions)),
-          vertex_collisions_constraints(std::move(other.vertex_collisions_constraints)),
-          aabb(other.aabb)
-    {
-        mesh.vertices = &positions;
-        for (auto& e : edges)  e.setObject(this);
-        for (auto& t : tetras) t.setObject(this);
-    }
+    std::vector<Edge> edges_to_draw; // drawn instead of edges when not empty
 
-    TetraObject& operator=(TetraObject&& other) noexcept {
-        if (this != &other) {
-            mesh              = std::move(other.mesh);
-            tetras            = std::move(other.tetras);
-            edges             = std::move(other.edges);
-            positions         = std::move(other.positions);
-            old_positions     = std::move(other.old_positions);
-            velocities        = std::move(other.velocities);
-            inv_masses        = std::move(other.inv_masses);
-            vertex_edges      = std::move(other.vertex_edges);
-            vertex_tetras     = std::move(other.vertex_tetras);
-            vertex_collisions = std::move(other.vertex_collisions);
-            vertex_collisions_constraints = std::move(other.vertex_collisions_constraints);
-            aabb              = other.aabb;
-
-            mesh.vertices = &positions;
-            for (auto& e : edges)  e.setObject(this);
-            for (auto& t : tetras) t.setObject(this);
-        }
-        return *this;
-    }
+    AABB aabb;
 
     TetraObject(std::vector<Real3> vs) : 
             positions(vs),
@@ -97,7 +57,6 @@ struct TetraObject {
             // vertex_tetras[t.vs[1]].push_back(tetra_idx);
             // vertex_tetras[t.vs[2]].push_back(tetra_idx);
             // vertex_tetras[t.vs[3]].push_back(tetra_idx);
-            t.setObject(this);
             t.rest_volume = tetra_volume(
                                     positions[t.vs[0]], 
                                     positions[t.vs[1]], 
@@ -121,7 +80,7 @@ struct TetraObject {
             VertexIndex v1 = e.first;
             VertexIndex v2 = e.second;
             Real length    = distance(positions[v1], positions[v2]);
-            Edge edge(box_edge_compliance, this, v1, v2, length);
+            Edge edge(box_edge_compliance, v1, v2, length);
 
             edges.push_back(edge);
 
@@ -130,8 +89,6 @@ struct TetraObject {
             edge_idx++;
         }
 
-        mesh = TetraMesh(&positions, tetras, edges);
-
         update_aabb();
 
     }
@@ -157,13 +114,7 @@ struct TetraObject {
         aabb = AABB(min, max);
 
         // for (auto& t : tetras) t.update_bounding_sphere();
-        for (auto& t : tetras) t.update_aabb();
-    }
-
-    void draw() {
-        mesh.drawWireframe();
-        // mesh.drawFaceNormals(tetras);
-        // mesh.drawPoints();
+        for (auto& t : tetras) t.update_aabb(positions);
     }
 
     void reset_tetras() {
@@ -190,26 +141,11 @@ struct TetraObject {
         std::fill(inv_masses.begin(), inv_masses.end(), 0.0);
     }
 
-    void set_edges_to_draw(const std::vector<Edge>& edges_to_draw) {
-        mesh.setEdgesToDraw(edges_to_draw);
+    void set_edges_to_draw(const std::vector<Edge>& edges) {
+        edges_to_draw = edges;
     }
-
 };
 
-std::array<Real3, 4> get_tetra_points(TetraObject* obj, VertexIndex vs[4]) {
-    return {obj->positions[vs[0]],
-            obj->positions[vs[1]],
-            obj->positions[vs[2]],
-            obj->positions[vs[3]]};
-}
-
-std::array<Real3, 4> get_old_tetra_points(TetraObject* obj, VertexIndex vs[4]) {
-    return {obj->old_positions[vs[0]],
-            obj->old_positions[vs[1]],
-            obj->old_positions[vs[2]],
-            obj->old_positions[vs[3]]};
-}
-
 TetraObject load_tetrahedral_data(const std::string& filename, Real scale = 2.0) {
     std::ifstream file(filename);
     std::vector<Real3> vertices;
@@ -241,7 +177,7 @@ TetraObject load_tetrahedral_data(const std::string& filename, Real scale = 2.0)
             std::istringstream iss(line);
             iss >> v0 >> v1 >> v2 >> v3;
             tetras.push_back({
-                        volume_compliance, nullptr, 
+                        volume_compliance, 
                         static_cast<VertexIndex>(v0), 
                         static_cast<VertexIndex>(v1), 
                         static_cast<VertexIndex>(v2), 
@@ -309,18 +245,18 @@ TetraObject create_box(Real3 starting_corner, Real width, Real height, Real dept
     TetraObject obj(ps);
     Real volume = 0.0;
 
-    // tetras.push_back({0.0, nullptr, 1, 0, 2, 8, volume});
-    // tetras.push_back({0.0, nullptr, 2, 0, 3, 8, volume});
-    // tetras.push_back({0.0, nullptr, 4, 5, 7, 8, volume});
-    // tetras.push_back({0.0, nullptr, 7, 5, 6, 8, volume});
-    // tetras.push_back({0.0, nullptr, 7, 6, 3, 8, volume});
-    // tetras.push_back({0.0, nullptr, 3, 6, 2, 8, volume});
-    // tetras.push_back({0.0, nullptr, 1, 4, 0, 8, volume});
-    // tetras.push_back({0.0, nullptr, 5, 4, 1, 8, volume});
-    // tetras.push_back({0.0, nullptr, 3, 4, 7, 8, volume});
-    // tetras.push_back({0.0, nullptr, 0, 4, 3, 8, volume});
-    // tetras.push_back({0.0, nullptr, 1, 6, 5, 8, volume});
-    // tetras.push_back({0.0, nullptr, 2, 6, 1, 8, volume});
+    // tetras.push_back({0.0, 1, 0, 2, 8, volume});
+    // tetras.push_back({0.0, 2, 0, 3, 8, volume});
+    // tetras.push_back({0.0, 4, 5, 7, 8, volume});
+    // tetras.push_back({0.0, 7, 5, 6, 8, volume});
+    // tetras.push_back({0.0, 7, 6, 3, 8, volume});
+    // tetras.push_back({0.0, 3, 6, 2, 8, volume});
+    // tetras.push_back({0.0, 1, 4, 0, 8, volume});
+    // tetras.push_back({0.0, 5, 4, 1, 8, volume});
+    // tetras.push_back({0.0, 3, 4, 7, 8, volume});
+    // tetras.push_back({0.0, 0, 4, 3, 8, volume});
+    // tetras.push_back({0.0, 1, 6, 5, 8, volume});
+    // tetras.push_back({0.0, 2, 6, 1, 8, volume});
 
     auto addFaceTetras = [&](
             VertexIndex v0, 
@@ -329,10 +265,10 @@ TetraObject create_box(Real3 starting_corner, Real width, Real height, Real dept
             VertexIndex v3,
             VertexIndex face_center, 
             VertexIndex center) {
-        tetras.push_back({0.0, nullptr, v0, v1, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v0, v3, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v2, v1, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v2, v3, face_center, center, volume});
+        tetras.push_back({0.0, v0, v1, face_center, center, volume});
+        tetras.push_back({0.0, v0, v3, face_center, center, volume});
+        tetras.push_back({0.0, v2, v1, face_center, center, volume});
+        tetras.push_back({0.0, v2, v3, face_center, center, volume});
     };
 
     addFaceTetras(0, 1, 2, 3,  9, 8); 
@@ -419,10 +355,10 @@ TetraObject create_ramp(Real3 starting_corner, Real width, Real height, Real dep
             VertexIndex v3,
             VertexIndex face_center, 
             VertexIndex center) {
-        tetras.push_back({0.0, nullptr, v0, v1, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v0, v3, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v2, v1, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v2, v3, face_center, center, volume});
+        tetras.push_back({0.0, v0, v1, face_center, center, volume});
+        tetras.push_back({0.0, v0, v3, face_center, center, volume});
+        tetras.push_back({0.0, v2, v1, face_center, center, volume});
+        tetras.push_back({0.0, v2, v3, face_center, center, volume});
     };
 
     auto addFaceTetras2 = [&](
@@ -431,8 +367,8 @@ TetraObject create_ramp(Real3 starting_corner, Real width, Real height, Real dep
             VertexIndex v2, 
             VertexIndex face_center, 
             VertexIndex center) {
-        tetras.push_back({0.0, nullptr, v0, v2, face_center, center, volume});
-        tetras.push_back({0.0, nullptr, v1, v2, face_center, center, volume});
+        tetras.push_back({0.0, v0, v2, face_center, center, volume});
+        tetras.push_back({0.0, v1, v2, face_center, center, volume});
     };
 
     // addFaceTetras(0, 1, 2, 3,  9, 8); 
@@ -474,7 +410,7 @@ TetraObject create_tetrahedron(Real3 p1, Real3 p2, Real3 p3, Real3 p4) {
 
     TetraObject obj(ps);
 
-    tetras.push_back({0.0, nullptr, 0, 1, 2, 3, 0.0});
+    tetras.push_back({0.0, 0, 1, 2, 3, 0.0});
 
     obj.init_tetras_and_edges(tetras);
 
@@ -539,9 +475,9 @@ TetraObject create_parallelepiped_grid(Real3 starting_corner, Real width, Real h
                                           VertexIndex cube_center) {
                     // Crea due tetraedri per ogni faccia quadrata
                     // Tetraedro 1: v0, v1, v2, center
-                    tetras.push_back({volume_compliance, nullptr, v0, v1, v2, cube_center, 0.0});
+                    tetras.push_back({volume_compliance, v0, v1, v2, cube_center, 0.0});
                     // Tetraedro 2: v0, v2, v3, center  
-                    tetras.push_back({volume_compliance, nullptr, v0, v2, v3, cube_center, 0.0});
+                    tetras.push_back({volume_compliance, v0, v2, v3, cube_center, 0.0});
                 };
                 
                 // Crea tetraedri per ogni faccia del cubo
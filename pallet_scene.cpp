@@ -0,0 +1,1287 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <limits>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#include "types.h"
+#include "scene.cpp"
+#include "xpbd.cpp"
+#include "XMLparser.cpp"
+#include "settings.cpp"
+#include "rigid.cpp"
+#include "scene_cache.cpp"
+#include "spsc_ring.cpp"
+
+// The palletizing pipeline without graphics: schema loading, scene building,
+// transport motion and data collection. Used by the viewer (main.cpp) and by
+// the headless runner (headless.cpp).
+
+#define MEASURE_TIME(function_call, accumulator)                                                   \
+do {                                                                                               \
+    auto start_##accumulator = std::chrono::high_resolution_clock::now();                          \
+    function_call;                                                                                 \
+    auto elapsed_##accumulator = std::chrono::high_resolution_clock::now() - start_##accumulator;  \
+    accumulator += std::chrono::duration<Real, std::milli>(elapsed_##accumulator).count();         \
+} while(0)
+
+// Paths are written Windows style ("..\\..\\palleting_data"), elsewhere the
+// separators are swapped
+std::string native_path(std::string path) 
+{
+#if !defined(_WIN32)
+    std::replace(path.begin(), path.end(), '\\', '/');
+#endif
+    return path;
+}
+
+std::string find_single_file(const std::string& folder_path) 
+{
+    for (const auto& entry : fs::directory_iterator(native_path(folder_path))) {
+        if (entry.is_regular_file()) {
+            return entry.path().string(); // ritorna il path completo
+        }
+    }
+    throw std::runtime_error("Nessun file trovato in " + folder_path);
+}
+
+std::vector<std::string> find_files_in_folder(const std::string& folder_path) 
+{
+    std::vector<std::string> files;
+    for (const auto& entry : fs::directory_iterator(native_path(folder_path))) {
+        if (entry.is_regular_file()) {
+            files.push_back(entry.path().string());
+        }
+    }
+    if (files.empty()) {
+        throw std::runtime_error("Nessun file trovato in " + folder_path);
+    }
+    return files;
+}
+
+struct Box 
+{
+    Real3 position;
+    Real3 size;
+    Real  weight;
+};
+
+// Placement of one box in a layer file (PalSchema_SPDisposalClass), in mm
+struct Disposal 
+{
+    int  x;
+    int  y;
+    bool rotation;
+};
+
+// The values of a palletizing schema used by the loaders, as in the files (mm, g)
+struct PalletSchema 
+{
+    int weight = 0;
+    int height = 0;
+    int width  = 0;
+    int length = 0;
+
+    int pallet_x = 0;
+    int pallet_y = 0;
+    int pallet_z = 0;
+
+    std::vector<std::string> layer_paths;
+    std::unordered_map<std::string, std::vector<Disposal>> layers; // by layer file name
+};
+
+// Reads every schema file in one pass with XMLCursor, over the mapped file
+PalletSchema read_pallet_schema(const std::string& schema_path) 
+{
+    PalletSchema schema;
+
+    // first element with each tag, in document order
+    auto read_ints = [](const std::string& filename, std::vector<std::pair<std::string_view, int*>> fields) 
+    {
+        MappedFile file(filename);
+        XMLCursor  cursor(file.view());
+
+        size_t missing = fields.size();
+        while (missing > 0 && cursor.next()) 
+        {
+            if (cursor.kind() != XMLCursor::Open) continue;
+
+            for (auto& [tag, value] : fields) 
+            {
+                if (value == nullptr || cursor.name() != tag) continue;
+                *value = cursor.int_text();
+                value  = nullptr;
+                missing--;
+                break;
+            }
+        }
+
+        for (const auto& [tag, value] : fields)
+            if (value != nullptr) throw std::runtime_error("Errore: " + std::string(tag) + " non trovato in " + filename);
+    };
+
+    read_ints(find_single_file("..\\..\\" + schema_path + "\\SecondaryPackaging"), 
+              {{"Weight", &schema.weight}, {"Height", &schema.height}, {"Width", &schema.width}, {"Length", &schema.length}});
+
+    read_ints(find_single_file("..\\..\\" + schema_path + "\\Pallet"), 
+              {{"DimX", &schema.pallet_x}, {"DimY", &schema.pallet_y}, {"Dim_Z", &schema.pallet_z}});
+
+    {
+        MappedFile file(find_single_file("..\\..\\" + schema_path + "\\PalletisingSchema"));
+        XMLCursor  cursor(file.view());
+
+        if (cursor.find("LayerPaths")) 
+        {
+            int depth = cursor.depth();
+            while (cursor.next_child(depth)) 
+            {
+                if (cursor.name() == "string") schema.layer_paths.emplace_back(cursor.element_text());
+            }
+        }
+    }
+
+    for (const auto& filename : find_files_in_folder("..\\..\\" + schema_path + "\\Layer")) 
+    {
+        MappedFile file(filename);
+        XMLCursor  cursor(file.view());
+
+        size_t name_pos = filename.find_last_of("\\/");
+        std::vector<Disposal>& disposals = schema.layers[name_pos == std::string::npos ? filename : filename.substr(name_pos + 1)];
+
+        while (cursor.find("PalSchema_SPDisposalClass")) 
+        {
+            Disposal disposal = {0, 0, false};
+
+            int depth = cursor.depth();
+            while (cursor.next_child(depth)) 
+            {
+                if      (cursor.name() == "_x")        disposal.x        = cursor.int_text();
+                else if (cursor.name() == "_y")        disposal.y        = cursor.int_text();
+                else if (cursor.name() == "_rotation") disposal.rotation = cursor.element_text() == "true";
+            }
+
+            disposals.push_back(disposal);
+        }
+    }
+
+    return schema;
+}
+
+Box load_rigid_schema(Scene& scene, const std::string& schema_path, Real scale, int *last_layer_idxs = nullptr) 
+{
+    try 
+    {
+        PalletSchema schema = read_pallet_schema(schema_path);
+
+        Real mult = 0.001;
+
+        Real weight =         mult * schema.weight;
+        Real height = scale * mult * schema.height;
+        Real width  = scale * mult * schema.width;
+        Real length = scale * mult * schema.length;
+
+        Real total_weight = 0.0;
+
+        std::vector<Box> boxes;
+
+        int layer_num = 0;
+        for (const auto& layer_file_name : schema.layer_paths) 
+        {
+            auto layer = schema.layers.find(layer_file_name);
+            if (layer != schema.layers.end()) 
+            {
+                if (last_layer_idxs != nullptr) last_layer_idxs[0] = (int) boxes.size();
+
+                for (const Disposal& box_pos : layer->second) 
+                {
+                    Real x = scale * mult * box_pos.x;
+                    Real z = scale * mult * box_pos.y;
+                    Real y = layer_num * height - 2.0;
+
+                    if (box_pos.rotation) 
+                        boxes.push_back({Real3(x, y, z), Real3(width, height, length), weight});
+                    else
+                        boxes.push_back({Real3(x, y, z), Real3(length, height, width), weight});
+
+                    total_weight += weight;
+                }
+
+                if (last_layer_idxs != nullptr) last_layer_idxs[1] = (int) boxes.size();
+            }
+            layer_num++;
+        }
+
+        // std::cout << "Total boxes weight: " << total_weight << " kg\n";
+
+        for (const auto& box : boxes) 
+        {
+            scene.addRigidObject(RigidBox(box.position + box.size*Real(0.5), box.size, box.weight));
+        }
+
+        // PALLET
+
+        Real size_x = scale * mult * schema.pallet_x;
+        Real size_z = scale * mult * schema.pallet_y;
+        Real size_y = scale * mult * schema.pallet_z;
+
+        return {Real3(0.0), Real3(size_x, size_y, size_z), 1.0};
+    } 
+    catch (const std::exception& e) { std::cerr << "Error loading schema: " << e.what() << "\n"; }
+
+    return {Real3(0.0), Real3(1.0), 1.0};
+}
+
+struct AccelerationProfile 
+{
+    Real acc_time;
+    Real dec_time;
+    Real still_time;
+    Real acceleration;
+    Real deceleration;
+    Real blend_time = 0.25;
+
+    Real get_acceleration(Real time) const 
+    {
+        static auto smoothstep = [](Real edge0, Real edge1, Real x) -> Real 
+        {
+            x = std::clamp((x - edge0) / (edge1 - edge0), Real(0.0), Real(1.0));
+            return x * x * (3 - 2 * x);
+        };
+
+        static auto blend = [](Real phase_start, Real blend_time, Real time, Real from, Real to) 
+        {
+            if (time < phase_start + blend_time) 
+            {
+                Real t = smoothstep(phase_start, phase_start + blend_time, time);
+                return from + t * (to - from);
+            }
+            return to;
+        };
+
+        if (time < acc_time) 
+            return blend(0.0, blend_time, time, 0.0, acceleration);
+        
+        if (time < acc_time + dec_time) 
+            return blend(acc_time, blend_time, time, acceleration, deceleration);
+        
+        if (time < acc_time + dec_time + still_time) 
+            return blend(acc_time + dec_time, blend_time, time, deceleration, 0.0);
+        
+        return 0.0;
+    }
+
+    bool is_complete(Real time) const 
+    {
+        return time >= acc_time + dec_time + still_time;
+    }
+};
+
+AABB getSceneAABB(Scene& scene)
+{
+    AABB aabb = scene.getRigidObject(0).aabb;
+    for (Index i=0; i<scene.rigid_objects.size(); i++) 
+    {
+        RigidBox &box = scene.getRigidObject(i);
+        aabb.expand(box.aabb.min);
+        aabb.expand(box.aabb.max);
+    }
+
+    return aabb;
+}
+
+// FNV-1a over the bits of every body's position, orientation and velocities.
+// Two runs end with the same hash only when they are bitwise identical, which
+// is what the solver modes, thread counts and kernels are checked against.
+uint64_t scene_state_hash(const Scene& scene)
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto add = [&hash](Real value)
+    {
+        unsigned char bytes[sizeof(Real)];
+        std::memcpy(bytes, &value, sizeof(Real));
+        for (unsigned char c : bytes) hash = (hash ^ c) * 1099511628211ull;
+    };
+
+    for (const RigidBox& box : scene.rigid_objects)
+    {
+        for (int k = 0; k < 3; k++) add(box.position[k]);
+        for (int k = 0; k < 4; k++) add(box.orientation[k]);
+        for (int k = 0; k < 3; k++) add(box.velocity[k]);
+        for (int k = 0; k < 3; k++) add(box.angular_velocity[k]);
+    }
+
+    return hash;
+}
+
+std::string state_hash_string(uint64_t hash)
+{
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+struct PrepareSceneOutput
+{
+    AABB stack_aabb;
+    int last_layer_indexes[2];
+};
+
+// The files prepare_scene reads, for source_files_key
+std::vector<std::string> scene_source_paths(const Settings& settings)
+{
+    return {native_path("..\\..\\palleting_data\\" + settings.schema_folder),
+            native_path("..\\..\\assets\\slitta.obj"),
+            native_path("..\\..\\assets\\pallet.obj")};
+}
+
+PrepareSceneOutput prepare_scene(SimulationContext& ctx)
+{
+    Scene          &scene    = ctx.scene;
+    const Settings &settings = ctx.settings;
+
+    scene.clear();
+
+    int last_layer_idxs[2];
+
+    Box bpallet = load_rigid_schema(scene, "palleting_data\\" + settings.schema_folder, settings.scale_factor, last_layer_idxs);
+
+    AABB stack_aabb = getSceneAABB(scene);
+    Real3 center    = (stack_aabb.min + stack_aabb.max) * Real(0.5);
+
+    Real length_x = stack_aabb.max.x - stack_aabb.min.x;
+    Real length_y = stack_aabb.max.y - stack_aabb.min.y;
+    Real length_z = stack_aabb.max.z - stack_aabb.min.z;
+
+    Real slitta_height = 0.10 * settings.scale_factor;
+    Real pallet_height = 0.13 * settings.scale_factor;
+
+    // PALLET HITBOX
+    scene.addRigidObject(
+            RigidBox(
+                Real3(center.x, -2.0 - bpallet.size.y/2.0 - 0.001, center.z),
+                Real3(bpallet.size.x + 1.0, bpallet.size.y, bpallet.size.z + 1.0),
+                1.0));
+    scene.getRigidObject(scene.rigid_objects.size()-1).make_kinematic();
+
+    // GROUND
+    scene.addRigidObject(
+            RigidBox(
+                Real3(28.5, - 3.0 - pallet_height - slitta_height,  center.z),
+                Real3(62.0, 2.0,  bpallet.size.z + 4.0),
+                1.0));
+    scene.getRigidObject(scene.rigid_objects.size()-1).make_static();
+
+    auto whichBox = [&](Real3 p) -> Index 
+    {
+        for (Index i=0; i<scene.rigid_objects.size()-1; i++) 
+        {
+            if (scene.getRigidObject(i).aabb.contains(p, 1e-4)) return i;
+        }
+        return scene.rigid_objects.size()-1;
+    };
+
+    auto validBox = [&](Index i) -> bool 
+    {
+        return i < scene.rigid_objects.size()-2;
+    };
+
+    auto attachPoint = [&](Real3 p, Index i) -> Real3 {
+        RigidBox &box = scene.getRigidObject(i);
+        return p - box.position;
+    };
+
+    // one generator for all the random wraps, a new draw each build without a wrap_seed
+    std::mt19937 wrap_gen(settings.wrap_seed != 0 ? (uint32_t)settings.wrap_seed : std::random_device{}());
+
+    auto wrapPlane = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, bool both_directions = true) 
+    {
+        int gen_cons = 0;
+
+        for (uint8_t i=0; i<=steps; i++) {
+        for (uint8_t j=0; j<=steps; j++) {
+
+            Real step1_size = glm::length(step1);
+            Real step2_size = glm::length(step2);
+            
+            Real3 p  = p1 + step1 * ((Real) i) + step2 * ((Real) j);
+            Real3 pr = p  + step1;
+            Real3 pd = p  + step2;
+
+            Index bi  = whichBox(p);
+            Index bir = whichBox(pr);
+            Index bid = whichBox(pd);
+
+            Real3 a  = attachPoint(p,  bi);
+            Real3 ar = attachPoint(pr, bir);
+            Real3 ad = attachPoint(pd, bid);
+
+
+            if (validBox(bi) && validBox(bir)) {
+                scene.addRigidConstraint(
+                        RigidSpringConstraint(
+                            settings.wrap_compliance, 
+                            bi, bir, 
+                            a,  ar, 
+                            step1_size));
+                if (bi != bir) gen_cons++;
+            }
+
+            if (both_directions && validBox(bi) && validBox(bid)) {
+                scene.addRigidConstraint(
+                        RigidSpringConstraint(
+                            settings.wrap_compliance, 
+                            bi, bid, 
+                            a,  ad, 
+                            step2_size));
+                if (bi != bid) gen_cons++;
+            }
+        }}
+
+        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
+    };
+
+    auto wrapPlaneRandom = [&](Real3 p1, Real3 p2, int num_constraints) 
+    {
+        Real step_x = p2.x - p1.x;
+        Real step_y = p2.y - p1.y;
+        Real step_z = p2.z - p1.z;
+
+        std::mt19937 &gen = wrap_gen;
+        std::uniform_real_distribution<Real> dis(0.0, 1.0);
+
+        int gen_cons = 0;
+
+        while (gen_cons < num_constraints) 
+        {
+            Real u1 = dis(gen);
+            Real v1 = dis(gen);
+            Real w1 = dis(gen);
+
+            Real u2 = dis(gen);
+            Real v2 = dis(gen);
+            Real w2 = dis(gen);
+
+            Real3 pr1 = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
+            Real3 pr2 = p1 + Real3(u2 * step_x, v2 * step_y, w2 * step_z);
+
+            Index b1 = whichBox(pr1);
+            Index b2 = whichBox(pr2);
+            
+            Real3 a1 = attachPoint(pr1, b1);
+            Real3 a2 = attachPoint(pr2, b2);
+
+
+            if (validBox(b1) && validBox(b2) && (b1 != b2)) 
+            {
+                Real distance = glm::length(pr1 - pr2);
+                scene.addRigidConstraint(
+                    RigidSpringConstraint(
+                        settings.wrap_compliance, 
+                        b1, b2, 
+                        a1,  a2, 
+                        distance));
+                gen_cons++;
+            }
+        }
+
+        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
+    };
+
+    auto wrapPlaneRandomLength = [&](Real3 p1, Real3 p2, Real length, int num_constraints, int plane_axis) {
+        
+        Real step_x = p2.x - p1.x;
+        Real step_y = p2.y - p1.y;
+        Real step_z = p2.z - p1.z;
+
+        std::mt19937 &gen = wrap_gen;
+        std::uniform_real_distribution<Real> dis(0.0, 1.0);
+
+        int gen_cons = 0;
+        
+        for (int k = 0; k < num_constraints; k++) 
+        {
+
+            // Real u1 = dis(gen);
+            // Real v1 = dis(gen);
+            // Real w1 = dis(gen);
+            Real3 pr1; // = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
+            Real3 pr2;
+
+            while(true) { 
+                Real u1 = dis(gen);
+                Real v1 = dis(gen);
+                Real w1 = dis(gen);
+                pr1     = p1 + Real3(u1 * step_x, v1 * step_y, w1 * step_z);
+
+                Real rand_direction = dis(gen) * 2.0 * glm::pi<Real>();
+                Real cos_length = glm::cos(rand_direction) * length;
+                Real sin_length = glm::sin(rand_direction) * length;
+                switch(plane_axis) {
+                    case 0: pr2 = pr1 + Real3(0.0, cos_length, sin_length); break;
+                    case 1: pr2 = pr1 + Real3(cos_length, 0.0, sin_length); break;
+                    case 2: pr2 = pr1 + Real3(cos_length, sin_length, 0.0); break;
+                }
+                bool inside = (pr2.x >= p1.x && pr2.x <= p2.x &&
+                               pr2.y >= p1.y && pr2.y <= p2.y &&
+                               pr2.z >= p1.z && pr2.z <= p2.z);
+
+                if (!inside) continue;
+
+                Index b1 = whichBox(pr1);
+                Index b2 = whichBox(pr2);
+
+                if (validBox(b1) && validBox(b2) && (b1 != b2)) break;
+            }
+
+            
+            Index b1 = whichBox(pr1);
+            Index b2 = whichBox(pr2);
+            
+            Real3 a1 = attachPoint(pr1, b1);
+            Real3 a2 = attachPoint(pr2, b2);
+
+
+            if (validBox(b1) && validBox(b2) && (b1 != b2)) 
+            {
+                Real distance = glm::length(pr1 - pr2);
+                scene.addRigidConstraint(
+                    RigidSpringConstraint(
+                        settings.wrap_compliance, 
+                        b1, b2, 
+                        a1, a2, 
+                        distance));
+                gen_cons++;
+            }
+        }
+
+        // std::cout << "Generated " << gen_cons << " wrap constraints.\n";
+    };
+
+    auto transform_axis_aligned_rectangle = [](Real3& p1,  Real3& p2, Real scale, Real rotation_angle, int plane_axis) 
+    {    
+        Real3 center = (p1 + p2) * Real(0.5);
+
+        p1 -= center;
+        p2 -= center;
+
+        p1 *= scale;
+        p2 *= scale;
+        
+        Real4x4 transform = Real4x4(1.0f);
+
+        Real angle_rad = glm::radians(rotation_angle);
+        if      (plane_axis == 0) transform = glm::rotate(transform, angle_rad, Real3(1.0f, 0.0f, 0.0f));
+        else if (plane_axis == 1) transform = glm::rotate(transform, angle_rad, Real3(0.0f, 1.0f, 0.0f));
+        else                      transform = glm::rotate(transform, angle_rad, Real3(0.0f, 0.0f, 1.0f));
+
+        Real4 p1t = transform * Real4(p1, 1.0f);
+        Real4 p2t = transform * Real4(p2, 1.0f);
+        
+        p1 = Real3(p1t.x, p1t.y, p1t.z);
+        p2 = Real3(p2t.x, p2t.y, p2t.z);
+
+        p1 += center;
+        p2 += center;
+    };
+
+    auto rotate_around_origin = [](Real3& point, Real angle_degrees, int plane_axis) {
+        Real angle_rad = glm::radians(angle_degrees);
+        Real cos_angle = std::cos(angle_rad);
+        Real sin_angle = std::sin(angle_rad);
+        
+        if (plane_axis == 0) { 
+            Real y = point.y * cos_angle - point.z * sin_angle;
+            Real z = point.y * sin_angle + point.z * cos_angle;
+            point.y = y;
+            point.z = z;
+        } else if (plane_axis == 1) { 
+            Real x = point.x * cos_angle + point.z * sin_angle;
+            Real z = -point.x * sin_angle + point.z * cos_angle;
+            point.x = x;
+            point.z = z;
+        } else { 
+            Real x = point.x * cos_angle - point.y * sin_angle;
+            Real y = point.x * sin_angle + point.y * cos_angle;
+            point.x = x;
+            point.y = y;
+        }
+    };
+
+    auto wrapPlaneRotated = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real angle, int plane_axis) 
+    {
+
+        Real3 c1p1 = p1;
+        Real3 c1p2 = p2;
+        Real3 c1step1 = step1;
+        Real3 c1step2 = step2;
+        transform_axis_aligned_rectangle(c1p1, c1p2, 3.0, angle, plane_axis);
+        rotate_around_origin(c1step1, angle, plane_axis);
+        rotate_around_origin(c1step2, angle, plane_axis);
+        steps += steps*2;
+
+        wrapPlane(c1p1, c1p2, c1step1, c1step2, steps);
+    };
+
+    auto wrapPlaneRotatedMirrored = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real angle, int plane_axis) 
+    {
+
+        Real3 c1p1 = p1;
+        Real3 c1p2 = p2;
+        Real3 c1step1 = step1;
+        Real3 c1step2 = step2;
+        transform_axis_aligned_rectangle(c1p1, c1p2, 3.0, angle, plane_axis);
+        rotate_around_origin(c1step1, angle, plane_axis);
+        rotate_around_origin(c1step2, angle, plane_axis);
+        
+        Real3 c2p1 = p1;
+        Real3 c2p2 = p2;
+        Real3 c2step1 = step1;
+        Real3 c2step2 = step2;
+        transform_axis_aligned_rectangle(c2p1, c2p2, 3.0, -angle, plane_axis);
+        rotate_around_origin(c2step1, -angle, plane_axis);
+        rotate_around_origin(c2step2, -angle, plane_axis);
+
+        steps += steps*2;
+
+        wrapPlane(c1p1, c1p2, c1step1, c1step2, steps, false);
+        wrapPlane(c2p1, c2p2, c2step1, c2step2, steps, false);
+    };
+
+    auto wrapPlaneShifted = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real shift) 
+    {
+
+        p1 += step1 * shift + step2 * shift;
+        p2 += step1 * shift + step2 * shift;
+
+        wrapPlane(p1, p2, step1, step2, steps);
+    };
+
+    auto wrapPlaneEdges = [&](Real3 p1, Real3 p2, Real3 step1, Real3 step2, uint8_t steps, Real shift) 
+    {
+        // Opposite edges: B1 (p1→p1+step1*N) and B3 (p2→p2-step1*N)
+        for (uint8_t i = 0; i <= steps; i++) 
+        {
+
+            Real t  = (Real) i / (Real) steps;
+            Real to = (Real) (steps - i) / (Real) steps;
+
+            Real3 e1 = p1 + step1 * (t  * (Real)steps);                // Edge 1 point
+            Real3 e3 = p2 - step1 * (to * (Real)steps) + step1*shift;  // Opposite edge point
+
+            Index b1 = whichBox(e1);
+            Index b3 = whichBox(e3);
+
+            if (validBox(b1) && validBox(b3)) 
+            {
+                Real3 a1  = attachPoint(e1, b1);
+                Real3 a3  = attachPoint(e3, b3);
+                Real dist = glm::length(e1 - e3);
+
+                scene.addRigidConstraint(
+                        RigidSpringConstraint(
+                            settings.wrap_compliance,
+                            b1,
+                            b3,
+                            a1, a3, dist));
+            }
+        }
+    };
+
+    auto attachBase = [&](Real3 p1, Real3 p2) 
+    {
+        for (Index bi=0; bi<scene.rigid_objects.size()-1; bi++) 
+        {
+            RigidBox &box = scene.getRigidObject(bi);
+            for (int vi=0; vi<8; vi++) {
+                Real3 v = box.world_vertices[vi];
+
+                if ( (v.x >= std::min(p1.x, p2.x) - 1e-4) && (v.x <= std::max(p1.x, p2.x) + 1e-4) &&
+                     (v.z >= std::min(p1.z, p2.z) - 1e-4) && (v.z <= std::max(p1.z, p2.z) + 1e-4) &&
+                     (std::abs(v.y - p1.y) < 1e-4) ) 
+                {
+                    
+                    scene.addRigidConstraint(
+                            FixedRigidSpringConstraint(
+                                settings.base_attach_compliance, 
+                                bi, 
+                                box.body_vertices[vi], 
+                                v,
+                                0.0));
+                }
+            }   
+        }
+    };
+
+    auto applyWrapType = [&](
+        const std::string& type, int steps, Real param, 
+        const Real3& p0, const Real3& p1, const Real3& p2, const Real3& p3, 
+        const Real3& p4, const Real3& p5, const Real3& p6, const Real3& p7,
+        const Real3& xstep, const Real3& ystep, const Real3& zstep,
+        Real length_x, Real length_y, Real length_z) 
+    {
+        if (type == NONE) return;
+
+        if (type == ROTATED) 
+        {
+            wrapPlaneRotated(p1, p6, xstep, ystep, steps, param, 2);
+            wrapPlaneRotated(p0, p7, xstep, ystep, steps, param, 2);
+            wrapPlaneRotated(p0, p5, zstep, ystep, steps, param, 0);
+            wrapPlaneRotated(p3, p6, zstep, ystep, steps, param, 0);
+            wrapPlaneRotated(p4, p6, xstep, zstep, steps, param, 1);
+        }
+        else if (type == ROTATED_MIRRORED) 
+        {
+            wrapPlaneRotatedMirrored(p1, p6, xstep, ystep, steps, param, 2);
+            wrapPlaneRotatedMirrored(p0, p7, xstep, ystep, steps, param, 2);
+            wrapPlaneRotatedMirrored(p0, p5, zstep, ystep, steps, param, 0);
+            wrapPlaneRotatedMirrored(p3, p6, zstep, ystep, steps, param, 0);
+            wrapPlaneRotatedMirrored(p4, p6, xstep, zstep, steps, param, 1);
+        }
+        else if (type == GRID) 
+        {
+            wrapPlane(p1, p6, xstep, ystep, steps);
+            wrapPlane(p0, p7, xstep, ystep, steps);
+            wrapPlane(p0, p5, zstep, ystep, steps);
+            wrapPlane(p3, p6, zstep, ystep, steps);
+            wrapPlane(p4, p6, xstep, zstep, steps);
+        }
+        else if (type == SHIFTED) 
+        {
+            wrapPlaneShifted(p1, p6, xstep, ystep, steps, param);
+            wrapPlaneShifted(p0, p7, xstep, ystep, steps, param);
+            wrapPlaneShifted(p0, p5, zstep, ystep, steps, param);
+            wrapPlaneShifted(p3, p6, zstep, ystep, steps, param);
+            wrapPlaneShifted(p4, p6, xstep, zstep, steps, param);
+        }
+        else if (type == RANDOM) 
+        {
+            wrapPlaneRandom(p1, p6, steps);
+            wrapPlaneRandom(p0, p7, steps);
+            wrapPlaneRandom(p0, p5, steps);
+            wrapPlaneRandom(p3, p6, steps);
+            wrapPlaneRandom(p4, p6, steps);
+        }
+        else if (type == RANDOM_LENGTH) 
+        {
+            Real clamp_p = glm::clamp((Real)param, Real(0.0), Real(0.9));
+            wrapPlaneRandomLength(p1, p6, length_x * clamp_p, steps, 2);
+            wrapPlaneRandomLength(p0, p7, length_x * clamp_p, steps, 2);
+            wrapPlaneRandomLength(p0, p5, length_z * clamp_p, steps, 0);
+            wrapPlaneRandomLength(p3, p6, length_z * clamp_p, steps, 0);
+            wrapPlaneRandomLength(p4, p6, length_x * clamp_p, steps, 1);
+        }
+        else if (type == EDGES) 
+        {
+            wrapPlaneEdges(p1, p6, ystep, xstep, steps, param);
+            wrapPlaneEdges(p0, p7, ystep, xstep, steps, param);
+            wrapPlaneEdges(p0, p5, ystep, zstep, steps, param);
+            wrapPlaneEdges(p3, p6, ystep, zstep, steps, param);
+            wrapPlaneEdges(p4, p6, xstep, zstep, steps, param);
+        }
+    };
+
+    Real3 p0(stack_aabb.min.x, stack_aabb.min.y, stack_aabb.min.z);
+    Real3 p1(stack_aabb.min.x, stack_aabb.min.y, stack_aabb.max.z);
+    Real3 p2(stack_aabb.max.x, stack_aabb.min.y, stack_aabb.max.z);
+    Real3 p3(stack_aabb.max.x, stack_aabb.min.y, stack_aabb.min.z);
+
+    Real3 p4(stack_aabb.min.x, stack_aabb.max.y, stack_aabb.min.z);
+    Real3 p5(stack_aabb.min.x, stack_aabb.max.y, stack_aabb.max.z);
+    Real3 p6(stack_aabb.max.x, stack_aabb.max.y, stack_aabb.max.z);
+    Real3 p7(stack_aabb.max.x, stack_aabb.max.y, stack_aabb.min.z);
+
+    auto run_wrap = [&](std::string type, int steps, Real param) 
+    {
+        if (type == NONE) return;
+
+        Real3 xstep(length_x / (Real)steps, 0.0, 0.0);
+        Real3 ystep(0.0, length_y / (Real)steps, 0.0);
+        Real3 zstep(0.0, 0.0, length_z / (Real)steps);
+
+        applyWrapType(type, steps, param, p0, p1, p2, p3, p4, p5, p6, p7, xstep, ystep, zstep, length_x, length_y, length_z);
+    };
+
+    run_wrap(settings.wrap_type,     settings.wrap_steps,     settings.wrap_param);
+    run_wrap(settings.wrap_type_sec, settings.wrap_steps_sec, settings.wrap_param_sec);
+
+    attachBase(p0, p2);
+
+    scene.addSceneObject(load_scene_object_from_obj(native_path("..\\..\\assets\\slitta.obj"), settings.scale_factor));
+    scene.addSceneObject(load_scene_object_from_obj(native_path("..\\..\\assets\\pallet.obj"), settings.scale_factor));
+
+    RigidBox &pallet_hitbox = scene.rigid_objects[scene.rigid_objects.size()-2];
+    SceneObject &slitta = scene.scene_objects[0];
+    SceneObject &pallet = scene.scene_objects[1];
+
+    slitta.translate(Real3(center.x, -2.0 - pallet_height, center.z));
+    pallet.translate(Real3(center.x, -2.0, center.z));
+
+    return {stack_aabb, {last_layer_idxs[0], last_layer_idxs[1]}};
+}
+
+// The series of DataCollection come in three groups, each sampled at its own
+// rate (data_rate, data_rate_springs, data_rate_bodies): the spring and body
+// series loop over the whole scene and can be sampled less often.
+enum DataGroup : uint8_t
+{
+    DATA_MOTION  = 1, // displacements, angles, accelerations
+    DATA_SPRINGS = 2, // elastic energies, max and total force, stretch
+    DATA_BODIES  = 4, // kinetic energy, com drift
+};
+
+// One DataCollection::update, the fields of the groups set in groups
+struct DataSample
+{
+    uint8_t groups = 0;
+    Real    time   = 0.0;
+
+    Real  displacement, angle, acceleration;
+    Real  elastic_energy, max_force, total_force;
+    Real3 total_stretch;
+    Real  kinetic_energy;
+    Real3 com_drift;
+};
+
+struct DataCollection
+{
+    struct Flags 
+    {
+        bool times            = true;
+        bool accelerations    = true;
+        bool displacements    = true;
+        bool angles           = true;
+        bool elastic_energies = true;
+        bool max_force        = true;
+        bool total_force      = true;
+        bool total_stretch    = true;
+        bool kinetic_energy   = true;
+        bool com_drift        = true;
+    } print_flags;
+
+    std::string postfix = "";
+
+    std::vector<Real> displacements;
+    std::vector<Real> times;
+    std::vector<Real> times_springs; // only with a data_rate_springs of its own
+    std::vector<Real> times_bodies;  // only with a data_rate_bodies of its own
+    std::vector<Real> angles;
+    std::vector<Real> accelerations;
+    std::vector<Real> elastic_energies;
+    std::vector<Real> max_force_recorded;
+    std::vector<Real> total_force_recorded;
+    std::vector<Real> total_stretch_x;
+    std::vector<Real> total_stretch_y;
+    std::vector<Real> total_stretch_z;
+    std::vector<Real> kinetic_energy;
+    std::vector<Real3> com_drift;
+
+    Real3 initial_com;
+    int last_layer_idxs[2];
+    int manifold_max_points;
+
+    int sample_every[3] = {1, 1, 1}; // steps between two samples of each group
+
+    // when set, update pushes its samples here (a DataStreamWriter drains them
+    // to disk) and the vectors stay empty
+    SpscRing<DataSample> *stream = nullptr;
+
+    DataCollection() {}
+
+    void clear()
+    {
+        for (std::vector<Real>* series : {&displacements, &times, &times_springs, &times_bodies, &angles, &accelerations, &elastic_energies,
+                                          &max_force_recorded, &total_force_recorded, &total_stretch_x, &total_stretch_y, &total_stretch_z, &kinetic_energy})
+            series->clear();
+        com_drift.clear();
+    }
+
+    // the group has times of its own, its rate differs from data_rate
+    bool own_times(DataGroup group) const { return sample_every[group == DATA_SPRINGS ? 1 : 2] != sample_every[0]; }
+
+    // the groups to sample at step
+    uint8_t due(uint64_t step) const
+    {
+        uint8_t groups = 0;
+        if (step % sample_every[0] == 0) groups |= DATA_MOTION;
+        if (step % sample_every[1] == 0) groups |= DATA_SPRINGS;
+        if (step % sample_every[2] == 0) groups |= DATA_BODIES;
+        return groups;
+    }
+
+    void init(SimulationContext& ctx, const AABB& stack_aabb, int last_layer_indexes[2])
+    {
+        Scene          &scene    = ctx.scene;
+        const Settings &settings = ctx.settings;
+
+        auto every = [&](int rate) { return std::max(1, (int)ctx.frequency / std::max(1, rate > 0 ? rate : settings.data_rate)); };
+        sample_every[0] = every(settings.data_rate);
+        sample_every[1] = every(settings.data_rate_springs);
+        sample_every[2] = every(settings.data_rate_bodies);
+
+        clear();
+
+        if (!stream)
+        {
+            size_t num_data_points = (settings.acc_time + settings.dec_time + settings.still_time) * ctx.frequency / sample_every[0] + 1;
+
+            for (std::vector<Real>* series : {&displacements, &times, &angles, &accelerations, &elastic_energies, &max_force_recorded,
+                                              &total_force_recorded, &total_stretch_x, &total_stretch_y, &total_stretch_z, &kinetic_energy})
+                series->reserve(num_data_points);
+            com_drift.reserve(num_data_points);
+        }
+
+        last_layer_idxs[0] = last_layer_indexes[0];
+        last_layer_idxs[1] = last_layer_indexes[1];
+        manifold_max_points = settings.manifold_max_points;
+
+        Real3 current_com_sum = Real3(0.0);
+        Real total_mass       = 0.0;
+
+        for(size_t i=0; i<scene.rigid_objects.size()-2; i++) 
+        {
+            const auto& box = scene.getRigidObject(i);
+
+            current_com_sum += box.position * box.mass;   
+            total_mass      += box.mass;
+        }
+
+        initial_com = current_com_sum / total_mass;
+    }
+
+    // appends a sample to the series of its groups
+    void record(const DataSample& sample)
+    {
+        if (sample.groups & DATA_MOTION)
+        {
+            times.push_back(sample.time);
+            displacements.push_back(sample.displacement);
+            angles.push_back(sample.angle);
+            accelerations.push_back(sample.acceleration);
+        }
+
+        if (sample.groups & DATA_SPRINGS)
+        {
+            if (own_times(DATA_SPRINGS)) times_springs.push_back(sample.time);
+            elastic_energies.push_back(sample.elastic_energy);
+            max_force_recorded.push_back(sample.max_force);
+            total_force_recorded.push_back(sample.total_force);
+            total_stretch_x.push_back(sample.total_stretch.x);
+            total_stretch_y.push_back(sample.total_stretch.y);
+            total_stretch_z.push_back(sample.total_stretch.z);
+        }
+
+        if (sample.groups & DATA_BODIES)
+        {
+            if (own_times(DATA_BODIES)) times_bodies.push_back(sample.time);
+            kinetic_energy.push_back(sample.kinetic_energy);
+            com_drift.push_back(sample.com_drift);
+        }
+    }
+    
+    void update(SimulationContext& ctx, uint8_t groups, Real time, Real3 center, Real base_x, Real base_y, Real3 acc_vector)
+    {
+        Scene     &scene   = ctx.scene;
+        const Real delta_t = ctx.delta_t;
+
+        DataSample sample;
+        sample.groups = groups;
+        sample.time   = time;
+
+        if (groups & DATA_MOTION)
+        {
+            Real x = std::numeric_limits<Real>::max();
+            Real y = 0.0;
+
+            for (int i=last_layer_idxs[0]; i<last_layer_idxs[1]; i++) 
+            {
+                const RigidBox &box = scene.rigid_objects[i];
+                if (box.min_x() < x) 
+                {
+                    x = box.min_x();
+                    y = box.max_y();
+                }
+            }
+
+            Real disp  = x - base_x;
+            Real angle = glm::degrees(atan2(y - base_y, disp)) - 90.0;
+
+            sample.displacement = disp;
+            sample.angle        = angle;
+            sample.acceleration = acc_vector.x;
+        }
+
+        // ===================================================================
+
+        if (groups & DATA_SPRINGS)
+        {
+            Real total_elastic_energy = 0.0;
+            Real max_force            = std::numeric_limits<Real>::lowest();
+            Real total_magnitude      = 0.0;
+            Real3 total_stretch       = Real3(0.0);
+
+            for (const auto& constraint : scene.rigid_constraints()) 
+            {   
+                const RigidBox *b1 = &scene.rigid_objects[constraint.i1];
+                const RigidBox *b2 = &scene.rigid_objects[constraint.i2];
+
+                if (b1 == b2) continue;
+
+                Real3 p1 = body_to_world(constraint.r1, b1->position, b1->orientation);
+                Real3 p2 = body_to_world(constraint.r2, b2->position, b2->orientation);
+
+                Real3 dir = p2 - p1;
+                Real dist = glm::length(dir);
+                Real C    = dist - constraint.rest_length;
+
+                if (C <= 0.0) continue;
+
+                Real3 stretch_dir = dir / dist;
+                Real3 stretch_vec = glm::abs(stretch_dir) * C;
+
+                Real force_scalar = constraint.lambda / (delta_t * delta_t);
+
+                total_stretch += stretch_vec;
+
+                total_magnitude += std::abs(force_scalar);
+
+                max_force = std::max(max_force, std::abs(force_scalar));
+
+                if (constraint.compliance > 0.0) total_elastic_energy += (C * C) / (2.0 * constraint.compliance);
+            }
+
+            sample.elastic_energy = total_elastic_energy;
+            sample.max_force      = max_force;
+            sample.total_force    = total_magnitude;
+            sample.total_stretch  = total_stretch;
+        }
+
+        // ==================================================================
+
+        if (groups & DATA_BODIES)
+        {
+            Real total_ke = 0.0;
+
+            Real3 current_com_sum = Real3(0.0);
+            Real total_mass       = 0.0;
+
+            for(size_t i=0; i<scene.rigid_objects.size()-2; i++) 
+            {
+                const auto& box = scene.getRigidObject(i);
+
+                Real3x3 R       = quat_to_rotmat(box.orientation);
+                Real3x3 I_world = R * box.inertia_tensor * glm::transpose(R);
+
+                total_ke += 0.5 * box.mass * glm::dot(box.velocity, box.velocity);
+                total_ke += 0.5 * glm::dot(box.angular_velocity, I_world * box.angular_velocity);
+
+                current_com_sum += box.position * box.mass;   
+                total_mass      += box.mass;
+            }
+
+            Real3 current_com = current_com_sum / total_mass;
+            
+            current_com.x -= center.x;
+
+            sample.kinetic_energy = total_ke;
+            sample.com_drift      = current_com - initial_com;
+        }
+
+        // a full ring drops the sample (counted by the ring), the solver never waits
+        if (stream) stream->try_push(sample);
+        else        record(sample);
+    }
+
+    void print(std::ostream& out = std::cout) const
+    {
+        auto pythonListPrint = [&](std::string list_name, const std::vector<Real>& vec) 
+        {
+            out << list_name << (postfix != "" ? "_" : "") << postfix << " = [";
+            for (size_t i=0; i<vec.size(); i++) 
+            {
+                out << vec[i];
+                if (i < vec.size()-1) out << ", ";
+            }
+            out << "]\n\n";
+        };
+
+        auto pythonReal3Print = [&](std::string list_name, const std::vector<Real3>& vec, int axis) 
+        {
+            out << list_name << (postfix != "" ? "_" : "") << postfix << " = [";
+            for (size_t i=0; i<vec.size(); i++) 
+            {
+                out << vec[i][axis]; 
+                if (i < vec.size()-1) out << ", ";
+            }
+            out << "]\n\n";
+        };
+
+        out << "# --- Data Export Start ---\n\n";
+
+        if (print_flags.times)            pythonListPrint("times", times);
+        if (print_flags.times && own_times(DATA_SPRINGS)) pythonListPrint("times_springs", times_springs);
+        if (print_flags.times && own_times(DATA_BODIES))  pythonListPrint("times_bodies", times_bodies);
+        if (print_flags.accelerations)    pythonListPrint("accelerations", accelerations);
+        if (print_flags.displacements)    pythonListPrint("displacements", displacements);
+        if (print_flags.angles)           pythonListPrint("angles", angles);
+        if (print_flags.elastic_energies) pythonListPrint("elastic_energies", elastic_energies);
+        if (print_flags.max_force)        pythonListPrint("max_force_recorded", max_force_recorded);
+        if (print_flags.total_force)      pythonListPrint("total_force_recorded", total_force_recorded);
+        if (print_flags.kinetic_energy)   pythonListPrint("kinetic_energy", kinetic_energy);
+
+        if (print_flags.total_stretch) 
+        {
+            pythonListPrint("total_stretch_x", total_stretch_x);
+            pythonListPrint("total_stretch_y", total_stretch_y);
+            pythonListPrint("total_stretch_z", total_stretch_z);
+        }
+
+        if (print_flags.com_drift) {
+            pythonReal3Print("com_drift_x", com_drift, 0);
+            pythonReal3Print("com_drift_y", com_drift, 1);
+            pythonReal3Print("com_drift_z", com_drift, 2);
+        }
+
+        // summary to compare runs with different contact settings (e.g. manifold_max_points)
+        auto peak = [](const std::vector<Real>& vec) 
+        {
+            Real value = 0.0;
+            for (Real v : vec) value = std::max(value, std::abs(v));
+            return value;
+        };
+
+        out << "# manifold_max_points = " << manifold_max_points 
+                  << ", peak displacement = " << peak(displacements) 
+                  << ", peak tilt = " << peak(angles) << "\n\n";
+
+        out << "# --- Data Export End ---\n" << std::flush;
+    }
+};
+
+// One run of the transport profile on the pallet scene, advanced one XPBD step
+// at a time by the viewer loop and by the headless runner. The scene comes
+// from the cache when only compliances or motion settings changed.
+struct TransportRun 
+{
+    uint64_t step;
+    Real     time;
+    Real     total_physics_time;
+
+    AccelerationProfile profile;
+    Real3 vel_vector;
+    Real3 acc_vector;
+    Real3 center;
+    Real  base_x, base_y;
+
+    Index pallet_hitbox;
+
+    void reset(SimulationContext& ctx, SceneCache& cache, DataCollection& data) 
+    {
+        Scene          &scene    = ctx.scene;
+        const Settings &settings = ctx.settings;
+
+        total_physics_time = 0.0;
+        vel_vector         = Real3(0.0);
+        acc_vector         = Real3(0.0);
+        profile            = {settings.acc_time, settings.dec_time, settings.still_time, settings.acceleration, settings.deceleration};
+        step               = 0;
+        time               = 0.0;
+
+        cache.directory = settings.scene_cache_dir;
+
+        std::string topology  = scene_topology_key(settings) + source_files_key(scene_source_paths(settings));
+        bool        cacheable = scene_is_cacheable(settings);
+
+        BuiltScene fresh;
+        const BuiltScene *built = cacheable ? cache.find(topology) : nullptr;
+        if (built)
+        {
+            built->load(scene, settings);
+        }
+        else 
+        {
+            PrepareSceneOutput output = prepare_scene(ctx);
+            fresh.stack_aabb            = output.stack_aabb;
+            fresh.last_layer_indexes[0] = output.last_layer_indexes[0];
+            fresh.last_layer_indexes[1] = output.last_layer_indexes[1];
+            built = &fresh;
+
+            if (cacheable)
+            {
+                fresh.save(scene);
+                built = &cache.store(topology, std::move(fresh));
+            }
+        }
+
+        AABB stack_aabb         = built->stack_aabb;
+        int  last_layer_idxs[2] = {built->last_layer_indexes[0], built->last_layer_indexes[1]};
+        center     = (stack_aabb.min + stack_aabb.max) * Real(0.5);
+        center.x   = 0.0;
+
+        XPBD_init(ctx, settings.xpbd_steps_x_second, settings.xpbd_iters_x_step);
+
+        data.init(ctx, stack_aabb, last_layer_idxs);
+        base_x = stack_aabb.min.x;
+        base_y = stack_aabb.min.y;
+
+        pallet_hitbox = scene.rigid_objects.size()-2;
+    }
+
+    bool finished(const SimulationContext& ctx) const { return profile.is_complete(step * ctx.delta_t); }
+
+    // moves the pallet by the profile and runs one XPBD step, true once the
+    // profile was complete at the start of the step
+    bool advance(SimulationContext& ctx, DataCollection& data) 
+    {
+        Scene          &scene    = ctx.scene;
+        const Settings &settings = ctx.settings;
+        const Real      delta_t  = ctx.delta_t;
+
+        time = step * delta_t;
+
+        bool complete = profile.is_complete(time);
+
+        acc_vector = Real3(profile.get_acceleration(time), 0.0, 0.0);
+
+        vel_vector  += acc_vector * delta_t;
+        Real3 offset = vel_vector * delta_t;
+
+        for (FixedRigidSpringConstraint &c : scene.fixed_rigid_constraints()) c.world_attach += offset;
+        center += offset;
+        base_x += offset.x;
+        scene.rigid_objects[pallet_hitbox].move_kinematic(offset, delta_t);
+
+        MEASURE_TIME(XPBD_step(ctx), total_physics_time);
+
+        if (settings.apply_tearing && (step % (ctx.frequency / 60) == 0))
+        {
+            for (auto& constraint : scene.rigid_constraints()) 
+            {   
+                Real curr_length    = getLength(scene.rigid_objects, constraint);
+                Real stretch        = curr_length - constraint.rest_length;
+                Real tear_threshold = constraint.rest_length * settings.tearing_stretch_percentage;
+
+                if (stretch > tear_threshold) constraint.active = false;
+
+                // Real force_magnitude = constraint.lambda / (delta_t*delta_t);
+                // if (std::abs(force_magnitude) > force_tearing_threshold) constraint.active = false;
+            }
+        }
+
+        uint8_t groups = settings.collect_data ? data.due(step) : 0;
+        if (groups) data.update(ctx, groups, time, center, base_x, base_y, acc_vector);
+
+        step++;
+
+        return complete;
+    }
+};
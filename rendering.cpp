@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 
+#include "mesh.cpp"
 #include "scene.cpp"
 #include "settings.cpp"
 #include "types.h"
@@ -29,7 +30,7 @@ struct SpringRenderer
         if (VAO != 0) glDeleteVertexArrays(1, &VAO);
         if (VBO != 0) glDeleteBuffers(1, &VBO);
 
-        buildVertices(scene.constraints);
+        buildVertices(scene);
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -38,21 +39,21 @@ struct SpringRenderer
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3_Color) * vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
+        glVertexAttribPointer(1, 4, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
         glEnableVertexAttribArray(1);
 
         glBindVertexArray(0);
     }
 
-    void buildVertices(std::vector<SpringConstraint> constraints) {
+    void buildVertices(const Scene &scene) {
         vertices.clear();
-        for (SpringConstraint &cons : constraints) 
+        for (const SpringConstraint &cons : scene.constraints) 
         {
-            Real3 v1 = cons.obj1->positions[cons.v1]; 
-            Real3 v2 = cons.obj2->positions[cons.v2];
+            Real3 v1 = scene.objects[cons.o1].positions[cons.v1]; 
+            Real3 v2 = scene.objects[cons.o2].positions[cons.v2];
             Real3_Color vc1 = {v1.x, v1.y, v1.z, 0.0, 1.0, 0.0, 0.3};
             Real3_Color vc2 = {v2.x, v2.y, v2.z, 0.0, 1.0, 0.0, 0.3};
             vertices.push_back(vc1);
@@ -61,7 +62,7 @@ struct SpringRenderer
     }
 
     void draw(Scene &scene) {
-        buildVertices(scene.constraints);
+        buildVertices(scene);
 
         glBindVertexArray(VAO);
 
@@ -92,7 +93,7 @@ struct FixedRigidSpringRenderer
         if (VAO != 0) glDeleteVertexArrays(1, &VAO);
         if (VBO != 0) glDeleteBuffers(1, &VBO);
 
-        buildVertices(scene.fixed_rigid_constraints);
+        buildVertices(scene);
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -101,20 +102,20 @@ struct FixedRigidSpringRenderer
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3_Color) * vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
+        glVertexAttribPointer(1, 4, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
         glEnableVertexAttribArray(1);
 
         glBindVertexArray(0);
     }
 
-    void buildVertices(std::vector<FixedRigidSpringConstraint> constraints) 
+    void buildVertices(const Scene &scene) 
     {
         vertices.clear();
-        for (FixedRigidSpringConstraint &cons : constraints) {
-            Real3 v1 = body_to_world(cons.body_attach, cons.box->position, cons.box->orientation);
+        for (const FixedRigidSpringConstraint &cons : scene.fixed_rigid_constraints()) {
+            Real3 v1 = scene.bodyToWorld(cons.box, cons.body_attach);
             Real3 v2 = cons.world_attach;
             Real3_Color vc1 = {v1.x, v1.y, v1.z, 0.0, 1.0, 0.0, 1.0};
             Real3_Color vc2 = {v2.x, v2.y, v2.z, 0.0, 1.0, 0.0, 1.0};
@@ -125,7 +126,7 @@ struct FixedRigidSpringRenderer
 
     void draw(Scene &scene) 
     {
-        buildVertices(scene.fixed_rigid_constraints);
+        buildVertices(scene);
 
         glBindVertexArray(VAO);
 
@@ -137,6 +138,90 @@ struct FixedRigidSpringRenderer
     }
 };
 
+// Render component of the rigid boxes, one BoxMesh per entry of
+// scene.rigid_objects. Meshes are created on first draw and reused when the
+// scene is rebuilt, since they only depend on the box topology.
+struct RigidBoxRenderer 
+{
+    std::vector<BoxMesh> meshes;
+
+    RigidBoxRenderer() = default;
+
+    ~RigidBoxRenderer() 
+    {
+        for (BoxMesh &mesh : meshes) mesh.clear();
+    }
+
+    void draw(Scene &scene) 
+    {
+        while (meshes.size() < scene.rigid_objects.size()) 
+            meshes.emplace_back(scene.rigid_objects[meshes.size()].world_vertices);
+
+        for (Index bi = 0; bi < scene.rigid_objects.size(); bi++) 
+        {
+            if (render_tearing) meshes[bi].drawSolid(scene.rigid_objects[bi].world_vertices);
+            else                meshes[bi].drawWireframe(scene.rigid_objects[bi].world_vertices);
+        }
+    }
+};
+
+// Render components of the deformable objects, the cloths and the static scene
+// objects, one mesh per entry of the scene vectors, created on first draw like
+// RigidBoxRenderer. The meshes point to the vertices of the scene, so the
+// pointer is set again before every draw.
+struct SoftBodyRenderer 
+{
+    std::vector<TetraMesh>    object_meshes;
+    std::vector<ClothMesh>    cloth_meshes;
+    std::vector<TriangleMesh> scene_object_meshes;
+
+    void drawObjects(Scene &scene) 
+    {
+        while (object_meshes.size() < scene.objects.size()) 
+        {
+            TetraObject &obj = scene.objects[object_meshes.size()];
+            object_meshes.emplace_back(&obj.positions, obj.tetras, obj.edges);
+            if (!obj.edges_to_draw.empty()) object_meshes.back().setEdgesToDraw(obj.edges_to_draw);
+        }
+
+        for (Index oi = 0; oi < scene.objects.size(); oi++) 
+        {
+            object_meshes[oi].vertices = &scene.objects[oi].positions;
+            object_meshes[oi].drawWireframe();
+        }
+    }
+
+    void drawCloths(Scene &scene) 
+    {
+        while (cloth_meshes.size() < scene.cloths.size()) 
+        {
+            Cloth &cloth = scene.cloths[cloth_meshes.size()];
+            cloth_meshes.emplace_back(&cloth.positions, cloth.triangles, cloth.edges);
+        }
+
+        for (Index ci = 0; ci < scene.cloths.size(); ci++) 
+        {
+            cloth_meshes[ci].vertices = &scene.cloths[ci].positions;
+            cloth_meshes[ci].drawWireframe();
+        }
+    }
+
+    void drawSceneObjects(Scene &scene) 
+    {
+        while (scene_object_meshes.size() < scene.scene_objects.size()) 
+        {
+            SceneObject &obj = scene.scene_objects[scene_object_meshes.size()];
+            scene_object_meshes.emplace_back(&obj.vertices, obj.indices);
+        }
+
+        for (Index si = 0; si < scene.scene_objects.size(); si++) 
+        {
+            scene_object_meshes[si].vertices = &scene.scene_objects[si].vertices;
+            scene_object_meshes[si].drawWireframe();
+        }
+    }
+};
+
 struct RigidSpringRenderer 
 {
 
@@ -156,7 +241,7 @@ struct RigidSpringRenderer
         if (VAO != 0) glDeleteVertexArrays(1, &VAO);
         if (VBO != 0) glDeleteBuffers(1, &VBO);
         
-        buildVertices(scene.rigid_constraints);
+        buildVertices(scene);
 
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -165,19 +250,19 @@ struct RigidSpringRenderer
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3_Color) * vertices.size(), vertices.data(), GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
+        glVertexAttribPointer(1, 4, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
         glEnableVertexAttribArray(1);
 
         glBindVertexArray(0);
     }
 
-    void buildVertices(std::vector<RigidSpringConstraint> constraints) 
+    void buildVertices(const Scene &scene) 
     {
         vertices.clear();
-        for (RigidSpringConstraint &cons : constraints) 
+        for (const RigidSpringConstraint &cons : scene.rigid_constraints()) 
         {
             if (cons.active == false) continue;
 
@@ -185,17 +270,17 @@ struct RigidSpringRenderer
             Real g = 1.0;
             Real b = 0.0;
 
-            Real3 v1 = body_to_world(cons.r1, cons.b1->position, cons.b1->orientation);
-            Real3 v2 = body_to_world(cons.r2, cons.b2->position, cons.b2->orientation);
+            Real3 v1 = scene.bodyToWorld(cons.i1, cons.r1);
+            Real3 v2 = scene.bodyToWorld(cons.i2, cons.r2);
 
             if (render_tearing )
             {
-                Real curr_length    = getLength(cons);
+                Real curr_length    = getLength(scene.rigid_objects, cons);
                 Real stretch        = curr_length - cons.rest_length;
                 Real tear_threshold = cons.rest_length * tearing_stretch_percentage;
 
                 Real t = stretch / tear_threshold;
-                t = glm::clamp(t, 0.0, 1.0);
+                t = glm::clamp(t, Real(0.0), Real(1.0));
 
                 r = t;
                 g = 1.0 - t;
@@ -210,7 +295,7 @@ struct RigidSpringRenderer
 
     void draw(Scene &scene) 
     {
-        buildVertices(scene.rigid_constraints);
+        buildVertices(scene);
 
         glBindVertexArray(VAO);
 
@@ -227,7 +312,17 @@ struct RigidSpringRenderer
     }
 };
 
-// struct NormalRenderer
+struct NormalRenderer 
+{
+    GLuint VAO = 0, VBO = 0;
+    std::vector<Real3_Color> normals;
+
+    NormalRenderer() = default;
+    ~NormalRenderer();
+    void init();
+    void buildNormals(const Quat& orientation, const Real3& position, Real size);
+    void draw(RigidBox *box);
+};
 
 void NormalRenderer::init() {
     normals.insert(normals.end(), 6, Real3_Color{0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 1.0});
@@ -239,10 +334,10 @@ void NormalRenderer::init() {
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(Real3_Color) * normals.size(), normals.data(), GL_DYNAMIC_DRAW);
 
-    glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)0);
+    glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)0);
     glEnableVertexAttribArray(0);
 
-    glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
+    glVertexAttribPointer(1, 4, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
     glEnableVertexAttribArray(1);
 
     glBindVertexArray(0);
@@ -301,10 +396,10 @@ struct ManifoldRenderer {
 
         glBufferData(GL_ARRAY_BUFFER, sizeof(Real3_Color) * 16, nullptr, GL_DYNAMIC_DRAW);
 
-        glVertexAttribPointer(0, 3, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)0);
+        glVertexAttribPointer(0, 3, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)0);
         glEnableVertexAttribArray(0);
 
-        glVertexAttribPointer(1, 4, GL_DOUBLE, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
+        glVertexAttribPointer(1, 4, GL_REAL, GL_FALSE, 7 * sizeof(Real), (void*)(3 * sizeof(Real)));
         glEnableVertexAttribArray(1);
 
         glBindVertexArray(0);
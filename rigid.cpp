@@ -11,12 +11,10 @@
 #include <sstream>
 
 #include "types.h"
-#include "mesh.cpp"
+#include "constraint.cpp"
 #include "AABB.cpp"
 #include "settings.cpp"
 
-extern bool render_tearing;
-
 struct RigidBox;
 
 
@@ -25,12 +23,21 @@ inline Quat quat_conjugate(const Quat& q)
     return Quat(-q.x, -q.y, -q.z, q.w);
 }
 
-inline Quat quat_multiplication(const Quat &p, const Quat &q) 
+// rotation matrix type of a quaternion type, for the helpers below that are
+// shared by the scene (Quat) and the solver (SolverQuat) precision
+template <typename Q> struct RotationOf;
+template <> struct RotationOf<glm::dvec4> { using type = glm::dmat3; };
+template <> struct RotationOf<glm::vec4>  { using type = glm::mat3;  };
+
+template <typename Q>
+inline Q quat_multiplication(const Q &p, const Q &q) 
 {
+    using T = typename Q::value_type;
+
     // p = (px,py,pz,pw), q = (qx,qy,qz,qw)
-    Real px = p.x, py = p.y, pz = p.z, pw = p.w;
-    Real qx = q.x, qy = q.y, qz = q.z, qw = q.w;
-    Quat r;
+    T px = p.x, py = p.y, pz = p.z, pw = p.w;
+    T qx = q.x, qy = q.y, qz = q.z, qw = q.w;
+    Q r;
     r.x = pw*qx + px*qw + py*qz - pz*qy;
     r.y = pw*qy - px*qz + py*qw + pz*qx;
     r.z = pw*qz + px*qy - py*qx + pz*qw;
@@ -38,24 +45,27 @@ inline Quat quat_multiplication(const Quat &p, const Quat &q)
     return r;
 }
 
-inline Real3x3 quat_to_rotmat(const Quat& q) 
+template <typename Q>
+inline typename RotationOf<Q>::type quat_to_rotmat(const Q& q) 
 {
-    Real x = q.x;
-    Real y = q.y;
-    Real z = q.z;
-    Real w = q.w;
-
-    Real xx = x * x;
-    Real yy = y * y;
-    Real zz = z * z;
-    Real xy = x * y;
-    Real xz = x * z;
-    Real yz = y * z;
-    Real wx = w * x;
-    Real wy = w * y;
-    Real wz = w * z;
-
-    return Real3x3(
+    using T = typename Q::value_type;
+
+    T x = q.x;
+    T y = q.y;
+    T z = q.z;
+    T w = q.w;
+
+    T xx = x * x;
+    T yy = y * y;
+    T zz = z * z;
+    T xy = x * y;
+    T xz = x * z;
+    T yz = y * z;
+    T wx = w * x;
+    T wy = w * y;
+    T wz = w * z;
+
+    return typename RotationOf<Q>::type(
         1 - 2 * (yy + zz), 2 * (xy - wz),     2 * (xz + wy),
         2 * (xy + wz),     1 - 2 * (xx + zz), 2 * (yz - wx),
         2 * (xz - wy),     2 * (yz + wx),     1 - 2 * (xx + yy)
@@ -110,6 +120,43 @@ inline Real3 world_to_body(const Real3& p_world, const Quat& q)
     return glm::transpose(R) * p_world;
 }
 
+// same as above with the rotation matrix of q already computed (Real3x3 or SolverReal3x3)
+template <typename V3, typename M3>
+inline V3 body_to_world(const V3& p_body, const V3& pos, const M3& R) 
+{
+    return R * p_body + pos;
+}
+
+template <typename V3, typename M3>
+inline V3 world_to_body(const V3& p_world, const V3& pos, const M3& R) 
+{
+    return glm::transpose(R) * (p_world - pos);
+}
+
+template <typename V3, typename M3>
+inline V3 world_to_body(const V3& p_world, const M3& R) 
+{
+    return glm::transpose(R) * p_world;
+}
+
+// Rotation matrix and normalized axes (its columns, as quat_to_axes) of an
+// orientation, kept with the quaternion they were computed from.
+struct BodyFrame 
+{
+    Quat                 orientation = Quat(0.0); // not a unit quaternion: never valid
+    Real3x3              rotation;
+    std::array<Real3, 3> axes;
+
+    void update(const Quat& q) 
+    {
+        if (orientation == q) return;
+
+        orientation = q;
+        rotation    = quat_to_rotmat(q);
+        axes        = {glm::normalize(rotation[0]), glm::normalize(rotation[1]), glm::normalize(rotation[2])};
+    }
+};
+
 struct RigidBox 
 {
     Real3   position;
@@ -124,13 +171,18 @@ struct RigidBox
     Real3x3 inertia_tensor;
     Real3x3 inv_inertia_tensor;
 
-    std::vector<Real3> world_vertices;
-    std::vector<Real3> body_vertices;
+    BoxVertices world_vertices;
+    BoxVertices body_vertices;
     Real3   size;
-    BoxMesh mesh;
     AABB    aabb;
 
+    // cache of the rotation of orientation, refreshed on access when orientation changed
+    mutable BodyFrame frame;
+
     bool is_static;
+    bool is_kinematic;
+    bool is_sleeping = false;
+    Real sleep_timer = 0.0; // time spent below the sleep velocities
 
     RigidBox(Real3 pos, Real3 size, Real mass)
         : position(pos), 
@@ -140,8 +192,9 @@ struct RigidBox
           orientation(0.0, 0.0, 0.0, 1.0), 
           angular_velocity(0.0), 
           size(size),
-          aabb(pos - size * 0.5, pos + size * 0.5),
-          is_static(false)
+          aabb(pos - size * Real(0.5), pos + size * Real(0.5)),
+          is_static(false),
+          is_kinematic(false)
     {
 
         body_vertices = {
@@ -155,8 +208,8 @@ struct RigidBox
             Real3( size.x/2,  size.y/2, -size.z/2),
         };
 
-        for (Real3 &v : body_vertices) {
-            world_vertices.push_back(v + pos);
+        for (size_t vi = 0; vi < body_vertices.size(); vi++) {
+            world_vertices[vi] = body_vertices[vi] + pos;
         }
 
         Real ix = (1.0 / 12.0) * mass * (size.y * size.y + size.z * size.z);
@@ -168,70 +221,17 @@ struct RigidBox
             0.0, 0.0, iz
         );
         inv_inertia_tensor = glm::inverse(inertia_tensor);
-
-        mesh = BoxMesh(&world_vertices);
-    }
-
-    RigidBox(RigidBox&& other) noexcept
-        : position(other.position),
-          old_position(other.old_position),
-          velocity(other.velocity),
-          mass(other.mass),
-          inv_mass(other.inv_mass),
-          orientation(other.orientation),
-          angular_velocity(other.angular_velocity),
-          old_orientation(other.old_orientation),
-          inertia_tensor(other.inertia_tensor),
-          inv_inertia_tensor(other.inv_inertia_tensor),
-          size(other.size),
-          aabb(other.aabb),
-          world_vertices(std::move(other.world_vertices)),
-          body_vertices(std::move(other.body_vertices)),
-          mesh(std::move(other.mesh)),
-          is_static(other.is_static)
-    {
-        mesh.vertices = &world_vertices;
-    }
-
-    RigidBox& operator=(RigidBox&& other) noexcept {
-        if (this != &other) {
-            position           = other.position;
-            old_position       = other.old_position;
-            velocity           = other.velocity;
-            mass               = other.mass;
-            inv_mass           = other.inv_mass;
-            orientation        = other.orientation;
-            old_orientation    = other.old_orientation;
-            angular_velocity   = other.angular_velocity;
-            inertia_tensor     = other.inertia_tensor;
-            inv_inertia_tensor = other.inv_inertia_tensor;
-            aabb               = other.aabb;
-            size               = other.size;
-            is_static          = other.is_static;
-
-            world_vertices     = std::move(other.world_vertices);
-            body_vertices      = std::move(other.body_vertices);
-            mesh               = std::move(other.mesh);
-
-            mesh.vertices      = &world_vertices;
-        }
-        return *this;
     }
 
     Real generalized_inverse_mass(Real3 pb, Real3 nb) const {
 
-        if (is_static) return 0.0;
+        if (is_static || is_sleeping) return 0.0;
 
         Real3 r_cross_n = glm::cross(pb, nb);
         Real w          = inv_mass + glm::dot(r_cross_n, inv_inertia_tensor * r_cross_n);
         return w;
     }
 
-    void clear() 
-    {
-        mesh.clear();
-    }
-
     void update(Real delta_t, Real3 gravity) 
     {
         if (is_static) return;
@@ -254,7 +254,7 @@ struct RigidBox
 
         #else
 
-        Real3x3 R                 = quat_to_rotmat(orientation); 
+        const Real3x3 &R          = get_frame().rotation; 
         Real3x3 inertia_world     = R * inertia_tensor     * glm::transpose(R);
         Real3x3 inv_inertia_world = R * inv_inertia_tensor * glm::transpose(R);
 
@@ -263,7 +263,7 @@ struct RigidBox
         angular_velocity += delta_t * (inv_inertia_world * (-gyro));
 
         Quat omega_q(angular_velocity.x, angular_velocity.y, angular_velocity.z, 0.0);
-        orientation += 0.5 * delta_t * (quat_multiplication(omega_q, orientation));
+        orientation += Real(0.5) * delta_t * (quat_multiplication(omega_q, orientation));
         orientation = glm::normalize(orientation);
 
         #endif
@@ -294,16 +294,21 @@ struct RigidBox
         velocity = (position - old_position) / delta_t;
 
         Quat dquat       = quat_multiplication(orientation, quat_conjugate(old_orientation));
-        angular_velocity = (2.0 / delta_t) * Real3(dquat.x, dquat.y, dquat.z);
+        angular_velocity = (Real(2.0) / delta_t) * Real3(dquat.x, dquat.y, dquat.z);
         angular_velocity = dquat.w >= 0.0? angular_velocity : -angular_velocity;
     }
     
+    const BodyFrame& get_frame() const 
+    {
+        frame.update(orientation);
+        return frame;
+    }
+
     void update_world_vertices() 
     {
-        world_vertices.clear();
-        world_vertices.reserve(body_vertices.size());
-        for (const Real3& v_body : body_vertices) {
-            world_vertices.push_back(body_to_world(v_body, position, orientation));
+        const Real3x3 &R = get_frame().rotation;
+        for (size_t vi = 0; vi < body_vertices.size(); vi++) {
+            world_vertices[vi] = body_to_world(body_vertices[vi], position, R);
         }
     }
 
@@ -319,12 +324,6 @@ struct RigidBox
         aabb.max = max_v;
     }
 
-    void draw() 
-    {
-        if (render_tearing) mesh.drawSolid();
-        else                mesh.drawWireframe();
-    }
-
     void rotate(const Quat& q_rotation) {
         orientation = quat_multiplication(orientation, q_rotation);
         orientation = glm::normalize(orientation);
@@ -342,65 +341,52 @@ struct RigidBox
         is_static = true;
         inv_mass  = 0.0;
     }
-};
 
-// ====================================
-// Rendering Cool Stuff
-// ====================================
-
-struct NormalRenderer 
-{
-    GLuint VAO = 0, VBO = 0;
-    std::vector<Real3_Color> normals;
-
-    NormalRenderer() = default;
-    ~NormalRenderer();
-    void init();
-    void buildNormals(const Quat& orientation, const Real3& position, Real size);
-    void draw(RigidBox *box);
-};
-
-struct SceneObject 
-{
-    TriangleMesh mesh;
-    std::vector<Real3> vertices;
-
-    SceneObject() = default;
+    // infinite mass like a static body, but moved by the caller (e.g. the pallet)
+    void make_kinematic() {
+        make_static();
+        is_kinematic = true;
+    }
 
-    SceneObject(const std::vector<Real3>& vs, const std::vector<GLuint>& indices) {
-        init(vs, indices);
+    void move_kinematic(const Real3& offset, Real delta_t) {
+        translate(offset);
+        velocity = offset / delta_t;
     }
 
-    SceneObject(SceneObject&& other) noexcept
-        : mesh(std::move(other.mesh)),
-          vertices(std::move(other.vertices))
-    {
-        mesh.vertices = &vertices;
+    // static, or dynamic but asleep: not moved by the solver
+    bool is_resting() const {
+        return is_sleeping || (is_static && !is_kinematic);
     }
 
-    SceneObject& operator=(SceneObject&& other) noexcept {
-        if (this != &other) {
-            mesh     = std::move(other.mesh);
-            vertices = std::move(other.vertices);
-            mesh.vertices = &vertices;
-        }
-        return *this;
+    void sleep() {
+        is_sleeping      = true;
+        velocity         = Real3(0.0);
+        angular_velocity = Real3(0.0);
     }
 
-    void init(const std::vector<Real3>& vs, const std::vector<GLuint>& indices) {
-        vertices = vs;
-        mesh     = TriangleMesh(&vertices, indices);
+    void wake() {
+        is_sleeping = false;
+        sleep_timer = 0.0;
     }
+};
+
+// Static geometry shown with the scene (slitta, pallet), not simulated. Drawn
+// by SceneObjectRenderer.
+struct SceneObject 
+{
+    std::vector<Real3>    vertices;
+    std::vector<uint32_t> indices; // 3 per triangle
+
+    SceneObject() = default;
+
+    SceneObject(const std::vector<Real3>& vs, const std::vector<uint32_t>& indices) 
+        : vertices(vs), indices(indices) {}
 
     void translate(const Real3& offset) {
         for (Real3 &v : vertices) {
             v += offset;
         }
     }
-
-    void draw() {
-        mesh.drawWireframe();
-    }
 };
 
 SceneObject load_scene_object_from_obj(const std::string& filename, Real scale_factor) {
@@ -410,7 +396,7 @@ SceneObject load_scene_object_from_obj(const std::string& filename, Real scale_f
     }
 
     std::vector<Real3> vertices;
-    std::vector<GLuint> indices;
+    std::vector<uint32_t> indices;
 
     std::string line;
     while (std::getline(file, line)) {
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#include "types.h"
+#include "rigid.cpp"
+
+// the x86 kernels work on SolverReal lanes: doubles, floats in float and mixed
+// builds (twice the lanes per register)
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    #define SAT_KERNEL_X86
+    #include <immintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+        #define SAT_TARGET_AVX2
+        #define SAT_TARGET_AVX512
+    #elif defined(__clang__)
+        #define SAT_TARGET_AVX2   __attribute__((target("avx2")))
+        #define SAT_TARGET_AVX512 __attribute__((target("avx512f")))
+    #else
+        // avx512f brings fma and gcc would fuse the mul/add pairs, the lanes
+        // must round like the scalar kernel
+        #define SAT_TARGET_AVX2   __attribute__((target("avx2"), optimize("fp-contract=off")))
+        #define SAT_TARGET_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+    #endif
+#endif
+
+// Separation-only SAT for two boxes in center + half-extent form: the
+// projection of a box on L is center.L +- sum_i h_i |n_i.L| with n_i its unit
+// axes and h_i its half sizes, so the 8 world vertices are not projected. The
+// 15 axes are stored in SoA lanes (16 with padding) and the kernels return the
+// index of the first separating axis, -1 if none, in the same order
+// SAT_box_box tests them.
+//
+// The lanes are SolverReal. The centers are taken relative to an origin (the
+// first box), so in mixed builds only the offset between the boxes is rounded
+// to float, as the solver does with RigidBodyStore::origin.
+//
+// The box is taken at position and orientation, the pose the solver left.
+// SAT_box_box projects world_vertices, refreshed at the prediction in
+// RigidBox::update, so for pairs within a step's motion of touching the two
+// can decide differently (sat_kernel = check counts them).
+struct SatBox
+{
+    SolverReal3                center;
+    std::array<SolverReal3, 3> normals;
+    SolverReal3                half; // half size along each normal
+};
+
+inline SatBox make_sat_box(const RigidBox &box, const Real3 &origin)
+{
+    const std::array<Real3, 3> &axes = box.get_frame().axes;
+    return {SolverReal3(box.position - origin), {SolverReal3(axes[0]), SolverReal3(axes[1]), SolverReal3(axes[2])}, SolverReal3(Real(0.5) * box.size)};
+}
+
+struct SatAxes
+{
+    alignas(64) SolverReal x[16];
+    alignas(64) SolverReal y[16];
+    alignas(64) SolverReal z[16];
+    // 0 for valid lanes, +inf for degenerate edge crosses and padding
+    alignas(64) SolverReal skip[16];
+};
+
+// the edges of SAT_box_box, v1 - v0, v3 - v0 and v4 - v0, run along the
+// body z, x and y axes
+static constexpr int SAT_EDGE_ORDER[3] = {2, 0, 1};
+
+inline void build_sat_axes(const SatBox &b1, const SatBox &b2, SatAxes &out)
+{
+    int count = 0;
+    auto push = [&](const SolverReal3 &axis, SolverReal skip)
+    {
+        out.x[count]    = axis.x;
+        out.y[count]    = axis.y;
+        out.z[count]    = axis.z;
+        out.skip[count] = skip;
+        count++;
+    };
+
+    for (const SolverReal3 &n : b1.normals) push(n, 0);
+    for (const SolverReal3 &n : b2.normals) push(n, 0);
+
+    // same edge order and degeneracy test (on the full edges) as SAT_box_box
+    for (int i : SAT_EDGE_ORDER)
+    {
+        for (int j : SAT_EDGE_ORDER)
+        {
+            SolverReal3 axis = glm::cross(SolverReal(2) * b1.half[i] * b1.normals[i], SolverReal(2) * b2.half[j] * b2.normals[j]);
+
+            if (glm::length(axis) < SolverReal(1e-6)) push(SolverReal3(0), std::numeric_limits<SolverReal>::infinity());
+            else                                      push(glm::normalize(axis), 0);
+        }
+    }
+
+    out.x[15] = out.y[15] = out.z[15] = 0;
+    out.skip[15] = std::numeric_limits<SolverReal>::infinity();
+}
+
+inline Real3 sat_axis(const SatAxes &axes, int ai)
+{
+    return Real3(axes.x[ai], axes.y[ai], axes.z[ai]);
+}
+
+// Returns the first lane whose overlap is below threshold, -1 if none. With
+// overlaps set, every lane is computed and stored there (the check mode
+// compares them bit for bit between kernels).
+using SatKernelFn = int (*)(const SatBox &, const SatBox &, const SatAxes &, SolverReal, SolverReal *);
+
+struct SatKernel
+{
+    SatKernelFn separating_axis = nullptr;
+    std::string name;
+};
+
+// Scalar fallback, every lane computed with the same operation order as the
+// SIMD kernels so that the overlaps are bit identical (as long as the compiler
+// does not contract the scalar expressions into FMAs).
+inline SolverReal sat_lane_overlap(const SatBox &b1, const SatBox &b2, const SatAxes &axes, const SolverReal3 &t, int ai)
+{
+    SolverReal lx = axes.x[ai], ly = axes.y[ai], lz = axes.z[ai];
+
+    auto radius = [&](const SatBox &b)
+    {
+        SolverReal d0 = b.half[0] * std::abs(lx * b.normals[0].x + ly * b.normals[0].y + lz * b.normals[0].z);
+        SolverReal d1 = b.half[1] * std::abs(lx * b.normals[1].x + ly * b.normals[1].y + lz * b.normals[1].z);
+        SolverReal d2 = b.half[2] * std::abs(lx * b.normals[2].x + ly * b.normals[2].y + lz * b.normals[2].z);
+        return (d0 + d1) + d2;
+    };
+
+    SolverReal dist = std::abs(lx * t.x + ly * t.y + lz * t.z);
+    return (radius(b1) + radius(b2)) - dist + axes.skip[ai];
+}
+
+int sat_separating_axis_scalar(const SatBox &b1, const SatBox &b2, const SatAxes &axes, SolverReal threshold, SolverReal *overlaps)
+{
+    SolverReal3 t = b2.center - b1.center;
+    for (int ai = 0; ai < 16; ai++)
+    {
+        SolverReal overlap = sat_lane_overlap(b1, b2, axes, t, ai);
+        if (overlaps) overlaps[ai] = overlap;
+        else if (overlap < threshold) return ai;
+    }
+    return -1;
+}
+
+#ifdef SAT_KERNEL_X86
+
+// SolverReal lanes of an AVX2 and an AVX-512 register: 4 and 8 doubles, or 8
+// and 16 floats. The operations the SAT and spring kernels use are overloaded
+// for the four register types, so each kernel is written once.
+#if defined(XPBD_FLOAT) || defined(XPBD_MIXED)
+using LanesAvx2   = __m256;
+using LanesAvx512 = __m512;
+#else
+using LanesAvx2   = __m256d;
+using LanesAvx512 = __m512d;
+#endif
+
+static constexpr int LANES_AVX2   = int(32 / sizeof(SolverReal));
+static constexpr int LANES_AVX512 = int(64 / sizeof(SolverReal));
+
+SAT_TARGET_AVX2 static inline __m256d avx2_load(const double *p)          { return _mm256_load_pd(p); }
+SAT_TARGET_AVX2 static inline __m256  avx2_load(const float *p)           { return _mm256_load_ps(p); }
+SAT_TARGET_AVX2 static inline void    avx2_store(double *p, __m256d v)    { _mm256_store_pd(p, v); }
+SAT_TARGET_AVX2 static inline void    avx2_store(float *p, __m256 v)      { _mm256_store_ps(p, v); }
+SAT_TARGET_AVX2 static inline void    avx2_storeu(double *p, __m256d v)   { _mm256_storeu_pd(p, v); }
+SAT_TARGET_AVX2 static inline void    avx2_storeu(float *p, __m256 v)     { _mm256_storeu_ps(p, v); }
+SAT_TARGET_AVX2 static inline __m256d avx2_set1(double x)                 { return _mm256_set1_pd(x); }
+SAT_TARGET_AVX2 static inline __m256  avx2_set1(float x)                  { return _mm256_set1_ps(x); }
+
+SAT_TARGET_AVX2 static inline __m256d lanes_add(__m256d a, __m256d b)     { return _mm256_add_pd(a, b); }
+SAT_TARGET_AVX2 static inline __m256  lanes_add(__m256 a, __m256 b)       { return _mm256_add_ps(a, b); }
+SAT_TARGET_AVX2 static inline __m256d lanes_sub(__m256d a, __m256d b)     { return _mm256_sub_pd(a, b); }
+SAT_TARGET_AVX2 static inline __m256  lanes_sub(__m256 a, __m256 b)       { return _mm256_sub_ps(a, b); }
+SAT_TARGET_AVX2 static inline __m256d lanes_mul(__m256d a, __m256d b)     { return _mm256_mul_pd(a, b); }
+SAT_TARGET_AVX2 static inline __m256  lanes_mul(__m256 a, __m256 b)       { return _mm256_mul_ps(a, b); }
+SAT_TARGET_AVX2 static inline __m256d lanes_div(__m256d a, __m256d b)     { return _mm256_div_pd(a, b); }
+SAT_TARGET_AVX2 static inline __m256  lanes_div(__m256 a, __m256 b)       { return _mm256_div_ps(a, b); }
+SAT_TARGET_AVX2 static inline __m256d lanes_sqrt(__m256d a)               { return _mm256_sqrt_pd(a); }
+SAT_TARGET_AVX2 static inline __m256  lanes_sqrt(__m256 a)                { return _mm256_sqrt_ps(a); }
+SAT_TARGET_AVX2 static inline __m256d lanes_and(__m256d a, __m256d b)     { return _mm256_and_pd(a, b); }
+SAT_TARGET_AVX2 static inline __m256  lanes_and(__m256 a, __m256 b)       { return _mm256_and_ps(a, b); }
+SAT_TARGET_AVX2 static inline __m256d lanes_abs(__m256d a)                { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a); }
+SAT_TARGET_AVX2 static inline __m256  lanes_abs(__m256 a)                 { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+// comparisons: all ones on the lanes where they hold, or one bit per lane
+SAT_TARGET_AVX2 static inline __m256d lanes_neq(__m256d a, __m256d b)     { return _mm256_cmp_pd(a, b, _CMP_NEQ_OQ); }
+SAT_TARGET_AVX2 static inline __m256  lanes_neq(__m256 a, __m256 b)       { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+SAT_TARGET_AVX2 static inline __m256d lanes_ge(__m256d a, __m256d b)      { return _mm256_cmp_pd(a, b, _CMP_GE_OQ); }
+SAT_TARGET_AVX2 static inline __m256  lanes_ge(__m256 a, __m256 b)        { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+SAT_TARGET_AVX2 static inline unsigned lanes_lt_mask(__m256d a, __m256d b) { return (unsigned)_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ)); }
+SAT_TARGET_AVX2 static inline unsigned lanes_lt_mask(__m256 a, __m256 b)   { return (unsigned)_mm256_movemask_ps(_mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+
+SAT_TARGET_AVX512 static inline __m512d avx512_load(const double *p)        { return _mm512_load_pd(p); }
+SAT_TARGET_AVX512 static inline __m512  avx512_load(const float *p)         { return _mm512_load_ps(p); }
+SAT_TARGET_AVX512 static inline void    avx512_storeu(double *p, __m512d v) { _mm512_storeu_pd(p, v); }
+SAT_TARGET_AVX512 static inline void    avx512_storeu(float *p, __m512 v)   { _mm512_storeu_ps(p, v); }
+SAT_TARGET_AVX512 static inline __m512d avx512_set1(double x)               { return _mm512_set1_pd(x); }
+SAT_TARGET_AVX512 static inline __m512  avx512_set1(float x)                { return _mm512_set1_ps(x); }
+
+SAT_TARGET_AVX512 static inline __m512d lanes_add(__m512d a, __m512d b)     { return _mm512_add_pd(a, b); }
+SAT_TARGET_AVX512 static inline __m512  lanes_add(__m512 a, __m512 b)       { return _mm512_add_ps(a, b); }
+SAT_TARGET_AVX512 static inline __m512d lanes_sub(__m512d a, __m512d b)     { return _mm512_sub_pd(a, b); }
+SAT_TARGET_AVX512 static inline __m512  lanes_sub(__m512 a, __m512 b)       { return _mm512_sub_ps(a, b); }
+SAT_TARGET_AVX512 static inline __m512d lanes_mul(__m512d a, __m512d b)     { return _mm512_mul_pd(a, b); }
+SAT_TARGET_AVX512 static inline __m512  lanes_mul(__m512 a, __m512 b)       { return _mm512_mul_ps(a, b); }
+SAT_TARGET_AVX512 static inline __m512d lanes_abs(__m512d a)                { return _mm512_abs_pd(a); }
+SAT_TARGET_AVX512 static inline __m512  lanes_abs(__m512 a)                 { return _mm512_abs_ps(a); }
+SAT_TARGET_AVX512 static inline unsigned lanes_lt_mask(__m512d a, __m512d b) { return (unsigned)_mm512_cmp_pd_mask(a, b, _CMP_LT_OQ); }
+SAT_TARGET_AVX512 static inline unsigned lanes_lt_mask(__m512 a, __m512 b)   { return (unsigned)_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+
+SAT_TARGET_AVX2
+static inline LanesAvx2 sat_dot_avx2(LanesAvx2 lx, LanesAvx2 ly, LanesAvx2 lz, const SolverReal3 &v)
+{
+    LanesAvx2 d = lanes_mul(lx, avx2_set1(v.x));
+    d = lanes_add(d, lanes_mul(ly, avx2_set1(v.y)));
+    d = lanes_add(d, lanes_mul(lz, avx2_set1(v.z)));
+    return d;
+}
+
+SAT_TARGET_AVX2
+static inline LanesAvx2 sat_radius_avx2(LanesAvx2 lx, LanesAvx2 ly, LanesAvx2 lz, const SatBox &b)
+{
+    LanesAvx2 r = lanes_mul(avx2_set1(b.half[0]), lanes_abs(sat_dot_avx2(lx, ly, lz, b.normals[0])));
+    r = lanes_add(r, lanes_mul(avx2_set1(b.half[1]), lanes_abs(sat_dot_avx2(lx, ly, lz, b.normals[1]))));
+    r = lanes_add(r, lanes_mul(avx2_set1(b.half[2]), lanes_abs(sat_dot_avx2(lx, ly, lz, b.normals[2]))));
+    return r;
+}
+
+SAT_TARGET_AVX2
+int sat_separating_axis_avx2(const SatBox &b1, const SatBox &b2, const SatAxes &axes, SolverReal threshold, SolverReal *overlaps)
+{
+    SolverReal3 t   = b2.center - b1.center;
+    LanesAvx2   thr = avx2_set1(threshold);
+
+    for (int ai = 0; ai < 16; ai += LANES_AVX2)
+    {
+        LanesAvx2 lx = avx2_load(axes.x + ai);
+        LanesAvx2 ly = avx2_load(axes.y + ai);
+        LanesAvx2 lz = avx2_load(axes.z + ai);
+
+        LanesAvx2 r       = lanes_add(sat_radius_avx2(lx, ly, lz, b1), sat_radius_avx2(lx, ly, lz, b2));
+        LanesAvx2 overlap = lanes_sub(r, lanes_abs(sat_dot_avx2(lx, ly, lz, t)));
+        overlap           = lanes_add(overlap, avx2_load(axes.skip + ai));
+
+        if (overlaps)
+        {
+            avx2_storeu(overlaps + ai, overlap);
+            continue;
+        }
+
+        unsigned mask = lanes_lt_mask(overlap, thr);
+        if (mask)
+        {
+            int lane = 0;
+            while (!(mask & (1u << lane))) lane++;
+            return ai + lane;
+        }
+    }
+    return -1;
+}
+
+SAT_TARGET_AVX512
+static inline LanesAvx512 sat_dot_avx512(LanesAvx512 lx, LanesAvx512 ly, LanesAvx512 lz, const SolverReal3 &v)
+{
+    LanesAvx512 d = lanes_mul(lx, avx512_set1(v.x));
+    d = lanes_add(d, lanes_mul(ly, avx512_set1(v.y)));
+    d = lanes_add(d, lanes_mul(lz, avx512_set1(v.z)));
+    return d;
+}
+
+SAT_TARGET_AVX512
+static inline LanesAvx512 sat_radius_avx512(LanesAvx512 lx, LanesAvx512 ly, LanesAvx512 lz, const SatBox &b)
+{
+    LanesAvx512 r = lanes_mul(avx512_set1(b.half[0]), lanes_abs(sat_dot_avx512(lx, ly, lz, b.normals[0])));
+    r = lanes_add(r, lanes_mul(avx512_set1(b.half[1]), lanes_abs(sat_dot_avx512(lx, ly, lz, b.normals[1]))));
+    r = lanes_add(r, lanes_mul(avx512_set1(b.half[2]), lanes_abs(sat_dot_avx512(lx, ly, lz, b.normals[2]))));
+    return r;
+}
+
+SAT_TARGET_AVX512
+int sat_separating_axis_avx512(const SatBox &b1, const SatBox &b2, const SatAxes &axes, SolverReal threshold, SolverReal *overlaps)
+{
+    SolverReal3 t   = b2.center - b1.center;
+    LanesAvx512 thr = avx512_set1(threshold);
+
+    for (int ai = 0; ai < 16; ai += LANES_AVX512)
+    {
+        LanesAvx512 lx = avx512_load(axes.x + ai);
+        LanesAvx512 ly = avx512_load(axes.y + ai);
+        LanesAvx512 lz = avx512_load(axes.z + ai);
+
+        LanesAvx512 r       = lanes_add(sat_radius_avx512(lx, ly, lz, b1), sat_radius_avx512(lx, ly, lz, b2));
+        LanesAvx512 overlap = lanes_sub(r, lanes_abs(sat_dot_avx512(lx, ly, lz, t)));
+        overlap             = lanes_add(overlap, avx512_load(axes.skip + ai));
+
+        if (overlaps)
+        {
+            avx512_storeu(overlaps + ai, overlap);
+            continue;
+        }
+
+        unsigned mask = lanes_lt_mask(overlap, thr);
+        if (mask)
+        {
+            int lane = 0;
+            while (!(mask & (1u << lane))) lane++;
+            return ai + lane;
+        }
+    }
+    return -1;
+}
+
+static bool cpu_supports_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx     = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool cpu_supports_avx512()
+{
+#if defined(_MSC_VER)
+    if (!cpu_supports_avx2()) return false;
+    if ((_xgetbv(0) & 0xe6) != 0xe6) return false; // opmask and zmm state enabled by the os
+    int info[4];
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+
+#endif // SAT_KERNEL_X86
+
+// the SIMD kernels this CPU runs, for the check mode
+std::vector<SatKernel> available_sat_kernels()
+{
+    std::vector<SatKernel> kernels;
+#ifdef SAT_KERNEL_X86
+    if (cpu_supports_avx2())   kernels.push_back({sat_separating_axis_avx2,   "avx2"});
+    if (cpu_supports_avx512()) kernels.push_back({sat_separating_axis_avx512, "avx512"});
+#endif
+    return kernels;
+}
+
+// mode: "auto", "scalar", "avx2" or "avx512". Falls back to the best supported
+// kernel when the requested one is not available.
+SatKernel select_sat_kernel([[maybe_unused]] const std::string &mode)
+{
+#ifdef SAT_KERNEL_X86
+    bool avx512 = cpu_supports_avx512();
+    bool avx2   = cpu_supports_avx2();
+
+    if (mode != "scalar")
+    {
+        if (avx512 && mode != "avx2") return {sat_separating_axis_avx512, "avx512"};
+        if (avx2)                     return {sat_separating_axis_avx2,   "avx2"};
+    }
+#endif
+    return {sat_separating_axis_scalar, "scalar"};
+}
@@ -3,22 +3,32 @@
 
 #include <map>
 #include <set>
+#include <type_traits>
 
 #include "object.cpp"
 #include "rigid.cpp"
 #include "cloth.cpp"
 #include "collision.cpp"
+#include "broadphase.cpp"
+#include "islands.cpp"
+#include "coloring.cpp"
+#include "jacobi.cpp"
+#include "body_store.cpp"
+#include "constraint_pools.cpp"
+#include "spring_kernel.cpp"
 
 struct Scene;
 
 struct Solver
 {
-    void solve(Edge &edge, Real delta_t) {
-        Real3 x1 = edge.obj->positions[edge.v1];
-        Real3 x2 = edge.obj->positions[edge.v2];
+    RigidBodyStore bodies; // rigid bodies seen by the rigid constraints, see XPBD_step
 
-        Real w1 = edge.obj->inv_masses[edge.v1];
-        Real w2 = edge.obj->inv_masses[edge.v2];
+    void solve(TetraObject &obj, Edge &edge, Real delta_t) {
+        Real3 x1 = obj.positions[edge.v1];
+        Real3 x2 = obj.positions[edge.v2];
+
+        Real w1 = obj.inv_masses[edge.v1];
+        Real w2 = obj.inv_masses[edge.v2];
         Real w  = w1 + w2;
 
         if (w == 0.0) return;
@@ -31,17 +41,17 @@ struct Solver
         Real d_lambda  = (-C - alpha*edge.lambda) / (w + alpha);
         edge.lambda += d_lambda;
 
-        edge.obj->positions[edge.v1] -= d_lambda * w1 * dC;
-        edge.obj->positions[edge.v2] += d_lambda * w2 * dC;
+        obj.positions[edge.v1] -= d_lambda * w1 * dC;
+        obj.positions[edge.v2] += d_lambda * w2 * dC;
     }
 
-    void solve(ClothEdge &edge, Real delta_t) 
+    void solve(Cloth &cloth, ClothEdge &edge, Real delta_t) 
     {
-        Real3 x1 = edge.cloth->positions[edge.v1];
-        Real3 x2 = edge.cloth->positions[edge.v2];
+        Real3 x1 = cloth.positions[edge.v1];
+        Real3 x2 = cloth.positions[edge.v2];
 
-        Real w1 = edge.cloth->inv_masses[edge.v1];
-        Real w2 = edge.cloth->inv_masses[edge.v2];
+        Real w1 = cloth.inv_masses[edge.v1];
+        Real w2 = cloth.inv_masses[edge.v2];
         Real w  = w1 + w2;
 
         if (w == 0.0) return;
@@ -54,13 +64,13 @@ struct Solver
         Real d_lambda  = (-C - alpha*edge.lambda) / (w + alpha);
         edge.lambda   += d_lambda;
 
-        edge.cloth->positions[edge.v1] -= d_lambda * w1 * dC;
-        edge.cloth->positions[edge.v2] += d_lambda * w2 * dC;
+        cloth.positions[edge.v1] -= d_lambda * w1 * dC;
+        cloth.positions[edge.v2] += d_lambda * w2 * dC;
     }
 
-    void solve(Tetrahedron &tetra, Real delta_t) 
+    void solve(TetraObject &obj, Tetrahedron &tetra, Real delta_t) 
     {
-        std::array<Real3, 4> positions = get_tetra_points(tetra.obj, tetra.vs);
+        std::array<Real3, 4> positions = get_tetra_points(obj.positions, tetra.vs);
         
         Real3 x0 = positions[0];
         Real3 x1 = positions[1];
@@ -79,7 +89,7 @@ struct Solver
         Real3 dC3 = -glm::cross(x1 - x0, x2 - x0);
 
         // Verifica che i gradienti siano consistenti con la normale
-        Real3 center = (x0 + x1 + x2 + x3) / 4.0;
+        Real3 center = (x0 + x1 + x2 + x3) / Real(4.0);
 
         Real3 to_center = center - positions[0];
         if (glm::dot(dC0, to_center) < 0) dC0 = -dC0;
@@ -94,10 +104,10 @@ struct Solver
         if (glm::dot(dC3, to_center) < 0) dC3 = -dC3;
 
         // Pesi (inverse masses)
-        Real w0 = tetra.obj->inv_masses[tetra.vs[0]];
-        Real w1 = tetra.obj->inv_masses[tetra.vs[1]];
-        Real w2 = tetra.obj->inv_masses[tetra.vs[2]];
-        Real w3 = tetra.obj->inv_masses[tetra.vs[3]];
+        Real w0 = obj.inv_masses[tetra.vs[0]];
+        Real w1 = obj.inv_masses[tetra.vs[1]];
+        Real w2 = obj.inv_masses[tetra.vs[2]];
+        Real w3 = obj.inv_masses[tetra.vs[3]];
 
         // Somma pesata dei gradienti
         Real w_sum = w0 * glm::dot(dC0, dC0) + w1 * glm::dot(dC1, dC1) + w2 * glm::dot(dC2, dC2) + w3 * glm::dot(dC3, dC3);
@@ -112,18 +122,21 @@ struct Solver
         tetra.lambda += d_lambda;
 
         // Applica correzioni
-        if (w0 > 0.0) tetra.obj->positions[tetra.vs[0]] += - d_lambda * w0 * dC0;
-        if (w1 > 0.0) tetra.obj->positions[tetra.vs[1]] += - d_lambda * w1 * dC1;
-        if (w2 > 0.0) tetra.obj->positions[tetra.vs[2]] += - d_lambda * w2 * dC2;
-        if (w3 > 0.0) tetra.obj->positions[tetra.vs[3]] += - d_lambda * w3 * dC3;
+        if (w0 > 0.0) obj.positions[tetra.vs[0]] += - d_lambda * w0 * dC0;
+        if (w1 > 0.0) obj.positions[tetra.vs[1]] += - d_lambda * w1 * dC1;
+        if (w2 > 0.0) obj.positions[tetra.vs[2]] += - d_lambda * w2 * dC2;
+        if (w3 > 0.0) obj.positions[tetra.vs[3]] += - d_lambda * w3 * dC3;
     }
 
-    void solve(SpringConstraint &constraint, Real delta_t) {
-        Real3 x1 = constraint.obj1->positions[constraint.v1];
-        Real3 x2 = constraint.obj2->positions[constraint.v2];
+    void solve(std::vector<TetraObject> &objects, SpringConstraint &constraint, Real delta_t) {
+        TetraObject &obj1 = objects[constraint.o1];
+        TetraObject &obj2 = objects[constraint.o2];
+
+        Real3 x1 = obj1.positions[constraint.v1];
+        Real3 x2 = obj2.positions[constraint.v2];
 
-        Real w1 = constraint.obj1->inv_masses[constraint.v1];
-        Real w2 = constraint.obj2->inv_masses[constraint.v2];
+        Real w1 = obj1.inv_masses[constraint.v1];
+        Real w2 = obj2.inv_masses[constraint.v2];
         Real w  = w1 + w2;
 
         if (w == 0.0) return;
@@ -139,19 +152,19 @@ struct Solver
         Real d_lambda      = (-C -alpha*constraint.lambda) / (w + alpha);
         constraint.lambda += d_lambda;
 
-        constraint.obj1->positions[constraint.v1] -= d_lambda * w1 * dC;
-        constraint.obj2->positions[constraint.v2] += d_lambda * w2 * dC;
+        obj1.positions[constraint.v1] -= d_lambda * w1 * dC;
+        obj2.positions[constraint.v2] += d_lambda * w2 * dC;
     }
 
-    void solve(CollisionConstraint &constraint, Real delta_t) {
+    void solve(TetraObject &obj, CollisionConstraint &constraint, Real delta_t) {
 
         if (!constraint.active) return;
 
-        Real3 x      = constraint.obj->positions[constraint.v];
-        Real3 old_x  = constraint.obj->old_positions[constraint.v];
+        Real3 x      = obj.positions[constraint.v];
+        Real3 old_x  = obj.old_positions[constraint.v];
         Real3 x_goal = constraint.goal_position;
 
-        Real w = constraint.obj->inv_masses[constraint.v];
+        Real w = obj.inv_masses[constraint.v];
 
         if (w == 0.0) return;
 
@@ -166,121 +179,159 @@ struct Solver
         Real d_lambda      = (-C - alpha*constraint.lambda) / (w + alpha);
         constraint.lambda += d_lambda;
 
-        constraint.obj->positions[constraint.v] += d_lambda * w * dC;
+        obj.positions[constraint.v] += d_lambda * w * dC;
     }
 
 
-    void applyPositionCorrection(RigidBox* body, const Real3& r, const Real3& nw, Real d_lambda, Real sign)
+    // with deferred set the correction is stored there instead of applied (Jacobi)
+    void applyPositionCorrection(Index bi, const SolverReal3& r, const SolverReal3& nw, SolverReal d_lambda, SolverReal sign, BodyDelta *deferred = nullptr)
     {
-        if (body->is_static) return;
+        if (!bodies.movable[bi]) return;
+
+        SolverQuat &orientation = bodies.orientation[bi];
+
+        SolverReal3 nb = world_to_body(nw, bodies.rotation_of(bi));
+
+        SolverReal3 pw =  sign * d_lambda * nw;
+        SolverReal3 pb = -sign * d_lambda * nb;
 
-        Real3 nb = world_to_body(nw, body->orientation);
+        SolverReal3 dp = pw / bodies.mass[bi];
 
-        Real3 pw =  sign * d_lambda * nw;
-        Real3 pb = -sign * d_lambda * nb;
+        SolverReal3 tau    = glm::cross(r, pb);
+        SolverReal3 domega = bodies.inv_inertia[bi] * tau;
+        SolverQuat omega_q(domega.x, domega.y, domega.z, 0);
 
-        body->position += pw / body->mass;
+        SolverQuat dq = SolverReal(0.5) * quat_multiplication(omega_q, orientation);
 
-        Real3 tau    = glm::cross(r, pb);
-        Real3 domega = body->inv_inertia_tensor * tau;
-        Quat omega_q(domega.x, domega.y, domega.z, 0);
+        if (deferred) 
+        {
+            *deferred = {dp, dq, 1.0};
+            return;
+        }
 
-        body->orientation += 0.5 * quat_multiplication(omega_q, body->orientation);
-        body->orientation  = glm::normalize(body->orientation);
+        bodies.position[bi] += dp;
+        orientation         += dq;
+        orientation          = glm::normalize(orientation);
+        bodies.mark_moved(bi);
     }
 
-    void solve(FixedRigidSpringConstraint &constraint, Real delta_t) 
+    // the rigid constraints work on the solver precision copy in bodies, world
+    // space constraint data goes through bodies.to_local / to_world
+
+    void solve(FixedRigidSpringConstraint &constraint, Real delta_t, BodyDelta *deferred = nullptr) 
     {
-        RigidBox *box  = constraint.box;
-        Real3 rb       = constraint.body_attach;
-        Real3 rw       = body_to_world(constraint.body_attach, box->position, box->orientation);
-        Real3 d        = constraint.world_attach - rw;
+        Index bi       = constraint.box;
+        SolverReal3 rb = SolverReal3(constraint.body_attach);
+        const SolverReal3x3 &R = bodies.rotation_of(bi);
+        SolverReal3 rw = body_to_world(rb, bodies.position[bi], R);
+        SolverReal3 d  = bodies.to_local(constraint.world_attach) - rw;
 
-        Real C   = glm::length(d) - constraint.rest_length;
-        Real3 nw = glm::normalize(d);
+        SolverReal C   = glm::length(d) - SolverReal(constraint.rest_length);
+        SolverReal3 nw = glm::normalize(d);
 
-        Real3 nb = world_to_body(nw, Real3(0.0), box->orientation);
+        SolverReal3 nb = world_to_body(nw, SolverReal3(0.0), R);
 
-        Real w = box->generalized_inverse_mass(constraint.body_attach, nb);
+        SolverReal w = bodies.generalized_inverse_mass(bi, rb, nb);
 
-        Real alpha  = constraint.compliance / delta_t / delta_t;
+        SolverReal alpha = SolverReal(constraint.compliance / delta_t / delta_t);
 
-        Real d_lambda      = (-C -alpha*constraint.lambda) / (w + alpha);
-        constraint.lambda += d_lambda;
+        SolverReal d_lambda = (-C -alpha*SolverReal(constraint.lambda)) / (w + alpha);
+        constraint.lambda  += d_lambda;
 
-        applyPositionCorrection(box, rb, nw, d_lambda, -1.0);
+        applyPositionCorrection(bi, rb, nw, d_lambda, -1.0, deferred);
     }
 
-    void solve(RigidSpringConstraint &constraint, Real delta_t) 
+    void solve(RigidSpringConstraint &constraint, Real delta_t, BodyDelta *deferred = nullptr) 
     {
         if (constraint.active == false) return;
 
-        RigidBox *b1 = constraint.b1;
-        RigidBox *b2 = constraint.b2;
+        Index b1 = constraint.i1;
+        Index b2 = constraint.i2;
 
         if (b1 == b2) return;
 
-        Real3 r1 = constraint.r1;
-        Real3 r2 = constraint.r2;
+        SolverReal3 r1 = SolverReal3(constraint.r1);
+        SolverReal3 r2 = SolverReal3(constraint.r2);
+
+        const SolverReal3x3 &R1 = bodies.rotation_of(b1);
+        const SolverReal3x3 &R2 = bodies.rotation_of(b2);
 
-        Real3 p1 = body_to_world(r1, b1->position, b1->orientation);
-        Real3 p2 = body_to_world(r2, b2->position, b2->orientation);
+        SolverReal3 p1 = body_to_world(r1, bodies.position[b1], R1);
+        SolverReal3 p2 = body_to_world(r2, bodies.position[b2], R2);
 
-        Real3 d = p2 - p1;
-        Real C  = glm::length(d) - constraint.rest_length;
+        SolverReal3 d = p2 - p1;
+        SolverReal C  = glm::length(d) - SolverReal(constraint.rest_length);
 
         if (C < 1e-6) return;
 
-        Real3 nw = glm::normalize(d);
-        Real3 nb1 = world_to_body(nw, Real3(0.0), b1->orientation);
-        Real3 nb2 = world_to_body(nw, Real3(0.0), b2->orientation);
+        SolverReal3 nw  = glm::normalize(d);
+        SolverReal3 nb1 = world_to_body(nw, SolverReal3(0.0), R1);
+        SolverReal3 nb2 = world_to_body(nw, SolverReal3(0.0), R2);
 
-        Real w1 = b1->generalized_inverse_mass(r1, nb1);
-        Real w2 = b2->generalized_inverse_mass(r2, nb2);
+        SolverReal w1 = bodies.generalized_inverse_mass(b1, r1, nb1);
+        SolverReal w2 = bodies.generalized_inverse_mass(b2, r2, nb2);
 
-        Real alpha = constraint.compliance / delta_t / delta_t;
+        SolverReal alpha = SolverReal(constraint.compliance / delta_t / delta_t);
 
-        Real d_lambda      = (-C -alpha*constraint.lambda) / (w1 + w2 + alpha);
-        constraint.lambda += d_lambda;
+        SolverReal d_lambda = (-C -alpha*SolverReal(constraint.lambda)) / (w1 + w2 + alpha);
+        constraint.lambda  += d_lambda;
 
-        applyPositionCorrection(b1, r1, nw, d_lambda, -1.0);
-        applyPositionCorrection(b2, r2, nw, d_lambda,  1.0);
+        applyPositionCorrection(b1, r1, nw, d_lambda, -1.0, deferred);
+        applyPositionCorrection(b2, r2, nw, d_lambda,  1.0, deferred ? deferred + 1 : nullptr);
     }
 
-    void solve(RigidCollisionConstraint &constraint, Real delta_t) 
+    void solve(RigidCollisionConstraint &constraint, Real delta_t, BodyDelta *deferred = nullptr) 
     {
-        RigidBox *b1 = constraint.b1;
-        RigidBox *b2 = constraint.b2;
+        Index b1 = constraint.i1;
+        Index b2 = constraint.i2;
 
-        Real3 p1 = constraint.p1;
-        Real3 p2 = constraint.p2;
+        const SolverReal3x3 &R1 = bodies.rotation_of(b1);
+        const SolverReal3x3 &R2 = bodies.rotation_of(b2);
 
-        Real3 r1 = world_to_body(p1, b1->position, b1->orientation);
-        Real3 r2 = world_to_body(p2, b2->position, b2->orientation);
+        SolverReal3 p1, p2, r1, r2;
 
-        constraint.r1 = r1;
-        constraint.r2 = r2;
+        if (constraint.tracked) 
+        {
+            r1 = SolverReal3(constraint.r1);
+            r2 = SolverReal3(constraint.r2);
+            p1 = body_to_world(r1, bodies.position[b1], R1);
+            p2 = body_to_world(r2, bodies.position[b2], R2);
+            constraint.p1 = bodies.to_world(p1);
+            constraint.p2 = bodies.to_world(p2);
+        }
+        else 
+        {
+            p1 = bodies.to_local(constraint.p1);
+            p2 = bodies.to_local(constraint.p2);
+            r1 = world_to_body(p1, bodies.position[b1], R1);
+            r2 = world_to_body(p2, bodies.position[b2], R2);
+            constraint.r1 = Real3(r1);
+            constraint.r2 = Real3(r2);
+        }
 
-        Real3 nw = constraint.n;
+        SolverReal3 nw = SolverReal3(constraint.n);
 
-        Real np1 = glm::dot(p1, nw);
-        Real np2 = glm::dot(p2, nw);
-        Real dnp = np2 - np1;
+        // dnp only depends on p2 - p1, so it is the same on origin relative points
+        SolverReal np1 = glm::dot(p1, nw);
+        SolverReal np2 = glm::dot(p2, nw);
+        SolverReal dnp = np2 - np1;
 
-        Real C = constraint.d - dnp;
+        // tracked contacts store d = depth - dnp at detection, the depth then 
+        // decreases as the anchors move apart along n
+        SolverReal C = constraint.tracked ? SolverReal(constraint.d) + dnp : SolverReal(constraint.d) - dnp;
 
         if (C <= 0.0) return;
 
-        Real w1 = b1->generalized_inverse_mass(r1, world_to_body(nw, Real3(0.0), b1->orientation));
-        Real w2 = b2->generalized_inverse_mass(r2, world_to_body(nw, Real3(0.0), b2->orientation));
+        SolverReal w1 = bodies.generalized_inverse_mass(b1, r1, world_to_body(nw, SolverReal3(0.0), R1));
+        SolverReal w2 = bodies.generalized_inverse_mass(b2, r2, world_to_body(nw, SolverReal3(0.0), R2));
 
-        Real alpha = constraint.compliance / delta_t / delta_t;
+        SolverReal alpha = SolverReal(constraint.compliance / delta_t / delta_t);
 
-        Real d_lambda = (-C -alpha*constraint.lambda) / (w1 + w2 + alpha);
-        constraint.lambda += d_lambda;
+        SolverReal d_lambda = (-C -alpha*SolverReal(constraint.lambda)) / (w1 + w2 + alpha);
+        constraint.lambda  += d_lambda;
 
-        applyPositionCorrection(b1, r1, nw, d_lambda, -1.0);
-        applyPositionCorrection(b2, r2, nw, d_lambda,  1.0);
+        applyPositionCorrection(b1, r1, nw, d_lambda, -1.0, deferred);
+        applyPositionCorrection(b2, r2, nw, d_lambda,  1.0, deferred ? deferred + 1 : nullptr);
     }
 };
 
@@ -288,10 +339,10 @@ struct Solver
 // EXPORTING DATA
 // =====================================================
 
-Real getLength(const RigidSpringConstraint &constraint)
+Real getLength(const std::vector<RigidBox> &bodies, const RigidSpringConstraint &constraint)
 {
-    const RigidBox *b1 = constraint.b1;
-    const RigidBox *b2 = constraint.b2;
+    const RigidBox *b1 = &bodies[constraint.i1];
+    const RigidBox *b2 = &bodies[constraint.i2];
 
     if (b1 == b2) return 0.0;
 
@@ -304,30 +355,178 @@ Real getLength(const RigidSpringConstraint &constraint)
     return dist;
 }
 
+// rigid constraints by type, in the order the serial solver visits them
+using RigidConstraintPools = ConstraintPools<FixedRigidSpringConstraint, RigidSpringConstraint, RigidCollisionConstraint>;
+
+static_assert(std::is_trivially_copyable<RigidBox>::value,                   "RigidBox is copied in bulk by snapshots");
+static_assert(std::is_trivially_copyable<FixedRigidSpringConstraint>::value, "rigid constraints are copied in bulk by snapshots");
+static_assert(std::is_trivially_copyable<RigidSpringConstraint>::value,      "rigid constraints are copied in bulk by snapshots");
+static_assert(std::is_trivially_copyable<RigidCollisionConstraint>::value,   "rigid constraints are copied in bulk by snapshots");
+
+// The state advanced by XPBD_step. Objects and constraints refer to each other
+// by index, so a snapshot is a copy of each vector (a single memmove for the
+// trivially copyable rigid ones) and stays valid in any Scene. What the step
+// derives from it (body sets, broadphase, colorings, islands) is not saved,
+// Scene::restore invalidates it.
+struct SceneSnapshot
+{
+    std::vector<RigidBox>         rigid_objects;
+    RigidConstraintPools          rigid_pools;
+    std::vector<TetraObject>      objects;
+    std::vector<SpringConstraint> constraints;
+    std::vector<Cloth>            cloths;
+    int collision_substep = 0;
+};
+
 struct Scene 
 {
     std::vector<TetraObject>      objects;
     std::vector<RigidBox>         rigid_objects;
     std::vector<SpringConstraint> constraints;
-    std::vector<FixedRigidSpringConstraint> fixed_rigid_constraints;
-    std::vector<RigidSpringConstraint> rigid_constraints;
     std::vector<SceneObject> scene_objects;
     std::vector<Cloth> cloths;
     Solver solver;
 
+    SweepAndPrune         broadphase;
+    StaticBVH             static_bvh;
+    std::vector<AABB>     rigid_aabbs;
+    std::vector<BodyPair> rigid_pairs;
+    std::vector<CachedPair> pair_cache;
+    bool rigid_pairs_valid = false; // rigid_pairs built from rigid_aabbs, reusable while no fat box is left
+
+    std::vector<Index> dynamic_bodies;
+    std::vector<Index> kinematic_bodies;
+    std::vector<Index> static_bodies;
+    std::vector<Index> moving_bodies; // dynamic + kinematic, in scene order
+    bool body_sets_dirty = true;
+
+    // contacts are kept across steps for collision_substeps > 1
+    RigidConstraintPools rigid_pools;
+
+    int collision_substep = 0;
+
+    UnionFind islands;
+    std::vector<SolverIsland> solver_islands; // first num_islands are in use
+    std::vector<Index>        island_index;   // union-find root -> solver island
+    Index     num_islands     = 0;
+    Index     sleeping_bodies = 0;
+
+    // colorings for solver_mode "colored": fixed springs and springs are kept
+    // until constraints are added (a torn spring is skipped by the solver, so
+    // the coloring stays valid), contacts are recolored at every detection
+    ConstraintColoring fixed_colors;
+    ConstraintColoring spring_colors;
+    ConstraintColoring contact_colors;
+
+    JacobiBuffers jacobi; // solver_mode "jacobi"
+
+    SpringBatches spring_batches; // colored springs solved by the spring kernel
+
     Scene() = default;
 
-    void clear() {
+    std::vector<FixedRigidSpringConstraint>& fixed_rigid_constraints() { return rigid_pools.get<FixedRigidSpringConstraint>(); }
+    std::vector<RigidSpringConstraint>&      rigid_constraints()       { return rigid_pools.get<RigidSpringConstraint>(); }
+    std::vector<RigidCollisionConstraint>&   rigid_contacts()          { return rigid_pools.get<RigidCollisionConstraint>(); }
 
-        for (auto & obj : rigid_objects) obj.clear();
+    const std::vector<FixedRigidSpringConstraint>& fixed_rigid_constraints() const { return rigid_pools.get<FixedRigidSpringConstraint>(); }
+    const std::vector<RigidSpringConstraint>&      rigid_constraints()       const { return rigid_pools.get<RigidSpringConstraint>(); }
+    const std::vector<RigidCollisionConstraint>&   rigid_contacts()          const { return rigid_pools.get<RigidCollisionConstraint>(); }
+
+    void clear() {
 
         objects.clear();
         rigid_objects.clear();
         constraints.clear();
-        fixed_rigid_constraints.clear();
-        rigid_constraints.clear();
+        rigid_pools.clear();
         scene_objects.clear();
         cloths.clear();
+        broadphase.clear();
+        static_bvh.clear();
+        rigid_aabbs.clear();
+        rigid_pairs_valid = false;
+        rigid_pairs.clear();
+        pair_cache.clear();
+        body_sets_dirty = true;
+        collision_substep = 0;
+        sleeping_bodies   = 0;
+        num_islands       = 0;
+        fixed_colors.clear();
+        spring_colors.clear();
+        contact_colors.clear();
+        jacobi.clear();
+        spring_batches.clear();
+    }
+
+    void snapshot(SceneSnapshot &state) const 
+    {
+        state.rigid_objects     = rigid_objects;
+        state.rigid_pools       = rigid_pools;
+        state.objects           = objects;
+        state.constraints       = constraints;
+        state.cloths            = cloths;
+        state.collision_substep = collision_substep;
+    }
+
+    // The scene objects are not part of the state, they are kept as they are.
+    void restore(const SceneSnapshot &state) 
+    {
+        rigid_objects     = state.rigid_objects;
+        rigid_pools       = state.rigid_pools;
+        objects           = state.objects;
+        constraints       = state.constraints;
+        cloths            = state.cloths;
+        collision_substep = state.collision_substep;
+
+        body_sets_dirty = true;
+        broadphase.clear();
+        rigid_aabbs.clear();
+        rigid_pairs_valid = false;
+        rigid_pairs.clear();
+        pair_cache.clear();
+        sleeping_bodies = 0;
+        num_islands     = 0;
+        fixed_colors.clear();
+        spring_colors.clear();
+        contact_colors.clear();
+        jacobi.clear();
+        spring_batches.clear();
+    }
+
+    void build_body_sets() 
+    {
+        dynamic_bodies.clear();
+        kinematic_bodies.clear();
+        static_bodies.clear();
+        moving_bodies.clear();
+
+        std::vector<AABB> static_aabbs;
+
+        for (Index i = 0; i < rigid_objects.size(); i++) 
+        {
+            const RigidBox &box = rigid_objects[i];
+
+            if (!box.is_static) 
+            {
+                dynamic_bodies.push_back(i);
+                moving_bodies.push_back(i);
+            }
+            else if (box.is_kinematic) 
+            {
+                kinematic_bodies.push_back(i);
+                moving_bodies.push_back(i);
+            }
+            else 
+            {
+                static_bodies.push_back(i);
+                static_aabbs.push_back(box.aabb);
+            }
+        }
+
+        static_bvh.build(static_aabbs, static_bodies);
+        broadphase.clear();
+        rigid_aabbs.clear();
+        rigid_pairs_valid = false;
+        body_sets_dirty = false;
     }
 
     void addCloth(Cloth &cloth) {
@@ -342,6 +541,10 @@ struct Scene
         scene_objects.push_back(std::move(obj)); 
     }
 
+    void addSceneObject(SceneObject&& obj) { 
+        scene_objects.push_back(std::move(obj)); 
+    }
+
     void addObject(TetraObject& obj) { 
         objects.push_back(std::move(obj)); 
     }
@@ -352,32 +555,41 @@ struct Scene
 
     void addRigidObject(RigidBox& obj) { 
         rigid_objects.push_back(std::move(obj)); 
+        body_sets_dirty = true;
     }
 
     void addRigidObject(RigidBox&& obj) { 
         rigid_objects.push_back(std::move(obj)); 
+        body_sets_dirty = true;
     }
 
     void addConstraint(SpringConstraint& constraint) { 
         constraints.push_back(std::move(constraint)); 
     }
 
-    void addRigidConstraint(FixedRigidSpringConstraint& constraint) { 
-        fixed_rigid_constraints.push_back(std::move(constraint)); 
+    void addRigidConstraint(const FixedRigidSpringConstraint& constraint) { 
+        fixed_rigid_constraints().push_back(constraint); 
+        fixed_colors.valid = false;
     }
 
-    void addRigidConstraint(RigidSpringConstraint& constraint) { 
-        rigid_constraints.push_back(std::move(constraint)); 
+    void addRigidConstraint(const RigidSpringConstraint& constraint) { 
+        rigid_constraints().push_back(constraint); 
+        spring_colors.valid = false;
     }
 
     void removeAllRigidConstraints() {
-        rigid_constraints.clear();
+        rigid_constraints().clear();
+        spring_colors.valid = false;
     }
 
     void removeAllConstraints() {
         constraints.clear();
     }
 
+    Real3 bodyToWorld(Index bi, const Real3 &p_body) const {
+        return body_to_world(p_body, rigid_objects[bi].position, rigid_objects[bi].orientation);
+    }
+
     Real3 center() {
         if (objects.empty()) return Real3(0.0);
 
@@ -386,7 +598,7 @@ struct Scene
             scene_aabb.min = glm::min(scene_aabb.min, objects[oi].aabb.min);
             scene_aabb.max = glm::max(scene_aabb.max, objects[oi].aabb.max);
         }
-        return (scene_aabb.min + scene_aabb.max) * 0.5;
+        return (scene_aabb.min + scene_aabb.max) * Real(0.5);
     }
 
     TetraObject& getObject(size_t index) {
@@ -404,222 +616,6 @@ struct Scene
     }
 };
 
-void export_scene_to_obj(Scene &scene, uint64_t frame, Real scale_factor, Real3 offset = Real3(0.0), std::string prefix = "")
-{
-    auto export_object_output = [&](const std::string& object_type) -> std::ofstream 
-    {
-        std::ostringstream oss;
-        oss << "..\\..\\animation\\" << object_type << "_" << std::setw(4) << std::setfill('0') << frame << ".obj";
-
-        std::string filename = oss.str();
-        std::ofstream out(filename);
-
-        if (!out.is_open()) std::cerr << "Errore: impossibile scrivere il file " << filename << "\n";
-
-        return out;
-    };
-
-    auto box_out = export_object_output(prefix + "Boxs");
-
-    int global_vertex_offset = 0; 
-    std::vector<RigidBox> &boxes = scene.rigid_objects;
-
-    static constexpr std::array<std::array<int, 4>, 6> cube_quads = {{
-        {{3, 2, 1, 0}}, // -Y
-        {{4, 5, 6, 7}}, // +Y
-        {{0, 4, 7, 3}}, // -X
-        {{1, 2, 6, 5}}, // +X
-        {{0, 1, 5, 4}}, // +Z
-        {{2, 3, 7, 6}}  // -Z
-    }};
-
-    auto rigidBoxToObj = [&](const RigidBox &box, const std::string& name, int vertex_offset) 
-    {
-        box_out << "g " << name << "\n";
-
-        for (const auto& v : box.world_vertices) 
-        {
-            Real3 scaled_pos = (v + offset) / scale_factor;
-            box_out << "v " << scaled_pos.x << " " 
-                            << scaled_pos.y << " " 
-                            << scaled_pos.z << "\n";
-        }
-
-        for (const auto& quad : cube_quads) 
-        {
-            box_out << "f " 
-                    << (quad[0] + 1 + vertex_offset) << " "
-                    << (quad[1] + 1 + vertex_offset) << " "
-                    << (quad[2] + 1 + vertex_offset) << " "
-                    << (quad[3] + 1 + vertex_offset) << "\n";
-        }
-    };
-
-    for (size_t i = 0; i < boxes.size()-1; ++i) 
-    {
-        std::string name = "Box_" + std::to_string(i);
-        rigidBoxToObj(boxes[i], name, global_vertex_offset);
-        global_vertex_offset += 8;
-    }
-
-    box_out.close();
-}
-
-void export_wrap_displacement_to_obj(Scene &scene, uint64_t frame, Real max_displacement_perc, Real scale_factor = 1.0, Real3 offset = Real3(0.0), const std::string& prefix = "")
-{
-    if (scene.rigid_objects.empty()) 
-    {
-        std::cerr << "Error: no rigid objects in scene\n";
-        return;
-    }
-
-    auto create_export_file = [&](const std::string& object_type) -> std::ofstream 
-    {
-        std::ostringstream oss;
-        oss << "..\\..\\animation\\" << object_type << "_" << std::setw(4) << std::setfill('0') << frame << ".obj";
-        
-        std::ofstream out(oss.str());
-        if (!out.is_open()) { std::cerr << "Error: cannot write file " << oss.str() << "\n"; }
-        return out;
-    };
-
-    std::ofstream pallet_out = create_export_file(prefix + "Wrap");
-    if (!pallet_out.is_open()) return;
-
-    pallet_out << "# Wrapped Pallet Export - Frame " << frame << "\n";
-    pallet_out << "o " << prefix << "Wrap\n";
-
-    struct ConstraintData 
-    {
-        size_t p1, p2;
-        Real displacement;
-        Real perc;
-        bool active;
-    };
-
-    std::vector<Real3>          points;
-    std::vector<ConstraintData> constraint_data;
-
-    constraint_data.reserve(scene.rigid_constraints.size());
-    points.reserve(scene.rigid_constraints.size()*2);
-
-    for (const auto& cons : scene.rigid_constraints) 
-    {
-        if (!cons.active) continue;
-
-        Real3 p1 = body_to_world(cons.r1, cons.b1->position, cons.b1->orientation);
-        Real3 p2 = body_to_world(cons.r2, cons.b2->position, cons.b2->orientation);
-        Real curr_length = glm::length(p2 - p1);
-        Real diff = curr_length - cons.rest_length;
-        Real perc = diff / cons.rest_length;
-
-        points.push_back(p1); points.push_back(p2);
-
-        constraint_data.push_back({points.size()-2, points.size()-1, diff, perc, true});
-    }
-
-    for (const auto& cons_data : constraint_data) 
-    {
-        if (cons_data.active == false) continue;
-
-        Real3 scaled_p1 = (points[cons_data.p1] + offset) / scale_factor;
-        Real3 scaled_p2 = (points[cons_data.p2] + offset) / scale_factor;
-
-        Real t = glm::clamp(cons_data.perc, 0.0, max_displacement_perc);
-        t = t / max_displacement_perc;
-
-        Real r = t;
-        Real g = 1.0 - t;
-        Real b = 0.0;
-
-        pallet_out << "v " << (float) scaled_p1.x << " " 
-                           << (float) scaled_p1.y << " " 
-                           << (float) scaled_p1.z << " "
-                           << (float) r << " " 
-                           << (float) g << " " 
-                           << (float) b << "\n";
-
-        pallet_out << "v " << (float) scaled_p2.x << " " 
-                           << (float) scaled_p2.y << " " 
-                           << (float) scaled_p2.z << " "
-                           << (float) r << " " 
-                           << (float) g << " " 
-                           << (float) b << "\n";
-    }
-
-    for (const auto& cons_data : constraint_data) 
-        pallet_out << "l " 
-                   << (cons_data.p1 + 1) << " " 
-                   << (cons_data.p2 + 1) << "\n";
-
-    pallet_out.close();
-}
-
-void export_wrap_to_obj(Scene &scene, uint64_t frame, Real scale_factor = 1.0, Real3 offset = Real3(0.0), const std::string& prefix = "")
-{
-    auto create_export_file = [&](const std::string& object_type) -> std::ofstream 
-    {
-        std::ostringstream oss;
-        oss << "..\\..\\animation\\" << object_type << "_" << std::setw(4) << std::setfill('0') << frame << ".obj";
-        
-        std::ofstream out(oss.str());
-        if (!out.is_open()) { std::cerr << "Error: cannot write file " << oss.str() << "\n"; }
-        return out;
-    };
-
-    std::ofstream pallet_out = create_export_file(prefix + "Wrap");
-    if (!pallet_out.is_open()) return;
-
-    pallet_out << "# Wrapped Pallet Export - Frame " << frame << "\n";
-    pallet_out << "o " << prefix << "Wrap\n";
-
-    std::vector<Real3> unique_points;
-    std::vector<std::pair<int, int>> constraint_lines;
-
-    unique_points.reserve(scene.rigid_constraints.size() * 2);
-    constraint_lines.reserve(scene.rigid_constraints.size());
-
-    auto find_or_add_point = [&](const Real3& pos) -> int 
-    {
-        constexpr Real tolerance_sq = 1e-12; 
-
-        for (size_t i = 0; i < unique_points.size(); ++i) 
-        {
-            Real3 diff = unique_points[i] - pos;
-            if (glm::dot(diff, diff) < tolerance_sq) return static_cast<int>(i);
-        }
-        
-        unique_points.push_back(pos);
-        return static_cast<int>(unique_points.size() - 1);
-    };
-
-    for (const auto& cons : scene.rigid_constraints) 
-    {
-        if (!cons.active) continue;
-        
-        Real3 p1 = body_to_world(cons.r1, cons.b1->position, cons.b1->orientation);
-        Real3 p2 = body_to_world(cons.r2, cons.b2->position, cons.b2->orientation);
-
-        int idx1 = find_or_add_point(p1);
-        int idx2 = find_or_add_point(p2);
-        
-        constraint_lines.push_back({idx1, idx2});
-    }
-
-    for (const auto& point : unique_points) 
-    {
-        Real3 scaled_pos = (point + offset) / scale_factor;
-        pallet_out << "v " << scaled_pos.x << " " 
-                           << scaled_pos.y << " " 
-                           << scaled_pos.z << "\n";
-    }
-
-    for (const auto& [idx1, idx2] : constraint_lines)
-        pallet_out << "l " << (idx1 + 1) << " " << (idx2 + 1) << "\n";
-
-    pallet_out.close();
-}
-
 // ======= EXTRA  =======
 
 void export_cloth_to_obj(Scene &scene, uint64_t frame, Real scale_factor = 1.0)
@@ -656,11 +652,11 @@ void export_cloth_to_obj(Scene &scene, uint64_t frame, Real scale_factor = 1.0)
                          << v.z  / scale_factor << "\n";
     }
 
-    for (size_t f = 0; f < cloth.mesh.triangleIndices.size(); f += 3) {
+    for (size_t f = 0; f < cloth.triangles.size(); f += 3) {
         cloth_out << "f "
-                  << (cloth.mesh.triangleIndices[f]     + 1) << " "
-                  << (cloth.mesh.triangleIndices[f + 1] + 1) << " "
-                  << (cloth.mesh.triangleIndices[f + 2] + 1) << "\n";
+                  << (cloth.triangles[f]     + 1) << " "
+                  << (cloth.triangles[f + 1] + 1) << " "
+                  << (cloth.triangles[f + 2] + 1) << "\n";
     }
 
     cloth_out.close();
@@ -786,7 +782,7 @@ void export_tetra_surface_with_normals(Scene &scene, uint64_t frame, uint32_t su
         Real3 x2 = tetra_obj.positions[surface_face[1]];
         Real3 x3 = tetra_obj.positions[surface_face[2]];
 
-        Real3 face_center = (x1 + x2 + x3) / 3.0;
+        Real3 face_center = (x1 + x2 + x3) / Real(3.0);
         Real3 to_center   = face_center - center;
         Real3 normal      = glm::cross((x2-x1), (x3-x1));
 
@@ -1043,8 +1039,8 @@ void export_two_rigid_bodies_to_obj(Scene &scene, uint64_t frame, Real scale_fac
     }
 
     // Punti di connessione del vincolo
-    if (!scene.rigid_constraints.empty()) {
-        RigidSpringConstraint &constraint = scene.rigid_constraints[0];
+    if (!scene.rigid_constraints().empty()) {
+        RigidSpringConstraint &constraint = scene.rigid_constraints()[0];
         
         // Calcola le posizioni mondiali dei punti di attacco
         Real3 world_point1 = body_to_world(constraint.r1, rigid_box1.position, rigid_box1.orientation);
@@ -1124,8 +1120,8 @@ void export_falling_rigid_to_obj(Scene &scene, uint64_t frame, Real scale_factor
 
     // Punto di ancoraggio (world anchor point)
     // Per trovare il punto di ancoraggio, dobbiamo accedere al vincolo
-    if (!scene.fixed_rigid_constraints.empty()) {
-        FixedRigidSpringConstraint &constraint = scene.fixed_rigid_constraints[0];
+    if (!scene.fixed_rigid_constraints().empty()) {
+        FixedRigidSpringConstraint &constraint = scene.fixed_rigid_constraints()[0];
         
         rigid_out << "o AnchorPoint\n";
         rigid_out << "v " << constraint.world_attach.x / scale_factor << " "
@@ -0,0 +1,338 @@
+#pragma once
+
+#include <map>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <filesystem>
+#include <type_traits>
+#include <thread>
+#include <random>
+#include <system_error>
+
+#include "types.h"
+#include "scene.cpp"
+#include "settings.cpp"
+
+// Settings that decide the topology of the pallet scene: which boxes are
+// loaded and which springs the wrap generates. Scenes built with the same key
+// differ only in the compliances, set again by apply_scene_compliances.
+std::string scene_topology_key(const Settings &settings)
+{
+    std::ostringstream oss;
+    oss.precision(17);
+    oss << settings.schema_folder << ';' << settings.scale_factor << ';'
+        << settings.wrap_type     << ';' << settings.wrap_steps     << ';' << settings.wrap_param     << ';'
+        << settings.wrap_type_sec << ';' << settings.wrap_steps_sec << ';' << settings.wrap_param_sec << ';'
+        << settings.wrap_seed;
+    return oss.str();
+}
+
+// The random and random_length wraps without a wrap_seed draw new springs at
+// every build: a cached scene would keep the first draw for every reset.
+bool scene_is_cacheable(const Settings &settings)
+{
+    auto drawn = [](const std::string &type) { return type == RANDOM || type == RANDOM_LENGTH; };
+    return settings.wrap_seed != 0 || !(drawn(settings.wrap_type) || drawn(settings.wrap_type_sec));
+}
+
+// Path, size and modification time of every file in paths (directories are
+// walked), to go in the key with the settings: a scene built from a schema or
+// an asset that changed since is not reused. Missing paths add nothing,
+// prepare_scene reports them.
+std::string source_files_key(const std::vector<std::string> &paths)
+{
+    namespace fs = std::filesystem;
+
+    std::vector<fs::path> files;
+    for (const std::string &path : paths)
+    {
+        std::error_code ec;
+        if (fs::is_directory(path, ec))
+        {
+            for (fs::recursive_directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec))
+                if (it->is_regular_file(ec)) files.push_back(it->path());
+        }
+        else if (fs::is_regular_file(path, ec)) files.push_back(path);
+    }
+    std::sort(files.begin(), files.end()); // directory order is unspecified
+
+    std::ostringstream oss;
+    for (const fs::path &file : files)
+    {
+        std::error_code ec;
+        uintmax_t size  = fs::file_size(file, ec);
+        auto      mtime = fs::last_write_time(file, ec).time_since_epoch().count();
+        oss << ';' << file.generic_string() << ':' << size << ':' << mtime;
+    }
+    return oss.str();
+}
+
+void apply_scene_compliances(Scene &scene, const Settings &settings)
+{
+    for (RigidSpringConstraint &c : scene.rigid_constraints())            c.compliance = settings.wrap_compliance;
+    for (FixedRigidSpringConstraint &c : scene.fixed_rigid_constraints()) c.compliance = settings.base_attach_compliance;
+}
+
+// What prepare_scene produces: the initial state, the static scene objects and
+// the stack measures used by the data collection.
+struct BuiltScene
+{
+    SceneSnapshot            state;
+    std::vector<SceneObject> scene_objects;
+    AABB stack_aabb;
+    int  last_layer_indexes[2] = {0, 0};
+
+    void save(const Scene &scene)
+    {
+        scene.snapshot(state);
+        scene_objects = scene.scene_objects;
+    }
+
+    void load(Scene &scene, const Settings &settings) const
+    {
+        scene.restore(state);
+        scene.scene_objects = scene_objects;
+        apply_scene_compliances(scene, settings);
+    }
+};
+
+// Built scenes by topology key, kept in memory and, when directory is set, in
+// one binary file per key so they survive the program.
+//
+// File layout: the header, the key, then every array as a 64 bit count and
+// the raw elements starting at a multiple of 64 bytes, so a file can be
+// mapped and the arrays used in place. The header records sizeof(Real) and
+// the element sizes: files written by a build with other types are rebuilt.
+// Only scenes without deformable objects and cloths are written.
+struct SceneCache
+{
+    static constexpr char     MAGIC[8] = {'X', 'P', 'B', 'D', 'S', 'C', 'N', '\0'};
+    static constexpr uint32_t VERSION  = 1;
+    static constexpr size_t   ALIGN    = 64;
+
+    struct Header
+    {
+        char     magic[8];
+        uint32_t version;
+        uint32_t real_size;
+        uint32_t body_size;
+        uint32_t fixed_spring_size;
+        uint32_t spring_size;
+        uint32_t contact_size;
+        uint32_t key_size;
+        int32_t  collision_substep;
+        int32_t  last_layer_indexes[2];
+        AABB     stack_aabb;
+    };
+
+    std::map<std::string, BuiltScene> entries;
+    std::string directory; // "" keeps the scenes in memory only
+
+    const BuiltScene* find(const std::string &key)
+    {
+        auto it = entries.find(key);
+        if (it != entries.end()) return &it->second;
+
+        BuiltScene built;
+        if (directory.empty() || !read_file(file_path(key), key, built)) return nullptr;
+
+        return &(entries[key] = std::move(built));
+    }
+
+    const BuiltScene& store(const std::string &key, BuiltScene &&built)
+    {
+        BuiltScene &entry = entries[key] = std::move(built);
+
+        if (!directory.empty() && entry.state.objects.empty() && entry.state.cloths.empty())
+        {
+            std::error_code ec;
+            std::filesystem::create_directories(directory, ec);
+            if (!write_file(file_path(key), key, entry))
+                std::cerr << "Scene cache: cannot write " << file_path(key) << "\n";
+        }
+
+        return entry;
+    }
+
+    std::string file_path(const std::string &key) const
+    {
+        std::ostringstream oss;
+        oss << "scene_" << std::hex << std::setw(16) << std::setfill('0') << (uint64_t)std::hash<std::string>{}(key) << ".bin";
+        return (std::filesystem::path(directory) / oss.str()).string();
+    }
+
+private:
+
+    static Header make_header(const std::string &key)
+    {
+        Header header = {};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version           = VERSION;
+        header.real_size         = sizeof(Real);
+        header.body_size         = sizeof(RigidBox);
+        header.fixed_spring_size = sizeof(FixedRigidSpringConstraint);
+        header.spring_size       = sizeof(RigidSpringConstraint);
+        header.contact_size      = sizeof(RigidCollisionConstraint);
+        header.key_size          = (uint32_t)key.size();
+        return header;
+    }
+
+    static void pad(std::ostream &out)
+    {
+        static const char zeros[ALIGN] = {};
+        size_t offset = (size_t)out.tellp();
+        if (offset % ALIGN) out.write(zeros, ALIGN - offset % ALIGN);
+    }
+
+    static void skip_pad(std::istream &in)
+    {
+        size_t offset = (size_t)in.tellg();
+        if (offset % ALIGN) in.seekg(ALIGN - offset % ALIGN, std::ios::cur);
+    }
+
+    template <typename T>
+    static void write_array(std::ostream &out, const std::vector<T> &v)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached arrays are written as raw bytes");
+
+        uint64_t count = v.size();
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        pad(out);
+        out.write(reinterpret_cast<const char*>(v.data()), count * sizeof(T));
+    }
+
+    // one read of the whole array, then a copy into v (T needs no default constructor)
+    template <typename T>
+    static bool read_array(std::istream &in, size_t file_size, std::vector<T> &v)
+    {
+        uint64_t count = 0;
+        if (!in.read(reinterpret_cast<char*>(&count), sizeof(count))) return false;
+        skip_pad(in);
+
+        size_t offset = (size_t)in.tellg();
+        if (count > (file_size - std::min(offset, file_size)) / sizeof(T)) return false;
+
+        std::vector<T> items;
+        if (count > 0)
+        {
+            std::vector<std::aligned_storage_t<sizeof(T), alignof(T)>> raw(count);
+            if (!in.read(reinterpret_cast<char*>(raw.data()), count * sizeof(T))) return false;
+
+            const T *first = reinterpret_cast<const T*>(raw.data());
+            items.assign(first, first + count);
+        }
+
+        v = std::move(items);
+        return true;
+    }
+
+    // Sweep threads and queue processes share the directory: the file is
+    // written under a name of its own and renamed in place, a reader sees the
+    // old file or the whole new one.
+    static bool write_file(const std::string &path, const std::string &key, const BuiltScene &built)
+    {
+        std::string temporary = temporary_path(path);
+        bool written = write_contents(temporary, key, built);
+
+        std::error_code ec;
+        if (written) std::filesystem::rename(temporary, path, ec);
+        if (!written || ec) std::filesystem::remove(temporary, ec);
+
+        return written && !ec;
+    }
+
+    // <path>.tmp.<token>-<thread>, the token drawn once per process
+    static std::string temporary_path(const std::string &path)
+    {
+        static const uint64_t token = ((uint64_t)std::random_device{}() << 32) ^ std::random_device{}();
+
+        std::ostringstream oss;
+        oss << path << ".tmp." << std::hex << token << "-" << std::hash<std::thread::id>{}(std::this_thread::get_id());
+        return oss.str();
+    }
+
+    static bool write_contents(const std::string &path, const std::string &key, const BuiltScene &built)
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) return false;
+
+        Header header = make_header(key);
+        header.collision_substep     = built.state.collision_substep;
+        header.last_layer_indexes[0] = built.last_layer_indexes[0];
+        header.last_layer_indexes[1] = built.last_layer_indexes[1];
+        header.stack_aabb            = built.stack_aabb;
+
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(key.data(), key.size());
+
+        write_array(out, built.state.rigid_objects);
+        write_array(out, built.state.rigid_pools.get<FixedRigidSpringConstraint>());
+        write_array(out, built.state.rigid_pools.get<RigidSpringConstraint>());
+        write_array(out, built.state.rigid_pools.get<RigidCollisionConstraint>());
+
+        uint64_t num_scene_objects = built.scene_objects.size();
+        out.write(reinterpret_cast<const char*>(&num_scene_objects), sizeof(num_scene_objects));
+        for (const SceneObject &obj : built.scene_objects)
+        {
+            write_array(out, obj.vertices);
+            write_array(out, obj.indices);
+        }
+
+        out.close();
+        return (bool)out;
+    }
+
+    static bool read_file(const std::string &path, const std::string &key, BuiltScene &built)
+    {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open()) return false;
+
+        size_t file_size = (size_t)in.tellg();
+        in.seekg(0);
+
+        Header header, expected = make_header(key);
+        if (!in.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+
+        if (std::memcmp(header.magic, expected.magic, sizeof(MAGIC)) != 0 ||
+            header.version           != expected.version           ||
+            header.real_size         != expected.real_size         ||
+            header.body_size         != expected.body_size         ||
+            header.fixed_spring_size != expected.fixed_spring_size ||
+            header.spring_size       != expected.spring_size       ||
+            header.contact_size      != expected.contact_size      ||
+            header.key_size          != expected.key_size) return false;
+
+        std::string file_key(header.key_size, '\0');
+        if (!in.read(&file_key[0], file_key.size()) || file_key != key) return false;
+
+        built.state.collision_substep = header.collision_substep;
+        built.last_layer_indexes[0]   = header.last_layer_indexes[0];
+        built.last_layer_indexes[1]   = header.last_layer_indexes[1];
+        built.stack_aabb              = header.stack_aabb;
+
+        if (!read_array(in, file_size, built.state.rigid_objects) ||
+            !read_array(in, file_size, built.state.rigid_pools.get<FixedRigidSpringConstraint>()) ||
+            !read_array(in, file_size, built.state.rigid_pools.get<RigidSpringConstraint>()) ||
+            !read_array(in, file_size, built.state.rigid_pools.get<RigidCollisionConstraint>())) return false;
+
+        uint64_t num_scene_objects = 0;
+        if (!in.read(reinterpret_cast<char*>(&num_scene_objects), sizeof(num_scene_objects))) return false;
+        if (num_scene_objects > file_size) return false;
+
+        built.scene_objects.resize(num_scene_objects);
+        for (SceneObject &obj : built.scene_objects)
+        {
+            if (!read_array(in, file_size, obj.vertices) || !read_array(in, file_size, obj.indices)) return false;
+        }
+
+        return true;
+    }
+};
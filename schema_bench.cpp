@@ -0,0 +1,184 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+#include "XMLparser.cpp"
+
+// Times the two readers of XMLparser.cpp on synthetic layer files of growing
+// size: XMLParser, a tree of XMLNode walked with find_first per record as the
+// schema loaders did, against XMLCursor over a MappedFile as
+// read_pallet_schema does. Both must read the same records.
+//
+//   XPBDSchemaBench [-o dir] [-r runs] [records ...]
+//
+//   -o  directory of the generated layer files, default the temporary
+//       directory, the files are removed at the end
+//   -r  timed runs per reader and file, the fastest is printed, default 3
+//
+// records are the PalSchema_SPDisposalClass entries of each file, default
+// 1000 100000 1000000.
+
+namespace fs = std::filesystem;
+
+struct LayerRecord
+{
+    int  x;
+    int  y;
+    bool rotation;
+
+    bool operator==(const LayerRecord& other) const { return x == other.x && y == other.y && rotation == other.rotation; }
+};
+
+// A layer file as written by the palletizing software (see palleting_data),
+// with records spread over a 1200 x 1000 mm pallet
+void write_layer_file(const std::string& path, size_t records)
+{
+    std::ofstream out(path, std::ios::out | std::ios::trunc);
+    if (!out.is_open()) throw std::runtime_error("cannot write " + path);
+
+    out << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n"
+        << "<LayerClass xmlns:xsi=\"http://www.w3.org/2001/XMLSchema-instance\" xmlns:xsd=\"http://www.w3.org/2001/XMLSchema\">\n"
+        << "  <Header>Layer</Header>\n"
+        << "  <Name>Synthetic</Name>\n"
+        << "  <Packs>" << records << "</Packs>\n"
+        << "  <SPDisposal>\n";
+
+    for (size_t i = 0; i < records; i++)
+    {
+        out << "    <PalSchema_SPDisposalClass>\n"
+            << "      <_x>" << (i * 37) % 1200 << "</_x>\n"
+            << "      <_y>" << (i * 53) % 1000 << "</_y>\n"
+            << "      <_rotation>" << (i % 3 == 0 ? "true" : "false") << "</_rotation>\n"
+            << "    </PalSchema_SPDisposalClass>\n";
+    }
+
+    out << "  </SPDisposal>\n"
+        << "</LayerClass>\n";
+
+    if (!out) throw std::runtime_error("cannot write " + path);
+}
+
+std::vector<LayerRecord> read_with_tree(const std::string& path)
+{
+    XMLParser parser(path);
+    XMLNode   layer = parser.parse();
+
+    std::vector<LayerRecord> records;
+    for (XMLNode& record : layer["LayerClass"][0]["SPDisposal"][0]["PalSchema_SPDisposalClass"])
+    {
+        records.push_back({record.find_first("_x")->int_value,
+                           record.find_first("_y")->int_value,
+                           record.find_first("_rotation")->value == "true"});
+    }
+    return records;
+}
+
+std::vector<LayerRecord> read_with_cursor(const std::string& path)
+{
+    MappedFile file(path);
+    XMLCursor  cursor(file.view());
+
+    std::vector<LayerRecord> records;
+    while (cursor.find("PalSchema_SPDisposalClass"))
+    {
+        LayerRecord record = {0, 0, false};
+
+        int depth = cursor.depth();
+        while (cursor.next_child(depth))
+        {
+            if      (cursor.name() == "_x")        record.x        = cursor.int_text();
+            else if (cursor.name() == "_y")        record.y        = cursor.int_text();
+            else if (cursor.name() == "_rotation") record.rotation = cursor.element_text() == "true";
+        }
+
+        records.push_back(record);
+    }
+    return records;
+}
+
+// fastest of runs calls, in ms; records gets the result of the last one
+template <typename Reader>
+double best_time(Reader read, const std::string& path, int runs, std::vector<LayerRecord>& records)
+{
+    double best = 0.0;
+    for (int r = 0; r < runs; r++)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        records    = read(path);
+        double ms  = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        if (r == 0 || ms < best) best = ms;
+    }
+    return best;
+}
+
+int main(int argc, char** argv)
+{
+    auto usage = []() { std::cerr << "usage: XPBDSchemaBench [-o dir] [-r runs] [records ...]\n"; };
+
+    std::string         directory = fs::temp_directory_path().string();
+    int                 runs      = 3;
+    std::vector<size_t> sizes;
+
+    for (int ai = 1; ai < argc; ai++)
+    {
+        std::string arg = argv[ai];
+        if (arg[0] != '-')
+        {
+            long long records = std::atoll(arg.c_str());
+            if (records <= 0) { usage(); return 1; }
+            sizes.push_back((size_t)records);
+            continue;
+        }
+
+        if (ai + 1 >= argc) { usage(); return 1; }
+        std::string value = argv[++ai];
+
+        if      (arg == "-o") directory = value;
+        else if (arg == "-r") runs      = std::max(1, std::atoi(value.c_str()));
+        else { usage(); return 1; }
+    }
+
+    if (sizes.empty()) sizes = {1000, 100000, 1000000};
+
+    printf("%7s  %9s  %19s  %9s  %9s\n", "records", "file", "tree + find_first", "cursor", "speedup");
+
+    bool same = true;
+    for (size_t records : sizes)
+    {
+        std::string path = (fs::path(directory) / ("xpbd_layer_" + std::to_string(records) + ".layer")).string();
+
+        std::vector<LayerRecord> tree_records, cursor_records;
+        double tree_ms = 0.0, cursor_ms = 0.0;
+        uintmax_t bytes = 0;
+        try
+        {
+            write_layer_file(path, records);
+            bytes     = fs::file_size(path);
+            tree_ms   = best_time(read_with_tree,   path, runs, tree_records);
+            cursor_ms = best_time(read_with_cursor, path, runs, cursor_records);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            std::error_code ec;
+            fs::remove(path, ec);
+            return 1;
+        }
+
+        std::error_code ec;
+        fs::remove(path, ec);
+
+        bool equal = tree_records.size() == records && tree_records == cursor_records;
+        same = same && equal;
+
+        printf("%7zu  %6.1f MB  %16.2f ms  %6.2f ms  %8.1fx%s\n", records, bytes / 1e6, tree_ms, cursor_ms,
+               cursor_ms > 0.0 ? tree_ms / cursor_ms : 0.0, equal ? "" : "  (records differ)");
+    }
+
+    return same ? 0 : 1;
+}
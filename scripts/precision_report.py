@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+"""Accuracy of the float and mixed builds against the double build.
+
+Runs XPBDPalletHeadless of each precision (XPBD_PRECISION) on every schema
+in palleting_data with the same settings, then compares the tilt (angles,
+degrees) and displacement (displacements, m) curves of the top layer with
+the double run of the same schema:
+
+    cmake -S . -B build/double -DXPBD_VIEWER=OFF -DCMAKE_BUILD_TYPE=Release
+    cmake -S . -B build/float  -DXPBD_VIEWER=OFF -DCMAKE_BUILD_TYPE=Release -DXPBD_PRECISION=float
+    cmake -S . -B build/mixed  -DXPBD_VIEWER=OFF -DCMAKE_BUILD_TYPE=Release -DXPBD_PRECISION=mixed
+    (cmake --build build/<precision> for each)
+
+    python3 scripts/precision_report.py -C build/Release -o precision_runs \\
+        -b double=build/double/XPBDPalletHeadless \\
+        -b float=build/float/XPBDPalletHeadless \\
+        -b mixed=build/mixed/XPBDPalletHeadless \\
+        -b "colored=build/double/XPBDPalletHeadless solver_mode=colored"
+
+Each -b is label=binary, optionally followed by settings of that build
+only. The last one above is the double build in solver_mode colored: its
+difference from double is the divergence a change of constraint order alone
+causes, a scale for the precision differences. -C is the working directory
+of the runs, as for the headless runner (the data paths are
+../../palleting_data from it), and name=value arguments go to every run.
+
+Each run writes <out>/<label>/<schema>.py; with --compare-only the existing
+files are compared without running anything. For every schema and build
+the table gives the largest, the RMS and the final difference from the
+double curve. The curves of all builds go to <out>/curves/<schema>.csv
+(and a .png with --plot, when matplotlib is installed).
+"""
+
+import argparse
+import ast
+import csv
+import math
+import os
+import subprocess
+import sys
+from concurrent.futures import ThreadPoolExecutor
+
+CURVES = [("angles", "tilt", "deg", 1.0), ("displacements", "disp", "mm", 1000.0)]
+
+
+def read_data_file(path):
+    """The lists of a data file written with data_format = python."""
+    values = {}
+    with open(path) as f:
+        for line in f:
+            name, sep, rest = line.partition("=")
+            if not sep or line.startswith("#"):
+                continue
+            try:
+                values[name.strip()] = ast.literal_eval(rest.strip())
+            except (ValueError, SyntaxError):
+                pass
+    return values
+
+
+def run(build, workdir, config, settings, schema, output):
+    os.makedirs(os.path.dirname(output), exist_ok=True)
+    binary, *build_settings = build.split()
+    command = [os.path.abspath(binary), "-o", os.path.abspath(output)]
+    if workdir:
+        command += ["-C", workdir]
+    if config:
+        command += ["-c", config]
+    command += settings + build_settings + ["schema_folder=" + schema]
+
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, text=True)
+    state = next((line.split()[1] for line in result.stdout.splitlines() if line.startswith("state ")), "-")
+    return result.returncode, state, result.stdout
+
+
+def differences(reference, other):
+    """max |d|, RMS and final d over the common samples."""
+    n = min(len(reference), len(other))
+    if n == 0:
+        return None
+    d = [other[i] - reference[i] for i in range(n)]
+    return max(abs(x) for x in d), math.sqrt(sum(x * x for x in d) / n), d[-1]
+
+
+def write_curves(path, schema, runs, plot):
+    labels = list(runs)
+    times = runs[labels[0]].get("times", [])
+    with open(path, "w", newline="") as f:
+        writer = csv.writer(f)
+        writer.writerow(["time"] + [f"{p}_{label}" for name, label, _, _ in CURVES for p in labels])
+        for i, t in enumerate(times):
+            row = [t]
+            for name, _, _, _ in CURVES:
+                for p in labels:
+                    series = runs[p].get(name, [])
+                    row.append(series[i] if i < len(series) else "")
+            writer.writerow(row)
+
+    if not plot:
+        return
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("--plot: matplotlib not installed", file=sys.stderr)
+        return
+
+    figure, axes = plt.subplots(len(CURVES), 1, sharex=True, figsize=(8, 6))
+    for axis, (name, label, unit, scale) in zip(axes, CURVES):
+        for p in labels:
+            series = runs[p].get(name, [])
+            axis.plot(times[:len(series)], [v * scale for v in series], label=p)
+        axis.set_ylabel(f"{label} [{unit}]")
+        axis.legend()
+    axes[-1].set_xlabel("time [s]")
+    figure.suptitle(schema)
+    figure.savefig(os.path.splitext(path)[0] + ".png", dpi=100)
+    plt.close(figure)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Tilt and displacement of the reduced precision builds against double.")
+    parser.add_argument("-b", dest="builds", action="append", default=[], metavar="LABEL=BINARY [SETTINGS]",
+                        help="a build to run, with settings of its own after the binary")
+    parser.add_argument("-C", dest="workdir", default="", help="working directory of the runs")
+    parser.add_argument("-c", dest="config", default="", help="configuration file of the runs")
+    parser.add_argument("-o", dest="out", default="precision_runs", help="directory of the data files and curves")
+    parser.add_argument("-j", dest="jobs", type=int, default=os.cpu_count() or 1, help="runs at the same time")
+    parser.add_argument("--schemas", default="all", help="comma separated schema folders, default every folder in palleting_data")
+    parser.add_argument("--reference", default="double", help="label of the build the others are compared with")
+    parser.add_argument("--compare-only", action="store_true", help="compare the existing data files, run nothing")
+    parser.add_argument("--plot", action="store_true", help="also plot the curves of each schema (matplotlib)")
+    parser.add_argument("settings", nargs="*", help="name=value settings of every run")
+    options = parser.parse_args()
+
+    builds = {}
+    for build in options.builds:
+        label, sep, command = build.partition("=")
+        if not sep or not command.strip():
+            parser.error(f"-b {build}: expected label=binary")
+        builds[label] = command
+    settings = options.settings
+
+    if options.reference not in builds or len(builds) < 2:
+        parser.error(f"give -b {options.reference}=<binary> and at least one other build")
+
+    if options.schemas == "all":
+        data_root = os.path.join(options.workdir or ".", "..", "..", "palleting_data")
+        schemas = sorted(d for d in os.listdir(data_root) if os.path.isdir(os.path.join(data_root, d)))
+    else:
+        schemas = [s for s in options.schemas.split(",") if s]
+
+    def output(label, schema):
+        return os.path.join(options.out, label, schema + ".py")
+
+    if not options.compare_only:
+        jobs = [(p, s) for s in schemas for p in builds]
+        with ThreadPoolExecutor(max_workers=max(1, options.jobs)) as pool:
+            results = pool.map(lambda job: (job, run(builds[job[0]], options.workdir, options.config, settings, job[1], output(*job))), jobs)
+            for (label, schema), (code, state, log) in results:
+                print(f"{label:>7} {schema}: state {state}" + ("" if code == 0 else f", failed ({code})"), file=sys.stderr)
+                if code != 0:
+                    print(log, file=sys.stderr)
+
+    others = [p for p in builds if p != options.reference]
+    os.makedirs(os.path.join(options.out, "curves"), exist_ok=True)
+
+    header = f"{'schema':<28} {'build':>7}"
+    for _, label, unit, _ in CURVES:
+        header += f"  {label + ' max':>10} {'rms':>8} {'final':>9} [{unit}]"
+    print(header)
+
+    summary = {p: {label: [] for _, label, _, _ in CURVES} for p in others}
+    for schema in schemas:
+        runs = {}
+        for p in builds:
+            path = output(p, schema)
+            if os.path.exists(path):
+                runs[p] = read_data_file(path)
+        if options.reference not in runs:
+            print(f"{schema:<28} no {options.reference} data")
+            continue
+
+        write_curves(os.path.join(options.out, "curves", schema + ".csv"), schema, runs, options.plot)
+
+        for p in others:
+            if p not in runs:
+                print(f"{schema:<28} {p:>7}  no data")
+                continue
+            line = f"{schema:<28} {p:>7}"
+            for name, label, unit, scale in CURVES:
+                d = differences(runs[options.reference].get(name, []), runs[p].get(name, []))
+                if d is None:
+                    line += f"  {'-':>10} {'-':>8} {'-':>9}  " + " " * len(unit)
+                    continue
+                peak, rms, final = (v * scale for v in d)
+                summary[p][label].append(peak)
+                line += f"  {peak:>10.4f} {rms:>8.4f} {final:>+9.4f}  " + " " * len(unit)
+            print(line.rstrip())
+
+    print()
+    for p in others:
+        for _, label, unit, _ in CURVES:
+            peaks = sorted(summary[p][label])
+            if not peaks:
+                continue
+            print(f"{p:>7} {label}: largest difference over {len(peaks)} schemas, median {peaks[len(peaks) // 2]:.4f} {unit}, max {peaks[-1]:.4f} {unit}")
+
+
+if __name__ == "__main__":
+    main()
@@ -2,9 +2,14 @@
 
 #include "types.h"
 #include <fstream>
+#include <iostream>
+#include <type_traits>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include <vector>
+#include <stdexcept>
+#include <initializer_list>
 
 using string = std::string;
 
@@ -49,6 +54,7 @@ WRAP_MODES
     X(Real,   wrap_param_sec,             0.0)       \
     X(string, wrap_type,                  GRID)      \
     X(string, wrap_type_sec,              NONE)      \
+    X(int,    wrap_seed,                  0)         \
     X(string, schema_folder,              "schema1") \
     X(bool,   look_at_stack_center,       false)     \
     X(Real,   camera_xoff,                -0.3)      \
@@ -62,6 +68,11 @@ WRAP_MODES
     X(Real,   still_time,                 1.0)       \
     X(string, prefix,                     "")        \
     X(bool,   export_obj,                 false)     \
+    X(int,    export_obj_threads,         2)         \
+    X(int,    export_obj_queue,           8)         \
+    X(string, export_format,              "obj")     \
+    X(Real,   anim_quantum,               0.0)       \
+    X(bool,   anim_delta,                 false)     \
     X(bool,   collect_data,               false)     \
     X(bool,   apply_tearing,              false)     \
     X(bool,   render_tearing,             false)     \
@@ -72,39 +83,70 @@ WRAP_MODES
     X(int,    video_fps,                  24*3)      \
     X(int,    xpbd_steps_x_second,        1000)      \
     X(int,    xpbd_iters_x_step,             1)      \
+    X(bool,   sap_broadphase,             true)      \
+    X(Real,   fat_aabb_margin,            0.02)      \
+    X(string, sat_kernel,                 "auto")    \
+    X(int,    manifold_max_points,        4)         \
+    X(int,    collision_substeps,         1)         \
+    X(Real,   speculative_margin,         0.0005)    \
+    X(bool,   enable_sleeping,            false)     \
+    X(Real,   sleep_linear_velocity,      0.1)       \
+    X(Real,   sleep_angular_velocity,     0.2)       \
+    X(Real,   sleep_time,                 0.2)       \
+    X(Real,   wake_force,                 500.0)     \
+    X(int,    solver_threads,             1)         \
+    X(string, solver_mode,                "islands") \
+    X(Real,   jacobi_relaxation,          1.0)       \
+    X(string, spring_kernel,              "auto")    \
+    X(int,    spring_kernel_benchmark,    0)         \
+    X(string, scene_cache_dir,            "")        \
+    X(string, data_format,                "python")  \
+    X(bool,   data_compress,              false)     \
+    X(int,    data_rate,                  50)        \
+    X(int,    data_rate_springs,          0)         \
+    X(int,    data_rate_bodies,           0)         \
+    X(bool,   data_stream,                false)     \
+    X(int,    data_stream_buffer,         4096)      \
 
+// The globals are the settings edited by the viewer and the .conf file. A
+// simulation reads its own Settings copy (SimulationContext::settings), so
+// simulations with different settings can run side by side.
 #define X(type, name, def_value) type name = def_value;
 CONFIG_PARAMS
 #undef X
 
-void load_configuration_file(const std::string& filename) 
+struct Settings 
 {
-    std::ifstream file(filename);
-    if (!file.is_open()) return;
-    
-    std::unordered_map<std::string, std::string> env_vars;
-    std::string line;
+    #define X(type, name, def_value) type name = def_value;
+    CONFIG_PARAMS
+    #undef X
+};
+
+Settings current_settings() 
+{
+    Settings settings;
+    #define X(type, name, def_value) settings.name = name;
+    CONFIG_PARAMS
+    #undef X
+    return settings;
+}
 
+void set_current_settings(const Settings& settings) 
+{
+    #define X(type, name, def_value) name = settings.name;
+    CONFIG_PARAMS
+    #undef X
+}
+
+// Sets the CONFIG_PARAMS entries named in env_vars (name -> value as written in
+// a .conf file) and returns the names that are not settings
+std::vector<std::string> apply_configuration(Settings& settings, std::unordered_map<std::string, std::string>& env_vars) 
+{
     auto trim = [](std::string& str) {
         str.erase(0, str.find_first_not_of(" \t"));
         str.erase(str.find_last_not_of(" \t") + 1);
     };
-    
-    while (std::getline(file, line)) {
-        if (line.empty() || line[0] == '#') continue;
-        
-        size_t equal_pos = line.find('=');
-        if (equal_pos == std::string::npos) continue;
-        
-        std::string key   = line.substr(0, equal_pos);
-        std::string value = line.substr(equal_pos + 1);
-        
-        trim(key);
-        trim(value);
-        
-        if (!key.empty()) env_vars[key] = value;
-    }
-    
+
     auto update_Real = [&](const std::string& key, Real& var) {
         if (env_vars.count(key)) var = std::stod(env_vars[key]);
     };
@@ -131,10 +173,122 @@ void load_configuration_file(const std::string& filename)
                 var = true;
             else if (value == "false" || value == "0" || value == "no" || value == "off") 
                 var = false;
+            else
+                throw std::invalid_argument(key + " = " + env_vars[key] + " is not true or false");
         }
     };
+
+    // string settings with a fixed set of values, a typo would fall back to a default
+    auto check_choice = [](const char* key, const std::string& value, std::initializer_list<const char*> choices) {
+        std::string list;
+        for (const char* choice : choices) {
+            if (value == choice) return;
+            list += (list.empty() ? "" : ", ") + std::string(choice);
+        }
+        throw std::invalid_argument(std::string(key) + " = " + value + " is not one of " + list);
+    };
     
-    #define X(type, name, defualt) update_##type (#name, name);
+    #define X(type, name, defualt) update_##type (#name, settings.name);
+    CONFIG_PARAMS
+    #undef X
+
+    check_choice("solver_mode",   settings.solver_mode,   {"islands", "colored", "jacobi"});
+    check_choice("sat_kernel",    settings.sat_kernel,    {"auto", "avx512", "avx2", "scalar", "reference", "check"});
+    check_choice("spring_kernel", settings.spring_kernel, {"auto", "avx2", "scalar", "reference"});
+    check_choice("data_format",   settings.data_format,   {"python", "columns"});
+    check_choice("export_format", settings.export_format, {"obj", "stream"});
+
+    #define X(name, string_val) #string_val,
+    check_choice("wrap_type",     settings.wrap_type,     {WRAP_MODES});
+    check_choice("wrap_type_sec", settings.wrap_type_sec, {WRAP_MODES});
+    #undef X
+
+    std::vector<std::string> unknown;
+    for (const auto& [key, value] : env_vars) 
+    {
+        bool known = false;
+        #define X(type, name, defualt) known = known || key == #name;
+        CONFIG_PARAMS
+        #undef X
+        if (!known) unknown.push_back(key);
+    }
+
+    return unknown;
+}
+
+// Same on the global settings, unchanged when a value cannot be parsed
+std::vector<std::string> apply_configuration(std::unordered_map<std::string, std::string>& env_vars) 
+{
+    Settings settings = current_settings();
+    std::vector<std::string> unknown = apply_configuration(settings, env_vars);
+    set_current_settings(settings);
+    return unknown;
+}
+
+// name -> value of the "name = value" lines of a .conf file, lines starting
+// with '#' are comments
+std::unordered_map<std::string, std::string> read_configuration(std::istream& in) 
+{
+    std::unordered_map<std::string, std::string> env_vars;
+    std::string line;
+
+    auto trim = [](std::string& str) {
+        str.erase(0, str.find_first_not_of(" \t"));
+        str.erase(str.find_last_not_of(" \t") + 1);
+    };
+    
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        
+        size_t equal_pos = line.find('=');
+        if (equal_pos == std::string::npos) continue;
+        
+        std::string key   = line.substr(0, equal_pos);
+        std::string value = line.substr(equal_pos + 1);
+        
+        trim(key);
+        trim(value);
+        
+        if (!key.empty()) env_vars[key] = value;
+    }
+
+    return env_vars;
+}
+
+// false, with the settings unchanged, when a value is invalid
+bool load_configuration_file(const std::string& filename) 
+{
+    std::ifstream file(filename);
+    if (!file.is_open()) return true;
+    
+    std::unordered_map<std::string, std::string> env_vars = read_configuration(file);
+    try
+    {
+        apply_configuration(env_vars);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << filename << ": invalid setting value: " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Every setting as a .conf line, read back exactly by read_configuration and
+// apply_configuration
+void write_configuration(std::ostream& out, const Settings& settings) 
+{
+    std::ostringstream value;
+    value.precision(17);
+
+    auto print = [&](const char* name, const auto& v) {
+        value.str("");
+        if constexpr (std::is_same_v<std::decay_t<decltype(v)>, bool>) value << (v ? "true" : "false");
+        else                                                          value << v;
+        out << name << " = " << value.str() << "\n";
+    };
+
+    #define X(type, name, def_value) print(#name, settings.name);
     CONFIG_PARAMS
     #undef X
-}
\ No newline at end of file
+}
@@ -0,0 +1,370 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cmath>
+#include <limits>
+
+#include "types.h"
+#include "constraint.cpp"
+#include "coloring.cpp"
+#include "body_store.cpp"
+#include "sat_kernel.cpp"
+
+// the x86 kernel works on SolverReal lanes, like the SAT kernels
+#if defined(SAT_KERNEL_X86)
+    #define SPRING_KERNEL_X86
+#endif
+
+static constexpr int   SPRING_MAX_LANES = 8;
+static constexpr int   SPRING_LANES     = int(32 / sizeof(SolverReal)); // one AVX2 register
+static constexpr Index NO_SPRING        = std::numeric_limits<Index>::max();
+
+// Rigid springs solved a batch at a time, one spring per SIMD lane: the same
+// update as Solver::solve(RigidSpringConstraint&) with the body data gathered
+// from the RigidBodyStore in SoA lanes. The springs of a batch must not share a
+// movable body (batches are cut from one color of the spring coloring), so the
+// lanes are independent. Unused lanes repeat lane 0 with enabled = 0.
+//
+// Vectors are split in components, matrices are the 9 entries of the glm
+// (column major) rotation.
+struct SpringBatch
+{
+    alignas(64) SolverReal x1[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal x2[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal R1[9][SPRING_MAX_LANES];
+    alignas(64) SolverReal R2[9][SPRING_MAX_LANES];
+    alignas(64) SolverReal r1[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal r2[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal inv_inertia1[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal inv_inertia2[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal inv_mass1[SPRING_MAX_LANES];
+    alignas(64) SolverReal inv_mass2[SPRING_MAX_LANES];
+    alignas(64) SolverReal mass1[SPRING_MAX_LANES];
+    alignas(64) SolverReal mass2[SPRING_MAX_LANES];
+    alignas(64) SolverReal rest_length[SPRING_MAX_LANES];
+    alignas(64) SolverReal alpha[SPRING_MAX_LANES];
+    alignas(64) SolverReal lambda[SPRING_MAX_LANES];
+    alignas(64) SolverReal enabled[SPRING_MAX_LANES];
+
+    // results: lambda is updated in place, solved is 1 on the lanes that moved
+    // their bodies, dp and domega are the corrections of body 1 and 2 (only
+    // meaningful on solved lanes)
+    alignas(64) SolverReal solved[SPRING_MAX_LANES];
+    alignas(64) SolverReal dp1[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal dp2[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal domega1[3][SPRING_MAX_LANES];
+    alignas(64) SolverReal domega2[3][SPRING_MAX_LANES];
+};
+
+using SpringKernel = void (*)(SpringBatch &, int lanes);
+
+// Scalar kernel, lane by lane with the same operation order as the SIMD kernels.
+inline void spring_batch_scalar(SpringBatch &b, int lanes)
+{
+    for (int l = 0; l < lanes; l++)
+    {
+        auto rotate = [&](SolverReal (*R)[SPRING_MAX_LANES], SolverReal (*v)[SPRING_MAX_LANES], int i)
+        {
+            return (R[i][l] * v[0][l] + R[i + 3][l] * v[1][l]) + R[i + 6][l] * v[2][l];
+        };
+
+        SolverReal p1[3], p2[3], d[3], n[3];
+        for (int i = 0; i < 3; i++)
+        {
+            p1[i] = rotate(b.R1, b.r1, i) + b.x1[i][l];
+            p2[i] = rotate(b.R2, b.r2, i) + b.x2[i][l];
+            d[i]  = p2[i] - p1[i];
+        }
+
+        SolverReal len = std::sqrt((d[0] * d[0] + d[1] * d[1]) + d[2] * d[2]);
+        SolverReal C   = len - b.rest_length[l];
+
+        if (!(b.enabled[l] != 0 && C >= SolverReal(1e-6)))
+        {
+            b.solved[l] = 0;
+            continue;
+        }
+
+        SolverReal inv_len = SolverReal(1) / len;
+        for (int i = 0; i < 3; i++) n[i] = d[i] * inv_len;
+
+        // r x (R^T n) and the generalized inverse mass of each end
+        auto end = [&](SolverReal (*R)[SPRING_MAX_LANES], SolverReal (*r)[SPRING_MAX_LANES],
+                       SolverReal (*inv_inertia)[SPRING_MAX_LANES], SolverReal inv_mass, SolverReal rxn[3])
+        {
+            SolverReal nb[3];
+            for (int i = 0; i < 3; i++) nb[i] = (R[3 * i][l] * n[0] + R[3 * i + 1][l] * n[1]) + R[3 * i + 2][l] * n[2];
+
+            rxn[0] = r[1][l] * nb[2] - r[2][l] * nb[1];
+            rxn[1] = r[2][l] * nb[0] - r[0][l] * nb[2];
+            rxn[2] = r[0][l] * nb[1] - r[1][l] * nb[0];
+
+            return inv_mass + ((rxn[0] * (inv_inertia[0][l] * rxn[0]) + rxn[1] * (inv_inertia[1][l] * rxn[1])) + rxn[2] * (inv_inertia[2][l] * rxn[2]));
+        };
+
+        SolverReal rxn1[3], rxn2[3];
+        SolverReal w1 = end(b.R1, b.r1, b.inv_inertia1, b.inv_mass1[l], rxn1);
+        SolverReal w2 = end(b.R2, b.r2, b.inv_inertia2, b.inv_mass2[l], rxn2);
+
+        SolverReal d_lambda = (-C - b.alpha[l] * b.lambda[l]) / ((w1 + w2) + b.alpha[l]);
+        b.lambda[l] += d_lambda;
+        b.solved[l]  = 1;
+
+        // body 1 is pulled along +n, body 2 along -n
+        for (int i = 0; i < 3; i++)
+        {
+            b.dp1[i][l]     = (-d_lambda * n[i]) / b.mass1[l];
+            b.dp2[i][l]     = ( d_lambda * n[i]) / b.mass2[l];
+            b.domega1[i][l] = b.inv_inertia1[i][l] * ( d_lambda * rxn1[i]);
+            b.domega2[i][l] = b.inv_inertia2[i][l] * (-d_lambda * rxn2[i]);
+        }
+    }
+}
+
+#ifdef SPRING_KERNEL_X86
+
+struct SpringLanesAvx2 { LanesAvx2 x, y, z; };
+
+using SpringLanes = const SolverReal (*)[SPRING_MAX_LANES];
+
+SAT_TARGET_AVX2
+static inline SpringLanesAvx2 spring_load3_avx2(SpringLanes v)
+{
+    return {avx2_load(v[0]), avx2_load(v[1]), avx2_load(v[2])};
+}
+
+// row i of R times v (R * v), and column i of R times v (R^T * v)
+SAT_TARGET_AVX2
+static inline LanesAvx2 spring_row_avx2(SpringLanes R, int i, const SpringLanesAvx2 &v)
+{
+    LanesAvx2 s = lanes_add(lanes_mul(avx2_load(R[i]), v.x), lanes_mul(avx2_load(R[i + 3]), v.y));
+    return lanes_add(s, lanes_mul(avx2_load(R[i + 6]), v.z));
+}
+
+SAT_TARGET_AVX2
+static inline LanesAvx2 spring_col_avx2(SpringLanes R, int i, const SpringLanesAvx2 &v)
+{
+    LanesAvx2 s = lanes_add(lanes_mul(avx2_load(R[3 * i]), v.x), lanes_mul(avx2_load(R[3 * i + 1]), v.y));
+    return lanes_add(s, lanes_mul(avx2_load(R[3 * i + 2]), v.z));
+}
+
+// generalized inverse mass of one end, rxn receives r x (R^T n)
+SAT_TARGET_AVX2
+static inline LanesAvx2 spring_end_avx2(SpringLanes R, SpringLanes r, SpringLanes inv_inertia, const SolverReal *inv_mass,
+                                        const SpringLanesAvx2 &n, SpringLanesAvx2 &rxn)
+{
+    SpringLanesAvx2 nb = {spring_col_avx2(R, 0, n), spring_col_avx2(R, 1, n), spring_col_avx2(R, 2, n)};
+    SpringLanesAvx2 rv = spring_load3_avx2(r);
+
+    rxn.x = lanes_sub(lanes_mul(rv.y, nb.z), lanes_mul(rv.z, nb.y));
+    rxn.y = lanes_sub(lanes_mul(rv.z, nb.x), lanes_mul(rv.x, nb.z));
+    rxn.z = lanes_sub(lanes_mul(rv.x, nb.y), lanes_mul(rv.y, nb.x));
+
+    LanesAvx2 w = lanes_add(lanes_mul(rxn.x, lanes_mul(avx2_load(inv_inertia[0]), rxn.x)),
+                            lanes_mul(rxn.y, lanes_mul(avx2_load(inv_inertia[1]), rxn.y)));
+    w = lanes_add(w, lanes_mul(rxn.z, lanes_mul(avx2_load(inv_inertia[2]), rxn.z)));
+    return lanes_add(avx2_load(inv_mass), w);
+}
+
+SAT_TARGET_AVX2
+static void spring_batch_avx2_lanes(SpringBatch &b, int base)
+{
+    auto at = [&](SolverReal (*v)[SPRING_MAX_LANES]) { return reinterpret_cast<SpringLanes>(&v[0][base]); };
+
+    SpringLanesAvx2 r1 = spring_load3_avx2(at(b.r1));
+    SpringLanesAvx2 r2 = spring_load3_avx2(at(b.r2));
+    SpringLanesAvx2 x1 = spring_load3_avx2(at(b.x1));
+    SpringLanesAvx2 x2 = spring_load3_avx2(at(b.x2));
+
+    SpringLanesAvx2 d =
+    {
+        lanes_sub(lanes_add(spring_row_avx2(at(b.R2), 0, r2), x2.x), lanes_add(spring_row_avx2(at(b.R1), 0, r1), x1.x)),
+        lanes_sub(lanes_add(spring_row_avx2(at(b.R2), 1, r2), x2.y), lanes_add(spring_row_avx2(at(b.R1), 1, r1), x1.y)),
+        lanes_sub(lanes_add(spring_row_avx2(at(b.R2), 2, r2), x2.z), lanes_add(spring_row_avx2(at(b.R1), 2, r1), x1.z)),
+    };
+
+    LanesAvx2 zero = avx2_set1(SolverReal(0));
+    LanesAvx2 one  = avx2_set1(SolverReal(1));
+
+    LanesAvx2 len = lanes_sqrt(lanes_add(lanes_add(lanes_mul(d.x, d.x), lanes_mul(d.y, d.y)), lanes_mul(d.z, d.z)));
+    LanesAvx2 C   = lanes_sub(len, avx2_load(b.rest_length + base));
+
+    LanesAvx2 solve = lanes_and(lanes_neq(avx2_load(b.enabled + base), zero), lanes_ge(C, avx2_set1(SolverReal(1e-6))));
+
+    LanesAvx2 inv_len = lanes_div(one, len);
+    SpringLanesAvx2 n = {lanes_mul(d.x, inv_len), lanes_mul(d.y, inv_len), lanes_mul(d.z, inv_len)};
+
+    SpringLanesAvx2 rxn1, rxn2;
+    LanesAvx2 w1 = spring_end_avx2(at(b.R1), at(b.r1), at(b.inv_inertia1), b.inv_mass1 + base, n, rxn1);
+    LanesAvx2 w2 = spring_end_avx2(at(b.R2), at(b.r2), at(b.inv_inertia2), b.inv_mass2 + base, n, rxn2);
+
+    LanesAvx2 alpha    = avx2_load(b.alpha + base);
+    LanesAvx2 lambda   = avx2_load(b.lambda + base);
+    LanesAvx2 neg_C    = lanes_sub(zero, C);
+    LanesAvx2 d_lambda = lanes_div(lanes_sub(neg_C, lanes_mul(alpha, lambda)), lanes_add(lanes_add(w1, w2), alpha));
+
+    // lanes that are not solved keep lambda, their corrections are not used
+    d_lambda = lanes_and(solve, d_lambda);
+    avx2_store(b.lambda + base, lanes_add(lambda, d_lambda));
+    avx2_store(b.solved + base, lanes_and(solve, one));
+
+    LanesAvx2 neg_d_lambda = lanes_sub(zero, d_lambda);
+    LanesAvx2 mass1 = avx2_load(b.mass1 + base);
+    LanesAvx2 mass2 = avx2_load(b.mass2 + base);
+
+    const LanesAvx2 nc[3]    = {n.x, n.y, n.z};
+    const LanesAvx2 rxn1c[3] = {rxn1.x, rxn1.y, rxn1.z};
+    const LanesAvx2 rxn2c[3] = {rxn2.x, rxn2.y, rxn2.z};
+
+    for (int i = 0; i < 3; i++)
+    {
+        avx2_store(b.dp1[i] + base, lanes_div(lanes_mul(neg_d_lambda, nc[i]), mass1));
+        avx2_store(b.dp2[i] + base, lanes_div(lanes_mul(d_lambda,     nc[i]), mass2));
+        avx2_store(b.domega1[i] + base, lanes_mul(avx2_load(b.inv_inertia1[i] + base), lanes_mul(d_lambda,     rxn1c[i])));
+        avx2_store(b.domega2[i] + base, lanes_mul(avx2_load(b.inv_inertia2[i] + base), lanes_mul(neg_d_lambda, rxn2c[i])));
+    }
+}
+
+SAT_TARGET_AVX2
+void spring_batch_avx2(SpringBatch &b, int lanes)
+{
+    for (int base = 0; base < lanes; base += LANES_AVX2) spring_batch_avx2_lanes(b, base);
+}
+
+#endif // SPRING_KERNEL_X86
+
+// mode: "auto", "avx2", "scalar" ("reference" is handled by the caller). Falls
+// back to the scalar kernel when AVX2 is not available; name and lanes receive
+// the kernel used and its batch width, one AVX2 register of SolverReal for
+// both kernels (4 doubles or 8 floats) so that they solve the same batches.
+SpringKernel select_spring_kernel([[maybe_unused]] const std::string &mode, std::string &name, int &lanes)
+{
+    lanes = SPRING_LANES;
+#ifdef SPRING_KERNEL_X86
+    if (mode != "scalar" && cpu_supports_avx2())
+    {
+        name = "avx2";
+        return spring_batch_avx2;
+    }
+#endif
+    name = "scalar";
+    return spring_batch_scalar;
+}
+
+// Cuts every color of the spring coloring in batches of lanes springs,
+// skipping the ones the solver would skip (torn, both bodies resting, both ends
+// on the same body). batches holds lanes entries per batch, NO_SPRING for the
+// unused lanes; the batches of color c are [batch_start[c], batch_start[c+1]).
+struct SpringBatches
+{
+    std::vector<Index> springs;
+    std::vector<Index> batch_start;
+    int lanes = SPRING_LANES;
+
+    void clear()
+    {
+        springs.clear();
+        batch_start.clear();
+    }
+
+    Index num_batches() const { return Index(springs.size() / lanes); }
+
+    template <typename Skip>
+    void build(const ConstraintColoring &coloring, int lanes, Skip &&skip)
+    {
+        this->lanes = lanes;
+        springs.clear();
+        batch_start.assign(1, 0);
+
+        for (Index c = 0; c < coloring.num_colors(); c++)
+        {
+            Index filled = 0;
+            for (Index k = coloring.color_start[c]; k < coloring.color_start[c+1]; k++)
+            {
+                Index ci = coloring.order[k];
+                if (skip(ci)) continue;
+                springs.push_back(ci);
+                filled++;
+            }
+
+            while (filled % lanes != 0)
+            {
+                springs.push_back(NO_SPRING);
+                filled++;
+            }
+
+            batch_start.push_back(num_batches());
+        }
+    }
+};
+
+// Gathers batch bi, runs the kernel and applies the results to the store
+// with the quaternion update of Solver::applyPositionCorrection.
+inline void solve_spring_batch(SpringKernel kernel, const SpringBatches &batches, Index bi,
+                               std::vector<RigidSpringConstraint> &springs, RigidBodyStore &bodies, Real delta_t)
+{
+    SpringBatch b;
+    int   lanes = batches.lanes;
+    const Index *ids = &batches.springs[size_t(bi) * lanes];
+
+    for (int l = 0; l < lanes; l++)
+    {
+        const RigidSpringConstraint &s = springs[ids[l] != NO_SPRING ? ids[l] : ids[0]];
+
+        auto body = [&](Index i, SolverReal (*x)[SPRING_MAX_LANES], SolverReal (*R)[SPRING_MAX_LANES],
+                        SolverReal (*inv_inertia)[SPRING_MAX_LANES], SolverReal *inv_mass, SolverReal *mass)
+        {
+            const SolverReal3x3 &rot = bodies.rotation_of(i);
+            for (int c = 0; c < 3; c++)
+            {
+                x[c][l]           = bodies.position[i][c];
+                inv_inertia[c][l] = bodies.inv_inertia[i][c];
+                for (int r = 0; r < 3; r++) R[3 * c + r][l] = rot[c][r];
+            }
+            inv_mass[l] = bodies.inv_mass[i];
+            mass[l]     = bodies.mass[i];
+        };
+
+        body(s.i1, b.x1, b.R1, b.inv_inertia1, b.inv_mass1, b.mass1);
+        body(s.i2, b.x2, b.R2, b.inv_inertia2, b.inv_mass2, b.mass2);
+
+        for (int c = 0; c < 3; c++)
+        {
+            b.r1[c][l] = SolverReal(s.r1[c]);
+            b.r2[c][l] = SolverReal(s.r2[c]);
+        }
+
+        b.rest_length[l] = SolverReal(s.rest_length);
+        b.alpha[l]       = SolverReal(s.compliance / delta_t / delta_t);
+        b.lambda[l]      = SolverReal(s.lambda);
+        b.enabled[l]     = ids[l] != NO_SPRING ? 1 : 0;
+    }
+
+    kernel(b, lanes);
+
+    auto apply = [&](Index i, int l, SolverReal (*dp)[SPRING_MAX_LANES], SolverReal (*domega)[SPRING_MAX_LANES])
+    {
+        if (!bodies.movable[i]) return;
+
+        SolverQuat &orientation = bodies.orientation[i];
+        SolverQuat omega_q(domega[0][l], domega[1][l], domega[2][l], 0);
+        SolverQuat dq = SolverReal(0.5) * quat_multiplication(omega_q, orientation);
+
+        bodies.position[i] += SolverReal3(dp[0][l], dp[1][l], dp[2][l]);
+        orientation        += dq;
+        orientation         = glm::normalize(orientation);
+        bodies.mark_moved(i);
+    };
+
+    for (int l = 0; l < lanes; l++)
+    {
+        if (ids[l] == NO_SPRING || b.solved[l] == 0) continue;
+
+        RigidSpringConstraint &s = springs[ids[l]];
+        s.lambda = b.lambda[l];
+
+        apply(s.i1, l, b.dp1, b.domega1);
+        apply(s.i2, l, b.dp2, b.domega2);
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Bounded single-producer single-consumer queue. Neither side locks or waits:
+// try_push fails when the ring is full (the record is dropped and counted),
+// try_pop when it is empty. head is written by the producer only, tail by the
+// consumer only, each on its own cache line.
+template <typename T>
+struct SpscRing
+{
+    // capacity rounded up to a power of two
+    explicit SpscRing(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity) size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t capacity() const { return slots.size(); }
+
+    // producer
+    bool try_push(const T& item)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+
+        if (head - cached_tail == slots.size())
+        {
+            cached_tail = tail_.load(std::memory_order_acquire);
+            if (head - cached_tail == slots.size())
+            {
+                dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+
+        slots[head & mask] = item;
+        head_.store(head + 1, std::memory_order_release);
+
+        size_t fill = head + 1 - cached_tail;
+        if (fill > high_water_.load(std::memory_order_relaxed)) high_water_.store(fill, std::memory_order_relaxed);
+        return true;
+    }
+
+    // consumer
+    bool try_pop(T& item)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+
+        if (tail == cached_head)
+        {
+            cached_head = head_.load(std::memory_order_acquire);
+            if (tail == cached_head) return false;
+        }
+
+        item = slots[tail & mask];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // records accepted, records dropped on a full ring, highest fill seen by
+    // the producer (an upper bound, the consumer may have moved on)
+    uint64_t pushed()     const { return head_.load(std::memory_order_acquire); }
+    uint64_t dropped()    const { return dropped_.load(std::memory_order_relaxed); }
+    size_t   high_water() const { return high_water_.load(std::memory_order_relaxed); }
+
+private:
+
+    std::vector<T> slots;
+    size_t         mask;
+
+    alignas(64) std::atomic<size_t>   head_{0};
+    size_t                            cached_tail = 0; // producer's copy of tail_
+    std::atomic<uint64_t>             dropped_{0};
+    std::atomic<size_t>               high_water_{0};
+
+    alignas(64) std::atomic<size_t>   tail_{0};
+    size_t                            cached_head = 0; // consumer's copy of head_
+};
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <unordered_map>
+#include <functional>
+
+#include "types.h"
+#include "settings.cpp"
+#include "thread_pool.cpp"
+#include "pallet_scene.cpp"
+#include "data_export.cpp"
+#include "data_stream.cpp"
+
+// Parameter sweeps: every point of a Cartesian grid of settings is one
+// TransportRun in its own SimulationContext, the runs share nothing but the
+// scene caches (one per thread) and go on a WorkStealingPool.
+
+// One axis of the grid: a CONFIG_PARAMS name and its values as written in a
+// .conf file
+struct SweepAxis
+{
+    std::string              name;
+    std::vector<std::string> values;
+};
+
+struct SweepRun
+{
+    Settings    settings;
+    std::string output_file;
+    int64_t     run_id = 0; // index in the grid
+
+    uint64_t    steps      = 0;
+    double      wall_ms    = 0.0;
+    uint64_t    state_hash = 0; // scene_state_hash at the end of the run
+    std::string error; // empty when the run completed
+
+    DataStreamStats stream; // with data_stream
+};
+
+// The grid points, the first axis varying slowest as in nested loops. Each run
+// gets prefix <prefix or schema_folder>_<value>_<value>... and writes
+// data_<prefix>.py in output_dir, or with data_format = columns appends its
+// block to data_<prefix or schema_folder>.xcol, shared by the whole sweep.
+// Throws std::invalid_argument for a name that is not a setting or a value
+// that cannot be parsed.
+std::vector<SweepRun> make_sweep(const Settings& base, const std::vector<SweepAxis>& axes, const std::string& output_dir = ".")
+{
+    size_t num_runs = 1;
+    for (const SweepAxis& axis : axes) num_runs *= axis.values.size();
+
+    std::vector<SweepRun> runs;
+    runs.reserve(num_runs);
+
+    for (size_t ri = 0; ri < num_runs; ri++)
+    {
+        SweepRun run;
+        run.settings = base;
+
+        std::unordered_map<std::string, std::string> point;
+        std::string run_prefix = base.prefix.empty() ? base.schema_folder : base.prefix;
+
+        size_t index = ri;
+        std::vector<const std::string*> values(axes.size());
+        for (size_t ai = axes.size(); ai-- > 0;)
+        {
+            values[ai] = &axes[ai].values[index % axes[ai].values.size()];
+            index     /= axes[ai].values.size();
+        }
+
+        for (size_t ai = 0; ai < axes.size(); ai++)
+        {
+            point[axes[ai].name] = *values[ai];
+            run_prefix          += "_" + *values[ai];
+        }
+
+        std::vector<std::string> unknown;
+        try
+        {
+            unknown = apply_configuration(run.settings, point);
+        }
+        catch (const std::exception& e)
+        {
+            throw std::invalid_argument("invalid sweep value (" + std::string(e.what()) + ")");
+        }
+        if (!unknown.empty()) throw std::invalid_argument("unknown setting " + unknown.front());
+
+        std::string file = run.settings.data_format == "columns"
+                         ? "data_" + (base.prefix.empty() ? base.schema_folder : base.prefix) + ".xcol"
+                         : "data_" + run_prefix + ".py";
+
+        run.settings.prefix       = run_prefix;
+        run.settings.collect_data = true;
+        run.output_file           = (fs::path(output_dir) / file).string();
+        run.run_id                = (int64_t)ri;
+
+        runs.push_back(std::move(run));
+    }
+
+    return runs;
+}
+
+// Writes the data of a finished run: its own Python file, or with
+// data_format = columns a block appended to output_file (runs of one process
+// append one at a time)
+void write_run_data(const SweepRun& run, const DataCollection& data)
+{
+    if (run.settings.data_format != "columns")
+    {
+        std::ofstream out(native_path(run.output_file), std::ios::out | std::ios::trunc);
+        if (!out.is_open()) throw std::runtime_error("cannot write " + run.output_file);
+        data.print(out);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(column_file_mutex());
+
+    std::ofstream out(native_path(run.output_file), std::ios::out | std::ios::binary | std::ios::app);
+    if (!out.is_open()) throw std::runtime_error("cannot write " + run.output_file);
+
+    if (!write_data_columns(out, data, run.run_id, run.settings.prefix, run.settings.data_compress))
+        std::cerr << "data_compress: built without zlib, columns written uncompressed\n";
+    if (!out) throw std::runtime_error("cannot write " + run.output_file);
+}
+
+// Runs one point to the end of the transport profile and writes its data file
+// (streamed while it runs with data_stream).
+// Errors (a missing schema, an unwritable file) end up in run.error. heartbeat,
+// when set, is called about once a second while the run goes.
+void run_sweep_point(SweepRun& run, SceneCache& cache, const std::function<void()>& heartbeat = nullptr)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    auto beat  = start;
+
+    try
+    {
+        SimulationContext ctx(run.settings);
+        ctx.print_stats = false;
+
+        DataCollection   data;
+        DataStreamWriter writer;
+        TransportRun     transport;
+
+        if (streams_data(run.settings))
+            writer.open(data, run.output_file, run.run_id, run.settings.prefix, run.settings.data_compress, run.settings.data_stream_buffer);
+
+        transport.reset(ctx, cache, data);
+        while (!transport.advance(ctx, data))
+        {
+            if (!heartbeat || transport.step % 256 != 0) continue;
+
+            auto now = std::chrono::high_resolution_clock::now();
+            if (now - beat < std::chrono::seconds(1)) continue;
+
+            heartbeat();
+            beat = now;
+        }
+
+        if (writer.is_open())
+        {
+            run.stream = writer.close();
+            if (run.stream.failed) throw std::runtime_error("cannot write " + run.output_file);
+            if (!run.stream.compressed) std::cerr << "data_compress: built without zlib, columns written uncompressed\n";
+        }
+        else write_run_data(run, data);
+
+        run.steps      = transport.step;
+        run.state_hash = scene_state_hash(ctx.scene);
+    }
+    catch (const std::exception& e)
+    {
+        run.error = e.what();
+    }
+
+    run.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+struct SweepReport
+{
+    size_t runs     = 0;
+    size_t failed   = 0;
+    size_t threads  = 0;
+    double wall_s   = 0.0; // whole sweep
+    double run_s    = 0.0; // sum over the runs
+
+    double runs_per_hour() const { return wall_s > 0.0 ? 3600.0 * (double)(runs - failed) / wall_s : 0.0; }
+};
+
+// Runs every SweepRun on num_threads threads, logging each one as it ends.
+// Each SimulationContext keeps solver_threads from its settings: with more
+// than one per run the machine is oversubscribed.
+SweepReport run_sweep(std::vector<SweepRun>& runs, size_t num_threads, std::ostream& log = std::cout)
+{
+    if (num_threads < 1) num_threads = 1;
+
+    std::vector<SceneCache> caches(num_threads);
+    std::mutex log_mutex;
+
+    std::vector<WorkStealingPool::Job> jobs;
+    for (SweepRun& sweep_run : runs)
+    {
+        jobs.push_back([&, run = &sweep_run](size_t thread_index)
+        {
+            run_sweep_point(*run, caches[thread_index]);
+
+            std::lock_guard<std::mutex> lock(log_mutex);
+            log << run->settings.prefix << ": ";
+            if (run->error.empty()) log << run->steps << " steps, " << run->wall_ms << " ms, state " << state_hash_string(run->state_hash)
+                                        << ", data in " << run->output_file
+                                        << (run->stream.dropped > 0 ? ", " + std::to_string(run->stream.dropped) + " samples dropped" : "") << "\n";
+            else                    log << "failed, " << run->error << "\n";
+        });
+    }
+
+    SweepReport report;
+    report.runs    = runs.size();
+    report.threads = std::min(num_threads, std::max<size_t>(runs.size(), 1));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    WorkStealingPool::run(num_threads, jobs);
+    report.wall_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+
+    for (const SweepRun& run : runs)
+    {
+        report.run_s  += run.wall_ms / 1000.0;
+        report.failed += !run.error.empty();
+    }
+
+    return report;
+}
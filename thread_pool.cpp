@@ -0,0 +1,184 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <deque>
+#include <algorithm>
+
+// Fixed set of worker threads running parallel_for over [0, count). The
+// calling thread takes part in the work and returns when every index is done.
+struct ThreadPool
+{
+    std::vector<std::thread> workers;
+
+    std::mutex              mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+
+    const std::function<void(size_t)> *task = nullptr;
+    size_t              task_count = 0;
+    std::atomic<size_t> next_index{0};
+    size_t              running    = 0;
+    uint64_t            generation = 0;
+    bool                stop       = false;
+
+    ThreadPool() {}
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() { shutdown(); }
+
+    size_t num_threads() const { return workers.size() + 1; }
+
+    // total threads including the caller
+    void resize(size_t num_threads)
+    {
+        if (num_threads < 1) num_threads = 1;
+        if (num_threads == this->num_threads()) return;
+
+        shutdown();
+        stop = false;
+
+        for (size_t ti = 0; ti + 1 < num_threads; ti++)
+            workers.emplace_back([this, seen = generation]() { worker_loop(seen); });
+    }
+
+    void shutdown()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        start_cv.notify_all();
+
+        for (std::thread &worker : workers) worker.join();
+        workers.clear();
+    }
+
+    void parallel_for(size_t count, const std::function<void(size_t)> &fn)
+    {
+        if (count == 0) return;
+
+        if (workers.empty() || count == 1)
+        {
+            for (size_t i = 0; i < count; i++) fn(i);
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            task       = &fn;
+            task_count = count;
+            next_index = 0;
+            running    = workers.size();
+            generation++;
+        }
+        start_cv.notify_all();
+
+        run_task(fn, count);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this]() { return running == 0; });
+        task = nullptr;
+    }
+
+private:
+    void run_task(const std::function<void(size_t)> &fn, size_t count)
+    {
+        for (size_t i = next_index++; i < count; i = next_index++) fn(i);
+    }
+
+    void worker_loop(uint64_t seen_generation)
+    {
+        while (true)
+        {
+            const std::function<void(size_t)> *fn;
+            size_t count;
+
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [&]() { return stop || generation != seen_generation; });
+                if (stop) return;
+
+                seen_generation = generation;
+                fn    = task;
+                count = task_count;
+            }
+
+            run_task(*fn, count);
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                running--;
+            }
+            done_cv.notify_one();
+        }
+    }
+};
+
+// Runs a list of independent jobs, each long (a whole simulation) and of
+// uneven length. Every thread has its own deque, dealt round robin: a thread
+// takes jobs from the back of its deque and, once that is empty, steals from
+// the front of the others. run returns when every job is done.
+struct WorkStealingPool
+{
+    using Job = std::function<void(size_t thread_index)>;
+
+    struct Queue
+    {
+        std::mutex      mutex;
+        std::deque<Job> jobs;
+    };
+
+    static void run(size_t num_threads, std::vector<Job> &jobs)
+    {
+        if (num_threads < 1) num_threads = 1;
+        num_threads = std::min(num_threads, std::max<size_t>(jobs.size(), 1));
+
+        std::vector<Queue> queues(num_threads);
+        for (size_t ji = 0; ji < jobs.size(); ji++) queues[ji % num_threads].jobs.push_back(std::move(jobs[ji]));
+        jobs.clear();
+
+        auto take = [&](size_t ti, Job &job) 
+        {
+            {
+                std::lock_guard<std::mutex> lock(queues[ti].mutex);
+                if (!queues[ti].jobs.empty())
+                {
+                    job = std::move(queues[ti].jobs.back());
+                    queues[ti].jobs.pop_back();
+                    return true;
+                }
+            }
+
+            for (size_t k = 1; k < num_threads; k++)
+            {
+                Queue &victim = queues[(ti + k) % num_threads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (victim.jobs.empty()) continue;
+
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+            return false;
+        };
+
+        // no job adds jobs, so a thread that finds every deque empty is done
+        auto worker = [&](size_t ti) 
+        {
+            Job job;
+            while (take(ti, job)) job(ti);
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t ti = 1; ti < num_threads; ti++) threads.emplace_back(worker, ti);
+        worker(0);
+
+        for (std::thread &thread : threads) thread.join();
+    }
+};
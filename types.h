@@ -1,9 +1,30 @@
 #pragma once
 
+#include <array>
 #include <glm/glm.hpp>
 
 using float64_t = double;
 
+// Scalar precision, selected at build time (XPBD_PRECISION in CMakeLists.txt):
+//   XPBD_FLOAT  scene state and solver in float
+//   XPBD_MIXED  scene state in double, rigid constraint solver in float on
+//               positions relative to a moving origin (see RigidBodyStore),
+//               SAT prefilter in float on box offsets (see SatBox)
+//   otherwise   everything in double
+#if defined(XPBD_FLOAT)
+
+using vec3 = glm::vec3;
+using mat3 = glm::mat3;
+
+using Real        = float;
+using Real3       = glm::vec3;
+using Real4       = glm::vec4;
+using Quat        = glm::vec4;
+using Real3x3     = glm::mat3;
+using Real4x4     = glm::mat4;
+
+#else
+
 using vec3 = glm::dvec3;
 using mat3 = glm::dmat3;
 
@@ -13,11 +34,27 @@ using Real4       = glm::dvec4;
 using Quat        = glm::dvec4;
 using Real3x3     = glm::dmat3;
 using Real4x4     = glm::dmat4;
+
+#endif
+
+#if defined(XPBD_FLOAT) || defined(XPBD_MIXED)
+using SolverReal    = float;
+using SolverReal3   = glm::vec3;
+using SolverQuat    = glm::vec4;
+using SolverReal3x3 = glm::mat3;
+#else
+using SolverReal    = Real;
+using SolverReal3   = Real3;
+using SolverQuat    = Quat;
+using SolverReal3x3 = Real3x3;
+#endif
 using TetraIndex  = uint32_t;
 using VertexIndex = uint32_t;
 using EdgeIndex   = uint32_t;
 using Index       = uint32_t;
 
+using BoxVertices = std::array<Real3, 8>;
+
 struct Real3_Color {
     Real x, y, z, r, g, b, a;
 };
@@ -2,44 +2,30 @@
 
 #include <vector>
 #include <chrono>
+#include <cassert>
+#include <cstring>
 
 #include "object.cpp"
+#include "scene.cpp"
 #include "rigid.cpp"
 #include "cloth.cpp"
 #include "types.h"
 
 #include "collision.cpp"
 #include "settings.cpp"
+#include "thread_pool.cpp"
 
 #include <stdio.h>
 
-static uint64_t frequency; //25*4*60;
-static uint64_t iterations_per_step = 1;
-static Real delta_t;
-
-extern Real coll_compliance;
-extern Real mu_dynamic;
-
-Real3 gravity(0.0, -9.81, 0.0);
-
-Real ground_y = -2.0;
-
 struct Collision {
-    TetraObject *obj1;
-    TetraObject *obj2;
+    Index o1;
+    Index o2;
     TetraIndex t1;
     TetraIndex t2;
     CollisionInfo info;
     Real3 dp_tang;
 };
 
-void XPBD_init(uint64_t heartz = 1000, uint64_t iterations = 1) 
-{
-    frequency           = heartz;
-    iterations_per_step = iterations;
-    delta_t             = 1.0 / frequency;
-}
-
 void XPBD_collect_collisions(
         std::vector<TetraObject> &objects, 
         std::vector<Collision>   &collisions) 
@@ -77,8 +63,8 @@ void XPBD_collect_collisions(
                     Real3 dpt = dp - (glm::dot(dp, info.axis) * info.axis);
 
                     Collision collision;
-                    collision.obj1    = &objects[o1i];
-                    collision.obj2    = &objects[o2i];
+                    collision.o1      = o1i;
+                    collision.o2      = o2i;
                     collision.t1      = t1i;
                     collision.t2      = t2i;
                     collision.info    = info;
@@ -105,12 +91,15 @@ void XPBD_collect_collisions(
 
 void XPBD_collision_vertex_ripositioning(
         std::vector<TetraObject> &objects,
-        std::vector<Collision>   &collisions) 
+        std::vector<Collision>   &collisions,
+        Real                      compliance) 
 {
-    for (TetraObject &obj : objects) {
+    for (Index oi = 0; oi < objects.size(); oi++) {
+        TetraObject &obj = objects[oi];
+
         for (VertexIndex vi = 0; vi < obj.num_vertices(); vi++) {
 
-            CollisionConstraint constraint(coll_compliance, &obj, vi, Real3(0.0), true);
+            CollisionConstraint constraint(compliance, vi, Real3(0.0), true);
             
             size_t num_collisions = obj.vertex_collisions[vi].size();
             if (num_collisions == 0) { // || vi >= 8) {
@@ -123,11 +112,11 @@ void XPBD_collision_vertex_ripositioning(
                 Index coll_idx  = obj.vertex_collisions[vi][ci];
                 Collision &coll = collisions[coll_idx];
 
-                assert(coll.obj1 == &obj || coll.obj2 == &obj);
+                assert(coll.o1 == oi || coll.o2 == oi);
 
-                Real3 update = (coll.info.axis * coll.info.penetration) * 0.5;
+                Real3 update = (coll.info.axis * coll.info.penetration) * Real(0.5);
 
-                if (coll.obj1 == &obj) constraint.goal_position -= update;
+                if (coll.o1 == oi) constraint.goal_position -= update;
                 else                   constraint.goal_position += update;
             }
 
@@ -145,28 +134,847 @@ struct StatCollector
 {
     int edge_collisions = 0;
     int face_collisions = 0;
+    uint64_t broadphase_pairs = 0;
+    uint64_t pair_list_reuses = 0;
+    uint64_t cached_axis_tests = 0;
+    uint64_t cached_axis_hits  = 0;
+    uint64_t kernel_tests      = 0;
+    uint64_t kernel_hits       = 0;
+    uint64_t kernel_mismatches = 0; // check: lanes that differ bitwise from the scalar kernel
+    uint64_t reference_mismatches = 0; // check: decisions that differ from SAT_box_box
+    std::string kernel_name    = "none";
+    uint64_t clipped_points    = 0;
+    uint64_t contact_points    = 0;
+    uint64_t detections        = 0;
+    uint64_t sleeping_bodies   = 0; // summed over steps
+    uint64_t wake_ups          = 0;
+    uint64_t islands           = 0; // summed over steps
+    uint64_t spring_colors     = 0; // summed over steps
+    uint64_t contact_colors    = 0; // summed over steps
+    std::string spring_kernel_name = "reference";
+    uint64_t spring_batches    = 0;
+    uint64_t batched_springs   = 0;
+    int      spring_lanes      = 4;
 
     double total_collision_time = 0.0;
+    double total_solve_time     = 0.0; // constraint iterations and friction pass
     int steps = 0;
 
-    ~StatCollector() 
+    void print(std::ostream &out, const Settings &settings) const 
     {
-        std::cout << "\n--- Simulation Statistics ---" << std::endl;
-        std::cout << "Edge Collisions: " << edge_collisions << std::endl;
-        std::cout << "Face Collisions: " << face_collisions << std::endl;
+        out << "\n--- Simulation Statistics ---" << std::endl;
+        out << "Edge Collisions: " << edge_collisions << std::endl;
+        out << "Face Collisions: " << face_collisions << std::endl;
+
+        out << "Face Contact Points: " << contact_points << " kept of " << clipped_points << " clipped"
+                  << " (" << (settings.manifold_max_points > 0 ? "max " + std::to_string(std::min(settings.manifold_max_points, 4)) + " per pair" : std::string("no reduction")) << ", " 
+                  << (steps > 0 ? (double)contact_points / (double)steps : 0.0) << " constraints per step)" << std::endl;
+
+        out << "Broadphase (" << (settings.sap_broadphase ? "sweep and prune" : "brute force") << ") Pairs per Step: " 
+                  << (steps > 0 ? (double)broadphase_pairs / (double)steps : 0.0) << std::endl;
 
-        std::cout << "Average Collision Detection Time per Step: " 
+        out << "Pair List Reused: " 
+                  << (steps > 0 ? 100.0 * (double)pair_list_reuses / (double)steps : 0.0) << " % of steps" << std::endl;
+
+        out << "Cached Axis Early Exits: " << cached_axis_hits << " / " << cached_axis_tests << " ("
+                  << (cached_axis_tests > 0 ? 100.0 * (double)cached_axis_hits / (double)cached_axis_tests : 0.0) << " %)" << std::endl;
+
+        out << "SAT Kernel (" << kernel_name << ") Early Exits: " << kernel_hits << " / " << kernel_tests << " ("
+                  << (kernel_tests > 0 ? 100.0 * (double)kernel_hits / (double)kernel_tests : 0.0) << " %)" << std::endl;
+
+        if (settings.sat_kernel == "check")
+            out << "SAT Kernel Check: " << kernel_mismatches << " lanes differ from the scalar kernel, " 
+                      << reference_mismatches << " decisions differ from SAT_box_box" << std::endl;
+
+        out << "Collision Detections: " << detections << " in " << steps << " steps" << std::endl;
+
+        if (islands > 0)
+            out << "Islands per Step: " << (steps > 0 ? (double)islands / (double)steps : 0.0) 
+                      << " (" << settings.solver_threads << " solver threads)" << std::endl;
+
+        if (spring_colors + contact_colors > 0)
+            out << "Colors per Step: " << (steps > 0 ? (double)spring_colors / (double)steps : 0.0) << " springs, " 
+                      << (steps > 0 ? (double)contact_colors / (double)steps : 0.0) << " contacts" 
+                      << " (" << settings.solver_threads << " solver threads)" << std::endl;
+
+        if (spring_batches > 0)
+            out << "Spring Kernel (" << spring_kernel_name << ") Batches per Step: " << (steps > 0 ? (double)spring_batches / (double)steps : 0.0)
+                      << " (" << 100.0 * (double)batched_springs / (double)(spring_batches * spring_lanes) << " % lanes used)" << std::endl;
+
+        if (settings.enable_sleeping)
+            out << "Sleeping Bodies per Step: " << (steps > 0 ? (double)sleeping_bodies / (double)steps : 0.0) 
+                      << " (" << wake_ups << " wake ups)" << std::endl;
+
+        out << "Average Collision Detection Time per Step: " 
                   << (steps > 0 ? (total_collision_time / (double)steps) * 1000.0 : 0.0) 
                   << " ms" << std::endl;
 
-        std::cout << "-----------------------------\n" << std::endl;
+        out << "Average Constraint Solve Time per Step: " 
+                  << (steps > 0 ? (total_solve_time / (double)steps) * 1000.0 : 0.0) 
+                  << " ms" << std::endl;
+
+        out << "-----------------------------\n" << std::endl;
     }
 };
 
-static StatCollector stat_collector;
+// sat_kernel resolved: the prefilter kernel, reference (prefilter off) or check
+enum class SatMode { Kernel, Reference, Check };
+
+// Everything one simulation reads and writes: its settings, time step, scene,
+// statistics, solver threads and selected kernels. Nothing is shared between
+// contexts, so simulations in different contexts can run at the same time.
+// settings is a copy, the viewer refreshes it from the globals it edits.
+struct SimulationContext 
+{
+    Settings settings;
+
+    uint64_t frequency           = 1000;
+    uint64_t iterations_per_step = 1;
+    Real     delta_t             = 1.0 / 1000;
+    Real3    gravity             = Real3(0.0, -9.81, 0.0);
+
+    Scene scene;
+
+    StatCollector stats;
+    bool          print_stats = true; // at destruction
+
+    ThreadPool solver_pool;
+
+    SatMode     sat_mode = SatMode::Kernel;
+    SatKernel   sat_kernel;
+    std::string sat_kernel_selected; // settings.sat_kernel that sat_mode and sat_kernel were resolved from
+    std::vector<SatKernel> sat_check_kernels; // with SatMode::Check
+
+    SpringKernel spring_kernel_fn = nullptr;
+    std::string  spring_kernel_selected;
+
+    SimulationContext() {}
+    explicit SimulationContext(const Settings &settings) : settings(settings) {}
+
+    ~SimulationContext() 
+    {
+        if (print_stats) stats.print(std::cout, settings);
+    }
+};
+
+void XPBD_init(SimulationContext &ctx, uint64_t heartz = 1000, uint64_t iterations = 1) 
+{
+    ctx.frequency           = heartz;
+    ctx.iterations_per_step = iterations;
+    ctx.delta_t             = 1.0 / ctx.frequency;
+}
+
+// Resolves settings.sat_kernel into ctx.sat_mode and ctx.sat_kernel, once per
+// narrowphase: the viewer can change it between steps.
+void XPBD_select_sat_kernel(SimulationContext &ctx)
+{
+    const std::string &mode = ctx.settings.sat_kernel;
+    if (ctx.sat_kernel.separating_axis && ctx.sat_kernel_selected == mode) return;
+
+    ctx.sat_mode            = mode == "reference" ? SatMode::Reference : mode == "check" ? SatMode::Check : SatMode::Kernel;
+    ctx.sat_kernel          = select_sat_kernel(mode);
+    ctx.sat_kernel_selected = mode;
+    ctx.stats.kernel_name   = ctx.sat_kernel.name;
+
+    ctx.sat_check_kernels.clear();
+    if (ctx.sat_mode == SatMode::Check) ctx.sat_check_kernels = available_sat_kernels();
+}
+
+// Separation-only prefilter in front of SAT_box_box. Returns the index of the
+// first separating axis in axes, -1 when the full SAT has to run.
+// sat_kernel: "auto", "avx512", "avx2", "scalar", "reference" (prefilter off)
+// or "check": the lanes of every SIMD kernel the CPU runs must equal the
+// scalar ones bit for bit, and the decision is compared with SAT_box_box.
+// Only the reference result is used, so a check run is the reference run.
+int XPBD_sat_prefilter(SimulationContext &ctx, RigidBox &b1, RigidBox &b2, SatAxes &axes, Real margin)
+{
+    StatCollector &stats = ctx.stats;
+
+    if (ctx.sat_mode == SatMode::Reference) return -1;
+
+    SatBox s1 = make_sat_box(b1, b1.position);
+    SatBox s2 = make_sat_box(b2, b1.position);
+    build_sat_axes(s1, s2, axes);
+
+    stats.kernel_tests++;
+
+    SolverReal threshold = SolverReal(NOT_COLLISION_THRESHOLD - margin);
+
+    if (ctx.sat_mode == SatMode::Check) 
+    {
+        alignas(64) SolverReal lanes[16], scalar_lanes[16];
+        sat_separating_axis_scalar(s1, s2, axes, threshold, scalar_lanes);
+
+        for (const SatKernel &kernel : ctx.sat_check_kernels)
+        {
+            kernel.separating_axis(s1, s2, axes, threshold, lanes);
+
+            for (int ai = 0; ai < 16; ai++)
+            {
+                if (std::memcmp(&lanes[ai], &scalar_lanes[ai], sizeof(SolverReal)) == 0) continue;
+
+                if (stats.kernel_mismatches++ < 10)
+                    std::cerr << "SAT kernel check: " << kernel.name << " lane " << ai << " = " << std::hexfloat << lanes[ai] 
+                              << ", scalar " << scalar_lanes[ai] << std::defaultfloat << "\n";
+            }
+        }
+
+        int  ai        = ctx.sat_kernel.separating_axis(s1, s2, axes, threshold, nullptr);
+        bool reference = SAT_box_box(b1, b2, margin, ctx.settings.manifold_max_points).intersecting;
+
+        if ((ai < 0) != reference) stats.reference_mismatches++;
+        if (ai >= 0) stats.kernel_hits++;
+        return -1;
+    }
+
+    int ai = ctx.sat_kernel.separating_axis(s1, s2, axes, threshold, nullptr);
+    if (ai >= 0) stats.kernel_hits++;
+    return ai;
+}
+
+// Candidate rigid pairs, sorted as (i, j) with i < j, stored in scene.pair_cache. 
+// Moving bodies (dynamic and kinematic) go through the sweep and prune, static 
+// bodies are only queried through the static BVH by dynamic bodies, so 
+// static-static and kinematic-static pairs are never enumerated.
+void XPBD_rigid_broadphase(SimulationContext &ctx, Real margin) 
+{
+    Scene          &scene    = ctx.scene;
+    const Settings &settings = ctx.settings;
+    StatCollector  &stats    = ctx.stats;
+
+    if (scene.body_sets_dirty) scene.build_body_sets();
+
+    std::vector<BodyPair> &pairs = scene.rigid_pairs;
+
+    if (!settings.sap_broadphase) 
+    {
+        std::vector<AABB> aabbs(scene.rigid_objects.size());
+        for (Index ri=0; ri<scene.rigid_objects.size(); ri++) 
+        {
+            const AABB &aabb = scene.rigid_objects[ri].aabb;
+            aabbs[ri] = AABB(aabb.min - Real3(0.5 * margin), aabb.max + Real3(0.5 * margin));
+        }
+
+        pairs.clear();
+        brute_force_pairs(aabbs, pairs);
+        update_pair_cache(scene.pair_cache, pairs);
+        scene.rigid_pairs_valid = false;
+        return;
+    }
+
+    // fat AABBs: the candidate pairs change only when a body leaves its fat box
+    std::vector<AABB> &fat_aabbs = scene.rigid_aabbs;
+    bool refit = fat_aabbs.size() != scene.moving_bodies.size();
+    fat_aabbs.resize(scene.moving_bodies.size());
+
+    for (Index mi=0; mi<scene.moving_bodies.size(); mi++) 
+    {
+        const AABB &tight = scene.rigid_objects[scene.moving_bodies[mi]].aabb;
+        AABB aabb(tight.min - Real3(0.5 * margin), tight.max + Real3(0.5 * margin));
+        if (!refit && fat_aabbs[mi].contains(aabb)) continue;
+
+        fat_aabbs[mi] = AABB(aabb.min - Real3(settings.fat_aabb_margin), aabb.max + Real3(settings.fat_aabb_margin));
+        refit = true;
+    }
+
+    if (!refit && scene.rigid_pairs_valid) 
+    {
+        stats.pair_list_reuses++;
+        return;
+    }
+
+    pairs.clear();
+
+    scene.broadphase.update(fat_aabbs);
+
+    for (auto [m1, m2] : scene.broadphase.pairs) 
+    {
+        Index ri1 = scene.moving_bodies[m1];
+        Index ri2 = scene.moving_bodies[m2];
+
+        if (scene.rigid_objects[ri1].is_static && scene.rigid_objects[ri2].is_static) continue;
+
+        pairs.push_back({ri1, ri2});
+    }
+
+    for (Index mi=0; mi<scene.moving_bodies.size(); mi++) 
+    {
+        Index ri = scene.moving_bodies[mi];
+        if (scene.rigid_objects[ri].is_static) continue;
+
+        // static boxes are not enlarged, the query box takes the whole margin
+        AABB query(fat_aabbs[mi].min - Real3(0.5 * margin), fat_aabbs[mi].max + Real3(0.5 * margin));
+
+        scene.static_bvh.query(query, [&](Index si) {
+            pairs.push_back(ri < si ? BodyPair(ri, si) : BodyPair(si, ri));
+        });
+    }
+
+    std::sort(pairs.begin(), pairs.end());
+
+    update_pair_cache(scene.pair_cache, pairs);
+    scene.rigid_pairs_valid = true;
+}
+
+// Contact constraints for every candidate pair. With margin > 0 pairs closer
+// than margin are kept too (speculative contacts, inactive until they touch).
+// Tracked contacts use the per point depth and are anchored on the bodies, 
+// see Solver::solve(RigidCollisionConstraint&).
+void XPBD_rigid_narrowphase(SimulationContext &ctx, std::vector<RigidCollisionConstraint> &rigid_collisions, Real margin, bool tracked) 
+{
+    Scene          &scene    = ctx.scene;
+    const Settings &settings = ctx.settings;
+    StatCollector  &stats    = ctx.stats;
+
+    rigid_collisions.clear();
+
+    auto add_contact = [&](RigidBox &b1, RigidBox &b2, const Real3 &p1, const Real3 &p2, Real penetration, Real depth, const Real3 &n) 
+    {
+        Index i1 = Index(&b1 - scene.rigid_objects.data());
+        Index i2 = Index(&b2 - scene.rigid_objects.data());
+        RigidCollisionConstraint constraint(settings.coll_compliance, i1, i2, p1, p2, penetration, n);
+
+        // both forms start at C = depth: untracked contacts keep p1 and p2
+        // fixed (C = d - dnp), tracked ones move them with the bodies (C = d + dnp).
+        // p1 == p2 for face contacts, the closest edge points for edge contacts
+        if (tracked) 
+        {
+            constraint.r1      = world_to_body(p1, b1.position, b1.orientation);
+            constraint.r2      = world_to_body(p2, b2.position, b2.orientation);
+            constraint.d       = depth - glm::dot(p2 - p1, n);
+            constraint.tracked = true;
+        }
+        else constraint.d = penetration + glm::dot(p2 - p1, n);
+
+        rigid_collisions.push_back(constraint);
+    };
+
+    XPBD_rigid_broadphase(ctx, margin);
+    XPBD_select_sat_kernel(ctx);
+
+    stats.broadphase_pairs += scene.pair_cache.size();
+
+    for (CachedPair &cached : scene.pair_cache) 
+    {
+        RigidBox &b1 = scene.getRigidObject(cached.b1);
+        RigidBox &b2 = scene.getRigidObject(cached.b2);
+
+        if (b1.is_static && b2.is_static) continue;
+        if (b1.is_resting() && b2.is_resting()) continue;
+        if (!b1.aabb.intersects(b2.aabb, margin)) continue;
+
+        if (cached.has_axis) 
+        {
+            stats.cached_axis_tests++;
+
+            if (separated_on_axis(b1, b2, cached.axis, margin)) 
+            {
+                stats.cached_axis_hits++;
+                continue;
+            }
+        }
+
+        SatAxes axes;
+        int separating = XPBD_sat_prefilter(ctx, b1, b2, axes, margin);
+        if (separating >= 0) 
+        {
+            cached.axis     = sat_axis(axes, separating);
+            cached.has_axis = true;
+            continue;
+        }
+
+        RigidCollisionInfo info = SAT_box_box(b1, b2, margin, settings.manifold_max_points);
+
+        cached.axis     = info.axis;
+        cached.has_axis = true;
+
+        if (!info.intersecting) continue;
+
+        if (info.owner == 0) 
+        {
+            assert(info.manifold_size == 2);
+            
+            add_contact(b1, b2, info.manifold[0], info.manifold[1], info.penetration, info.depths[0], info.axis);
+
+            stats.edge_collisions++;
+
+            continue;
+        }
+
+        stats.face_collisions++;
+        stats.clipped_points += info.clipped_size;
+        stats.contact_points += info.manifold_size;
+
+        for (int pi=0; pi<info.manifold_size; pi++) 
+            add_contact(b1, b2, info.manifold[pi], info.manifold[pi], info.penetration /* / (Real) info.manifold_size */, info.depths[pi], info.axis);
+    }
+}
+
+// Constraints between resting bodies (static or sleeping) are skipped by the
+// solver. Fixed springs are always solved, their lambda is what wakes a sleeping box.
+inline bool XPBD_is_resting(const Scene &, const FixedRigidSpringConstraint &) 
+{
+    return false;
+}
+
+template <typename C>
+inline bool XPBD_is_resting(const Scene &scene, const C &constraint) 
+{
+    return scene.rigid_objects[constraint.i1].is_resting() && scene.rigid_objects[constraint.i2].is_resting();
+}
+
+// Islands: union-find over the non static bodies linked by fixed springs, active
+// springs and contacts (static and kinematic bodies are never moved by the
+// solver, so they do not join islands). Each island also gets the indices of
+// its constraints, in serial solve order.
+void XPBD_build_islands(SimulationContext &ctx, const std::vector<RigidCollisionConstraint> &rigid_collisions) 
+{
+    Scene &scene = ctx.scene;
+    std::vector<RigidBox> &bodies = scene.rigid_objects;
+    UnionFind &islands = scene.islands;
+    islands.reset(bodies.size());
+
+    auto link = [&](Index i1, Index i2) 
+    {
+        if (!bodies[i1].is_static && !bodies[i2].is_static) islands.unite(i1, i2);
+    };
+
+    for (const RigidSpringConstraint &constraint : scene.rigid_constraints()) 
+        if (constraint.active) link(constraint.i1, constraint.i2);
+
+    for (const RigidCollisionConstraint &constraint : rigid_collisions) 
+        link(constraint.i1, constraint.i2);
+
+    const Index NONE = std::numeric_limits<Index>::max();
+    scene.island_index.assign(bodies.size(), NONE);
+    scene.num_islands = 0;
+
+    auto island_of = [&](Index i1, Index i2) -> SolverIsland& 
+    {
+        Index root = islands.find(bodies[i1].is_static ? i2 : i1);
+        Index &ii  = scene.island_index[root];
+
+        if (ii == NONE) 
+        {
+            ii = scene.num_islands++;
+            if (scene.solver_islands.size() < scene.num_islands) scene.solver_islands.emplace_back();
+            scene.solver_islands[ii].clear();
+        }
+        return scene.solver_islands[ii];
+    };
+
+    for (Index ci=0; ci<scene.fixed_rigid_constraints().size(); ci++) 
+    {
+        const FixedRigidSpringConstraint &constraint = scene.fixed_rigid_constraints()[ci];
+        island_of(constraint.box, constraint.box).fixed_springs.push_back(ci);
+    }
+
+    for (Index ci=0; ci<scene.rigid_constraints().size(); ci++) 
+    {
+        const RigidSpringConstraint &constraint = scene.rigid_constraints()[ci];
+        if (constraint.active) island_of(constraint.i1, constraint.i2).springs.push_back(ci);
+    }
+
+    for (Index ci=0; ci<rigid_collisions.size(); ci++) 
+    {
+        const RigidCollisionConstraint &constraint = rigid_collisions[ci];
+        island_of(constraint.i1, constraint.i2).contacts.push_back(ci);
+    }
 
-void XPBD_step(Scene &scene) 
+    ctx.stats.islands += scene.num_islands;
+}
+
+// Islands are the dynamic bodies connected by active springs and contacts. An
+// island falls asleep when all its bodies stayed below the sleep velocities for
+// sleep_time, and wakes up as a whole when a spring or contact touching it
+// pulls harder than wake_force (so wake_force must be above the resting loads)
+// or when a moving kinematic body touches it. Sleeping bodies are not integrated and behave
+// like static ones in the solver, but their constraints are still evaluated
+// against awake or kinematic bodies to measure that force.
+void XPBD_update_sleeping(SimulationContext &ctx, const std::vector<RigidCollisionConstraint> &rigid_collisions) 
 {
+    Scene          &scene    = ctx.scene;
+    const Settings &settings = ctx.settings;
+    StatCollector  &stats    = ctx.stats;
+    const Real      delta_t  = ctx.delta_t;
+
+    if (!settings.enable_sleeping) 
+    {
+        if (scene.sleeping_bodies == 0) return;
+
+        for (RigidBox &body : scene.rigid_objects) body.wake();
+        scene.sleeping_bodies = 0;
+        return;
+    }
+
+    std::vector<RigidBox> &bodies = scene.rigid_objects;
+    UnionFind &islands = scene.islands; // built by XPBD_build_islands for this step
+
+    std::vector<bool> wake(bodies.size(), false);
+    Real wake_lambda = settings.wake_force * delta_t * delta_t;
+
+    auto link = [&](Index i1, Index i2, Real lambda) 
+    {
+        const RigidBox *b1 = &bodies[i1];
+        const RigidBox *b2 = &bodies[i2];
+
+        // kinematic bodies (the pallet) wake what they touch as soon as they move
+        bool pushed = (b1->is_kinematic && glm::length(b1->velocity) > settings.sleep_linear_velocity) || 
+                      (b2->is_kinematic && glm::length(b2->velocity) > settings.sleep_linear_velocity);
+
+        if (pushed || std::abs(lambda) > wake_lambda) wake[i1] = wake[i2] = true;
+    };
+
+    for (const FixedRigidSpringConstraint &constraint : scene.fixed_rigid_constraints()) 
+        link(constraint.box, constraint.box, constraint.lambda);
+
+    for (const RigidSpringConstraint &constraint : scene.rigid_constraints()) 
+        if (constraint.active) link(constraint.i1, constraint.i2, constraint.lambda);
+
+    for (const RigidCollisionConstraint &constraint : rigid_collisions) 
+        link(constraint.i1, constraint.i2, constraint.lambda);
+
+    // per island: can sleep if every body is slow for long enough, wakes if any body is pulled
+    std::vector<bool> island_awake(bodies.size(), false);
+    std::vector<bool> island_pulled(bodies.size(), false);
+
+    for (Index ri : scene.dynamic_bodies) 
+    {
+        RigidBox &body = bodies[ri];
+        Index root = islands.find(ri);
+
+        if (!body.is_sleeping) 
+        {
+            bool slow = glm::length(body.velocity)         < settings.sleep_linear_velocity && 
+                        glm::length(body.angular_velocity) < settings.sleep_angular_velocity;
+
+            body.sleep_timer = slow ? body.sleep_timer + delta_t : 0.0;
+
+            if (body.sleep_timer < settings.sleep_time) island_awake[root] = true;
+        }
+
+        if (body.is_sleeping && wake[ri]) island_pulled[root] = true;
+    }
+
+    Index sleeping = 0;
+    for (Index ri : scene.dynamic_bodies) 
+    {
+        RigidBox &body = bodies[ri];
+        Index root = islands.find(ri);
+
+        if (body.is_sleeping && island_pulled[root]) 
+        {
+            body.wake();
+            stats.wake_ups++;
+        }
+        else if (!body.is_sleeping && !island_awake[root] && !island_pulled[root]) 
+        {
+            body.sleep();
+        }
+
+        if (body.is_sleeping) sleeping++;
+    }
+
+    scene.sleeping_bodies = sleeping;
+    stats.sleeping_bodies += sleeping;
+}
+
+void XPBD_color_springs(Scene &scene) 
+{
+    if (scene.spring_colors.valid) return;
+
+    const std::vector<RigidBox> &bodies = scene.rigid_objects;
+    auto index_of = [&](Index bi) { return bodies[bi].is_static ? NO_BODY : bi; };
+
+    color_constraints(scene.spring_colors, bodies.size(), scene.rigid_constraints().size(), 
+        [&](Index ci, Index &b1, Index &b2) { b1 = index_of(scene.rigid_constraints()[ci].i1); b2 = index_of(scene.rigid_constraints()[ci].i2); }, 
+        [&](Index ci) { return scene.rigid_constraints()[ci].active; });
+}
+
+// Colored Gauss-Seidel: the constraints of one color share no dynamic body, so
+// each color is solved in parallel, colors one after the other. The result
+// does not depend on the number of threads but differs from the serial order.
+void XPBD_color_constraints(SimulationContext &ctx, const std::vector<RigidCollisionConstraint> &rigid_collisions, bool contacts_detected) 
+{
+    Scene &scene = ctx.scene;
+    const std::vector<RigidBox> &bodies = scene.rigid_objects;
+    size_t num_bodies = bodies.size();
+
+    auto index_of = [&](Index bi) { return bodies[bi].is_static ? NO_BODY : bi; };
+
+    if (!scene.fixed_colors.valid) 
+    {
+        color_constraints(scene.fixed_colors, num_bodies, scene.fixed_rigid_constraints().size(), 
+            [&](Index ci, Index &b1, Index &b2) { b1 = index_of(scene.fixed_rigid_constraints()[ci].box); b2 = NO_BODY; }, 
+            [](Index) { return true; });
+    }
+
+    XPBD_color_springs(scene);
+
+    if (contacts_detected || !scene.contact_colors.valid) 
+    {
+        color_constraints(scene.contact_colors, num_bodies, rigid_collisions.size(), 
+            [&](Index ci, Index &b1, Index &b2) { b1 = index_of(rigid_collisions[ci].i1); b2 = index_of(rigid_collisions[ci].i2); }, 
+            [](Index) { return true; });
+    }
+
+    ctx.stats.spring_colors  += scene.spring_colors.num_colors();
+    ctx.stats.contact_colors += scene.contact_colors.num_colors();
+}
+
+// fn(i) for i in [begin, end) on the solver pool, chunk indices per task
+template <typename F>
+void XPBD_parallel_range(ThreadPool &pool, Index begin, Index end, Index chunk, F &&fn) 
+{
+    if (end <= begin) return;
+
+    pool.parallel_for((end - begin + chunk - 1) / chunk, [&](size_t ki) 
+    {
+        Index k_end = std::min<Index>(end, begin + Index(ki + 1) * chunk);
+        for (Index k = begin + Index(ki) * chunk; k < k_end; k++) fn(k);
+    });
+}
+
+template <typename Solve>
+void XPBD_solve_colors(ThreadPool &pool, const ConstraintColoring &coloring, Solve &&solve) 
+{
+    // colors are small, each body appears at most once per color
+    for (Index c = 0; c < coloring.num_colors(); c++) 
+        XPBD_parallel_range(pool, coloring.color_start[c], coloring.color_start[c+1], 8, [&](Index k) { solve(coloring.order[k]); });
+}
+
+// spring_kernel: "auto", "avx2", "scalar" or "reference" (Solver::solve one
+// spring at a time). Returns nullptr for "reference".
+SpringKernel XPBD_spring_kernel(SimulationContext &ctx) 
+{
+    const Settings &settings = ctx.settings;
+
+    if (settings.spring_kernel == "reference") return nullptr;
+
+    if (!ctx.spring_kernel_fn || ctx.spring_kernel_selected != settings.spring_kernel) 
+    {
+        ctx.spring_kernel_fn       = select_spring_kernel(settings.spring_kernel, ctx.stats.spring_kernel_name, ctx.stats.spring_lanes);
+        ctx.spring_kernel_selected = settings.spring_kernel;
+    }
+
+    return ctx.spring_kernel_fn;
+}
+
+// Springs of the current spring coloring in batches for the kernel, leaving out
+// the ones the solver would skip. Rebuilt every step, the resting test changes
+// with the sleeping bodies.
+void XPBD_batch_springs(Scene &scene, int lanes) 
+{
+    const std::vector<RigidSpringConstraint> &springs = scene.rigid_constraints();
+
+    scene.spring_batches.build(scene.spring_colors, lanes, [&](Index ci) 
+    {
+        const RigidSpringConstraint &constraint = springs[ci];
+        return !constraint.active || constraint.i1 == constraint.i2 || XPBD_is_resting(scene, constraint);
+    });
+}
+
+template <typename Solve>
+void XPBD_solve_spring_batches(ThreadPool &pool, const SpringBatches &batches, Solve &&solve) 
+{
+    for (Index c = 0; c + 1 < Index(batches.batch_start.size()); c++) 
+        XPBD_parallel_range(pool, batches.batch_start[c], batches.batch_start[c+1], 2, solve);
+}
+
+// Solves the springs sweeps times, colored, with the reference solver and
+// with every spring kernel available, each run starting from the current
+// solver state, and prints the springs per second and the largest difference
+// of the kernels from the reference (positions and lambda). The solver state
+// and the spring lambdas are restored at the end. Single threaded.
+void XPBD_benchmark_spring_kernels(SimulationContext &ctx, int sweeps) 
+{
+    Scene     &scene   = ctx.scene;
+    const Real delta_t = ctx.delta_t;
+
+    std::vector<RigidSpringConstraint> &springs = scene.rigid_constraints();
+    RigidBodyStore &bodies = scene.solver.bodies;
+
+    XPBD_color_springs(scene);
+
+    std::vector<Real> lambdas(springs.size());
+    for (size_t ci = 0; ci < springs.size(); ci++) lambdas[ci] = springs[ci].lambda;
+    RigidBodyStore start = bodies;
+
+    auto restore = [&]() 
+    {
+        bodies = start;
+        for (size_t ci = 0; ci < springs.size(); ci++) springs[ci].lambda = lambdas[ci];
+    };
+
+    auto skip = [&](Index ci) { return !springs[ci].active || springs[ci].i1 == springs[ci].i2; };
+
+    Index num_springs = 0;
+    for (Index ci : scene.spring_colors.order) num_springs += !skip(ci);
+
+    SpringBatches batches;
+
+    // mode "reference" or a kernel name, false when that kernel is not available
+    auto run = [&](const std::string &mode) 
+    {
+        restore();
+
+        SpringKernel kernel = nullptr;
+        if (mode != "reference") 
+        {
+            std::string name;
+            int lanes;
+            kernel = select_spring_kernel(mode, name, lanes);
+            if (name != mode) return false;
+            batches.build(scene.spring_colors, lanes, skip);
+        }
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+
+        for (int sweep = 0; sweep < sweeps; sweep++) 
+        {
+            if (!kernel) 
+            {
+                for (Index ci : scene.spring_colors.order) 
+                    if (!skip(ci)) scene.solver.solve(springs[ci], delta_t);
+                continue;
+            }
+
+            for (Index bi = 0; bi < batches.num_batches(); bi++) 
+                solve_spring_batch(kernel, batches, bi, springs, bodies, delta_t);
+        }
+
+        double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t0).count();
+        std::cout << "Spring Kernel " << mode << ": " << (seconds > 0.0 ? (double)num_springs * sweeps / seconds : 0.0) / 1e6
+                  << " M springs/s" << std::endl;
+        return true;
+    };
+
+    std::cout << "\n--- Spring Kernel Benchmark (" << num_springs << " springs, " << scene.spring_colors.num_colors() 
+              << " colors, " << sweeps << " sweeps) ---" << std::endl;
+
+    run("reference");
+    RigidBodyStore reference = bodies;
+    std::vector<Real> reference_lambdas(springs.size());
+    for (size_t ci = 0; ci < springs.size(); ci++) reference_lambdas[ci] = springs[ci].lambda;
+
+    for (const char *mode : {"scalar", "avx2"}) 
+    {
+        if (!run(mode)) continue;
+
+        Real max_dp = 0.0, max_dlambda = 0.0;
+        for (size_t bi = 0; bi < bodies.size(); bi++) 
+            max_dp = std::max(max_dp, (Real)glm::length(bodies.position[bi] - reference.position[bi]));
+        for (size_t ci = 0; ci < springs.size(); ci++) 
+            max_dlambda = std::max(max_dlambda, std::abs(springs[ci].lambda - reference_lambdas[ci]));
+
+        std::cout << "    max difference from reference: " << max_dp << " position, " << max_dlambda << " lambda" << std::endl;
+    }
+
+    std::cout << "-----------------------------\n" << std::endl;
+
+    restore();
+}
+
+// Jacobi: every constraint computes its corrections from the positions at the
+// start of the iteration into its own slots, then each body averages the
+// corrections of its constraints (times jacobi_relaxation) and applies them
+// once. Slots are summed per body in CSR order, so the result is bitwise the
+// same for any number of threads. Converges slower per iteration than Gauss-Seidel.
+void XPBD_solve_jacobi(SimulationContext &ctx, std::vector<RigidCollisionConstraint> &rigid_collisions) 
+{
+    Scene     &scene   = ctx.scene;
+    const Real delta_t = ctx.delta_t;
+
+    std::vector<RigidBox> &bodies = scene.rigid_objects;
+    JacobiBuffers &jacobi = scene.jacobi;
+
+    Index num_fixed    = Index(scene.fixed_rigid_constraints().size());
+    Index num_springs  = Index(scene.rigid_constraints().size());
+    Index num_contacts = Index(rigid_collisions.size());
+
+    auto index_of = [&](Index bi) { return bodies[bi].is_static ? NO_BODY : bi; };
+
+    jacobi.build(bodies.size(), num_fixed, num_springs, num_contacts, [&](Index si) 
+    {
+        if (si < num_fixed) return index_of(scene.fixed_rigid_constraints()[si].box);
+
+        Index k = si < num_fixed + 2 * num_springs ? si - num_fixed : si - num_fixed - 2 * num_springs;
+        Index b1, b2;
+
+        if (si < num_fixed + 2 * num_springs) { b1 = scene.rigid_constraints()[k / 2].i1; b2 = scene.rigid_constraints()[k / 2].i2; }
+        else                                  { b1 = rigid_collisions[k / 2].i1;          b2 = rigid_collisions[k / 2].i2; }
+
+        return index_of(k % 2 == 0 ? b1 : b2);
+    });
+
+    Index num_constraints = num_fixed + num_springs + num_contacts;
+
+    for (int it=0; it<ctx.iterations_per_step; it++) 
+    {
+        XPBD_parallel_range(ctx.solver_pool, 0, num_constraints, 64, [&](Index ci) 
+        {
+            if (ci < num_fixed) 
+            {
+                BodyDelta *slot = &jacobi.deltas[ci];
+                *slot = BodyDelta();
+                scene.solver.solve(scene.fixed_rigid_constraints()[ci], delta_t, slot);
+                return;
+            }
+
+            if (ci < num_fixed + num_springs) 
+            {
+                Index k = ci - num_fixed;
+                BodyDelta *slot = &jacobi.deltas[jacobi.spring_base + 2 * k];
+                slot[0] = slot[1] = BodyDelta();
+
+                RigidSpringConstraint &constraint = scene.rigid_constraints()[k];
+                if (XPBD_is_resting(scene, constraint)) return;
+                scene.solver.solve(constraint, delta_t, slot);
+                return;
+            }
+
+            Index k = ci - num_fixed - num_springs;
+            BodyDelta *slot = &jacobi.deltas[jacobi.contact_base + 2 * k];
+            slot[0] = slot[1] = BodyDelta();
+
+            RigidCollisionConstraint &constraint = rigid_collisions[k];
+            if (XPBD_is_resting(scene, constraint)) return;
+            scene.solver.solve(constraint, delta_t, slot);
+        });
+
+        XPBD_parallel_range(ctx.solver_pool, 0, Index(scene.dynamic_bodies.size()), 16, [&](Index di) 
+        {
+            Index ri = scene.dynamic_bodies[di];
+            BodyDelta sum;
+
+            for (Index k = jacobi.offsets[ri]; k < jacobi.offsets[ri+1]; k++) 
+            {
+                const BodyDelta &delta = jacobi.deltas[jacobi.slots[k]];
+                sum.dp     += delta.dp;
+                sum.dq     += delta.dq;
+                sum.weight += delta.weight;
+            }
+
+            if (sum.weight == 0.0) return;
+
+            SolverReal scale = SolverReal(ctx.settings.jacobi_relaxation) / sum.weight;
+
+            RigidBodyStore &store = scene.solver.bodies;
+            store.position[ri]    += scale * sum.dp;
+            store.orientation[ri] += scale * sum.dq;
+            store.orientation[ri]  = glm::normalize(store.orientation[ri]);
+            store.mark_moved(ri);
+            store.refresh_rotation(ri); // the next constraint pass reads it from any thread
+        });
+    }
+}
+
+void XPBD_step(SimulationContext &ctx) 
+{
+    Scene          &scene    = ctx.scene;
+    const Settings &settings = ctx.settings;
+    StatCollector  &stats    = ctx.stats;
+    const Real      delta_t  = ctx.delta_t;
 
     /*
     for (TetraObject &obj : scene.objects) obj.reset_tetras();
@@ -175,7 +983,7 @@ void XPBD_step(Scene &scene)
 
     XPBD_collect_collisions(scene.objects, collisions);
 
-    XPBD_collision_vertex_ripositioning(scene.objects, collisions);
+    XPBD_collision_vertex_ripositioning(scene.objects, collisions, settings.coll_compliance);
 
     for (TetraObject &obj : scene.objects) 
     {
@@ -212,22 +1020,22 @@ void XPBD_step(Scene &scene)
         for (TetraObject &obj : scene.objects) 
         {
             for (Edge &edge : obj.edges)
-                scene.solver.solve(edge, delta_t);
+                scene.solver.solve(obj, edge, delta_t);
 
             for (Tetrahedron &tetra : obj.tetras)
-                scene.solver.solve(tetra, delta_t);
+                scene.solver.solve(obj, tetra, delta_t);
         }
 
         for (Cloth &cloth : scene.cloths)
             for (ClothEdge &edge : cloth.edges)
-                scene.solver.solve(edge, delta_t);
+                scene.solver.solve(cloth, edge, delta_t);
 
         for (SpringConstraint &constraint : scene.constraints) 
-            scene.solver.solve(constraint, delta_t);
+            scene.solver.solve(scene.objects, constraint, delta_t);
 
         for (TetraObject &obj : scene.objects) 
             for (int vi=0; vi<obj.num_vertices(); vi++) 
-                scene.solver.solve(obj.vertex_collisions_constraints[vi], delta_t);
+                scene.solver.solve(obj, obj.vertex_collisions_constraints[vi], delta_t);
     }
 
     for (TetraObject &obj : scene.objects) {
@@ -250,106 +1058,171 @@ void XPBD_step(Scene &scene)
     */
 
     // Rigid Objects
-    std::vector<RigidCollisionConstraint> rigid_collisions;
-    rigid_collisions.reserve(scene.rigid_objects.size() * scene.rigid_objects.size() / 2);
+    auto collision_start = std::chrono::high_resolution_clock::now();
 
-    for (int ri1=0; ri1<scene.rigid_objects.size(); ri1++) 
+    std::vector<RigidCollisionConstraint> &rigid_collisions = scene.rigid_contacts();
+
+    // with collision_substeps > 1 contacts are detected once every collision_substeps 
+    // steps, with a speculative margin, and tracked on the bodies in between
+    int  substeps = std::max(settings.collision_substeps, 1);
+    bool tracked  = substeps > 1;
+
+    bool contacts_detected = scene.collision_substep == 0;
+
+    if (contacts_detected) 
     {
-        for (int ri2=ri1+1; ri2<scene.rigid_objects.size(); ri2++) 
-        {
-            RigidBox &b1 = scene.getRigidObject(ri1);
-            RigidBox &b2 = scene.getRigidObject(ri2);
+        XPBD_rigid_narrowphase(ctx, rigid_collisions, tracked ? settings.speculative_margin : 0.0, tracked);
+        stats.detections++;
+    }
 
-            if (!b1.aabb.intersects(b2.aabb)) continue;
+    scene.collision_substep = (scene.collision_substep + 1) % substeps;
 
-            RigidCollisionInfo info = SAT_box_box(b1, b2);
+    stats.total_collision_time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - collision_start).count();
+    stats.steps++;
 
-            if (!info.intersecting)           continue;
-            if (b1.is_static && b2.is_static) continue;
+    for (Index ri : scene.dynamic_bodies) 
+    {
+        if (scene.rigid_objects[ri].is_sleeping) continue;
+        scene.rigid_objects[ri].update(delta_t, ctx.gravity);
+    }
 
-            if (info.owner == 0) 
-            {
-                assert(info.manifold_size == 2);
-                
-                RigidCollisionConstraint constraint(
-                    coll_compliance, 
-                    &b1, 
-                    &b2, 
-                    info.manifold[0], 
-                    info.manifold[1], 
-                    info.penetration, 
-                    info.axis);
-                
-                rigid_collisions.push_back(constraint);
-
-                stat_collector.edge_collisions++;
+    scene.rigid_pools.for_each([](auto &pool) 
+    {
+        for (auto &constraint : pool) constraint.reset();
+    });
 
-                continue;
-            }
+    // constraints, solved on the structure of arrays copy of the bodies
 
-            stat_collector.face_collisions++;
+    auto solve_start = std::chrono::high_resolution_clock::now();
 
-            for (int pi=0; pi<info.manifold_size; pi++) 
-            {
+    scene.solver.bodies.gather(scene.rigid_objects);
 
-                RigidCollisionConstraint constraint(
-                    coll_compliance, 
-                    &b1, 
-                    &b2, 
-                    info.manifold[pi], 
-                    info.manifold[pi], 
-                    info.penetration, // / (Real) info.manifold_size, 
-                    info.axis);
+    if (settings.spring_kernel_benchmark > 0 && stats.steps == settings.spring_kernel_benchmark) 
+        XPBD_benchmark_spring_kernels(ctx, 200);
 
-                rigid_collisions.push_back(constraint);
-            }
-        }
-    }
+    bool colored     = settings.solver_mode == "colored";
+    bool jacobi      = settings.solver_mode == "jacobi";
+    bool use_islands = (!colored && !jacobi && settings.solver_threads > 1) || settings.enable_sleeping;
+    if (use_islands) XPBD_build_islands(ctx, rigid_collisions);
 
-    for (RigidBox &obj : scene.rigid_objects) 
+    if (jacobi) 
     {
-        obj.update(delta_t, gravity);
+        ctx.solver_pool.resize(settings.solver_threads);
+        XPBD_solve_jacobi(ctx, rigid_collisions);
     }
+    else if (colored) 
+    {
+        ctx.solver_pool.resize(settings.solver_threads);
+        XPBD_color_constraints(ctx, rigid_collisions, contacts_detected);
 
-    for (FixedRigidSpringConstraint &constraint : scene.fixed_rigid_constraints) 
-        constraint.reset();
-
-    for (RigidSpringConstraint &constraint : scene.rigid_constraints) 
-        constraint.reset();
+        SpringKernel batch_kernel = XPBD_spring_kernel(ctx);
+        if (batch_kernel) 
+        {
+            XPBD_batch_springs(scene, stats.spring_lanes);
+            stats.spring_batches  += scene.spring_batches.num_batches();
+            for (Index ci : scene.spring_batches.springs) stats.batched_springs += ci != NO_SPRING;
+        }
 
-    for (RigidCollisionConstraint &constraint : rigid_collisions) 
-        constraint.reset();
+        for (int it=0; it<ctx.iterations_per_step; it++) 
+        {
+            XPBD_solve_colors(ctx.solver_pool, scene.fixed_colors, [&](Index ci) 
+            {
+                scene.solver.solve(scene.fixed_rigid_constraints()[ci], delta_t);
+            });
 
-    // constraints
+            if (batch_kernel) 
+            {
+                XPBD_solve_spring_batches(ctx.solver_pool, scene.spring_batches, [&](Index bi) 
+                {
+                    solve_spring_batch(batch_kernel, scene.spring_batches, bi, scene.rigid_constraints(), scene.solver.bodies, delta_t);
+                });
+            }
+            else 
+            {
+                XPBD_solve_colors(ctx.solver_pool, scene.spring_colors, [&](Index ci) 
+                {
+                    RigidSpringConstraint &constraint = scene.rigid_constraints()[ci];
+                    if (XPBD_is_resting(scene, constraint)) return;
+                    scene.solver.solve(constraint, delta_t);
+                });
+            }
 
-    for (int it=0; it<iterations_per_step; it++) 
+            XPBD_solve_colors(ctx.solver_pool, scene.contact_colors, [&](Index ci) 
+            {
+                RigidCollisionConstraint &constraint = rigid_collisions[ci];
+                if (XPBD_is_resting(scene, constraint)) return;
+                scene.solver.solve(constraint, delta_t);
+            });
+        }
+    }
+    else if (settings.solver_threads > 1) 
     {
-        for (FixedRigidSpringConstraint &constraint : scene.fixed_rigid_constraints) 
-            scene.solver.solve(constraint, delta_t);
+        ctx.solver_pool.resize(settings.solver_threads);
 
-        for (RigidSpringConstraint &constraint : scene.rigid_constraints) 
-            scene.solver.solve(constraint, delta_t);
+        ctx.solver_pool.parallel_for(scene.num_islands, [&](size_t ii) 
+        {
+            const SolverIsland &island = scene.solver_islands[ii];
 
-        for (RigidCollisionConstraint &constraint : rigid_collisions) 
-            scene.solver.solve(constraint, delta_t);
+            for (int it=0; it<ctx.iterations_per_step; it++) 
+            {
+                for (Index ci : island.fixed_springs) 
+                    scene.solver.solve(scene.fixed_rigid_constraints()[ci], delta_t);
+
+                for (Index ci : island.springs) 
+                {
+                    RigidSpringConstraint &constraint = scene.rigid_constraints()[ci];
+                    if (XPBD_is_resting(scene, constraint)) continue;
+                    scene.solver.solve(constraint, delta_t);
+                }
+
+                for (Index ci : island.contacts) 
+                {
+                    RigidCollisionConstraint &constraint = rigid_collisions[ci];
+                    if (XPBD_is_resting(scene, constraint)) continue;
+                    scene.solver.solve(constraint, delta_t);
+                }
+            }
+        });
     }
+    else 
+    {
+        for (int it=0; it<ctx.iterations_per_step; it++) 
+        {
+            scene.rigid_pools.for_each([&](auto &pool) 
+            {
+                for (auto &constraint : pool) 
+                {
+                    if (XPBD_is_resting(scene, constraint)) continue;
+                    scene.solver.solve(constraint, delta_t);
+                }
+            });
+        }
+    }
+
+    scene.solver.bodies.scatter(scene.rigid_objects);
 
-    for (RigidBox &obj : scene.rigid_objects) 
+    for (Index ri : scene.dynamic_bodies) 
     {
-        obj.update_velocities(delta_t);
+        if (scene.rigid_objects[ri].is_sleeping) continue;
+        scene.rigid_objects[ri].update_velocities(delta_t);
     }
 
     // velocity solve for dynmaic collision
     for (RigidCollisionConstraint &constraint : rigid_collisions) 
     {
-        RigidBox *b1 = constraint.b1;
-        RigidBox *b2 = constraint.b2;
+        if (constraint.lambda == 0.0) continue; // inactive (e.g. speculative) contact, no friction
+
+        RigidBox *b1 = &scene.rigid_objects[constraint.i1];
+        RigidBox *b2 = &scene.rigid_objects[constraint.i2];
 
         Real3 p1 = constraint.p1;
         Real3 p2 = constraint.p2;
 
-        Real3 r1 = world_to_body(p1, b1->position, b1->orientation);
-        Real3 r2 = world_to_body(p2, b2->position, b2->orientation);
+        const Real3x3 &R1 = b1->get_frame().rotation;
+        const Real3x3 &R2 = b2->get_frame().rotation;
+
+        Real3 r1 = world_to_body(p1, b1->position, R1);
+        Real3 r2 = world_to_body(p2, b2->position, R2);
 
         Real3 nw = constraint.n;
 
@@ -365,29 +1238,35 @@ void XPBD_step(Scene &scene)
 
         if (glm::length(vt) < 1e-6) continue;
 
-        Real3 dv = - glm::normalize(vt) * glm::min(mu_dynamic * fn, glm::length(vt));
+        Real3 dv = - glm::normalize(vt) * glm::min(settings.mu_dynamic * fn, glm::length(vt));
 
-        Real w1 = b1->generalized_inverse_mass(r1, world_to_body(nw, Real3(0.0), b1->orientation));
-        Real w2 = b2->generalized_inverse_mass(r2, world_to_body(nw, Real3(0.0), b2->orientation));
+        Real w1 = b1->generalized_inverse_mass(r1, world_to_body(nw, Real3(0.0), R1));
+        Real w2 = b2->generalized_inverse_mass(r2, world_to_body(nw, Real3(0.0), R2));
 
         Real3 pw = dv / (w1 + w2);
 
         auto applyVelocityCorrection = [&](RigidBox* body, const Real3& pw, const Real3& r, Real sign) 
         {
-            Real3 pb     = world_to_body(pw, Real3(0.0), body->orientation);
+            const Real3x3 &R = body->get_frame().rotation;
+
+            Real3 pb     = world_to_body(pw, Real3(0.0), R);
             Real3 tau    = glm::cross(r, pb);
             Real3 domega = body->inv_inertia_tensor * tau;
             
-            domega = quat_to_rotmat(body->orientation) * domega;
+            domega = R * domega;
 
             body->velocity         += sign * pw / body->mass;
             body->angular_velocity += sign * domega;
         };
 
-        if (!b1->is_static) applyVelocityCorrection(b1, pw, r1, 1.0);
+        if (!b1->is_static && !b1->is_sleeping) applyVelocityCorrection(b1, pw, r1, 1.0);
 
-        if (!b2->is_static) applyVelocityCorrection(b2, pw, r2, -1.0);
+        if (!b2->is_static && !b2->is_sleeping) applyVelocityCorrection(b2, pw, r2, -1.0);
     }
 
+    stats.total_solve_time += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - solve_start).count();
+
+    XPBD_update_sleeping(ctx, rigid_collisions);
+
 
 }
\ No newline at end of file